@@ -1,11 +1,13 @@
 #include "bitstream.h"
+#include "odz.h"
 #include <stdlib.h>
 #include <string.h>
 
 /* ── Writer ────────────────────────────────────────────────── */
 
-int bw_init(bit_writer_t *w, size_t initial_cap) {
-    w->buf = malloc(initial_cap);
+int bw_init(bit_writer_t *w, size_t initial_cap, const odz_mem_t *mem) {
+    w->mem = mem;
+    w->buf = odz_alloc(mem, initial_cap);
     if (!w->buf) return -1;
     w->cap = initial_cap;
     w->pos = 0;
@@ -15,16 +17,18 @@ int bw_init(bit_writer_t *w, size_t initial_cap) {
 }
 
 void bw_free(bit_writer_t *w) {
-    free(w->buf);
+    odz_free(w->mem, w->buf, w->cap);
     w->buf = NULL;
     w->cap = w->pos = 0;
 }
 
 static int bw_grow(bit_writer_t *w, size_t need) {
     while (w->pos + need >= w->cap) {
-        w->cap = w->cap * 2 + 1024;
-        w->buf = realloc(w->buf, w->cap);
-        if (!w->buf) return -1;
+        size_t cap = w->cap * 2 + 1024;
+        uint8_t *buf = odz_realloc(w->mem, w->buf, w->cap, cap);
+        if (!buf) return -1;
+        w->buf = buf;
+        w->cap = cap;
     }
     return 0;
 }
@@ -51,6 +55,17 @@ int bw_flush(bit_writer_t *w) {
     return 0;
 }
 
+int bw_write_bytes(bit_writer_t *w, const uint8_t *src, size_t n) {
+    if (bw_grow(w, n) != 0) return -1;
+    memcpy(w->buf + w->pos, src, n);
+    w->pos += n;
+    return 0;
+}
+
+int bw_reserve(bit_writer_t *w, size_t n) {
+    return bw_grow(w, n);
+}
+
 /* ── Reader ────────────────────────────────────────────────── */
 
 void br_init(bit_reader_t *r, const uint8_t *buf, size_t len) {
@@ -61,34 +76,9 @@ void br_init(bit_reader_t *r, const uint8_t *buf, size_t len) {
     r->nbits = 0;
 }
 
-static void br_refill(bit_reader_t *r) {
-    if (r->pos + 8 <= r->len) {
-        /* Fast path: load 8 bytes in one shot */
-        uint64_t raw;
-        memcpy(&raw, r->buf + r->pos, 8);
-        int shift = r->nbits;
-        r->bits |= raw << shift;
-        /* We loaded 8 bytes but can only use what fits in 64 bits */
-        int consumed = (64 - shift) >> 3;  /* full bytes that fit */
-        r->pos   += (size_t)consumed;
-        r->nbits += consumed * 8;
-    } else {
-        /* Slow path near end of buffer */
-        while (r->nbits <= 56 && r->pos < r->len) {
-            r->bits |= (uint64_t)r->buf[r->pos++] << r->nbits;
-            r->nbits += 8;
-        }
+void br_refill_slow(bit_reader_t *r) {
+    while (r->nbits <= 56 && r->pos < r->len) {
+        r->bits |= (uint64_t)r->buf[r->pos++] << r->nbits;
+        r->nbits += 8;
     }
 }
-
-uint32_t br_peek(bit_reader_t *r, int nbits) {
-    if (r->nbits < nbits) br_refill(r);
-    return (uint32_t)(r->bits & ((1ULL << nbits) - 1));
-}
-
-uint32_t br_read(bit_reader_t *r, int nbits) {
-    uint32_t val = br_peek(r, nbits);
-    r->bits >>= nbits;
-    r->nbits -= nbits;
-    return val;
-}
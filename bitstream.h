@@ -3,6 +3,9 @@
 
 #include <stdint.h>
 #include <stddef.h>
+#include <string.h>
+
+struct odz_mem;
 
 /* ── Memory-backed bit writer ──────────────────────────────── */
 typedef struct {
@@ -11,12 +14,31 @@ typedef struct {
     size_t   pos;       /* next byte position */
     uint64_t bits;      /* accumulator */
     int      nbits;     /* valid bits in accumulator */
+    const struct odz_mem *mem;  /* buf's allocator, NULL = malloc */
 } bit_writer_t;
 
-int  bw_init(bit_writer_t *w, size_t initial_cap);  /* 0=ok, -1=oom */
+int  bw_init(bit_writer_t *w, size_t initial_cap, const struct odz_mem *mem);  /* 0=ok, -1=oom */
 void bw_free(bit_writer_t *w);
 int  bw_write(bit_writer_t *w, uint32_t val, int nbits);  /* LSB-first, 0=ok, -1=oom */
 int  bw_flush(bit_writer_t *w);                            /* pad to byte, 0=ok, -1=oom */
+int  bw_write_bytes(bit_writer_t *w, const uint8_t *src, size_t n);  /* byte-aligned only */
+int  bw_reserve(bit_writer_t *w, size_t n);                /* room for n more bytes, 0=ok, -1=oom */
+
+/* bw_write into room set aside by bw_reserve, for hot loops: nbits ≤ 16,
+ * whole bytes go out four at a time (little-endian stores).  Up to 31
+ * bits may stay in the accumulator; bw_write(w, 0, 0) drains it to
+ * fewer than 8 before a bw_flush. */
+static inline void bw_write_fast(bit_writer_t *w, uint32_t val, int nbits) {
+    w->bits |= (uint64_t)val << w->nbits;
+    w->nbits += nbits;
+    if (w->nbits >= 32) {
+        uint32_t word = (uint32_t)w->bits;
+        memcpy(w->buf + w->pos, &word, 4);
+        w->pos += 4;
+        w->bits >>= 32;
+        w->nbits -= 32;
+    }
+}
 
 /* ── Memory-backed bit reader ──────────────────────────────── */
 typedef struct {
@@ -28,8 +50,40 @@ typedef struct {
 } bit_reader_t;
 
 void     br_init(bit_reader_t *r, const uint8_t *buf, size_t len);
-uint32_t br_peek(bit_reader_t *r, int nbits);
-uint32_t br_read(bit_reader_t *r, int nbits);   /* LSB-first */
+void     br_refill_slow(bit_reader_t *r);       /* near the end of the buffer */
+
+/* Top the accumulator up to at least 56 bits (fewer only at the end) */
+static inline void br_refill(bit_reader_t *r) {
+    if (r->pos + 8 <= r->len) {
+        /* Fast path: load 8 bytes in one shot, keep the whole bytes that fit */
+        uint64_t raw;
+        memcpy(&raw, r->buf + r->pos, 8);
+        r->bits |= raw << r->nbits;
+        int consumed = (64 - r->nbits) >> 3;
+        r->pos   += (size_t)consumed;
+        r->nbits += consumed * 8;
+    } else {
+        br_refill_slow(r);
+    }
+}
+
+static inline uint32_t br_peek(bit_reader_t *r, int nbits) {
+    if (r->nbits < nbits) br_refill(r);
+    return (uint32_t)(r->bits & ((1ULL << nbits) - 1));
+}
+
+/* LSB-first */
+static inline uint32_t br_read(bit_reader_t *r, int nbits) {
+    uint32_t val = br_peek(r, nbits);
+    r->bits >>= nbits;
+    r->nbits -= nbits;
+    return val;
+}
+
+/* Bytes consumed so far, a partly read byte counting as whole */
+static inline size_t br_bytes_used(const bit_reader_t *r) {
+    return (size_t)(((int64_t)r->pos * 8 - r->nbits + 7) / 8);
+}
 
 /* Lightweight consume after br_peek — just shifts bits, no refill */
 static inline void br_consume(bit_reader_t *r, int nbits) {
@@ -2,12 +2,20 @@
  * Block-based LZ77 + Huffman compressor.
  *
  * For each 1 MB block:
+ *   0. Optionally run a pre-LZ filter (x86, delta, shuffle) over a copy
  *   1. Run LZ77 hash-chain matcher → token buffer
- *   2. Count symbol frequencies, build Huffman trees
- *   3. Write Huffman trees + encoded tokens to bitstream buffer
+ *   2. Count symbol frequencies, build Huffman trees (or reuse the
+ *      previous block's when that is cheaper than sending new ones)
+ *   3. Write Huffman trees + encoded tokens to bitstream buffer (4
+ *      interleaved streams for large blocks), and also FSE-code the
+ *      tokens; keep FSE if clearly smaller.  At -8 and -9 the block is
+ *      also Burrows-Wheeler coded (odz_bwt.c), kept on the same terms
  *   4. Write block header + compressed data to output
  */
 
+#ifndef _WIN32
+#define _POSIX_C_SOURCE 200809L  /* fseeko / ftello under -std=c17 */
+#endif
 #include <stdlib.h>
 #include <string.h>
 
@@ -20,54 +28,302 @@
 #include "odz.h"
 #include "bitstream.h"
 #include "huffman.h"
+#include "fse.h"
 #include "lz_tables.h"
 #include "lz_matcher.h"
+#include "odz_cpu.h"
+#include "deflate.h"
+#include "odz_io.h"
+#include "odz_pool.h"
+#include "odz_filter.h"
+#include "odz_dedup.h"
+#include "odz_bwt.h"
 
 /* Raw LZ token: either a literal or a (length, distance) match */
 typedef struct {
     uint16_t litlen;    /* literal byte (0-255) or match length (3-258) */
-    uint16_t dist;      /* 0 = literal, >0 = match distance */
+    uint16_t dist;      /* 0 = literal, >0 = match distance or TOK_REF_* */
 } token_t;
 
-/* Compress one block of raw data into the bitstream buffer.
- * Returns the compressed data size, or 0 on error (sets *err). */
-static size_t compress_block(const uint8_t *in, size_t n,
-                             bit_writer_t *bw, int *err) {
-    *err = 0;
-
-    /* ── Pass 1: LZ77 → token buffer + frequency counts ──── */
-    size_t max_tokens = n + 1; /* worst case: all literals + end symbol */
-    token_t *tokens = malloc(max_tokens * sizeof(token_t));
-    if (!tokens) { *err = ODZ_ERR_OOM; return 0; }
-    size_t ntok = 0;
-
-    uint32_t ll_freq[LITLEN_SYMS] = {0};
-    uint32_t d_freq[DIST_SYMS]    = {0};
-
-    lz_matcher_t m;
-    if (lz_matcher_init(&m, n, HASH_BITS, MAX_CHAIN_STEPS) != 0) {
-        free(tokens);
-        *err = ODZ_ERR_OOM;
-        return 0;
+/* Special token_t.dist values: repeat offsets (v5) and reference matches
+ * (patch mode) */
+#define TOK_REP0      0xFFFB    /* + k: k-th most recent distance (DIST_REP0 + k) */
+#define TOK_REF_POS   0xFFFE    /* at the next entry of lz_block_t.ref_pos */
+#define TOK_REF_NEXT  0xFFFF    /* where the previous reference match ended */
+
+/* One block after LZ77: tokens plus symbol frequencies (EOB included).
+ * A literal-only block (rung 0) has no token buffer: its ntok tokens are
+ * the bytes at lits. */
+typedef struct {
+    token_t  *tokens;
+    const uint8_t *lits;    /* literal-only: the block itself, else NULL */
+    size_t    ntok;
+    uint64_t *ref_pos;      /* positions of the TOK_REF_POS tokens, in order */
+    size_t    nref;
+    int       ref_bits;     /* explicit position width */
+    uint32_t  ll_freq[LITLEN_SYMS];
+    uint32_t  d_freq[DIST_SYMS];
+    const odz_mem_t *mem;   /* tokens and ref_pos come from here */
+    size_t    tok_cap, ref_cap;
+} lz_block_t;
+
+static void lz_block_free(lz_block_t *lb) {
+    odz_free_big(lb->mem, lb->tokens, lb->tok_cap * sizeof *lb->tokens);
+    odz_free(lb->mem, lb->ref_pos, lb->ref_cap * sizeof *lb->ref_pos);
+}
+
+/* Distance symbol + extra bits of a match token.  Repeat offsets and
+ * reference matches have none; an explicit position follows DIST_REF_POS
+ * instead. */
+static inline void token_dist_code(unsigned dist, int *sym, int *ebits, int *eval) {
+    if (dist >= TOK_REP0) {
+        *sym = dist == TOK_REF_POS ? DIST_REF_POS :
+               dist == TOK_REF_NEXT ? DIST_REF_NEXT : DIST_REP0 + (int)(dist - TOK_REP0);
+        *ebits = *eval = 0;
+    } else {
+        dist_to_code((int)dist, sym, ebits, eval);
     }
+}
+
+/* Position of the TOK_REF_POS token t, for emitters that visit a subset
+ * of the tokens in order: *scan / *k track how far the count has got */
+static uint64_t token_ref_pos(const lz_block_t *lb, size_t t, size_t *scan, size_t *k) {
+    for (; *scan < t; (*scan)++)
+        if (lb->tokens[*scan].dist == TOK_REF_POS) (*k)++;
+    return lb->ref_pos[*k];
+}
+
+/* Code lengths of a Huffman block's lit/len + distance trees */
+typedef struct {
+    int     valid;
+    uint8_t ll_lens[LITLEN_SYMS];
+    uint8_t d_lens[DIST_SYMS];
+} huff_trees_t;
+
+/* ── Contexts ──────────────────────────────────────────────── */
+
+/* Scratch kept from one odz_compress call to the next (odz_options_t.ctx) */
+struct odz_ctx {
+    lz_matcher_t m;         /* head[] at HASH_BITS, prev[] for cap positions */
+    size_t       cap;
+};
+
+/* Positions a new context has room for before it first grows */
+#define CTX_WARM_POSITIONS  (64u << 10)
+
+odz_ctx_t *odz_ctx_create(void) {
+    odz_ctx_t *ctx = calloc(1, sizeof *ctx);
+    if (!ctx) return NULL;
+    if (lz_matcher_init(&ctx->m, CTX_WARM_POSITIONS, HASH_BITS, MAX_CHAIN_STEPS, NULL) != 0) {
+        free(ctx);
+        return NULL;
+    }
+    ctx->cap = CTX_WARM_POSITIONS;
+    return ctx;
+}
+
+void odz_ctx_free(odz_ctx_t *ctx) {
+    if (!ctx) return;
+    lz_matcher_free(&ctx->m);
+    free(ctx);
+}
+
+/* About eight buckets a position, up to HASH_BITS: a block under 4 KB
+ * does not clear a table sized for a large one */
+static int block_hash_bits(size_t n) {
+    int bits = 10;
+    while (bits < HASH_BITS && ((size_t)1 << bits) < 8 * n) bits++;
+    return bits;
+}
+
+/* The matcher for a block of n bytes: ctx's, grown if need be and
+ * cleared, or local, freshly allocated from mem.  A context outlives the
+ * call and so the hooks in mem; it takes only the huge-page choice.
+ * NULL when out of memory. */
+static lz_matcher_t *matcher_open(odz_ctx_t *ctx, lz_matcher_t *local, size_t n,
+                                  const odz_mem_t *mem) {
+    int bits = block_hash_bits(n);
+    if (!ctx) return lz_matcher_init(local, n, bits, MAX_CHAIN_STEPS, mem) == 0 ? local : NULL;
+    if (!ctx->m.head || n > ctx->cap) {
+        odz_mem_t own = { .huge = mem && mem->huge };
+        lz_matcher_free(&ctx->m);
+        ctx->cap = 0;
+        if (lz_matcher_init(&ctx->m, n, HASH_BITS, MAX_CHAIN_STEPS, &own) != 0) return NULL;
+        ctx->cap = n;
+    }
+    lz_matcher_reset(&ctx->m, n, bits);
+    return &ctx->m;
+}
+
+static void matcher_close(odz_ctx_t *ctx, lz_matcher_t *m) {
+    if (!ctx) lz_matcher_free(m);
+}
+
+/* ── Effort ladder ─────────────────────────────────────────────
+ * What a block may spend, by rung: levels 1-9 are rungs 1-9, and the
+ * adaptive controller may also drop to rung 0, which codes literals
+ * straight from a byte histogram. */
+
+typedef struct {
+    int chain;          /* max hash-chain steps; 0 = no matching */
+    int lazy;           /* look one position ahead before taking a match */
+    int fse;            /* try tANS against Huffman */
+    int bwt;            /* try Burrows-Wheeler against LZ */
+} effort_t;
+
+#define EFFORT_RUNGS (ODZ_LEVEL_MAX + 1)
+
+static const effort_t effort_ladder[EFFORT_RUNGS] = {
+    {    0, 0, 0, 0 },
+    {    4, 0, 0, 0 },
+    {    8, 0, 0, 0 },
+    {   16, 0, 0, 0 },
+    {   32, 1, 0, 0 },
+    {   64, 1, 1, 0 },
+    {  MAX_CHAIN_STEPS, 1, 1, 0 },    /* ODZ_LEVEL_DEFAULT */
+    {  512, 1, 1, 0 },
+    { 1024, 1, 1, 1 },
+    { 4096, 1, 1, 1 },
+};
+
+/* ── Pass 1: LZ77 → token buffer + frequency counts ────────── */
+
+/* Reference matches shorter than this are weighed against the window */
+#define REF_LONG 32
+
+/* A repeat-offset match this long is taken without walking the chain */
+#define REP_LONG 32
+
+/* Token for window distance dist: a repeat offset if it is one (reps is
+ * the block's repeat-offset state, updated as the decoder will) */
+static inline unsigned rep_token(uint32_t *reps, unsigned dist) {
+    int k = 0;
+    while (k < DIST_REPS && reps[k] != dist) k++;
+    unsigned tok = k < DIST_REPS ? TOK_REP0 + (unsigned)k : dist;
+    odz_rep_use(reps, k < DIST_REPS ? k : DIST_REPS - 1, dist);
+    return tok;
+}
+
+/* Tokenizer state the match loop carries, besides lb */
+typedef struct {
+    size_t   ntok;
+    uint64_t ref_next;      /* where the last reference match ended */
+    uint64_t nrefm, refb, nrep;
+    uint32_t reps[DIST_REPS];
+} tok_state_t;
+
+/* With ref (patch mode), matches may also copy from the reference: the
+ * continuation of the previous one is checked first, then the long-range
+ * index.  A long reference match is taken without searching the window,
+ * and its positions are not inserted there, so unchanged stretches cost
+ * little more than a compare.
+ * With use_reps (odz v5), the repeat offsets are probed before the chain
+ * and matches at them are coded as DIST_REP0 + k; a tie with the chain's
+ * best goes to the repeat offset, which costs no extra bits.
+ * With lazy, a match is held back for a longer one a position on.
+ *
+ * Always inlined into the instances below with the three switches
+ * constant, so each compiles only the paths it takes; the chain depth is
+ * fixed likewise in m's search instance.  ODZ_OK, or ODZ_ERR_OOM. */
+static ODZ_ALWAYS_INLINE
+int tokenize_loop(const uint8_t *in, size_t n, const lz_ref_t *ref, lz_matcher_t *m,
+                  const odz_mem_t *mem, lz_block_t *lb, tok_state_t *ts,
+                  const int lazy, const int use_reps, const int has_ref) {
+    token_t *tokens = lb->tokens;
+    uint32_t *ll_freq = lb->ll_freq, *d_freq = lb->d_freq;
+    size_t ntok = 0, i = 0;
+    int held = 0, held_len = 0, held_dist = 0;     /* lazy: search at i already done */
 
-    size_t i = 0;
     while (i < n) {
-        int best_len = 0, best_dist = 0;
-        lz_matcher_find_best(&m, in, i, n, (int)ODZ_WINDOW,
-                             ODZ_MIN_MATCH, ODZ_MAX_MATCH,
-                             &best_len, &best_dist);
+        int best_len = 0, best_dist = 0, searched = 0;
+        size_t ins = i;         /* first position not yet in the chains */
+        if (lazy && held) {
+            best_len = held_len;
+            best_dist = held_dist;
+            searched = 1;
+            ins = i + 1;
+            held = 0;
+        }
+
+        if (has_ref) {
+            uint64_t rpos = ts->ref_next;
+            unsigned rdist = TOK_REF_NEXT;
+            int rlen = lz_ref_match_len(ref, in, i, n, ts->ref_next, ODZ_MAX_MATCH);
+            if (rlen < REF_LONG) {
+                uint64_t p;
+                int l = lz_ref_find(ref, in, i, n, ODZ_MAX_MATCH, &p);
+                if (l > rlen + 2) { rlen = l; rpos = p; rdist = TOK_REF_POS; }
+            }
+            if (!searched && rlen >= ODZ_MIN_MATCH && rlen < REF_LONG) {
+                lz_matcher_search(m, in, i, n, &best_len, &best_dist);
+                searched = 1;
+                ins = i + 1;
+            }
+            /* An explicit position costs more than a window distance */
+            if (rlen >= ODZ_MIN_MATCH && rlen >= best_len + (rdist == TOK_REF_POS ? 3 : 0)) {
+                if (rdist == TOK_REF_POS) {
+                    /* Take back literals the match also covers */
+                    while (rlen < ODZ_MAX_MATCH && rpos > 0 && ntok > 0 &&
+                           tokens[ntok - 1].dist == 0 && in[i - 1] == ref->data[rpos - 1]) {
+                        ntok--;
+                        ll_freq[in[--i]]--;
+                        rpos--;
+                        rlen++;
+                    }
+                    if (lb->nref == lb->ref_cap) {
+                        size_t cap = lb->ref_cap ? 2 * lb->ref_cap : 256;
+                        uint64_t *rp = odz_realloc(mem, lb->ref_pos, lb->ref_cap * sizeof *rp,
+                                                   cap * sizeof *rp);
+                        if (!rp) return ODZ_ERR_OOM;
+                        lb->ref_pos = rp;
+                        lb->ref_cap = cap;
+                    }
+                    lb->ref_pos[lb->nref++] = rpos;
+                }
+                int lsym = 0, lebits = 0, leval = 0;
+                len_to_code(rlen, &lsym, &lebits, &leval);
+                ll_freq[lsym]++;
+                d_freq[rdist == TOK_REF_POS ? DIST_REF_POS : DIST_REF_NEXT]++;
+                tokens[ntok].litlen = (uint16_t)rlen;
+                tokens[ntok].dist   = (uint16_t)rdist;
+                ntok++;
+                i += (size_t)rlen;
+                ts->ref_next = rpos + (uint64_t)rlen;
+                ts->nrefm++;
+                ts->refb += (uint64_t)rlen;
+                continue;
+            }
+        }
+
+        int rep_len = 0, rep_dist = 0;
+        if (use_reps) {
+            for (int k = 0; k < DIST_REPS; k++) {
+                int l = lz_match_len_at(in, i, n, ts->reps[k], ODZ_MAX_MATCH);
+                if (l > rep_len) { rep_len = l; rep_dist = (int)ts->reps[k]; }
+            }
+        }
+        if (!searched && rep_len < REP_LONG) {
+            lz_matcher_search(m, in, i, n, &best_len, &best_dist);
+            ins = i + 1;
+        }
+        if (rep_len >= ODZ_MIN_MATCH && rep_len >= best_len) {
+            best_len = rep_len;
+            best_dist = rep_dist;
+        }
 
         /* Lazy matching: check if the next position has a longer match.
          * Skip the check for near-maximum matches (not worth it). */
-        if (best_len >= ODZ_MIN_MATCH && best_len < ODZ_MAX_MATCH - 1 && i + 1 < n) {
-            lz_matcher_insert(&m, in, i);
+        if (lazy && best_len >= ODZ_MIN_MATCH && best_len < ODZ_MAX_MATCH - 1 && i + 1 < n) {
+            if (ins == i) lz_matcher_insert(m, in, i);
             int next_len = 0, next_dist = 0;
-            lz_matcher_find_best_next(&m, in, i, n, (int)ODZ_WINDOW,
-                                      ODZ_MIN_MATCH, ODZ_MAX_MATCH,
-                                      &next_len, &next_dist);
+            lz_matcher_search(m, in, i + 1, n, &next_len, &next_dist);
+            ins = i + 2;
             if (next_len > best_len) {
-                /* Emit literal, take the longer match next time */
+                /* Emit literal, take the longer match next time:
+                 * the search there is done */
+                held = 1;
+                held_len = next_len;
+                held_dist = next_dist;
                 ll_freq[in[i]]++;
                 tokens[ntok].litlen = in[i];
                 tokens[ntok].dist = 0;
@@ -82,87 +338,990 @@ static size_t compress_block(const uint8_t *in, size_t n,
             len_to_code(best_len, &lsym, &lebits, &leval);
             ll_freq[lsym]++;
 
+            unsigned dist = use_reps ? rep_token(ts->reps, (unsigned)best_dist) : (unsigned)best_dist;
             int dsym = 0, debits = 0, deval = 0;
-            dist_to_code(best_dist, &dsym, &debits, &deval);
+            token_dist_code(dist, &dsym, &debits, &deval);
             d_freq[dsym]++;
+            ts->nrep += dsym >= DIST_REP0;
 
             tokens[ntok].litlen = (uint16_t)best_len;
-            tokens[ntok].dist   = (uint16_t)best_dist;
+            tokens[ntok].dist   = (uint16_t)dist;
             ntok++;
 
-            /* Insert ALL positions covered by the match */
-            for (size_t p = i; p < i + (size_t)best_len && p + 2 < n; p++)
-                lz_matcher_insert(&m, in, p);
+            /* Insert ALL positions covered by the match; inserting one
+             * twice would link it to itself */
+            for (size_t p = ins; p < i + (size_t)best_len && p + 2 < n; p++)
+                lz_matcher_insert(m, in, p);
             i += (size_t)best_len;
         } else {
             /* Emit literal */
-            lz_matcher_insert(&m, in, i);
+            if (ins == i) lz_matcher_insert(m, in, i);
             ll_freq[in[i]]++;
             tokens[ntok].litlen = in[i];
             tokens[ntok].dist = 0;
             ntok++; i++;
         }
     }
-    lz_matcher_free(&m);
+    ts->ntok = ntok;
+    return ODZ_OK;
+}
+
+typedef int (*tokenize_fn)(const uint8_t *in, size_t n, const lz_ref_t *ref, lz_matcher_t *m,
+                           const odz_mem_t *mem, lz_block_t *lb, tok_state_t *ts);
+
+#define TOKENIZE_AT(lazy, reps, ref)                                                     \
+    static int tokenize_##lazy##reps##ref(const uint8_t *in, size_t n, const lz_ref_t *r, \
+                                          lz_matcher_t *m, const odz_mem_t *mem,        \
+                                          lz_block_t *lb, tok_state_t *ts) {            \
+        return tokenize_loop(in, n, r, m, mem, lb, ts, lazy, reps, ref);                \
+    }
+TOKENIZE_AT(0, 0, 0) TOKENIZE_AT(0, 0, 1) TOKENIZE_AT(0, 1, 0) TOKENIZE_AT(0, 1, 1)
+TOKENIZE_AT(1, 0, 0) TOKENIZE_AT(1, 0, 1) TOKENIZE_AT(1, 1, 0) TOKENIZE_AT(1, 1, 1)
+
+/* [lazy][use_reps][ref] */
+static const tokenize_fn tokenize_table[2][2][2] = {
+    { { tokenize_000, tokenize_001 }, { tokenize_010, tokenize_011 } },
+    { { tokenize_100, tokenize_101 }, { tokenize_110, tokenize_111 } },
+};
+
+/* Byte histogram of p[0..n) added into freq, over four tables so that
+ * runs of one byte do not serialize on a single counter */
+static void byte_histogram(const uint8_t *p, size_t n, uint32_t *freq) {
+    uint32_t h[4][256];
+    memset(h, 0, sizeof h);
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4) {
+        h[0][p[i]]++;
+        h[1][p[i + 1]]++;
+        h[2][p[i + 2]]++;
+        h[3][p[i + 3]]++;
+    }
+    for (; i < n; i++) h[0][p[i]]++;
+    for (int s = 0; s < 256; s++) freq[s] += h[0][s] + h[1][s] + h[2][s] + h[3][s];
+}
+
+/* LZ77 over in[0..n) into lb's tokens and frequency counts, by the
+ * tokenize_loop instance for eff and the switches (see there).  Without
+ * a chain (rung 0) every byte is a literal: only the histogram is taken,
+ * and lb refers to in, which must outlive it.
+ * With ctx, its matcher is reused instead of allocating one.
+ * The token buffer, and a matcher without ctx, come from mem. */
+static int lz_tokenize(const uint8_t *in, size_t n, const lz_ref_t *ref, int use_reps,
+                       const effort_t *eff, odz_ctx_t *ctx, const odz_mem_t *mem,
+                       lz_block_t *lb, odz_stats_t *st) {
+    uint64_t t0 = st ? odz_now_ns() : 0;
+
+    size_t max_tokens = eff->chain ? n + 1 : 0; /* worst case: all literals + end symbol */
+    token_t *tokens = NULL;
+    if (max_tokens && !(tokens = odz_alloc_big(mem, max_tokens * sizeof(token_t))))
+        return ODZ_ERR_OOM;
+    lb->mem = mem;
+    lb->tokens = tokens;
+    lb->lits = eff->chain ? NULL : in;
+    lb->tok_cap = max_tokens;
+    lb->ref_pos = NULL;
+    lb->nref = 0;
+    lb->ref_cap = 0;
+    lb->ref_bits = ref ? odz_ref_bits(ref->size) : 0;
+    tok_state_t ts = { .reps = ODZ_REP_INIT };
+
+    uint32_t *ll_freq = lb->ll_freq, *d_freq = lb->d_freq;
+    memset(ll_freq, 0, sizeof lb->ll_freq);
+    memset(d_freq, 0, sizeof lb->d_freq);
+
+    lz_matcher_t local, *m = NULL;
+    if (eff->chain) {
+        if (!(m = matcher_open(ctx, &local, n, mem))) {
+            lz_block_free(lb);
+            return ODZ_ERR_OOM;
+        }
+        lz_matcher_set_chain(m, eff->chain);
+        int rc = tokenize_table[eff->lazy != 0][use_reps != 0][ref != NULL](in, n, ref, m, mem,
+                                                                           lb, &ts);
+        if (rc != ODZ_OK) {
+            matcher_close(ctx, m);
+            lz_block_free(lb);
+            return rc;
+        }
+    } else {
+        byte_histogram(in, n, ll_freq);
+        ts.ntok = n;
+    }
+
+    if (st && m) {
+        st->chain_searches += m->searches;
+        st->chain_steps    += m->steps;
+        if (m->steps_max > st->chain_steps_max) st->chain_steps_max = m->steps_max;
+    }
+    if (st) {
+        uint64_t lits = 0;
+        for (int s = 0; s < 256; s++) lits += ll_freq[s];
+        st->literals    += lits;
+        st->match_bytes += n - lits;
+        for (int c = 0; c < ODZ_STATS_LEN_CODES; c++) {
+            st->len_hist[c] += ll_freq[257 + c];
+            st->matches     += ll_freq[257 + c];
+        }
+        for (int c = 0; c < ODZ_STATS_DIST_CODES; c++) st->dist_hist[c] += d_freq[c];
+        st->rep_matches += ts.nrep;
+        st->ref_matches += ts.nrefm;
+        st->ref_bytes   += ts.refb;
+        st->ns_match += odz_now_ns() - t0;
+    }
+    if (m) matcher_close(ctx, m);
 
     /* End-of-block symbol */
     ll_freq[LITLEN_END]++;
 
-    /* Ensure at least one distance symbol exists (for valid tree) */
-    if (d_freq[0] == 0) {
-        int any = 0;
-        for (int s = 0; s < DIST_SYMS; s++) if (d_freq[s]) { any = 1; break; }
-        if (!any) d_freq[0] = 1;
-    }
+    lb->ntok = ts.ntok;
+    return ODZ_OK;
+}
 
-    /* ── Build Huffman trees ─────────────────────────────── */
-    uint8_t  ll_lens[LITLEN_SYMS], d_lens[DIST_SYMS];
-    uint16_t ll_codes[LITLEN_SYMS], d_codes[DIST_SYMS];
+/* Ensure at least one distance symbol exists (for valid tree) */
+static void ensure_dist_symbol(uint32_t *d_freq) {
+    for (int s = 0; s < DIST_SYMS; s++) if (d_freq[s]) return;
+    d_freq[0] = 1;
+}
+
+/* ── Pass 2: encoded tokens + end-of-block → bitstream ─────── */
 
-    huff_build_lengths(ll_freq, LITLEN_SYMS, HUFF_MAX_BITS, ll_lens);
-    huff_build_lengths(d_freq, DIST_SYMS, HUFF_MAX_BITS, d_lens);
+/* Emit tokens first, first + step, ...; end-of-block counts as token
+ * ntok and is written only if it falls on this stride. */
+static int emit_tokens(bit_writer_t *bw, const lz_block_t *lb,
+                       const uint8_t *ll_lens, const uint8_t *d_lens,
+                       size_t first, size_t step) {
+    uint16_t ll_codes[LITLEN_SYMS], d_codes[DIST_SYMS];
     huff_build_codes(ll_lens, LITLEN_SYMS, ll_codes);
     huff_build_codes(d_lens, DIST_SYMS, d_codes);
 
-    /* ── Pass 2: write trees + encoded tokens to bitstream ── */
-    huff_write_trees(bw, ll_lens, LITLEN_SYMS, d_lens, DIST_SYMS);
+    /* Literal-only: at most HUFF_MAX_BITS per byte, reserved up front */
+    const uint8_t *lits = lb->lits;
+    if (lits) {
+        size_t cnt = lb->ntok > first ? (lb->ntok - first + step - 1) / step : 0;
+        if (bw_reserve(bw, cnt * HUFF_MAX_BITS / 8 + 8) != 0) return -1;
+        for (size_t t = first; t < lb->ntok; t += step)
+            bw_write_fast(bw, ll_codes[lits[t]], ll_lens[lits[t]]);
+        if (bw_write(bw, 0, 0) != 0) return -1;
+    }
 
-    for (size_t t = 0; t < ntok; t++) {
+    const token_t *tokens = lb->tokens;
+    size_t scan = 0, k = 0;
+    for (size_t t = first; !lits && t < lb->ntok; t += step) {
         if (tokens[t].dist == 0) {
             /* Literal */
             int s = tokens[t].litlen;
-            if (bw_write(bw, ll_codes[s], ll_lens[s]) != 0) goto oom;
+            if (bw_write(bw, ll_codes[s], ll_lens[s]) != 0) return -1;
         } else {
             /* Match */
             int lsym = 0, lebits = 0, leval = 0;
             len_to_code(tokens[t].litlen, &lsym, &lebits, &leval);
-            if (bw_write(bw, ll_codes[lsym], ll_lens[lsym]) != 0) goto oom;
-            if (lebits > 0 && bw_write(bw, (uint32_t)leval, lebits) != 0) goto oom;
+            if (bw_write(bw, ll_codes[lsym], ll_lens[lsym]) != 0) return -1;
+            if (lebits > 0 && bw_write(bw, (uint32_t)leval, lebits) != 0) return -1;
 
             int dsym = 0, debits = 0, deval = 0;
-            dist_to_code(tokens[t].dist, &dsym, &debits, &deval);
-            if (bw_write(bw, d_codes[dsym], d_lens[dsym]) != 0) goto oom;
-            if (debits > 0 && bw_write(bw, (uint32_t)deval, debits) != 0) goto oom;
+            token_dist_code(tokens[t].dist, &dsym, &debits, &deval);
+            if (bw_write(bw, d_codes[dsym], d_lens[dsym]) != 0) return -1;
+            if (debits > 0 && bw_write(bw, (uint32_t)deval, debits) != 0) return -1;
+            if (dsym == DIST_REF_POS) {
+                uint64_t pos = token_ref_pos(lb, t, &scan, &k);
+                for (int b = 0; b < lb->ref_bits; b += ODZ_REF_PIECE) {
+                    int nb = lb->ref_bits - b < ODZ_REF_PIECE ? lb->ref_bits - b : ODZ_REF_PIECE;
+                    if (bw_write(bw, (uint32_t)(pos >> b) & ((1u << nb) - 1), nb) != 0) return -1;
+                }
+            }
         }
     }
 
     /* End-of-block */
-    if (bw_write(bw, ll_codes[LITLEN_END], ll_lens[LITLEN_END]) != 0) goto oom;
-    if (bw_flush(bw) != 0) goto oom;
+    if ((lb->ntok - first) % step != 0) return 0;
+    return bw_write(bw, ll_codes[LITLEN_END], ll_lens[LITLEN_END]);
+}
+
+/*
+ * Multi-stream layout: token t goes to stream t % ODZ_HUFF_STREAMS, each
+ * stream byte-aligned, preceded by the byte sizes of all but the last
+ * (u32 LE).  The decoder then runs one independent bit reader per
+ * stream, so its table lookups do not wait on each other.
+ */
+static int emit_tokens_multi(bit_writer_t *bw, const lz_block_t *lb,
+                             const uint8_t *ll_lens, const uint8_t *d_lens) {
+    if (bw_flush(bw) != 0) return -1;
+    size_t jump = bw->pos;
+    uint8_t sizes[4 * (ODZ_HUFF_STREAMS - 1)] = {0};
+    if (bw_write_bytes(bw, sizes, sizeof sizes) != 0) return -1;
+    for (size_t i = 0; i < ODZ_HUFF_STREAMS; i++) {
+        size_t start = bw->pos;
+        if (emit_tokens(bw, lb, ll_lens, d_lens, i, ODZ_HUFF_STREAMS) != 0 ||
+            bw_flush(bw) != 0)
+            return -1;
+        if (i + 1 < ODZ_HUFF_STREAMS)
+            wr_u32le(bw->buf + jump + 4 * i, (uint32_t)(bw->pos - start));
+    }
+    return 0;
+}
+
+/* ── Pass 2 (tANS): the same tokens as FSE-coded streams ───── */
 
-    free(tokens);
+/*
+ * Payload: has_dist(1) | lit/len counts | [distance counts] |
+ *          lit/len state | [distance state] | per-token bits.
+ *
+ * The decoder reads, for each token: the bits advancing the lit/len
+ * state to this token (not for the first), then for a match the length
+ * extra bits, the bits advancing the distance state (not for the first
+ * match) and the distance extra bits.  Encoding runs backwards, so each
+ * token's bits are produced in the opposite order and the whole list is
+ * written out reversed.
+ */
+static int emit_tokens_fse(bit_writer_t *bw, const lz_block_t *lb) {
+    uint32_t nmatch = 0;
+    for (int s = 257; s < LITLEN_SYMS; s++) nmatch += lb->ll_freq[s];
+
+    int16_t ll_norm[LITLEN_SYMS], d_norm[DIST_SYMS];
+    int ll_log = fse_normalize(lb->ll_freq, LITLEN_SYMS, FSE_LL_TABLELOG, ll_norm);
+    int d_log = nmatch ? fse_normalize(lb->d_freq, DIST_SYMS, FSE_D_TABLELOG, d_norm) : 0;
+
+    fse_ctable_t *ct = odz_alloc(lb->mem, 2 * sizeof *ct);
+    /* (value << 4) | nbits: up to 4 per token, plus position pieces */
+    size_t em_cap = 4 * lb->ntok + (64 / ODZ_REF_PIECE + 1) * lb->nref + 2;
+    uint32_t *em = odz_alloc_big(lb->mem, em_cap * sizeof *em);
+    uint8_t *dsyms = odz_alloc(lb->mem, (size_t)nmatch + 1);
+    int rc = -1;
+    if (!ct || !em || !dsyms) goto done;
+    fse_ctable_t *ll_ct = &ct[0], *d_ct = &ct[1];
+    fse_build_ctable(ll_norm, LITLEN_SYMS, ll_log, ll_ct);
+    if (nmatch) fse_build_ctable(d_norm, DIST_SYMS, d_log, d_ct);
+
+    /* Symbols for each token; distance symbols in match order */
+    const token_t *tokens = lb->tokens;
+    size_t ntok = lb->ntok, nem = 0, j = 0;
+    for (size_t t = 0; nmatch && t < ntok; t++) {
+        if (!tokens[t].dist) continue;
+        int dsym = 0, debits = 0, deval = 0;
+        token_dist_code(tokens[t].dist, &dsym, &debits, &deval);
+        dsyms[j++] = (uint8_t)dsym;
+    }
+
+    uint32_t ll_state = fse_init_state(ll_ct, LITLEN_END);
+    uint32_t d_state = nmatch ? fse_init_state(d_ct, dsyms[nmatch - 1]) : 0;
+    size_t r = lb->nref;
+    for (size_t k = ntok + 1; k-- > 0; ) {    /* k == ntok is end-of-block */
+        if (nmatch && k < ntok && tokens[k].dist) {
+            int lsym = 0, lebits = 0, leval = 0, dsym = 0, debits = 0, deval = 0;
+            len_to_code(tokens[k].litlen, &lsym, &lebits, &leval);
+            token_dist_code(tokens[k].dist, &dsym, &debits, &deval);
+            j--;
+            if (dsym == DIST_REF_POS) {
+                /* Position pieces, high piece first (the list is reversed) */
+                uint64_t pos = lb->ref_pos[--r];
+                int b = (lb->ref_bits - 1) / ODZ_REF_PIECE * ODZ_REF_PIECE;
+                for (; b >= 0; b -= ODZ_REF_PIECE) {
+                    int nb = lb->ref_bits - b < ODZ_REF_PIECE ? lb->ref_bits - b : ODZ_REF_PIECE;
+                    em[nem++] = ((uint32_t)(pos >> b) & ((1u << nb) - 1)) << 4 | (uint32_t)nb;
+                }
+            }
+            em[nem++] = ((uint32_t)deval << 4) | (uint32_t)debits;
+            if (j > 0) em[nem++] = fse_encode(d_ct, &d_state, dsyms[j - 1]);
+            em[nem++] = ((uint32_t)leval << 4) | (uint32_t)lebits;
+        }
+        if (k > 0 && lb->lits) {
+            em[nem++] = fse_encode(ll_ct, &ll_state, lb->lits[k - 1]);
+        } else if (k > 0) {
+            const token_t *p = &tokens[k - 1];
+            int lsym = p->litlen, lebits = 0, leval = 0;
+            if (p->dist) len_to_code(p->litlen, &lsym, &lebits, &leval);
+            em[nem++] = fse_encode(ll_ct, &ll_state, lsym);
+        }
+    }
+    if (nmatch) em[nem++] = ((d_state - (1u << d_log)) << 4) | (uint32_t)d_log;
+    em[nem++] = ((ll_state - (1u << ll_log)) << 4) | (uint32_t)ll_log;
+
+    if (bw_write(bw, nmatch != 0, 1) != 0) goto done;
+    if (fse_write_counts(bw, ll_norm, LITLEN_SYMS, ll_log) != 0) goto done;
+    if (nmatch && fse_write_counts(bw, d_norm, DIST_SYMS, d_log) != 0) goto done;
+    while (nem-- > 0) {
+        int nb = (int)(em[nem] & 15);
+        if (nb && bw_write(bw, em[nem] >> 4, nb) != 0) goto done;
+    }
+    rc = 0;
+
+done:
+    odz_free(lb->mem, ct, 2 * sizeof *ct);
+    odz_free_big(lb->mem, em, em_cap * sizeof *em);
+    odz_free(lb->mem, dsyms, (size_t)nmatch + 1);
+    return rc;
+}
+
+/* Bits to code the block's symbols with the given lengths (extra bits
+ * excluded — they are the same for any tree), or SIZE_MAX if a used
+ * symbol has no code. */
+static size_t coded_bits(const uint32_t *ll_freq, const uint32_t *d_freq,
+                         const huff_trees_t *tr) {
+    size_t bits = 0;
+    for (int s = 0; s < LITLEN_SYMS; s++) {
+        if (!ll_freq[s]) continue;
+        if (!tr->ll_lens[s]) return SIZE_MAX;
+        bits += (size_t)ll_freq[s] * tr->ll_lens[s];
+    }
+    for (int s = 0; s < DIST_SYMS; s++) {
+        if (!d_freq[s]) continue;
+        if (!tr->d_lens[s]) return SIZE_MAX;
+        bits += (size_t)d_freq[s] * tr->d_lens[s];
+    }
+    return bits;
+}
+
+/* ── Literal-only probe ──────────────────────────────────────
+ * Skewed bytes without repeats (sensor noise, coded media, payloads
+ * already deduplicated) give the matcher nothing to find, and its chain
+ * walks are most of the block's time.  So before matching, a few spans
+ * of the block are parsed as the shallowest level would: the repeat
+ * offsets first, then a PROBE_DEPTH-step hash chain, greedily taking
+ * matches of ODZ_MIN_MATCH bytes and up.  That parse is priced as a block
+ * would be coded, at the Huffman code lengths of its own literal/length
+ * and distance histograms plus the extra bits, and the same bytes as
+ * literals only at those of their byte histogram.  Only a block with
+ * essentially no repeats, under 1/PROBE_RARE of the sample matched, that
+ * LZ also saves nothing on is coded from its byte histogram alone.
+ */
+#define PROBE_SPANS  16
+#define PROBE_SPAN   4096
+#define PROBE_BITS   12
+#define PROBE_DEPTH  4          /* as level 1's chain */
+#define PROBE_RARE   8
+
+/* Bits freq[0..nsym) take under a Huffman code built for them; every
+ * code is at least a bit long, even a lone symbol's */
+static uint64_t probe_code_bits(const uint32_t *freq, int nsym) {
+    uint8_t lens[LITLEN_SYMS];
+    huff_build_lengths(freq, nsym, HUFF_MAX_BITS, lens);
+    uint64_t bits = 0;
+    for (int s = 0; s < nsym; s++)
+        if (freq[s]) bits += (uint64_t)freq[s] * (lens[s] ? lens[s] : 1);
+    return bits;
+}
+
+static inline uint32_t probe_hash(const uint8_t *p) {
+    uint32_t v = (uint32_t)p[0] << 16 | (uint32_t)p[1] << 8 | p[2];
+    return (v * 2654435761u) >> (32 - PROBE_BITS);
+}
+
+/* Whether LZ is worth running on in[0..n) (see above) */
+int odz_lz_pays(const uint8_t *in, size_t n) {
+    size_t nspans = n > PROBE_SPANS * PROBE_SPAN ? PROBE_SPANS : 1;
+    size_t len = nspans > 1 ? PROBE_SPAN : (n < PROBE_SPAN ? n : PROBE_SPAN);
+    if (len < 256) return 1;    /* too little to judge: leave it to the matcher */
+
+    uint32_t freq[256] = {0}, ll_freq[LITLEN_SYMS] = {0}, d_freq[DIST_SYMS] = {0};
+    uint64_t extra = 0, covered = 0;
+    uint16_t head[1 << PROBE_BITS], prev[PROBE_SPAN];  /* position + 1, 0 = none */
+    for (size_t k = 0; k < nspans; k++) {
+        const uint8_t *p = in + (n - len) / (nspans > 1 ? nspans - 1 : 1) * k;
+        byte_histogram(p, len, freq);
+        memset(head, 0, sizeof head);
+        uint32_t reps[DIST_REPS] = ODZ_REP_INIT;
+        size_t i = 0;
+        while (i + ODZ_MIN_MATCH <= len) {
+            size_t max = len - i < ODZ_MAX_MATCH ? len - i : ODZ_MAX_MATCH;
+            size_t best = 0, dist = 0;
+            for (int r = 0; r < DIST_REPS; r++) {
+                if (reps[r] > i) continue;
+                size_t m = (size_t)lz_match_len_at(p, i, len, reps[r], (int)max);
+                if (m > best) { best = m; dist = reps[r]; }
+            }
+            uint32_t h = probe_hash(p + i);
+            uint16_t c = head[h];
+            for (int step = 0; c && step < PROBE_DEPTH && best < max; step++, c = prev[c - 1]) {
+                size_t m = (size_t)lz_match_len_at(p, i, len, i - (c - 1), (int)max);
+                if (m > best) { best = m; dist = i - (c - 1); }
+            }
+            prev[i] = head[h];
+            head[h] = (uint16_t)(i + 1);
+            if (best < ODZ_MIN_MATCH) {
+                ll_freq[p[i++]]++;
+                continue;
+            }
+
+            int sym = 0, ebits = 0, eval = 0;
+            len_to_code((int)best, &sym, &ebits, &eval);
+            ll_freq[sym]++;
+            extra += (uint64_t)ebits;
+            int r = 0;
+            while (r < DIST_REPS && reps[r] != dist) r++;
+            if (r < DIST_REPS) {
+                d_freq[DIST_REP0 + r]++;
+            } else {
+                dist_to_code((int)dist, &sym, &ebits, &eval);
+                d_freq[sym]++;
+                extra += (uint64_t)ebits;
+                r = DIST_REPS - 1;
+            }
+            odz_rep_use(reps, r, (uint32_t)dist);
+            covered += best;
+            for (size_t end = i + best; ++i < end; ) {
+                if (i + ODZ_MIN_MATCH > len) continue;
+                h = probe_hash(p + i);
+                prev[i] = head[h];
+                head[h] = (uint16_t)(i + 1);
+            }
+        }
+        while (i < len) ll_freq[p[i++]]++;
+    }
+    uint64_t lit_bits = probe_code_bits(freq, 256);
+    uint64_t lz_bits = probe_code_bits(ll_freq, LITLEN_SYMS) +
+                       probe_code_bits(d_freq, DIST_SYMS) + extra;
+    return covered * PROBE_RARE >= nspans * len || lz_bits + lit_bits / 64 < lit_bits;
+}
+
+/* Compress one block of raw data into the bitstream buffer.
+ * If the previous Huffman block's trees (prev) code this block at least
+ * as cheaply as fresh trees plus their header, they are reused and no
+ * trees are written (ODZ_BLOCK_REUSE_TREES).  The trees in effect are
+ * returned in *used so the caller can carry them forward once the block
+ * is emitted.  Blocks of at least ODZ_MULTISTREAM_MIN tokens are written
+ * as interleaved streams (ODZ_BLOCK_MULTISTREAM).  If eff allows, the
+ * tokens are also FSE-coded, and that is kept instead if it came out
+ * clearly smaller.  Without ref, a block odz_lz_pays finds no repeats
+ * in is coded literals only, skipping the matcher.  Either may, if eff
+ * allows, be Burrows-Wheeler coded instead, kept on the same terms.
+ * *flags receives the block type and flag bits (not ODZ_BLOCK_LAST).
+ * ref, if non-NULL, is the patch reference matches may copy from; it
+ * needs a rung with a chain, as reference matches are weighed against
+ * the window's.
+ * *filt is the filter requested on entry and the one applied on return;
+ * a filtered block also gets ODZ_BLOCK_FILTERED.
+ * Returns the compressed data size, or 0 on error (sets *err).
+ * Stage timings and token counters are accumulated into st if non-NULL. */
+static size_t compress_block(const uint8_t *in, size_t n, const lz_ref_t *ref,
+                             const effort_t *eff, odz_ctx_t *ctx, odz_filter_t *filt,
+                             const huff_trees_t *prev, huff_trees_t *used,
+                             int *flags, bit_writer_t *bw,
+                             odz_stats_t *st, int *err) {
+    /* Work buffers come from the allocator bw was set up with.  The
+     * filtered copy is kept until emitted, for a literal-only block. */
+    const odz_mem_t *mem = bw->mem;
+    uint8_t *fbuf = NULL;
+    size_t fcap = n ? n : 1;
+    *filt = odz_filter_pick(*filt, in, n);
+    if (filt->id != ODZ_FILTER_NONE) {
+        if (!(fbuf = odz_alloc_big(mem, fcap))) { *err = ODZ_ERR_OOM; return 0; }
+        odz_filter_encode(*filt, in, fbuf, n);
+        in = fbuf;
+    }
+    effort_t lit = { 0, 0, eff->fse, eff->bwt };   /* the BWT trial still runs */
+    if (eff->chain && !ref && !odz_lz_pays(in, n)) eff = &lit;
+    if (st && !eff->chain) st->literal_blocks++;
+    lz_block_t lb;
+    *err = lz_tokenize(in, n, ref, 1, eff, ctx, mem, &lb, st);
+    if (*err) {
+        odz_free_big(mem, fbuf, fcap);
+        return 0;
+    }
+
+    uint64_t t1 = st ? odz_now_ns() : 0;
+
+    /* Cost of coding with the previous block's trees (no header) */
+    size_t prev_bits = prev->valid ? coded_bits(lb.ll_freq, lb.d_freq, prev) : SIZE_MAX;
+
+    ensure_dist_symbol(lb.d_freq);
+
+    /* ── Build Huffman trees, or keep the previous ones ──── */
+    huff_build_lengths(lb.ll_freq, LITLEN_SYMS, HUFF_MAX_BITS, used->ll_lens);
+    huff_build_lengths(lb.d_freq, DIST_SYMS, HUFF_MAX_BITS, used->d_lens);
+    used->valid = 1;
+
+    *flags = ODZ_BLOCK_HUFFMAN << 1;
+    if (prev_bits != SIZE_MAX) {
+        size_t new_bits = coded_bits(lb.ll_freq, lb.d_freq, used) +
+                          huff_tree_bits(used->ll_lens, LITLEN_SYMS, used->d_lens, DIST_SYMS,
+                                         HUFF_HDIST_BITS_V5);
+        if (prev_bits <= new_bits) {
+            *used = *prev;
+            *flags |= ODZ_BLOCK_REUSE_TREES;
+        }
+    }
+
+    uint64_t t2 = st ? odz_now_ns() : 0;
+
+    /* ── Write trees + encoded tokens to bitstream ───────── */
+    if (!(*flags & ODZ_BLOCK_REUSE_TREES))
+        huff_write_trees(bw, used->ll_lens, LITLEN_SYMS, used->d_lens, DIST_SYMS, HUFF_HDIST_BITS_V5);
+    int rc;
+    if (lb.ntok >= ODZ_MULTISTREAM_MIN) {
+        *flags |= ODZ_BLOCK_MULTISTREAM;
+        rc = emit_tokens_multi(bw, &lb, used->ll_lens, used->d_lens);
+    } else {
+        rc = emit_tokens(bw, &lb, used->ll_lens, used->d_lens, 0, 1);
+    }
+    if (rc != 0 || bw_flush(bw) != 0) {
+        lz_block_free(&lb);
+        odz_free_big(mem, fbuf, fcap);
+        *err = ODZ_ERR_OOM;
+        return 0;
+    }
+
+    /* ── tANS alternative, if clearly smaller ──────────────
+     * FSE decodes as one serial chain where multi-stream Huffman runs
+     * four, so it has to save at least 1/64 of the size to be kept. */
+    if (eff->fse) {
+        bit_writer_t fw;
+        if (bw_init(&fw, bw->pos + 1024, mem) != 0 ||
+            emit_tokens_fse(&fw, &lb) != 0 || bw_flush(&fw) != 0) {
+            bw_free(&fw);
+            lz_block_free(&lb);
+            odz_free_big(mem, fbuf, fcap);
+            *err = ODZ_ERR_OOM;
+            return 0;
+        }
+        if (fw.pos + (bw->pos >> 6) < bw->pos) {
+            bit_writer_t tmp = *bw;
+            *bw = fw;
+            fw = tmp;
+            *flags = ODZ_BLOCK_FSE << 1;
+        }
+        bw_free(&fw);
+    }
+
+    /* ── Burrows-Wheeler alternative, if clearly smaller ───
+     * The whole block is its context, against LZ's 32K window, but it
+     * decodes several times slower, so it too must save 1/64. */
+    if (eff->bwt && !ref && n <= ODZ_BWT_MAX) {
+        bit_writer_t xw;
+        if (bw_init(&xw, bw->pos + 1024, mem) != 0 ||
+            odz_bwt_encode(in, n, &xw, mem) != 0 || bw_flush(&xw) != 0) {
+            bw_free(&xw);
+            lz_block_free(&lb);
+            odz_free_big(mem, fbuf, fcap);
+            *err = ODZ_ERR_OOM;
+            return 0;
+        }
+        if (xw.pos + (bw->pos >> 6) < bw->pos) {
+            bit_writer_t tmp = *bw;
+            *bw = xw;
+            xw = tmp;
+            *flags = ODZ_BLOCK_BWT << 1;
+        }
+        bw_free(&xw);
+    }
+    if (filt->id != ODZ_FILTER_NONE) *flags |= ODZ_BLOCK_FILTERED;
+
+    if (st) {
+        st->ns_huff_build += t2 - t1;
+        st->ns_huff_code  += odz_now_ns() - t2;
+    }
+    lz_block_free(&lb);
+    odz_free_big(mem, fbuf, fcap);
     return bw->pos;
+}
 
-oom:
-    free(tokens);
-    *err = ODZ_ERR_OOM;
+/* ── DEFLATE block writer (gzip / zlib / raw output) ───────── */
+
+#define DEFLATE_STORED_MAX 65535u
+
+static int write_deflate_stored(bit_writer_t *bw, const uint8_t *in, size_t n, int final) {
+    size_t off = 0;
+    do {
+        size_t len = n - off < DEFLATE_STORED_MAX ? n - off : DEFLATE_STORED_MAX;
+        int last = final && off + len == n;
+        if (bw_write(bw, (uint32_t)last, 1) != 0 || bw_write(bw, 0, 2) != 0) return -1;
+        if (bw_flush(bw) != 0) return -1;  /* stored data is byte-aligned */
+        if (bw_write(bw, (uint32_t)len, 16) != 0 || bw_write(bw, (uint32_t)~len & 0xFFFF, 16) != 0) return -1;
+        if (bw_write_bytes(bw, in + off, len) != 0) return -1;
+        off += len;
+    } while (off < n);
     return 0;
 }
 
+int odz_deflate_block(const uint8_t *in, size_t n, int final, int level, odz_ctx_t *ctx,
+                      bit_writer_t *bw, odz_stats_t *st) {
+    /* Empty input (or empty final block): a zero-length stored block */
+    if (n == 0)
+        return write_deflate_stored(bw, in, 0, final) == 0 ? ODZ_OK : ODZ_ERR_OOM;
+
+    lz_block_t lb;
+    int rc = lz_tokenize(in, n, NULL, 0, &effort_ladder[level ? level : ODZ_LEVEL_DEFAULT],
+                         ctx, bw->mem, &lb, st);
+    if (rc != ODZ_OK) return rc;
+
+    uint64_t t1 = st ? odz_now_ns() : 0;
+    ensure_dist_symbol(lb.d_freq);
+    uint8_t ll_lens[LITLEN_SYMS], d_lens[DIST_SYMS];
+    huff_build_lengths(lb.ll_freq, LITLEN_SYMS, HUFF_MAX_BITS, ll_lens);
+    huff_build_lengths(lb.d_freq, DIST_SYMS, HUFF_MAX_BITS, d_lens);
+    uint64_t t2 = st ? odz_now_ns() : 0;
+
+    /* Dynamic-Huffman block: BFINAL, BTYPE=10, trees, tokens, EOB */
+    size_t mark_pos = bw->pos;
+    uint64_t mark_bits = bw->bits;
+    int mark_nbits = bw->nbits;
+    if (bw_write(bw, (uint32_t)final, 1) != 0 || bw_write(bw, 2, 2) != 0) goto oom;
+    huff_write_trees(bw, ll_lens, LITLEN_SYMS, d_lens, DIST_SYMS, HUFF_HDIST_BITS);
+    if (emit_tokens(bw, &lb, ll_lens, d_lens, 0, 1) != 0) goto oom;
+    lz_block_free(&lb);
+
+    size_t dyn_bits = (bw->pos - mark_pos) * 8 + (size_t)bw->nbits - (size_t)mark_nbits;
+    size_t nstored = n ? (n + DEFLATE_STORED_MAX - 1) / DEFLATE_STORED_MAX : 1;
+    size_t stored_bits = n * 8 + nstored * (3 + 7 + 32);
+    int type = ODZ_BLOCK_HUFFMAN;
+    if (stored_bits < dyn_bits) {
+        /* Roll back and store instead */
+        bw->pos = mark_pos;
+        bw->bits = mark_bits;
+        bw->nbits = mark_nbits;
+        if (write_deflate_stored(bw, in, n, final) != 0) return ODZ_ERR_OOM;
+        type = ODZ_BLOCK_STORED;
+    }
+
+    if (st) {
+        st->ns_huff_build += t2 - t1;
+        st->ns_huff_code  += odz_now_ns() - t2;
+        st->block_count[type]++;
+        st->block_raw[type]  += n;
+        st->block_comp[type] += ((bw->pos - mark_pos) * 8 + (size_t)bw->nbits - (size_t)mark_nbits + 7) / 8;
+    }
+    return ODZ_OK;
+
+oom:
+    lz_block_free(&lb);
+    return ODZ_ERR_OOM;
+}
+
 /* ── Public API ────────────────────────────────────────────── */
 
+/* Account one emitted block (header + payload) in the stats */
+static void stats_block(odz_stats_t *st, int type, uint64_t raw, uint64_t on_disk) {
+    if (!st) return;
+    st->block_count[type]++;
+    st->block_raw[type]  += raw;
+    st->block_comp[type] += on_disk;
+}
+
+/* Block header, then its payload p, in an encrypted stream sealed in
+ * place under the block's index with the header as associated data and
+ * followed by the tag */
+static int write_sealed(odz_io_t *io, const odz_crypt_t *crypt, uint64_t index,
+                        const uint8_t *hdr, size_t hlen, uint8_t *p, size_t n, odz_stats_t *st) {
+    uint8_t tag[ODZ_CRYPT_TAG];
+    if (crypt) {
+        uint64_t t = st ? odz_now_ns() : 0;
+        odz_crypt_seal(crypt, index, hdr, hlen, p, n, tag);
+        if (st) st->ns_crypt += odz_now_ns() - t;
+    }
+    if (odz_io_write(io, hdr, hlen) != hlen) return ODZ_ERR_IO;
+    if (n && odz_io_write(io, p, n) != n) return ODZ_ERR_IO;
+    if (crypt && odz_io_write(io, tag, sizeof tag) != sizeof tag) return ODZ_ERR_IO;
+    return ODZ_OK;
+}
+
+/* Write one block: the coded data in bw if smaller than raw, else raw as
+ * a stored block.  Block index'th of the stream; raw and bw's buffer are
+ * encrypted in place when crypt is set.  Returns ODZ_OK or ODZ_ERR_IO. */
+static int write_block(odz_io_t *io, uint8_t *raw, size_t nread, int is_last,
+                       int flags, odz_filter_t filt, bit_writer_t *bw, size_t comp_size,
+                       const odz_crypt_t *crypt, uint64_t index, odz_stats_t *st) {
+    uint64_t t = st ? odz_now_ns() : 0;
+    size_t tag = crypt ? ODZ_CRYPT_TAG : 0;
+    int rc;
+
+    /* Block header: flags(1) + raw_size(4) [+ comp_size(4) [+ filter(2)]] */
+    uint8_t blk_hdr[11];
+    if (comp_size < nread) {
+        /* Use compressed block */
+        int type = ODZ_BLOCK_TYPE(flags);
+        size_t hlen = 9;
+        blk_hdr[0] = (uint8_t)((is_last ? ODZ_BLOCK_LAST : 0) | flags);
+        wr_u32le(blk_hdr + 1, (uint32_t)nread);
+        wr_u32le(blk_hdr + 5, (uint32_t)comp_size);
+        if (flags & ODZ_BLOCK_FILTERED) {
+            blk_hdr[hlen++] = filt.id;
+            blk_hdr[hlen++] = filt.width;
+        }
+        rc = write_sealed(io, crypt, index, blk_hdr, hlen, bw->buf, comp_size, st);
+        if (rc != ODZ_OK) return rc;
+        stats_block(st, type, nread, hlen + comp_size + tag);
+        if (st && (flags & ODZ_BLOCK_REUSE_TREES)) st->huff_trees_reused++;
+        if (st && (flags & ODZ_BLOCK_FILTERED)) st->filtered_blocks++;
+    } else {
+        /* Stored block (compression didn't help) */
+        blk_hdr[0] = (uint8_t)((is_last ? 1 : 0) | (ODZ_BLOCK_STORED << 1));
+        wr_u32le(blk_hdr + 1, (uint32_t)nread);
+        if ((rc = write_sealed(io, crypt, index, blk_hdr, 5, raw, nread, st)) != ODZ_OK) return rc;
+        stats_block(st, ODZ_BLOCK_STORED, nread, 5 + nread + tag);
+    }
+    if (st) st->ns_write += odz_now_ns() - t;
+    return ODZ_OK;
+}
+
+/* Write a dedup reference: n bytes repeated from output offset src.
+ * Encrypted, it has no payload but still a tag over its header. */
+static int write_ref(odz_io_t *io, uint64_t src, size_t n, int is_last,
+                     const odz_crypt_t *crypt, uint64_t index, odz_stats_t *st) {
+    uint64_t t = st ? odz_now_ns() : 0;
+    uint8_t blk_hdr[ODZ_REF_BLOCK_HEADER];
+    blk_hdr[0] = (uint8_t)((is_last ? ODZ_BLOCK_LAST : 0) | (ODZ_BLOCK_REF << 1));
+    wr_u32le(blk_hdr + 1, (uint32_t)n);
+    wr_u64le(blk_hdr + 5, src);
+    int rc = write_sealed(io, crypt, index, blk_hdr, sizeof blk_hdr, NULL, 0, st);
+    if (rc != ODZ_OK) return rc;
+    stats_block(st, ODZ_BLOCK_REF, n, sizeof blk_hdr + (crypt ? ODZ_CRYPT_TAG : 0));
+    if (st) st->ns_write += odz_now_ns() - t;
+    return ODZ_OK;
+}
+
+/* Next block of input, up to n bytes: straight reads, or with dedup the
+ * next span, *src set to the offset a repeat copies from */
+static size_t read_span(odz_io_t *io, odz_dedup_t *dd, uint8_t *dst, size_t n, uint64_t *src) {
+    *src = ODZ_DEDUP_FRESH;
+    return dd ? odz_dedup_read(dd, io, dst, src) : odz_io_read(io, dst, n);
+}
+
+/* Fold one block's counters into the stream's */
+static void stats_merge(odz_stats_t *dst, const odz_stats_t *src) {
+    dst->ns_match      += src->ns_match;
+    dst->ns_huff_build += src->ns_huff_build;
+    dst->ns_huff_code  += src->ns_huff_code;
+    dst->chain_searches += src->chain_searches;
+    dst->chain_steps    += src->chain_steps;
+    if (src->chain_steps_max > dst->chain_steps_max) dst->chain_steps_max = src->chain_steps_max;
+    dst->literals    += src->literals;
+    dst->matches     += src->matches;
+    dst->match_bytes += src->match_bytes;
+    dst->rep_matches += src->rep_matches;
+    dst->ref_matches += src->ref_matches;
+    dst->ref_bytes   += src->ref_bytes;
+    dst->literal_blocks += src->literal_blocks;
+    for (int i = 0; i < ODZ_STATS_LEN_CODES; i++)  dst->len_hist[i]  += src->len_hist[i];
+    for (int i = 0; i < ODZ_STATS_DIST_CODES; i++) dst->dist_hist[i] += src->dist_hist[i];
+}
+
+/* ── Adaptive effort ───────────────────────────────────────────
+ * With a target speed or a pace callback the rung moves block by block.
+ * Each block's compress time, wall clock or thread CPU, and its ratio
+ * are averaged per rung.  A block slower than the target steps down;
+ * the next rung up is taken when its last known speed holds the target
+ * and it still bought ratio, or when it has no figures yet or only stale
+ * ones (the data may have changed).  Outside pressure, from the pace
+ * callback or else a backed-up output ring, overrides the target. */
+
+#define PACE_STALE      16      /* blocks after which a rung is measured again */
+#define PACE_SLACK      0.95    /* below target × this, step down */
+#define PACE_GAIN       0.995   /* a rung up must shrink the output by ≥ 0.5% */
+
+typedef struct {
+    int         on;
+    int         rung, lo;       /* lo: lowest rung allowed */
+    int         cpu;            /* time blocks in thread CPU time */
+    double      target;         /* bytes per ns per block in flight, 0 = pressure only */
+    double      speed[EFFORT_RUNGS];    /* bytes per ns, 0 = not measured */
+    double      ratio[EFFORT_RUNGS];    /* output / input */
+    uint64_t    seen[EFFORT_RUNGS];     /* block count at the last measurement */
+    uint64_t    blocks;
+    odz_pace_fn pace;
+    void       *userdata;
+    odz_io_t   *io;             /* write backlog, without a callback */
+} pace_t;
+
+/* lanes: blocks compressed at once, which share a wall-clock target.
+ * Patch mode keeps a chain (see compress_block). */
+static void pace_init(pace_t *p, const odz_options_t *opts, odz_io_t *io, int lanes,
+                      const lz_ref_t *ref) {
+    memset(p, 0, sizeof *p);
+    p->rung = opts && opts->level ? opts->level : ODZ_LEVEL_DEFAULT;
+    p->lo = ref ? 1 : 0;
+    if (!opts || (opts->target_speed <= 0 && !opts->pace)) return;
+    p->on = 1;
+    p->cpu = opts->target_cpu;
+    p->target = opts->target_speed > 0 ? opts->target_speed / 1e3 : 0;
+    if (!p->cpu) p->target /= lanes;
+    p->pace = opts->pace;
+    p->userdata = opts->userdata;
+    p->io = io;
+}
+
+static uint64_t pace_clock(const pace_t *p) {
+    return !p->on ? 0 : p->cpu ? odz_cpu_ns() : odz_now_ns();
+}
+
+/* The rung for the next block */
+static int pace_next(pace_t *p) {
+    if (!p->on) return p->rung;
+    int r = p->rung;
+    int press = p->pace ? p->pace(p->userdata) :
+                p->target > 0 && odz_io_write_backlog(p->io) ? -1 : 0;
+    if (press > 0) {
+        r--;
+    } else if (press < 0) {
+        r++;
+    } else if (p->target > 0 && p->speed[r] > 0) {
+        if (p->speed[r] < p->target * PACE_SLACK) {
+            r--;
+        } else if (r + 1 < EFFORT_RUNGS) {
+            int stale = p->speed[r + 1] == 0 || p->blocks - p->seen[r + 1] > PACE_STALE;
+            int holds = p->speed[r + 1] >= p->target;
+            int gains = p->ratio[r + 1] < p->ratio[r] * PACE_GAIN;
+            if (stale || (holds && gains)) r++;
+        }
+    }
+    if (r < p->lo) r = p->lo;
+    if (r >= EFFORT_RUNGS) r = EFFORT_RUNGS - 1;
+    return p->rung = r;
+}
+
+/* Fold in a block of n bytes coded to comp at rung r in ns */
+static void pace_done(pace_t *p, int r, size_t n, size_t comp, uint64_t ns) {
+    if (!p->on || n == 0) return;
+    double speed = (double)n / (double)(ns ? ns : 1);
+    double ratio = (double)(comp < n ? comp : n) / (double)n;
+    if (p->speed[r] > 0 && p->blocks - p->seen[r] <= PACE_STALE) {
+        speed = (p->speed[r] + speed) / 2;
+        ratio = (p->ratio[r] + ratio) / 2;
+    }
+    p->speed[r] = speed;
+    p->ratio[r] = ratio;
+    p->seen[r] = ++p->blocks;
+}
+
+/* ── Parallel blocks ───────────────────────────────────────────
+ * With a pool, each block is a task.  Blocks are compressed on their own
+ * (no tree reuse, which would chain them) and written in order; the
+ * caller reads ahead into a ring of threads + 2 slots so the pool never
+ * runs dry while the oldest block is being written. */
+
+typedef struct {
+    uint8_t      *raw;
+    size_t        nread;
+    uint64_t      index;        /* block number in the stream, the nonce if encrypted */
+    uint64_t      src;          /* dedup repeat: nothing to compress */
+    int           is_last;
+    bit_writer_t  bw;
+    size_t        comp_size;
+    int           flags, err;
+    odz_stats_t   st;
+    odz_stats_t  *stp;          /* &st if stats are wanted */
+    const lz_ref_t *ref;
+    odz_filter_t  filter;       /* requested, then applied */
+    const pace_t *pace;
+    int           rung;
+    uint64_t      pace_ns;      /* compress time, by pace_clock */
+    odz_group_t   group;
+} par_slot_t;
+
+static void compress_task(void *arg) {
+    par_slot_t *s = arg;
+    huff_trees_t none = { .valid = 0 }, trees;
+    uint64_t t = pace_clock(s->pace);
+    s->comp_size = compress_block(s->raw, s->nread, s->ref, &effort_ladder[s->rung], NULL,
+                                  &s->filter, &none, &trees, &s->flags, &s->bw, s->stp, &s->err);
+    s->pace_ns = pace_clock(s->pace) - t;
+}
+
+static int compress_parallel(odz_io_t *io, uint64_t in_size, size_t block_size,
+                             const lz_ref_t *ref, odz_dedup_t *dd, odz_filter_t filter,
+                             const odz_options_t *opts, const odz_mem_t *mem,
+                             const odz_crypt_t *crypt, odz_stats_t *st) {
+    odz_pool_t *pool = opts->pool;
+    uint64_t nblocks = (in_size + block_size - 1) / block_size;
+    size_t nslots = (size_t)odz_pool_threads(pool) + 2;
+    if (nslots > nblocks) nslots = (size_t)nblocks;
+    par_slot_t *slots = odz_alloc(mem, nslots * sizeof *slots);
+    if (!slots) return ODZ_ERR_OOM;
+    memset(slots, 0, nslots * sizeof *slots);
+    pace_t pace;
+    pace_init(&pace, opts, io, odz_pool_threads(pool), ref);
+
+    int rc = ODZ_OK, eof = 0;
+    uint64_t total_read = 0, total_in = 0, t = 0, index = 0;
+    size_t head = 0, inflight = 0;
+    for (;;) {
+        /* Read ahead into the free slots */
+        while (rc == ODZ_OK && !eof && inflight < nslots) {
+            par_slot_t *s = &slots[(head + inflight) % nslots];
+            if (!s->raw && !(s->raw = odz_alloc_big(mem, block_size))) { rc = ODZ_ERR_OOM; break; }
+            if (st) t = odz_now_ns();
+            s->nread = read_span(io, dd, s->raw, block_size, &s->src);
+            if (st) st->ns_read += odz_now_ns() - t;
+            if (s->nread == 0) {
+                if (odz_io_error(io)) rc = ODZ_ERR_IO;
+                eof = 1;
+                break;
+            }
+            total_read += s->nread;
+            s->is_last = eof = total_read >= in_size;
+            s->index = index++;
+            if (s->src != ODZ_DEDUP_FRESH) { inflight++; continue; }
+            if (bw_init(&s->bw, s->nread + 1024, mem) != 0) { rc = ODZ_ERR_OOM; break; }
+            s->err = 0;
+            s->ref = ref;
+            s->filter = filter;
+            s->pace = &pace;
+            s->rung = pace_next(&pace);
+            s->stp = NULL;
+            if (st) { memset(&s->st, 0, sizeof s->st); s->stp = &s->st; }
+            odz_pool_spawn(pool, &s->group, compress_task, s);
+            inflight++;
+        }
+        if (inflight == 0) break;
+
+        /* Write the oldest in order; after an error just drain */
+        par_slot_t *s = &slots[head];
+        odz_pool_wait(pool, &s->group);
+        head = (head + 1) % nslots;
+        inflight--;
+        if (s->src != ODZ_DEDUP_FRESH) {
+            if (rc == ODZ_OK) rc = write_ref(io, s->src, s->nread, s->is_last, crypt, s->index, st);
+        } else {
+            if (rc == ODZ_OK) rc = s->err;
+            if (rc == ODZ_OK)
+                rc = write_block(io, s->raw, s->nread, s->is_last, s->flags, s->filter,
+                                 &s->bw, s->comp_size, crypt, s->index, st);
+            if (st) stats_merge(st, &s->st);
+            if (st) st->level_blocks[s->rung]++;
+            pace_done(&pace, s->rung, s->nread, s->comp_size, s->pace_ns);
+            bw_free(&s->bw);
+        }
+        total_in += s->nread;
+
+        if (rc == ODZ_OK && opts->progress &&
+            opts->progress(total_in, in_size, opts->userdata) != 0)
+            rc = ODZ_ERR_IO;
+    }
+
+    for (size_t i = 0; i < nslots; i++) odz_free_big(mem, slots[i].raw, block_size);
+    odz_free(mem, slots, nslots * sizeof *slots);
+    return rc;
+}
+
 int odz_compress(FILE *in, FILE *out, const odz_options_t *opts) {
-    int rc = ODZ_OK;
+    if (opts && opts->level && (opts->level < ODZ_LEVEL_MIN || opts->level > ODZ_LEVEL_MAX))
+        return ODZ_ERR_FORMAT;
+    if (opts && opts->format != ODZ_FORMAT_ODZ)
+        return opts->patch_from || opts->filter || opts->dedup || odz_crypt_wanted(opts) ? ODZ_ERR_FORMAT
+                                                               : odz_deflate_stream(in, out, opts);
+
+    size_t block_size = opts && opts->block_size ? opts->block_size : ODZ_BLOCK_SIZE;
+    if (block_size < ODZ_BLOCK_SIZE_MIN || block_size > ODZ_BLOCK_SIZE_MAX)
+        return ODZ_ERR_FORMAT;
+
+    /* Filter request; x86 and auto take no width.  Filtering would hide a patch
+     * reference's matches, so auto leaves patch streams alone. */
+    odz_filter_t filter = { ODZ_FILTER_NONE, 0 };
+    if (opts && opts->filter) {
+        if (opts->filter < 0 || opts->filter > ODZ_FILTER_AUTO ||
+            opts->filter_width < 0 || opts->filter_width > ODZ_FILTER_WIDTH_MAX)
+            return ODZ_ERR_FORMAT;
+        filter.id = (uint8_t)opts->filter;
+        if (opts->filter == ODZ_FILTER_DELTA || opts->filter == ODZ_FILTER_SHUFFLE)
+            filter.width = (uint8_t)opts->filter_width;
+        if (filter.width && !odz_filter_valid(filter)) return ODZ_ERR_FORMAT;
+        if (filter.id == ODZ_FILTER_AUTO && opts->patch_from) filter.id = ODZ_FILTER_NONE;
+    }
+
+    odz_mem_t mem;
+    int rc = odz_mem_from(&mem, opts);
+    if (rc != ODZ_OK) return rc;
+    odz_stats_t *st = opts ? opts->stats : NULL;
+    uint64_t t_start = 0, t = 0;
+    if (st) { memset(st, 0, sizeof *st); t_start = odz_now_ns(); }
 
     /* Get input size */
     if (fseeko(in, 0, SEEK_END) != 0) return ODZ_ERR_IO;
@@ -170,49 +1329,112 @@ int odz_compress(FILE *in, FILE *out, const odz_options_t *opts) {
     if (in_size < 0) return ODZ_ERR_IO;
     if (fseeko(in, 0, SEEK_SET) != 0) return ODZ_ERR_IO;
 
-    /* Write file header: "ODZ" version(1) original_size(8) */
-    uint8_t hdr[12];
+    odz_io_t *io;
+    rc = odz_io_open(&io, in, out, opts ? opts->io : ODZ_IO_STDIO, opts && opts->io_direct);
+    if (rc != ODZ_OK) return rc;
+
+    /* Patch mode: map and index the reference */
+    odz_map_t ref_map = { 0 };
+    lz_ref_t ref_idx = { 0 }, *ref = NULL;
+    odz_dedup_t *dd = NULL;
+    uint8_t *block_buf = NULL;
+    size_t buf_size = 0;
+    odz_crypt_t crypt_key, *crypt = NULL;
+    if (opts && opts->patch_from) {
+        if ((rc = odz_io_map(&ref_map, opts->patch_from)) != ODZ_OK) goto cleanup;
+        if (lz_ref_init(&ref_idx, ref_map.data, ref_map.size, &mem) != 0) { rc = ODZ_ERR_OOM; goto cleanup; }
+        ref = &ref_idx;
+    }
+
+    /* Dedup mode: chunk the input and fingerprint what has been written */
+    if (opts && opts->dedup && (rc = odz_dedup_create(&dd, block_size, opts->dedup_window, &mem)) != ODZ_OK)
+        goto cleanup;
+
+    /* Write file header: "ODZ" version(1) original_size(8) block_size(4) stream_flags(1)
+     * [ref_size(8) ref_crc32(4)] [dedup_window(8)] [kdf(1) kdf_param(1) salt(16) check(16)] */
+    uint8_t hdr[ODZ_HEADER_SIZE_MAX];
+    size_t hdr_len = ODZ_HEADER_SIZE;
     hdr[0] = 'O'; hdr[1] = 'D'; hdr[2] = 'Z'; hdr[3] = ODZ_VERSION;
     wr_u64le(hdr + 4, (uint64_t)in_size);
-    if (fwrite(hdr, 1, 12, out) != 12) return ODZ_ERR_IO;
+    wr_u32le(hdr + 12, (uint32_t)block_size);
+    hdr[16] = (ref ? ODZ_STREAM_PATCH : 0) | (dd ? ODZ_STREAM_DEDUP : 0) |
+              (odz_crypt_wanted(opts) ? ODZ_STREAM_ENCRYPTED : 0);
+    if (ref) {
+        wr_u64le(hdr + hdr_len, ref_map.size);
+        wr_u32le(hdr + hdr_len + 8, odz_crc32(0, ref_map.data, (size_t)ref_map.size));
+        hdr_len += 12;
+    }
+    if (dd) {
+        wr_u64le(hdr + hdr_len, opts->dedup_window);
+        hdr_len += 8;
+    }
+    if (hdr[16] & ODZ_STREAM_ENCRYPTED) {
+        if (st) t = odz_now_ns();
+        if ((rc = odz_crypt_begin(&crypt_key, opts, hdr + hdr_len)) != ODZ_OK) goto cleanup;
+        crypt = &crypt_key;
+        hdr_len += ODZ_CRYPT_FIELDS;
+        odz_crypt_seal_header(crypt, hdr, hdr_len);
+        if (st) st->ns_kdf += odz_now_ns() - t;
+    }
+    if (odz_io_write(io, hdr, hdr_len) != hdr_len) { rc = ODZ_ERR_IO; goto cleanup; }
+
+    if (opts && odz_pool_threads(opts->pool) > 1 && (uint64_t)in_size > block_size) {
+        rc = compress_parallel(io, (uint64_t)in_size, block_size, ref, dd, filter, opts, &mem, crypt, st);
+        goto cleanup;
+    }
 
-    uint8_t *block_buf = malloc(ODZ_BLOCK_SIZE);
-    if (!block_buf) return ODZ_ERR_OOM;
+    /* No bigger than the input: small files with large blocks stay cheap */
+    buf_size = (uint64_t)in_size < block_size ? (size_t)in_size : block_size;
+    if (!buf_size) buf_size = 1;
+    block_buf = odz_alloc_big(&mem, buf_size);
+    if (!block_buf) { rc = ODZ_ERR_OOM; goto cleanup; }
 
-    uint64_t total_in = 0;
+    uint64_t total_in = 0, index = 0;
+    huff_trees_t prev_trees = { .valid = 0 }, trees;
+    pace_t pace;
+    pace_init(&pace, opts, io, 1, ref);
 
     int wrote_any = 0;
     for (;;) {
-        size_t nread = fread(block_buf, 1, ODZ_BLOCK_SIZE, in);
+        if (st) t = odz_now_ns();
+        uint64_t src;
+        size_t nread = read_span(io, dd, block_buf, buf_size, &src);
+        if (st) st->ns_read += odz_now_ns() - t;
+        if (nread == 0 && odz_io_error(io)) { rc = ODZ_ERR_IO; goto cleanup; }
         if (nread == 0) break;
         wrote_any = 1;
 
         int is_last = (total_in + nread >= (uint64_t)in_size);
 
-        /* Try Huffman compression */
+        if (src != ODZ_DEDUP_FRESH) {
+            if ((rc = write_ref(io, src, nread, is_last, crypt, index++, st)) != ODZ_OK) goto cleanup;
+            total_in += nread;
+            if (opts->progress && opts->progress(total_in, (uint64_t)in_size, opts->userdata) != 0) {
+                rc = ODZ_ERR_IO;
+                goto cleanup;
+            }
+            continue;
+        }
+
+        /* Try entropy coding */
         bit_writer_t bw;
-        if (bw_init(&bw, nread + 1024) != 0) { rc = ODZ_ERR_OOM; goto cleanup; }
+        if (bw_init(&bw, nread + 1024, &mem) != 0) { rc = ODZ_ERR_OOM; goto cleanup; }
 
-        int blk_err;
-        size_t comp_size = compress_block(block_buf, nread, &bw, &blk_err);
+        int blk_err, flags;
+        odz_filter_t filt = filter;
+        int rung = pace_next(&pace);
+        uint64_t tp = pace_clock(&pace);
+        size_t comp_size = compress_block(block_buf, nread, ref, &effort_ladder[rung],
+                                          opts ? opts->ctx : NULL, &filt,
+                                          &prev_trees, &trees, &flags, &bw, st, &blk_err);
         if (blk_err) { bw_free(&bw); rc = blk_err; goto cleanup; }
+        pace_done(&pace, rung, nread, comp_size, pace_clock(&pace) - tp);
+        if (st) st->level_blocks[rung]++;
 
-        /* Block header: flags(1) + raw_size(4) */
-        uint8_t blk_hdr[9];
-        if (comp_size < nread) {
-            /* Use compressed block */
-            blk_hdr[0] = (uint8_t)((is_last ? 1 : 0) | (ODZ_BLOCK_HUFFMAN << 1));
-            wr_u32le(blk_hdr + 1, (uint32_t)nread);
-            wr_u32le(blk_hdr + 5, (uint32_t)comp_size);
-            if (fwrite(blk_hdr, 1, 9, out) != 9) { bw_free(&bw); rc = ODZ_ERR_IO; goto cleanup; }
-            if (fwrite(bw.buf, 1, comp_size, out) != comp_size) { bw_free(&bw); rc = ODZ_ERR_IO; goto cleanup; }
-        } else {
-            /* Stored block (compression didn't help) */
-            blk_hdr[0] = (uint8_t)((is_last ? 1 : 0) | (ODZ_BLOCK_STORED << 1));
-            wr_u32le(blk_hdr + 1, (uint32_t)nread);
-            if (fwrite(blk_hdr, 1, 5, out) != 5) { bw_free(&bw); rc = ODZ_ERR_IO; goto cleanup; }
-            if (fwrite(block_buf, 1, nread, out) != nread) { bw_free(&bw); rc = ODZ_ERR_IO; goto cleanup; }
-        }
+        rc = write_block(io, block_buf, nread, is_last, flags, filt, &bw, comp_size,
+                         crypt, index++, st);
+        if (rc != ODZ_OK) { bw_free(&bw); goto cleanup; }
+        if (comp_size < nread && ODZ_BLOCK_TYPE(flags) == ODZ_BLOCK_HUFFMAN) prev_trees = trees;
 
         bw_free(&bw);
         total_in += nread;
@@ -231,10 +1453,21 @@ int odz_compress(FILE *in, FILE *out, const odz_options_t *opts) {
         uint8_t blk_hdr[5];
         blk_hdr[0] = 1 | (ODZ_BLOCK_STORED << 1);  /* is_last + stored */
         wr_u32le(blk_hdr + 1, 0);
-        if (fwrite(blk_hdr, 1, 5, out) != 5) { rc = ODZ_ERR_IO; goto cleanup; }
+        if ((rc = write_sealed(io, crypt, 0, blk_hdr, 5, NULL, 0, st)) != ODZ_OK) goto cleanup;
+        stats_block(st, ODZ_BLOCK_STORED, 0, 5 + (crypt ? ODZ_CRYPT_TAG : 0));
     }
 
 cleanup:
-    free(block_buf);
+    /* Pending writes land here; their errors count too */
+    if (st) t = odz_now_ns();
+    int io_rc = odz_io_close(io);
+    if (st) st->ns_write += odz_now_ns() - t;
+    if (rc == ODZ_OK) rc = io_rc;
+    if (st) st->ns_total = odz_now_ns() - t_start;
+    odz_free_big(&mem, block_buf, buf_size);
+    odz_dedup_free(dd);
+    lz_ref_free(&ref_idx);
+    odz_io_unmap(&ref_map);
+    if (crypt) odz_crypt_wipe(crypt, sizeof *crypt);
     return rc;
 }
@@ -4,7 +4,23 @@
  * For each block:
  *   1. Read block header (type, raw size, compressed size)
  *   2. For stored blocks: copy raw data
- *   3. For Huffman blocks: read trees, decode tokens, replay LZ
+ *   3. For Huffman blocks: read trees (unless reusing the previous
+ *      block's decode tables), decode tokens (from 1 or 4 interleaved
+ *      streams), replay LZ; trees that code no lengths take a
+ *      literal-only loop
+ *   4. For FSE blocks: read normalized counts, decode tokens, replay LZ
+ *   5. For BWT blocks (v5): undo the symbol coding and the transform
+ *      (odz_bwt.c)
+ *
+ * Filtered blocks (ODZ_BLOCK_FILTERED) decode to the filtered bytes, and
+ * the filter is undone before they are written.
+ *
+ * Patch streams (ODZ_STREAM_PATCH) also copy matches from the reference
+ * file, which must be the one named in the header (size + CRC-32).
+ *
+ * Dedup streams (ODZ_STREAM_DEDUP) add REF blocks, which repeat earlier
+ * output: kept in a ring of the last dedup_window bytes, or with no
+ * window read back from the output file.
  */
 
 #include <stdlib.h>
@@ -14,171 +30,618 @@
 #include "odz.h"
 #include "bitstream.h"
 #include "huffman.h"
+#include "fse.h"
 #include "lz_tables.h"
+#include "deflate.h"
+#include "odz_io.h"
+#include "odz_filter.h"
+#include "odz_bwt.h"
+
+/* Patch reference, as seen by the block decoders */
+typedef struct {
+    const uint8_t *data;
+    uint64_t       size;
+    int            pos_bits;
+} dec_ref_t;
+
+/* Replay a reference match (distance symbol DIST_REF_NEXT / DIST_REF_POS)
+ * of length bytes into dst; *next is where the block's previous one
+ * ended.  The caller has checked length against the output room.
+ * Returns ODZ_OK or ODZ_ERR_CORRUPT. */
+static int ref_match(bit_reader_t *br, int dcode, const dec_ref_t *ref,
+                     uint64_t *next, uint8_t *dst, size_t length) {
+    if (!ref || dcode > DIST_REF_POS) return ODZ_ERR_CORRUPT;
+    uint64_t pos = *next;
+    if (dcode == DIST_REF_POS) {
+        pos = 0;
+        for (int b = 0; b < ref->pos_bits; b += ODZ_REF_PIECE) {
+            int nb = ref->pos_bits - b < ODZ_REF_PIECE ? ref->pos_bits - b : ODZ_REF_PIECE;
+            pos |= (uint64_t)br_read(br, nb) << b;
+        }
+    }
+    if (pos > ref->size || length > ref->size - pos) return ODZ_ERR_CORRUPT;
+    memcpy(dst, ref->data + pos, length);
+    *next = pos + length;
+    return ODZ_OK;
+}
+
+/* Decode tokens from ns streams, token t from br[t % ns], until end of
+ * block.  Each round first looks up the next lit/len symbol of every
+ * stream, so the ns lookups form independent dependency chains, then
+ * replays the tokens in order.  Called with constant ns so each variant
+ * is specialized (and the rounds fully unrolled).  Returns ODZ_OK or ODZ_ERR_CORRUPT. */
+static inline int decode_tokens(const bit_reader_t *brs, int ns,
+                                const huff_decode_table_t *ll_tab,
+                                const huff_decode_table_t *d_tab,
+                                const dec_ref_t *ref,
+                                uint8_t *out, size_t raw_size, size_t *out_pos,
+                                uint64_t *nmatch, uint64_t *mbytes, uint64_t *nsec) {
+    /* Work on local copies: stores through out (a byte pointer) could
+     * alias the readers and would force them back to memory each time */
+    bit_reader_t br[ODZ_HUFF_STREAMS];
+    for (int i = 0; i < ns; i++) br[i] = brs[i];
+    size_t op = *out_pos;
+    uint64_t nm = 0, mb = 0, sec = 0, ref_next = 0;
+    uint32_t reps[DIST_REPS] = ODZ_REP_INIT;
+    for (;;) {
+        int syms[ODZ_HUFF_STREAMS] = {0};
+        ODZ_UNROLL(ODZ_HUFF_STREAMS)
+        for (int i = 0; i < ns; i++) syms[i] = huff_decode2(&br[i], ll_tab, &sec);
+
+        ODZ_UNROLL(ODZ_HUFF_STREAMS)
+        for (int i = 0; i < ns; i++) {
+            int sym = syms[i];
+            if (sym < 256) {
+                /* Literal */
+                if (op >= raw_size) return ODZ_ERR_CORRUPT;
+                out[op++] = (uint8_t)sym;
+            } else if (sym == LITLEN_END) {
+                /* End of block */
+                *out_pos = op;
+                *nmatch += nm;
+                *mbytes += mb;
+                *nsec += sec;
+                return ODZ_OK;
+            } else {
+                /* Length code (257-285) */
+                int code_idx = sym - 257;
+                if (code_idx < 0 || code_idx >= 29) return ODZ_ERR_CORRUPT;
+                int length = base_length[code_idx];
+                if (extra_lbits[code_idx] > 0)
+                    length += (int)br_read(&br[i], extra_lbits[code_idx]);
 
-/* Decode one symbol using two-level table */
-static inline int huff_decode2(bit_reader_t *br,
-                               const huff_decode_table_t *t) {
-    uint32_t bits = br_peek(br, HUFF_MAX_BITS);
-    huff_entry_t e = t->primary[bits & ((1 << HUFF_PRIMARY_BITS) - 1)];
-    if ((e.len & 0x8000) == 0) {
-        /* Primary hit (95%+ of cases) */
-        br_consume(br, e.len);
-        return e.sym;
-    }
-    /* Secondary lookup */
-    int total_bits = e.len & 0x7FFF;
-    int sub_idx = e.sym + (int)((bits >> HUFF_PRIMARY_BITS) &
-                  ((1u << (total_bits - HUFF_PRIMARY_BITS)) - 1));
-    huff_entry_t se = t->secondary[sub_idx];
-    br_consume(br, se.len);
-    return se.sym;
+                /* Distance code */
+                int dcode = huff_decode2(&br[i], d_tab, &sec);
+                if (dcode < 0 || dcode >= DIST_SYMS) return ODZ_ERR_CORRUPT;
+                int dist;
+                if (dcode < DIST_CODES) {
+                    dist = base_dist[dcode];
+                    if (extra_dbits[dcode] > 0)
+                        dist += (int)br_read(&br[i], extra_dbits[dcode]);
+                    odz_rep_use(reps, DIST_REPS - 1, (uint32_t)dist);
+                } else if (dcode >= DIST_REP0) {
+                    dist = (int)reps[dcode - DIST_REP0];
+                    odz_rep_use(reps, dcode - DIST_REP0, (uint32_t)dist);
+                } else {
+                    if (op + (size_t)length > raw_size ||
+                        ref_match(&br[i], dcode, ref, &ref_next, out + op, (size_t)length) != ODZ_OK)
+                        return ODZ_ERR_CORRUPT;
+                    op += (size_t)length;
+                    nm++;
+                    mb += (uint64_t)length;
+                    continue;
+                }
+
+                /* Copy match */
+                if (dist <= 0 || (size_t)dist > op) return ODZ_ERR_CORRUPT;
+                if (op + (size_t)length > raw_size) return ODZ_ERR_CORRUPT;
+                odz_copy_match(out + op, (size_t)dist, (size_t)length);
+                op += (size_t)length;
+                nm++;
+                mb += (uint64_t)length;
+            }
+        }
+    }
 }
 
-/* Returns ODZ_OK on success, ODZ_ERR_* on failure */
+/* decode_tokens for a block whose lit/len tree codes no lengths (the
+ * encoder's literal-only blocks): every symbol is a byte until end of
+ * block, so the loop carries no match path, and while all ns streams'
+ * next bytes fit in out it skips the per-byte room check.  Returns
+ * ODZ_OK or ODZ_ERR_CORRUPT. */
+static inline int decode_literals(const bit_reader_t *brs, int ns,
+                                  const huff_decode_table_t *ll_tab,
+                                  uint8_t *out, size_t raw_size, size_t *out_pos,
+                                  uint64_t *nsec) {
+    bit_reader_t br[ODZ_HUFF_STREAMS];
+    for (int i = 0; i < ns; i++) br[i] = brs[i];
+    size_t op = *out_pos;
+    uint64_t sec = 0;
+    for (;;) {
+        int syms[ODZ_HUFF_STREAMS] = {0};
+        ODZ_UNROLL(ODZ_HUFF_STREAMS)
+        for (int i = 0; i < ns; i++) syms[i] = huff_decode2(&br[i], ll_tab, &sec);
+
+        if (op + (size_t)ns <= raw_size) {
+            int all = 1;
+            ODZ_UNROLL(ODZ_HUFF_STREAMS)
+            for (int i = 0; i < ns; i++) {
+                all &= syms[i] < 256;
+                out[op + (size_t)i] = (uint8_t)syms[i];
+            }
+            if (all) {
+                op += (size_t)ns;
+                continue;
+            }
+        }
+        for (int i = 0; i < ns; i++) {
+            if (syms[i] == LITLEN_END) {
+                *out_pos = op;
+                *nsec += sec;
+                return ODZ_OK;
+            }
+            if (syms[i] > 255 || op >= raw_size) return ODZ_ERR_CORRUPT;
+            out[op++] = (uint8_t)syms[i];
+        }
+    }
+}
+
+/* Returns ODZ_OK on success, ODZ_ERR_* on failure.
+ * With reuse_trees the block carries no trees and ll_tab/d_tab are used
+ * as left by the previous Huffman block (*have_tables must be set: 1,
+ * or 2 if their lit/len tree codes no lengths, for decode_literals).
+ * With multistream the tokens follow in ODZ_HUFF_STREAMS streams.
+ * hdist_bits is the trees' HDIST width for the stream version. */
 static int decompress_huffman_block(const uint8_t *comp, size_t comp_size,
                                     uint8_t *out, size_t raw_size,
-                                    size_t *out_pos,
+                                    size_t *out_pos, int reuse_trees,
+                                    int multistream, const dec_ref_t *ref, int hdist_bits,
                                     huff_decode_table_t *ll_tab,
-                                    huff_decode_table_t *d_tab) {
+                                    huff_decode_table_t *d_tab,
+                                    int *have_tables,
+                                    odz_stats_t *st) {
+    uint64_t t0 = st ? odz_now_ns() : 0;
     bit_reader_t br;
     br_init(&br, comp, comp_size);
 
-    /* Read Huffman trees */
-    uint8_t ll_lens[LITLEN_SYMS], d_lens[DIST_SYMS];
-    int n_ll, n_dist;
-    if (huff_read_trees(&br, ll_lens, &n_ll, d_lens, &n_dist) != 0)
-        return ODZ_ERR_CORRUPT;
+    if (reuse_trees) {
+        if (!*have_tables) return ODZ_ERR_CORRUPT;
+    } else {
+        /* Read Huffman trees */
+        uint8_t ll_lens[LITLEN_SYMS], d_lens[DIST_SYMS];
+        int n_ll, n_dist;
+        *have_tables = 0;
+        if (huff_read_trees(&br, ll_lens, &n_ll, d_lens, &n_dist, hdist_bits) != 0)
+            return ODZ_ERR_CORRUPT;
 
-    /* Build two-level decode tables */
-    if (huff_build_decode_table2(ll_lens, LITLEN_SYMS, ll_tab) != 0)
-        return ODZ_ERR_OOM;
-    if (huff_build_decode_table2(d_lens, DIST_SYMS, d_tab) != 0)
-        return ODZ_ERR_OOM;
+        /* Build two-level decode tables */
+        if (huff_build_decode_table2(ll_lens, LITLEN_SYMS, ll_tab) != 0)
+            return ODZ_ERR_OOM;
+        if (huff_build_decode_table2(d_lens, DIST_SYMS, d_tab) != 0)
+            return ODZ_ERR_OOM;
+        *have_tables = 2;
+        for (int s = LITLEN_END + 1; s < LITLEN_SYMS; s++)
+            if (ll_lens[s]) *have_tables = 1;
+    }
+
+    /* Split into streams: byte-aligned, sizes of all but the last first */
+    bit_reader_t brs[ODZ_HUFF_STREAMS];
+    if (multistream) {
+        size_t off = br_bytes_used(&br), jump = off;
+        off += 4 * (ODZ_HUFF_STREAMS - 1);
+        if (off > comp_size) return ODZ_ERR_CORRUPT;
+        for (int i = 0; i < ODZ_HUFF_STREAMS; i++) {
+            size_t len = comp_size - off;
+            if (i + 1 < ODZ_HUFF_STREAMS) {
+                len = rd_u32le(comp + jump + 4 * (size_t)i);
+                if (len > comp_size - off) return ODZ_ERR_CORRUPT;
+            }
+            br_init(&brs[i], comp + off, len);
+            off += len;
+        }
+    }
+
+    uint64_t t1 = st ? odz_now_ns() : 0;
 
     /* Decode tokens */
     size_t op = *out_pos;
+    uint64_t nmatch = 0, mbytes = 0, nsec = 0;
+    int rc;
+    if (*have_tables == 2)
+        rc = multistream
+            ? decode_literals(brs, ODZ_HUFF_STREAMS, ll_tab, out, raw_size, &op, &nsec)
+            : decode_literals(&br, 1, ll_tab, out, raw_size, &op, &nsec);
+    else
+        rc = multistream
+            ? decode_tokens(brs, ODZ_HUFF_STREAMS, ll_tab, d_tab, ref, out, raw_size, &op,
+                            &nmatch, &mbytes, &nsec)
+            : decode_tokens(&br, 1, ll_tab, d_tab, ref, out, raw_size, &op,
+                            &nmatch, &mbytes, &nsec);
+    if (rc != ODZ_OK) return rc;
+    if (st) {
+        uint64_t nlit = (op - *out_pos) - mbytes;
+        st->ns_huff_build  += t1 - t0;
+        st->ns_huff_code   += odz_now_ns() - t1;
+        st->literals       += nlit;
+        st->matches        += nmatch;
+        st->match_bytes    += mbytes;
+        st->huff_lookups   += nlit + 2 * nmatch + 1;
+        st->huff_secondary += nsec;
+    }
+    *out_pos = op;
+    return ODZ_OK;
+}
+
+/* Decode an FSE block into out (see emit_tokens_fse in compress.c).
+ * ll_dt/d_dt are scratch tables.  Returns ODZ_OK or ODZ_ERR_CORRUPT. */
+static int decompress_fse_block(const uint8_t *comp, size_t comp_size,
+                                uint8_t *out, size_t raw_size, size_t *out_pos,
+                                const dec_ref_t *ref,
+                                fse_dtable_t *ll_dt, fse_dtable_t *d_dt,
+                                odz_stats_t *st) {
+    uint64_t t0 = st ? odz_now_ns() : 0;
+    bit_reader_t br;
+    br_init(&br, comp, comp_size);
+
+    int16_t norm[LITLEN_SYMS];
+    int log, has_dist = (int)br_read(&br, 1);
+    if (fse_read_counts(&br, norm, LITLEN_SYMS, &log) != 0) return ODZ_ERR_CORRUPT;
+    fse_build_dtable(norm, LITLEN_SYMS, log, ll_dt);
+    if (has_dist) {
+        if (fse_read_counts(&br, norm, DIST_SYMS, &log) != 0) return ODZ_ERR_CORRUPT;
+        fse_build_dtable(norm, DIST_SYMS, log, d_dt);
+    }
+    uint32_t ll_state = br_read(&br, ll_dt->log);
+    uint32_t d_state = has_dist ? br_read(&br, d_dt->log) : 0;
+
+    uint64_t t1 = st ? odz_now_ns() : 0;
+
+    /* Decode tokens; each state advances just before its next symbol */
+    size_t op = *out_pos;
+    uint64_t nmatch = 0, mbytes = 0, ref_next = 0;
+    uint32_t reps[DIST_REPS] = ODZ_REP_INIT;
+    int first_ll = 1, first_d = 1;
     for (;;) {
-        int sym = huff_decode2(&br, ll_tab);
+        if (!first_ll) ll_state = fse_next_state(ll_dt, &br, ll_state);
+        first_ll = 0;
+        int sym = ll_dt->table[ll_state].sym;
 
         if (sym < 256) {
-            /* Literal */
             if (op >= raw_size) return ODZ_ERR_CORRUPT;
             out[op++] = (uint8_t)sym;
         } else if (sym == LITLEN_END) {
-            /* End of block */
             break;
         } else {
-            /* Length code (257-285) */
             int code_idx = sym - 257;
-            if (code_idx < 0 || code_idx >= 29) return ODZ_ERR_CORRUPT;
+            if (code_idx >= 29 || !has_dist) return ODZ_ERR_CORRUPT;
             int length = base_length[code_idx];
             if (extra_lbits[code_idx] > 0)
                 length += (int)br_read(&br, extra_lbits[code_idx]);
 
-            /* Distance code */
-            int dcode = huff_decode2(&br, d_tab);
-            if (dcode < 0 || dcode >= 30) return ODZ_ERR_CORRUPT;
-            int dist = base_dist[dcode];
-            if (extra_dbits[dcode] > 0)
-                dist += (int)br_read(&br, extra_dbits[dcode]);
-
-            /* Copy match */
-            if (dist <= 0 || (size_t)dist > op) return ODZ_ERR_CORRUPT;
+            if (!first_d) d_state = fse_next_state(d_dt, &br, d_state);
+            first_d = 0;
+            int dcode = d_dt->table[d_state].sym;
             if (op + (size_t)length > raw_size) return ODZ_ERR_CORRUPT;
-            size_t src = op - (size_t)dist;
-            if ((size_t)dist >= (size_t)length) {
-                /* Non-overlapping: straight memcpy */
-                memcpy(out + op, out + src, (size_t)length);
-            } else if (dist == 1) {
-                /* Byte fill (very common for runs) */
-                memset(out + op, out[src], (size_t)length);
+            if (dcode >= DIST_CODES && dcode < DIST_REP0) {
+                if (ref_match(&br, dcode, ref, &ref_next, out + op, (size_t)length) != ODZ_OK)
+                    return ODZ_ERR_CORRUPT;
             } else {
-                /* Overlapping: copy in dist-sized chunks */
-                size_t rem = (size_t)length;
-                size_t d = (size_t)dist;
-                uint8_t *dst = out + op;
-                const uint8_t *s = out + src;
-                while (rem >= d) {
-                    memcpy(dst, s, d);
-                    dst += d;
-                    rem -= d;
+                int dist;
+                if (dcode < DIST_CODES) {
+                    dist = base_dist[dcode];
+                    if (extra_dbits[dcode] > 0)
+                        dist += (int)br_read(&br, extra_dbits[dcode]);
+                    odz_rep_use(reps, DIST_REPS - 1, (uint32_t)dist);
+                } else {
+                    dist = (int)reps[dcode - DIST_REP0];
+                    odz_rep_use(reps, dcode - DIST_REP0, (uint32_t)dist);
                 }
-                if (rem > 0) memcpy(dst, s, rem);
+                if (dist <= 0 || (size_t)dist > op) return ODZ_ERR_CORRUPT;
+                odz_copy_match(out + op, (size_t)dist, (size_t)length);
             }
             op += (size_t)length;
+            nmatch++;
+            mbytes += (uint64_t)length;
         }
     }
+    if (st) {
+        st->ns_huff_build += t1 - t0;
+        st->ns_huff_code  += odz_now_ns() - t1;
+        st->literals      += (op - *out_pos) - mbytes;
+        st->matches       += nmatch;
+        st->match_bytes   += mbytes;
+    }
     *out_pos = op;
     return ODZ_OK;
 }
 
 /* ── Public API ────────────────────────────────────────────── */
 
+/* Dedup window: the last size bytes of output, as a ring indexed by
+ * output offset.  buf is NULL for an unlimited window. */
+typedef struct {
+    uint8_t *buf;
+    size_t   size;
+} dec_hist_t;
+
+/* Record n bytes of output written at offset at */
+static void hist_put(dec_hist_t *h, uint64_t at, const uint8_t *p, size_t n) {
+    if (!h->buf) return;
+    if (n > h->size) {
+        p  += n - h->size;
+        at += n - h->size;
+        n   = h->size;
+    }
+    size_t i = (size_t)(at % h->size);
+    size_t k = n < h->size - i ? n : h->size - i;
+    memcpy(h->buf + i, p, k);
+    memcpy(h->buf, p + k, n - k);
+}
+
+/* Output offsets [at, at + n), which must lie within the window */
+static void hist_get(const dec_hist_t *h, uint64_t at, uint8_t *dst, size_t n) {
+    size_t i = (size_t)(at % h->size);
+    size_t k = n < h->size - i ? n : h->size - i;
+    memcpy(dst, h->buf + i, k);
+    memcpy(dst + k, h->buf, n - k);
+}
+
+/* Account one decoded block (header + payload) in the stats */
+static void stats_block(odz_stats_t *st, int type, uint64_t raw, uint64_t on_disk) {
+    if (!st) return;
+    st->block_count[type]++;
+    st->block_raw[type]  += raw;
+    st->block_comp[type] += on_disk;
+}
+
+/* Encrypted streams: read the tag after a block's payload p, already
+ * read, and authenticate and decrypt p in place under the block's index */
+static int open_block(odz_io_t *io, const odz_crypt_t *crypt, uint64_t index,
+                      const uint8_t *hdr, size_t hlen, uint8_t *p, size_t n, odz_stats_t *st) {
+    if (!crypt) return ODZ_OK;
+    uint8_t tag[ODZ_CRYPT_TAG];
+    if (odz_io_read(io, tag, sizeof tag) != sizeof tag) return ODZ_ERR_IO;
+    uint64_t t = st ? odz_now_ns() : 0;
+    int ok = odz_crypt_open(crypt, index, hdr, hlen, p, n, tag) == 0;
+    if (st) st->ns_crypt += odz_now_ns() - t;
+    return ok ? ODZ_OK : ODZ_ERR_CORRUPT;
+}
+
 int odz_decompress(FILE *in, FILE *out, const odz_options_t *opts) {
-    int rc = ODZ_OK;
+    if (opts && opts->format != ODZ_FORMAT_ODZ)
+        return odz_inflate_stream(in, out, opts->format, NULL, 0, opts);
+
+    odz_mem_t mem;
+    int rc = odz_mem_from(&mem, opts);
+    if (rc != ODZ_OK) return rc;
     uint8_t *block_out = NULL;
+    uint8_t *filter_tmp = NULL;     /* second block buffer, for unshuffling */
+    uint32_t *bwt_tt = NULL;        /* inverse transform vector, on first BWT block */
+    size_t bwt_cap = 0;
     uint8_t *comp = NULL;
+    uint32_t comp_size = 0;
+    odz_stats_t *st = opts ? opts->stats : NULL;
+    uint64_t t_start = 0, t = 0;
+    if (st) { memset(st, 0, sizeof *st); t_start = odz_now_ns(); }
 
-    /* Read file header */
-    uint8_t hdr[12];
-    if (fread(hdr, 1, 12, in) != 12) return ODZ_ERR_IO;
+    /* Read file header; gzip and zlib streams are recognised by magic */
+    uint8_t hdr[ODZ_HEADER_SIZE_MAX];
+    if (fread(hdr, 1, 2, in) != 2) return ODZ_ERR_IO;
+    int format = odz_sniff_format(hdr);
+    if (format >= 0) return odz_inflate_stream(in, out, format, hdr, 2, opts);
+    if (fread(hdr + 2, 1, ODZ_HEADER_SIZE_V3 - 2, in) != ODZ_HEADER_SIZE_V3 - 2) return ODZ_ERR_IO;
     if (hdr[0] != 'O' || hdr[1] != 'D' || hdr[2] != 'Z') return ODZ_ERR_FORMAT;
-    if (hdr[3] != ODZ_VERSION) return ODZ_ERR_FORMAT;
+    if (hdr[3] < ODZ_VERSION_MIN || hdr[3] > ODZ_VERSION) return ODZ_ERR_FORMAT;
+    int version = hdr[3];
 
     uint64_t original_size = rd_u64le(hdr + 4);
+    uint32_t block_size = ODZ_BLOCK_SIZE;
+    if (version >= 4) {
+        size_t n = ODZ_HEADER_SIZE - ODZ_HEADER_SIZE_V3;
+        if (fread(hdr + ODZ_HEADER_SIZE_V3, 1, n, in) != n) return ODZ_ERR_IO;
+        block_size = rd_u32le(hdr + 12);
+        if (block_size < ODZ_BLOCK_SIZE_MIN || block_size > ODZ_BLOCK_SIZE_MAX) return ODZ_ERR_FORMAT;
+        if (hdr[16] & ~ODZ_STREAM_FLAGS_KNOWN) return ODZ_ERR_FORMAT;
+    }
+    /* A valid stream has no block larger than the whole output */
+    size_t block_cap = original_size < block_size ? (size_t)original_size : block_size;
+    size_t out_cap = block_cap ? block_cap : 1;
     uint64_t total_out = 0;
 
-    block_out = malloc(ODZ_BLOCK_SIZE);
-    if (!block_out) return ODZ_ERR_OOM;
+    /* Patch stream: the reference must be the exact file it was made from */
+    odz_map_t ref_map = {0};
+    dec_ref_t ref_buf, *ref = NULL;
+    if (version >= 4 && (hdr[16] & ODZ_STREAM_PATCH)) {
+        if (fread(hdr + ODZ_HEADER_SIZE, 1, 12, in) != 12) return ODZ_ERR_IO;
+        uint64_t ref_size = rd_u64le(hdr + 17);
+        uint32_t ref_crc  = rd_u32le(hdr + 25);
+        if (!opts || !opts->patch_from) return ODZ_ERR_REF;
+        rc = odz_io_map(&ref_map, opts->patch_from);
+        if (rc != ODZ_OK) return rc;
+        if (ref_map.size != ref_size || odz_crc32(0, ref_map.data, (size_t)ref_map.size) != ref_crc) {
+            odz_io_unmap(&ref_map);
+            return ODZ_ERR_REF;
+        }
+        ref_buf.data = ref_map.data;
+        ref_buf.size = ref_map.size;
+        ref_buf.pos_bits = odz_ref_bits(ref_size);
+        ref = &ref_buf;
+    }
+
+    /* Dedup stream: REF blocks reach back at most dedup_window bytes */
+    int dedup = version >= 4 && (hdr[16] & ODZ_STREAM_DEDUP);
+    uint64_t dedup_window = 0;
+    size_t hdr_len = ODZ_HEADER_SIZE + (ref ? 12 : 0);
+    if (dedup) {
+        if (fread(hdr + hdr_len, 1, 8, in) != 8) { odz_io_unmap(&ref_map); return ODZ_ERR_IO; }
+        dedup_window = rd_u64le(hdr + hdr_len);
+        hdr_len += 8;
+    }
+
+    /* Encrypted stream: the key must open the header's check tag */
+    odz_crypt_t crypt_key, *crypt = NULL;
+    if (version >= 4 && (hdr[16] & ODZ_STREAM_ENCRYPTED)) {
+        if (fread(hdr + hdr_len, 1, ODZ_CRYPT_FIELDS, in) != ODZ_CRYPT_FIELDS) {
+            odz_io_unmap(&ref_map);
+            return ODZ_ERR_IO;
+        }
+        hdr_len += ODZ_CRYPT_FIELDS;
+        if (st) t = odz_now_ns();
+        rc = odz_crypt_read(&crypt_key, opts, hdr, hdr_len);
+        if (st) st->ns_kdf += odz_now_ns() - t;
+        if (rc != ODZ_OK) { odz_io_unmap(&ref_map); return rc; }
+        crypt = &crypt_key;
+    }
+    dec_hist_t hist = { NULL, 0 };
+
+    odz_io_t *io;
+    rc = odz_io_open(&io, in, out, opts ? opts->io : ODZ_IO_STDIO, opts && opts->io_direct);
+    if (rc != ODZ_OK) {
+        odz_io_unmap(&ref_map);
+        if (crypt) odz_crypt_wipe(crypt, sizeof *crypt);
+        return rc;
+    }
 
     /* Allocate decode tables once, reuse across blocks */
-    huff_decode_table_t ll_tab = {.secondary = NULL, .secondary_size = 0, .secondary_cap = 0};
-    huff_decode_table_t d_tab  = {.secondary = NULL, .secondary_size = 0, .secondary_cap = 0};
+    huff_decode_table_t ll_tab = {.secondary = NULL, .secondary_size = 0, .secondary_cap = 0, .mem = &mem};
+    huff_decode_table_t d_tab  = {.secondary = NULL, .secondary_size = 0, .secondary_cap = 0, .mem = &mem};
+    int have_tables = 0;
+    fse_dtable_t *fse_tabs = NULL;   /* lit/len + distance, on first FSE block */
 
-    for (;;) {
-        /* Read block header */
-        uint8_t blk_hdr[9];
-        if (fread(blk_hdr, 1, 1, in) != 1) { rc = ODZ_ERR_IO; goto cleanup; }
+    block_out = odz_alloc_big(&mem, out_cap);
+    if (!block_out) { rc = ODZ_ERR_OOM; goto cleanup; }
+    if (dedup_window && original_size) {
+        uint64_t size = dedup_window < original_size ? dedup_window : original_size;
+        if (size > SIZE_MAX || !(hist.buf = odz_alloc_big(&mem, (size_t)size))) { rc = ODZ_ERR_OOM; goto cleanup; }
+        hist.size = (size_t)size;
+    }
 
-        int is_last  = blk_hdr[0] & 1;
-        int blk_type = (blk_hdr[0] >> 1) & 3;
+    size_t tag = crypt ? ODZ_CRYPT_TAG : 0;
+    for (uint64_t index = 0;; index++) {
+        /* Read block header; with a filter it runs to 11 bytes */
+        uint8_t blk_hdr[ODZ_REF_BLOCK_HEADER];
+        if (odz_io_read(io, blk_hdr, 1) != 1) { rc = ODZ_ERR_IO; goto cleanup; }
+
+        int is_last  = blk_hdr[0] & ODZ_BLOCK_LAST;
+        int blk_type = ODZ_BLOCK_TYPE(blk_hdr[0]);
+        int reuse    = 0;
+        int multi    = 0;
+        int filtered = 0;
+        if (version >= 3) {
+            if (blk_hdr[0] & ~ODZ_BLOCK_FLAGS_KNOWN) { rc = ODZ_ERR_FORMAT; goto cleanup; }
+            reuse = (blk_hdr[0] & ODZ_BLOCK_REUSE_TREES) != 0;
+            multi = (blk_hdr[0] & ODZ_BLOCK_MULTISTREAM) != 0;
+            filtered = (blk_hdr[0] & ODZ_BLOCK_FILTERED) != 0;
+            if ((reuse || multi) && blk_type != ODZ_BLOCK_HUFFMAN) { rc = ODZ_ERR_CORRUPT; goto cleanup; }
+            if (filtered && (version < 4 || blk_type == ODZ_BLOCK_STORED || blk_type == ODZ_BLOCK_REF)) {
+                rc = ODZ_ERR_CORRUPT;
+                goto cleanup;
+            }
+        }
 
         if (blk_type == ODZ_BLOCK_STORED) {
             /* Read raw_size */
-            if (fread(blk_hdr + 1, 1, 4, in) != 4) { rc = ODZ_ERR_IO; goto cleanup; }
+            if (odz_io_read(io, blk_hdr + 1, 4) != 4) { rc = ODZ_ERR_IO; goto cleanup; }
             uint32_t raw_size = rd_u32le(blk_hdr + 1);
-            if (raw_size > ODZ_BLOCK_SIZE) { rc = ODZ_ERR_CORRUPT; goto cleanup; }
+            if (raw_size > block_cap) { rc = ODZ_ERR_CORRUPT; goto cleanup; }
 
             /* Read and write raw data */
-            if (fread(block_out, 1, raw_size, in) != raw_size) { rc = ODZ_ERR_IO; goto cleanup; }
-            if (fwrite(block_out, 1, raw_size, out) != raw_size) { rc = ODZ_ERR_IO; goto cleanup; }
+            if (st) t = odz_now_ns();
+            if (odz_io_read(io, block_out, raw_size) != raw_size) { rc = ODZ_ERR_IO; goto cleanup; }
+            if (st) st->ns_read += odz_now_ns() - t;
+            if ((rc = open_block(io, crypt, index, blk_hdr, 5, block_out, raw_size, st)) != ODZ_OK)
+                goto cleanup;
+            if (st) t = odz_now_ns();
+            if (odz_io_write(io, block_out, raw_size) != raw_size) { rc = ODZ_ERR_IO; goto cleanup; }
+            if (st) st->ns_write += odz_now_ns() - t;
+            hist_put(&hist, total_out, block_out, raw_size);
             total_out += raw_size;
+            stats_block(st, ODZ_BLOCK_STORED, raw_size, 5 + (uint64_t)raw_size + tag);
 
-        } else if (blk_type == ODZ_BLOCK_HUFFMAN) {
+        } else if (blk_type == ODZ_BLOCK_HUFFMAN || (blk_type == ODZ_BLOCK_FSE && version >= 3) ||
+                   (blk_type == ODZ_BLOCK_BWT && version >= 5)) {
             /* Read raw_size + compressed_size */
-            if (fread(blk_hdr + 1, 1, 8, in) != 8) { rc = ODZ_ERR_IO; goto cleanup; }
+            if (odz_io_read(io, blk_hdr + 1, 8) != 8) { rc = ODZ_ERR_IO; goto cleanup; }
             uint32_t raw_size  = rd_u32le(blk_hdr + 1);
-            uint32_t comp_size = rd_u32le(blk_hdr + 5);
-            if (raw_size > ODZ_BLOCK_SIZE) { rc = ODZ_ERR_CORRUPT; goto cleanup; }
+            comp_size = rd_u32le(blk_hdr + 5);
+            if (raw_size > block_cap) { rc = ODZ_ERR_CORRUPT; goto cleanup; }
+            odz_filter_t filt = { ODZ_FILTER_NONE, 0 };
+            if (filtered) {
+                if (odz_io_read(io, blk_hdr + 9, 2) != 2) { rc = ODZ_ERR_IO; goto cleanup; }
+                filt.id = blk_hdr[9];
+                filt.width = blk_hdr[10];
+                if (!odz_filter_valid(filt)) { rc = ODZ_ERR_CORRUPT; goto cleanup; }
+                if (filt.id == ODZ_FILTER_SHUFFLE && !filter_tmp &&
+                    !(filter_tmp = odz_alloc_big(&mem, out_cap))) { rc = ODZ_ERR_OOM; goto cleanup; }
+            }
 
             /* Read compressed data */
-            comp = malloc(comp_size);
+            comp = odz_alloc(&mem, comp_size);
             if (!comp) { rc = ODZ_ERR_OOM; goto cleanup; }
-            if (fread(comp, 1, comp_size, in) != comp_size) { rc = ODZ_ERR_IO; goto cleanup; }
+            if (st) t = odz_now_ns();
+            if (odz_io_read(io, comp, comp_size) != comp_size) { rc = ODZ_ERR_IO; goto cleanup; }
+            if (st) st->ns_read += odz_now_ns() - t;
+            rc = open_block(io, crypt, index, blk_hdr, filtered ? 11 : 9, comp, comp_size, st);
+            if (rc != ODZ_OK) goto cleanup;
 
             /* Decompress */
             size_t out_pos = 0;
-            rc = decompress_huffman_block(comp, comp_size,
-                                          block_out, raw_size, &out_pos,
-                                          &ll_tab, &d_tab);
-            if (rc != ODZ_OK) { free(comp); comp = NULL; goto cleanup; }
-            if (out_pos != raw_size) { free(comp); comp = NULL; rc = ODZ_ERR_CORRUPT; goto cleanup; }
+            if (blk_type == ODZ_BLOCK_BWT) {
+                if (!bwt_tt) {
+                    bwt_cap = ((out_cap < ODZ_BWT_MAX ? out_cap : ODZ_BWT_MAX) + 1) * sizeof *bwt_tt;
+                    if (!(bwt_tt = odz_alloc_big(&mem, bwt_cap))) rc = ODZ_ERR_OOM;
+                }
+                if (bwt_tt) {
+                    uint64_t t0 = st ? odz_now_ns() : 0;
+                    rc = odz_bwt_decode(comp, comp_size, block_out, raw_size, bwt_tt, &mem);
+                    out_pos = raw_size;
+                    if (st) st->ns_huff_code += odz_now_ns() - t0;
+                }
+            } else if (blk_type == ODZ_BLOCK_FSE) {
+                if (!fse_tabs && !(fse_tabs = odz_alloc(&mem, 2 * sizeof *fse_tabs))) rc = ODZ_ERR_OOM;
+                else rc = decompress_fse_block(comp, comp_size, block_out, raw_size, &out_pos, ref,
+                                               &fse_tabs[0], &fse_tabs[1], st);
+            } else {
+                rc = decompress_huffman_block(comp, comp_size,
+                                              block_out, raw_size, &out_pos, reuse, multi, ref,
+                                              version >= 5 ? HUFF_HDIST_BITS_V5 : HUFF_HDIST_BITS,
+                                              &ll_tab, &d_tab, &have_tables, st);
+            }
+            if (rc != ODZ_OK) { odz_free(&mem, comp, comp_size); comp = NULL; goto cleanup; }
+            if (out_pos != raw_size) { odz_free(&mem, comp, comp_size); comp = NULL; rc = ODZ_ERR_CORRUPT; goto cleanup; }
+            const uint8_t *data = filtered ? odz_filter_decode(filt, block_out, filter_tmp, raw_size)
+                                           : block_out;
 
-            if (fwrite(block_out, 1, raw_size, out) != raw_size) { free(comp); comp = NULL; rc = ODZ_ERR_IO; goto cleanup; }
+            if (st) t = odz_now_ns();
+            if (odz_io_write(io, data, raw_size) != raw_size) { odz_free(&mem, comp, comp_size); comp = NULL; rc = ODZ_ERR_IO; goto cleanup; }
+            if (st) st->ns_write += odz_now_ns() - t;
+            hist_put(&hist, total_out, data, raw_size);
             total_out += raw_size;
-            free(comp);
+            stats_block(st, blk_type, raw_size, (filtered ? 11 : 9) + (uint64_t)comp_size + tag);
+            if (st && reuse) st->huff_trees_reused++;
+            if (st && filtered) st->filtered_blocks++;
+            odz_free(&mem, comp, comp_size);
             comp = NULL;
+        } else if (blk_type == ODZ_BLOCK_REF && dedup) {
+            /* Read raw_size + source offset; the source must be written already */
+            size_t n = ODZ_REF_BLOCK_HEADER - 1;
+            if (odz_io_read(io, blk_hdr + 1, n) != n) { rc = ODZ_ERR_IO; goto cleanup; }
+            rc = open_block(io, crypt, index, blk_hdr, ODZ_REF_BLOCK_HEADER, NULL, 0, st);
+            if (rc != ODZ_OK) goto cleanup;
+            uint32_t raw_size = rd_u32le(blk_hdr + 1);
+            uint64_t src      = rd_u64le(blk_hdr + 5);
+            if (raw_size > block_cap || src > total_out || raw_size > total_out - src ||
+                (dedup_window && total_out - src > dedup_window)) { rc = ODZ_ERR_CORRUPT; goto cleanup; }
+
+            if (st) t = odz_now_ns();
+            if (hist.buf) hist_get(&hist, src, block_out, raw_size);
+            else if ((rc = odz_io_read_back(io, src, block_out, raw_size)) != ODZ_OK) goto cleanup;
+            if (st) { st->ns_read += odz_now_ns() - t; t = odz_now_ns(); }
+            if (odz_io_write(io, block_out, raw_size) != raw_size) { rc = ODZ_ERR_IO; goto cleanup; }
+            if (st) st->ns_write += odz_now_ns() - t;
+            hist_put(&hist, total_out, block_out, raw_size);
+            total_out += raw_size;
+            stats_block(st, ODZ_BLOCK_REF, raw_size, ODZ_REF_BLOCK_HEADER + tag);
         } else {
             rc = ODZ_ERR_FORMAT;
             goto cleanup;
@@ -198,9 +661,20 @@ int odz_decompress(FILE *in, FILE *out, const odz_options_t *opts) {
     if (total_out != original_size) { rc = ODZ_ERR_CORRUPT; goto cleanup; }
 
 cleanup:
+    if (st) t = odz_now_ns();
+    int io_rc = odz_io_close(io);
+    if (st) st->ns_write += odz_now_ns() - t;
+    if (rc == ODZ_OK) rc = io_rc;
+    if (st) st->ns_total = odz_now_ns() - t_start;
     huff_free_decode_table2(&ll_tab);
     huff_free_decode_table2(&d_tab);
-    free(block_out);
-    free(comp);
+    odz_free(&mem, fse_tabs, 2 * sizeof *fse_tabs);
+    odz_free_big(&mem, block_out, out_cap);
+    odz_free_big(&mem, filter_tmp, out_cap);
+    odz_free_big(&mem, bwt_tt, bwt_cap);
+    odz_free_big(&mem, hist.buf, hist.size);
+    odz_free(&mem, comp, comp_size);
+    odz_io_unmap(&ref_map);
+    if (crypt) odz_crypt_wipe(crypt, sizeof *crypt);
     return rc;
 }
@@ -0,0 +1,565 @@
+/*
+ * gzip / zlib / raw DEFLATE streams.
+ *
+ * Compression reuses the odz block pipeline: each input block is coded by
+ * odz_deflate_block as one dynamic-Huffman DEFLATE block (or stored blocks
+ * when smaller), packed back-to-back into a single bitstream and wrapped
+ * in the gzip or zlib container.
+ *
+ * Decompression is a streaming inflate: the input is read through a
+ * refillable bit reader, output goes through a buffer that keeps the last
+ * 32 KB as history for back-references across DEFLATE blocks, and
+ * dynamic / fixed blocks are decoded with the odz two-level tables.
+ */
+
+#ifndef _WIN32
+#define _POSIX_C_SOURCE 200809L  /* fseeko / ftello under -std=c17 */
+#endif
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef _MSC_VER
+#define fseeko _fseeki64
+#define ftello _ftelli64
+#endif
+
+#include "libodzip.h"
+#include "odz.h"
+#include "bitstream.h"
+#include "huffman.h"
+#include "lz_tables.h"
+#include "deflate.h"
+#include "odz_io.h"
+
+#define GZIP_ID1    0x1f
+#define GZIP_ID2    0x8b
+#define GZIP_CM     8       /* deflate */
+#define GZIP_OS     255     /* unknown */
+#define ZLIB_CMF    0x78    /* deflate, 32 KB window */
+#define ZLIB_FLG    0x9c    /* default level, no dictionary; CMF*256+FLG ≡ 0 mod 31 */
+#define ZLIB_FLG_FASTEST 0x01
+#define ZLIB_FLG_FAST    0x5e
+#define ZLIB_FLG_MAX     0xda
+#define GZIP_XFL_MAX     2
+#define GZIP_XFL_FASTEST 4
+
+/* gzip FLG bits */
+#define GZ_FHCRC    0x02
+#define GZ_FEXTRA   0x04
+#define GZ_FNAME    0x08
+#define GZ_FCOMMENT 0x10
+#define GZ_FRESERVED 0xE0
+
+static int is_zlib_header(uint8_t cmf, uint8_t flg) {
+    return (cmf & 0x0F) == 8 && (cmf >> 4) <= 7 && (((unsigned)cmf << 8) | flg) % 31 == 0;
+}
+
+int odz_sniff_format(const uint8_t hdr[2]) {
+    if (hdr[0] == GZIP_ID1 && hdr[1] == GZIP_ID2) return ODZ_FORMAT_GZIP;
+    if (is_zlib_header(hdr[0], hdr[1])) return ODZ_FORMAT_ZLIB;
+    return -1;
+}
+
+/* ── Compression ───────────────────────────────────────────── */
+
+int odz_deflate_stream(FILE *in, FILE *out, const odz_options_t *opts) {
+    int format = opts->format;
+    if (format != ODZ_FORMAT_GZIP && format != ODZ_FORMAT_ZLIB && format != ODZ_FORMAT_DEFLATE)
+        return ODZ_ERR_FORMAT;
+
+    odz_mem_t mem;
+    int rc = odz_mem_from(&mem, opts);
+    if (rc != ODZ_OK) return rc;
+    odz_stats_t *st = opts->stats;
+    uint64_t t_start = 0, t = 0;
+    if (st) { memset(st, 0, sizeof *st); t_start = odz_now_ns(); }
+
+    /* Get input size */
+    if (fseeko(in, 0, SEEK_END) != 0) return ODZ_ERR_IO;
+    int64_t in_size = ftello(in);
+    if (in_size < 0) return ODZ_ERR_IO;
+    if (fseeko(in, 0, SEEK_SET) != 0) return ODZ_ERR_IO;
+
+    odz_io_t *io;
+    rc = odz_io_open(&io, in, out, opts->io, opts->io_direct);
+    if (rc != ODZ_OK) return rc;
+
+    /* No bigger than the input: small payloads stay cheap */
+    size_t buf_size = (uint64_t)in_size < ODZ_BLOCK_SIZE ? (size_t)in_size : ODZ_BLOCK_SIZE;
+    size_t buf_cap = buf_size ? buf_size : 1;
+    uint8_t *block_buf = odz_alloc_big(&mem, buf_cap);
+    bit_writer_t bw = { .buf = NULL };
+    if (!block_buf || bw_init(&bw, buf_size + 1024, &mem) != 0) { rc = ODZ_ERR_OOM; goto cleanup; }
+
+    /* Container header; both carry an advisory level hint */
+    int level = opts->level ? opts->level : ODZ_LEVEL_DEFAULT;
+    if (format == ODZ_FORMAT_GZIP) {
+        uint8_t gz[10] = { GZIP_ID1, GZIP_ID2, GZIP_CM, 0, 0, 0, 0, 0, 0, GZIP_OS };
+        gz[8] = level == ODZ_LEVEL_MAX ? GZIP_XFL_MAX : level == ODZ_LEVEL_MIN ? GZIP_XFL_FASTEST : 0;
+        if (odz_io_write(io, gz, 10) != 10) { rc = ODZ_ERR_IO; goto cleanup; }
+    } else if (format == ODZ_FORMAT_ZLIB) {
+        uint8_t zl[2] = { ZLIB_CMF, level == ODZ_LEVEL_MIN ? ZLIB_FLG_FASTEST :
+                                    level < ODZ_LEVEL_DEFAULT ? ZLIB_FLG_FAST :
+                                    level > ODZ_LEVEL_DEFAULT ? ZLIB_FLG_MAX : ZLIB_FLG };
+        if (odz_io_write(io, zl, 2) != 2) { rc = ODZ_ERR_IO; goto cleanup; }
+    }
+
+    uint32_t crc = 0, adler = 1;
+    uint64_t total_in = 0;
+    int wrote_final = 0;
+
+    while (!wrote_final) {
+        if (st) t = odz_now_ns();
+        size_t nread = odz_io_read(io, block_buf, buf_size);
+        if (st) st->ns_read += odz_now_ns() - t;
+        if (nread == 0 && odz_io_error(io)) { rc = ODZ_ERR_IO; goto cleanup; }
+
+        /* A short read at EOF (or a shrunken file) still ends the stream */
+        int final = nread == 0 || total_in + nread >= (uint64_t)in_size;
+        rc = odz_deflate_block(block_buf, nread, final, opts->level, opts->ctx, &bw, st);
+        if (rc != ODZ_OK) goto cleanup;
+        wrote_final = final;
+
+        if (format == ODZ_FORMAT_GZIP)  crc   = odz_crc32(crc, block_buf, nread);
+        if (format == ODZ_FORMAT_ZLIB)  adler = odz_adler32(adler, block_buf, nread);
+        total_in += nread;
+
+        /* Hand off whole bytes; the partial byte stays in the accumulator */
+        if (final && bw_flush(&bw) != 0) { rc = ODZ_ERR_OOM; goto cleanup; }
+        if (st) t = odz_now_ns();
+        if (odz_io_write(io, bw.buf, bw.pos) != bw.pos) { rc = ODZ_ERR_IO; goto cleanup; }
+        if (st) st->ns_write += odz_now_ns() - t;
+        bw.pos = 0;
+
+        /* Progress callback */
+        if (opts->progress && opts->progress(total_in, (uint64_t)in_size, opts->userdata) != 0) {
+            rc = ODZ_ERR_IO;
+            goto cleanup;
+        }
+    }
+
+    /* Container trailer */
+    uint8_t trailer[8];
+    if (format == ODZ_FORMAT_GZIP) {
+        wr_u32le(trailer, crc);
+        wr_u32le(trailer + 4, (uint32_t)total_in);  /* ISIZE: size mod 2^32 */
+        if (odz_io_write(io, trailer, 8) != 8) rc = ODZ_ERR_IO;
+    } else if (format == ODZ_FORMAT_ZLIB) {
+        trailer[0] = (uint8_t)(adler >> 24); trailer[1] = (uint8_t)(adler >> 16);
+        trailer[2] = (uint8_t)(adler >> 8);  trailer[3] = (uint8_t)adler;
+        if (odz_io_write(io, trailer, 4) != 4) rc = ODZ_ERR_IO;
+    }
+
+cleanup:
+    if (st) t = odz_now_ns();
+    int io_rc = odz_io_close(io);
+    if (st) st->ns_write += odz_now_ns() - t;
+    if (rc == ODZ_OK) rc = io_rc;
+    if (st) st->ns_total = odz_now_ns() - t_start;
+    bw_free(&bw);
+    odz_free_big(&mem, block_buf, buf_cap);
+    return rc;
+}
+
+/* ── Decompression: input side ─────────────────────────────── */
+
+#define IN_CAP        (256u * 1024)
+#define IN_LOOKAHEAD  1024    /* > largest tree header, so trees decode without refill */
+#define IN_PAD        32      /* zero bytes appended at EOF so the bit reader can over-read */
+
+typedef struct {
+    odz_io_t    *io;
+    uint8_t     *buf;
+    size_t       real_len;    /* bytes of actual input in buf (excludes padding) */
+    uint64_t     base;        /* stream offset of buf[0] */
+    int          eof, padded;
+    bit_reader_t br;
+    odz_stats_t *st;
+} inflate_in_t;
+
+/* Keep at least IN_LOOKAHEAD unread bytes buffered; at EOF, append zero
+ * padding once.  Returns ODZ_OK, ODZ_ERR_IO, or ODZ_ERR_CORRUPT if the
+ * decoder has run into the padding (truncated stream). */
+static int in_refill(inflate_in_t *z) {
+    bit_reader_t *r = &z->br;
+    if (z->padded) {
+        return (r->len - r->pos < IN_PAD / 2) ? ODZ_ERR_CORRUPT : ODZ_OK;
+    }
+    if (r->len - r->pos >= IN_LOOKAHEAD) return ODZ_OK;
+
+    size_t keep = r->len - r->pos;
+    memmove(z->buf, z->buf + r->pos, keep);
+    z->base += r->pos;
+    uint64_t t = z->st ? odz_now_ns() : 0;
+    size_t got = z->eof ? 0 : odz_io_read(z->io, z->buf + keep, IN_CAP - keep);
+    if (z->st) z->st->ns_read += odz_now_ns() - t;
+    if (got == 0) {
+        if (odz_io_error(z->io)) return ODZ_ERR_IO;
+        z->eof = 1;
+    }
+    z->real_len = keep + got;
+    r->buf = z->buf;
+    r->len = z->real_len;
+    r->pos = 0;
+    if (z->eof && r->len - r->pos < IN_LOOKAHEAD) {
+        memset(z->buf + r->len, 0, IN_PAD);
+        r->len += IN_PAD;
+        z->padded = 1;
+    }
+    return ODZ_OK;
+}
+
+/* Stream offset of the next unconsumed bit, in bits */
+static uint64_t in_bitpos(const inflate_in_t *z) {
+    return (z->base + z->br.pos) * 8 - (uint64_t)z->br.nbits;
+}
+
+/* Nonzero if the decoder consumed bits past the real end of input */
+static int in_overrun(const inflate_in_t *z) {
+    return z->padded && in_bitpos(z) > (z->base + z->real_len) * 8;
+}
+
+/* Discard bits up to the next byte boundary */
+static void in_align(inflate_in_t *z) {
+    br_consume(&z->br, z->br.nbits & 7);
+}
+
+/* Read one byte at a byte boundary; -1 at end of input */
+static int in_byte(inflate_in_t *z) {
+    if (in_refill(z) != ODZ_OK) return -1;
+    if (z->padded && in_bitpos(z) + 8 > (z->base + z->real_len) * 8) return -1;
+    return (int)br_read(&z->br, 8);
+}
+
+/* Unread bytes of real input left (for detecting trailing data) */
+static uint64_t in_remaining(const inflate_in_t *z) {
+    uint64_t end = (z->base + z->real_len) * 8, pos = in_bitpos(z);
+    return (end > pos && (z->eof || z->padded)) ? (end - pos) / 8 : (z->eof ? 0 : 1);
+}
+
+/* ── Decompression: output window ──────────────────────────── */
+
+#define OUT_WINDOW  ODZ_WINDOW
+#define OUT_CHUNK   ODZ_BLOCK_SIZE
+#define OUT_CAP     (OUT_WINDOW + OUT_CHUNK + ODZ_MAX_MATCH)
+
+typedef struct {
+    odz_io_t *io;
+    uint8_t  *buf;
+    size_t    op;         /* next write position */
+    size_t    flushed;    /* buf[0..flushed) already written */
+    int       format;
+    uint32_t  check;      /* running CRC-32 (gzip) or Adler-32 (zlib) */
+    uint64_t  total;      /* bytes produced in the current member */
+    odz_stats_t *st;
+} inflate_out_t;
+
+static int out_flush(inflate_out_t *o) {
+    size_t n = o->op - o->flushed;
+    if (n == 0) return ODZ_OK;
+    const uint8_t *p = o->buf + o->flushed;
+    if (o->format == ODZ_FORMAT_GZIP) o->check = odz_crc32(o->check, p, n);
+    if (o->format == ODZ_FORMAT_ZLIB) o->check = odz_adler32(o->check, p, n);
+    uint64_t t = o->st ? odz_now_ns() : 0;
+    if (odz_io_write(o->io, p, n) != n) return ODZ_ERR_IO;
+    if (o->st) o->st->ns_write += odz_now_ns() - t;
+    o->total += n;
+    o->flushed = o->op;
+    return ODZ_OK;
+}
+
+/* Bytes decoded so far in the current member */
+static uint64_t out_produced(const inflate_out_t *o) {
+    return o->total + (o->op - o->flushed);
+}
+
+/* Flush and keep only the last 32 KB as history */
+static int out_slide(inflate_out_t *o) {
+    int rc = out_flush(o);
+    if (rc != ODZ_OK) return rc;
+    if (o->op > OUT_WINDOW) {
+        memmove(o->buf, o->buf + o->op - OUT_WINDOW, OUT_WINDOW);
+        o->op = o->flushed = OUT_WINDOW;
+    }
+    return ODZ_OK;
+}
+
+/* ── Decompression: blocks ─────────────────────────────────── */
+
+static int inflate_stored(inflate_in_t *z, inflate_out_t *o) {
+    in_align(z);
+    int b0 = in_byte(z), b1 = in_byte(z), b2 = in_byte(z), b3 = in_byte(z);
+    if (b0 < 0 || b1 < 0 || b2 < 0 || b3 < 0) return ODZ_ERR_CORRUPT;
+    size_t len = (size_t)(b0 | (b1 << 8));
+    if ((len ^ 0xFFFF) != (size_t)(b2 | (b3 << 8))) return ODZ_ERR_CORRUPT;
+
+    /* Drain bytes still held in the bit accumulator, then copy directly */
+    while (len > 0 && z->br.nbits >= 8) {
+        if (o->op >= OUT_CAP && out_slide(o) != ODZ_OK) return ODZ_ERR_IO;
+        o->buf[o->op++] = (uint8_t)br_read(&z->br, 8);
+        len--;
+    }
+    while (len > 0) {
+        int rc = in_refill(z);
+        if (rc == ODZ_ERR_IO) return rc;
+        size_t avail = z->real_len > z->br.pos ? z->real_len - z->br.pos : 0;
+        if (avail == 0) return ODZ_ERR_CORRUPT;
+        if (o->op >= OUT_CAP && out_slide(o) != ODZ_OK) return ODZ_ERR_IO;
+        size_t n = len;
+        if (n > avail) n = avail;
+        if (n > OUT_CAP - o->op) n = OUT_CAP - o->op;
+        memcpy(o->buf + o->op, z->br.buf + z->br.pos, n);
+        z->br.pos += n;
+        o->op += n;
+        len -= n;
+    }
+    return ODZ_OK;
+}
+
+static int inflate_huffman(inflate_in_t *z, inflate_out_t *o,
+                           const huff_decode_table_t *ll_tab,
+                           const huff_decode_table_t *d_tab) {
+    bit_reader_t *br = &z->br;
+    uint8_t *out = o->buf;
+    size_t op = o->op;
+    uint64_t nmatch = 0, mbytes = 0, nsec = 0, start = op, slid = 0;
+    int rc = ODZ_OK;
+
+    for (;;) {
+        if (br->len - br->pos < 64 && (rc = in_refill(z)) != ODZ_OK) break;
+        if (op > OUT_WINDOW + OUT_CHUNK) {
+            o->op = op;
+            if ((rc = out_slide(o)) != ODZ_OK) break;
+            slid += op - o->op;
+            op = o->op;
+        }
+
+        int sym = huff_decode2(br, ll_tab, &nsec);
+        if (sym < 256) {
+            out[op++] = (uint8_t)sym;
+        } else if (sym == LITLEN_END) {
+            break;
+        } else {
+            int code_idx = sym - 257;
+            if (code_idx < 0 || code_idx >= 29) { rc = ODZ_ERR_CORRUPT; break; }
+            int length = base_length[code_idx];
+            if (extra_lbits[code_idx] > 0)
+                length += (int)br_read(br, extra_lbits[code_idx]);
+
+            int dcode = huff_decode2(br, d_tab, &nsec);
+            if (dcode < 0 || dcode >= 30) { rc = ODZ_ERR_CORRUPT; break; }
+            int dist = base_dist[dcode];
+            if (extra_dbits[dcode] > 0)
+                dist += (int)br_read(br, extra_dbits[dcode]);
+
+            if ((size_t)dist > op) { rc = ODZ_ERR_CORRUPT; break; }
+            odz_copy_match(out + op, (size_t)dist, (size_t)length);
+            op += (size_t)length;
+            nmatch++;
+            mbytes += (uint64_t)length;
+        }
+    }
+    o->op = op;
+
+    if (o->st) {
+        uint64_t nlit = (op + slid - start) - mbytes;
+        o->st->literals       += nlit;
+        o->st->matches        += nmatch;
+        o->st->match_bytes    += mbytes;
+        o->st->huff_lookups   += nlit + 2 * nmatch + 1;
+        o->st->huff_secondary += nsec;
+    }
+    return rc;
+}
+
+/* Fixed-Huffman code lengths (RFC 1951 §3.2.6); codes 286/287 and
+ * distances 30/31 are never valid and are left out. */
+static int build_fixed_tables(huff_decode_table_t *ll_tab, huff_decode_table_t *d_tab) {
+    uint8_t ll_lens[LITLEN_SYMS], d_lens[DIST_CODES];
+    for (int s = 0; s < LITLEN_SYMS; s++)
+        ll_lens[s] = s < 144 ? 8 : s < 256 ? 9 : s < 280 ? 7 : 8;
+    memset(d_lens, 5, sizeof d_lens);
+    if (huff_build_decode_table2(ll_lens, LITLEN_SYMS, ll_tab) != 0) return ODZ_ERR_OOM;
+    if (huff_build_decode_table2(d_lens, DIST_CODES, d_tab) != 0) return ODZ_ERR_OOM;
+    return ODZ_OK;
+}
+
+/* Decode DEFLATE blocks up to and including the one with BFINAL set */
+static int inflate_blocks(inflate_in_t *z, inflate_out_t *o,
+                          huff_decode_table_t *ll_tab, huff_decode_table_t *d_tab,
+                          const odz_options_t *opts, uint64_t in_size) {
+    odz_stats_t *st = o->st;
+    for (;;) {
+        int rc = in_refill(z);
+        if (rc != ODZ_OK) return rc;
+        uint64_t bit0 = in_bitpos(z), out0 = out_produced(o);
+        uint64_t t0 = st ? odz_now_ns() : 0;
+
+        int final = (int)br_read(&z->br, 1);
+        int btype = (int)br_read(&z->br, 2);
+        int type;
+        if (btype == 0) {
+            rc = inflate_stored(z, o);
+            type = ODZ_BLOCK_STORED;
+        } else if (btype == 1 || btype == 2) {
+            if (btype == 1) {
+                rc = build_fixed_tables(ll_tab, d_tab);
+            } else {
+                uint8_t ll_lens[LITLEN_SYMS], d_lens[DIST_SYMS];
+                int n_ll, n_dist;
+                rc = ODZ_OK;
+                if (huff_read_trees(&z->br, ll_lens, &n_ll, d_lens, &n_dist, HUFF_HDIST_BITS) != 0)
+                    rc = ODZ_ERR_CORRUPT;
+                else if (huff_build_decode_table2(ll_lens, LITLEN_SYMS, ll_tab) != 0 ||
+                         huff_build_decode_table2(d_lens, DIST_SYMS, d_tab) != 0)
+                    rc = ODZ_ERR_OOM;
+            }
+            uint64_t t1 = st ? odz_now_ns() : 0;
+            if (st) st->ns_huff_build += t1 - t0;
+            if (rc == ODZ_OK) rc = inflate_huffman(z, o, ll_tab, d_tab);
+            if (st) st->ns_huff_code += odz_now_ns() - t1;
+            type = ODZ_BLOCK_HUFFMAN;
+        } else {
+            return ODZ_ERR_CORRUPT;
+        }
+        if (rc != ODZ_OK) return rc;
+        if (in_overrun(z)) return ODZ_ERR_CORRUPT;
+
+        if (st) {
+            st->block_count[type]++;
+            st->block_raw[type]  += out_produced(o) - out0;
+            st->block_comp[type] += (in_bitpos(z) - bit0 + 7) / 8;
+        }
+        if (opts && opts->progress &&
+            opts->progress(z->base + z->br.pos, in_size, opts->userdata) != 0)
+            return ODZ_ERR_IO;
+        if (final) return ODZ_OK;
+    }
+}
+
+/* ── Decompression: containers ─────────────────────────────── */
+
+static int skip_zstring(inflate_in_t *z) {
+    int c;
+    while ((c = in_byte(z)) > 0) ;
+    return c < 0 ? ODZ_ERR_CORRUPT : ODZ_OK;
+}
+
+static int read_gzip_header(inflate_in_t *z) {
+    int b[10];
+    for (int i = 0; i < 10; i++)
+        if ((b[i] = in_byte(z)) < 0) return ODZ_ERR_CORRUPT;
+    if (b[0] != GZIP_ID1 || b[1] != GZIP_ID2 || b[2] != GZIP_CM) return ODZ_ERR_FORMAT;
+    int flg = b[3];
+    if (flg & GZ_FRESERVED) return ODZ_ERR_FORMAT;
+    if (flg & GZ_FEXTRA) {
+        int lo = in_byte(z), hi = in_byte(z);
+        if (lo < 0 || hi < 0) return ODZ_ERR_CORRUPT;
+        for (int xlen = lo | (hi << 8); xlen > 0; xlen--)
+            if (in_byte(z) < 0) return ODZ_ERR_CORRUPT;
+    }
+    if ((flg & GZ_FNAME) && skip_zstring(z) != ODZ_OK) return ODZ_ERR_CORRUPT;
+    if ((flg & GZ_FCOMMENT) && skip_zstring(z) != ODZ_OK) return ODZ_ERR_CORRUPT;
+    if ((flg & GZ_FHCRC) && (in_byte(z) < 0 || in_byte(z) < 0)) return ODZ_ERR_CORRUPT;
+    return ODZ_OK;
+}
+
+/* Read n trailer bytes (after aligning) into v, little- or big-endian */
+static int read_trailer_u32(inflate_in_t *z, int big_endian, uint32_t *v) {
+    uint32_t x = 0;
+    for (int i = 0; i < 4; i++) {
+        int c = in_byte(z);
+        if (c < 0) return ODZ_ERR_CORRUPT;
+        x = big_endian ? (x << 8) | (uint32_t)c : x | ((uint32_t)c << (8 * i));
+    }
+    *v = x;
+    return ODZ_OK;
+}
+
+int odz_inflate_stream(FILE *in, FILE *out, int format,
+                       const uint8_t *peek, size_t npeek,
+                       const odz_options_t *opts) {
+    if (format != ODZ_FORMAT_GZIP && format != ODZ_FORMAT_ZLIB && format != ODZ_FORMAT_DEFLATE)
+        return ODZ_ERR_FORMAT;
+
+    odz_mem_t mem;
+    int rc = odz_mem_from(&mem, opts);
+    if (rc != ODZ_OK) return rc;
+    odz_stats_t *st = opts ? opts->stats : NULL;
+    uint64_t t_start = 0, t = 0;
+    if (st) { memset(st, 0, sizeof *st); t_start = odz_now_ns(); }
+
+    /* Input size for progress (0 if the stream can't seek) */
+    uint64_t in_size = 0;
+    int64_t here = ftello(in);
+    if (here >= 0 && fseeko(in, 0, SEEK_END) == 0) {
+        int64_t end = ftello(in);
+        if (end >= 0) in_size = (uint64_t)end;
+        if (fseeko(in, here, SEEK_SET) != 0) return ODZ_ERR_IO;
+    }
+
+    odz_io_t *io;
+    rc = odz_io_open(&io, in, out, opts ? opts->io : ODZ_IO_STDIO, opts && opts->io_direct);
+    if (rc != ODZ_OK) return rc;
+
+    inflate_in_t z = { .io = io, .st = st };
+    inflate_out_t o = { .io = io, .format = format, .st = st };
+    huff_decode_table_t ll_tab = {.secondary = NULL, .secondary_size = 0, .secondary_cap = 0, .mem = &mem};
+    huff_decode_table_t d_tab  = {.secondary = NULL, .secondary_size = 0, .secondary_cap = 0, .mem = &mem};
+
+    z.buf = odz_alloc(&mem, IN_CAP + IN_PAD);
+    o.buf = odz_alloc(&mem, OUT_CAP);
+    if (!z.buf || !o.buf) { rc = ODZ_ERR_OOM; goto cleanup; }
+    if (npeek) memcpy(z.buf, peek, npeek);
+    z.real_len = npeek;
+    br_init(&z.br, z.buf, npeek);
+
+    for (;;) {
+        o.check = format == ODZ_FORMAT_ZLIB ? 1 : 0;
+        o.total = 0;
+
+        if (format == ODZ_FORMAT_GZIP) {
+            if ((rc = read_gzip_header(&z)) != ODZ_OK) goto cleanup;
+        } else if (format == ODZ_FORMAT_ZLIB) {
+            int cmf = in_byte(&z), flg = in_byte(&z);
+            if (cmf < 0 || flg < 0) { rc = ODZ_ERR_CORRUPT; goto cleanup; }
+            if (!is_zlib_header((uint8_t)cmf, (uint8_t)flg)) { rc = ODZ_ERR_FORMAT; goto cleanup; }
+            if (flg & 0x20) { rc = ODZ_ERR_FORMAT; goto cleanup; }  /* preset dictionary */
+        }
+
+        rc = inflate_blocks(&z, &o, &ll_tab, &d_tab, opts, in_size);
+        if (rc != ODZ_OK) goto cleanup;
+        if ((rc = out_flush(&o)) != ODZ_OK) goto cleanup;
+        o.op = o.flushed = 0;   /* members don't share history */
+
+        if (format == ODZ_FORMAT_DEFLATE) break;
+        in_align(&z);
+        if (format == ODZ_FORMAT_ZLIB) {
+            uint32_t adler;
+            if ((rc = read_trailer_u32(&z, 1, &adler)) != ODZ_OK) goto cleanup;
+            if (adler != o.check) { rc = ODZ_ERR_CORRUPT; goto cleanup; }
+            break;
+        }
+
+        uint32_t crc, isize;
+        if ((rc = read_trailer_u32(&z, 0, &crc)) != ODZ_OK) goto cleanup;
+        if ((rc = read_trailer_u32(&z, 0, &isize)) != ODZ_OK) goto cleanup;
+        if (crc != o.check || isize != (uint32_t)o.total) { rc = ODZ_ERR_CORRUPT; goto cleanup; }
+
+        /* Concatenated gzip members decode as one stream */
+        if ((rc = in_refill(&z)) != ODZ_OK) goto cleanup;
+        if (in_remaining(&z) == 0) break;
+    }
+
+cleanup:
+    if (st) t = odz_now_ns();
+    int io_rc = odz_io_close(io);
+    if (st) st->ns_write += odz_now_ns() - t;
+    if (rc == ODZ_OK) rc = io_rc;
+    if (st) st->ns_total = odz_now_ns() - t_start;
+    huff_free_decode_table2(&ll_tab);
+    huff_free_decode_table2(&d_tab);
+    odz_free(&mem, z.buf, IN_CAP + IN_PAD);
+    odz_free(&mem, o.buf, OUT_CAP);
+    return rc;
+}
@@ -0,0 +1,40 @@
+#ifndef DEFLATE_H
+#define DEFLATE_H
+
+/*
+ * gzip (RFC 1952), zlib (RFC 1950) and raw DEFLATE (RFC 1951) streams,
+ * built on the odz matcher and Huffman engine.
+ */
+
+#include <stdio.h>
+#include "bitstream.h"
+#include "libodzip.h"
+
+/*
+ * Code n bytes as one dynamic-Huffman DEFLATE block, or as stored blocks
+ * if that is smaller, with BFINAL set when final is nonzero (compress.c).
+ * Bits are left unflushed in bw so consecutive blocks pack back-to-back.
+ * level is ODZ_LEVEL_MIN..MAX, or 0 for the default.  ctx, if non-NULL,
+ * lends its matcher.  Returns ODZ_OK or ODZ_ERR_OOM.
+ */
+int odz_deflate_block(const uint8_t *in, size_t n, int final, int level, odz_ctx_t *ctx,
+                      bit_writer_t *bw, odz_stats_t *st);
+
+/* Compress in → out in opts->format (gzip, zlib or raw DEFLATE). */
+int odz_deflate_stream(FILE *in, FILE *out, const odz_options_t *opts);
+
+/*
+ * Identify a gzip or zlib stream from its first two bytes.
+ * Returns ODZ_FORMAT_GZIP, ODZ_FORMAT_ZLIB, or -1.
+ */
+int odz_sniff_format(const uint8_t hdr[2]);
+
+/*
+ * Decompress a gzip / zlib / raw DEFLATE stream.  The first npeek bytes
+ * of the stream (already read for format detection) are passed in peek.
+ */
+int odz_inflate_stream(FILE *in, FILE *out, int format,
+                       const uint8_t *peek, size_t npeek,
+                       const odz_options_t *opts);
+
+#endif
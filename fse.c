@@ -0,0 +1,223 @@
+#include "fse.h"
+#include <string.h>
+
+static int highbit(uint32_t x) {
+    int n = 0;
+    while (x >>= 1) n++;
+    return n;
+}
+
+/* ── Normalization ─────────────────────────────────────────── */
+
+/* Symbol order for handing out the rounding remainder: by freq / norm,
+ * highest first when dir > 0, lowest first otherwise, ties to the lower
+ * symbol.  Kept as a binary heap, so small blocks with many symbols and
+ * hundreds of states to place do not rescan the alphabet per state. */
+typedef struct {
+    const uint32_t *freqs;
+    const int16_t  *norm;
+    int             dir;
+    int             n;
+    int             h[LITLEN_SYMS];
+} share_heap_t;
+
+static int share_before(const share_heap_t *q, int a, int b) {
+    uint64_t x = (uint64_t)q->freqs[a] * (uint64_t)q->norm[b];
+    uint64_t y = (uint64_t)q->freqs[b] * (uint64_t)q->norm[a];
+    if (x != y) return q->dir > 0 ? x > y : x < y;
+    return a < b;
+}
+
+static void share_sift(share_heap_t *q, int i) {
+    for (;;) {
+        int c = 2 * i + 1;
+        if (c >= q->n) return;
+        if (c + 1 < q->n && share_before(q, q->h[c + 1], q->h[c])) c++;
+        if (!share_before(q, q->h[c], q->h[i])) return;
+        int t = q->h[i]; q->h[i] = q->h[c]; q->h[c] = t;
+        i = c;
+    }
+}
+
+static void share_init(share_heap_t *q, const uint32_t *freqs, const int16_t *norm,
+                       int nsym, int dir) {
+    q->freqs = freqs;
+    q->norm = norm;
+    q->dir = dir;
+    q->n = 0;
+    for (int s = 0; s < nsym; s++)
+        if (dir > 0 ? freqs[s] != 0 : norm[s] > 1) q->h[q->n++] = s;
+    for (int i = q->n / 2 - 1; i >= 0; i--) share_sift(q, i);
+}
+
+int fse_normalize(const uint32_t *freqs, int nsym, int max_log, int16_t *norm) {
+    uint64_t total = 0;
+    int used = 0;
+    for (int s = 0; s < nsym; s++) {
+        total += freqs[s];
+        used += freqs[s] != 0;
+    }
+    if (total == 0) return -1;
+
+    /* No point in more states than ~2x the symbols coded */
+    int log = max_log;
+    while (log > FSE_MIN_TABLELOG && (1ull << (log - 1)) >= total) log--;
+    while ((1 << log) < used) log++;
+    int32_t L = 1 << log;
+
+    /* Proportional share, rounded down, at least 1 for used symbols */
+    int32_t sum = 0;
+    for (int s = 0; s < nsym; s++) {
+        norm[s] = 0;
+        if (!freqs[s]) continue;
+        uint64_t c = (uint64_t)freqs[s] * (uint64_t)L / total;
+        norm[s] = (int16_t)(c ? c : 1);
+        sum += norm[s];
+    }
+
+    /* Hand out what rounding left over to the symbols that gain the most
+     * (highest freq / norm), and reclaim any excess from those that lose
+     * the least (lowest freq / norm). */
+    share_heap_t q;
+    if (sum != L) share_init(&q, freqs, norm, nsym, sum < L ? 1 : -1);
+    while (sum < L) {
+        norm[q.h[0]]++;
+        sum++;
+        share_sift(&q, 0);
+    }
+    while (sum > L) {
+        int s = q.h[0];
+        norm[s]--;
+        sum--;
+        if (norm[s] <= 1) q.h[0] = q.h[--q.n];
+        share_sift(&q, 0);
+    }
+    return log;
+}
+
+/* ── Count header ──────────────────────────────────────────── */
+
+/*
+ * Counts are written in symbol order, each in just enough bits to hold
+ * the states still unassigned, and stop once all 2^log are assigned.
+ * A zero count is followed by the number of further zeros, in 2-bit
+ * chunks where 3 means "3, and more follow".
+ */
+int fse_write_counts(bit_writer_t *bw, const int16_t *norm, int nsym, int log) {
+    if (bw_write(bw, (uint32_t)(log - FSE_MIN_TABLELOG), 3) != 0) return -1;
+    int32_t remaining = 1 << log;
+    int s = 0;
+    while (remaining > 0 && s < nsym) {
+        int nb = highbit((uint32_t)remaining) + 1;
+        if (bw_write(bw, (uint32_t)norm[s], nb) != 0) return -1;
+        remaining -= norm[s];
+        if (norm[s] == 0) {
+            int run = 0;
+            while (s + 1 + run < nsym && norm[s + 1 + run] == 0) run++;
+            s += 1 + run;
+            for (; run >= 3; run -= 3)
+                if (bw_write(bw, 3, 2) != 0) return -1;
+            if (bw_write(bw, (uint32_t)run, 2) != 0) return -1;
+        } else {
+            s++;
+        }
+    }
+    return 0;
+}
+
+int fse_read_counts(bit_reader_t *br, int16_t *norm, int nsym, int *log) {
+    *log = FSE_MIN_TABLELOG + (int)br_read(br, 3);
+    if (*log > FSE_MAX_TABLELOG) return -1;
+    memset(norm, 0, (size_t)nsym * sizeof *norm);
+    int32_t remaining = 1 << *log;
+    int s = 0;
+    while (remaining > 0) {
+        if (s >= nsym) return -1;
+        int nb = highbit((uint32_t)remaining) + 1;
+        int32_t c = (int32_t)br_read(br, nb);
+        if (c > remaining) return -1;
+        norm[s] = (int16_t)c;
+        remaining -= c;
+        if (c == 0) {
+            int run = 0;
+            uint32_t chunk;
+            do {
+                chunk = br_read(br, 2);
+                run += (int)chunk;
+                if (s + 1 + run > nsym) return -1;
+            } while (chunk == 3);
+            s += 1 + run;
+        } else {
+            s++;
+        }
+    }
+    if (br->nbits < 0) return -1;  /* ran off the end */
+    return 0;
+}
+
+/* ── Tables ────────────────────────────────────────────────── */
+
+/* Scatter each symbol's states across the table so that every symbol
+ * appears at a spread of state values (the step is odd, hence coprime
+ * with the power-of-two table size and visits every slot once). */
+static void spread_symbols(const int16_t *norm, int nsym, int log, uint16_t *sym_at) {
+    uint32_t L = 1u << log, mask = L - 1;
+    uint32_t step = (L >> 1) + (L >> 3) + 3;
+    uint32_t pos = 0;
+    for (int s = 0; s < nsym; s++) {
+        for (int i = 0; i < norm[s]; i++) {
+            sym_at[pos] = (uint16_t)s;
+            pos = (pos + step) & mask;
+        }
+    }
+}
+
+void fse_build_ctable(const int16_t *norm, int nsym, int log, fse_ctable_t *ct) {
+    uint32_t L = 1u << log;
+    uint16_t sym_at[1 << FSE_MAX_TABLELOG];
+    spread_symbols(norm, nsym, log, sym_at);
+
+    /* States of each symbol, grouped by symbol, in increasing order */
+    int32_t cumul[LITLEN_SYMS + 1];
+    cumul[0] = 0;
+    for (int s = 0; s < nsym; s++) cumul[s + 1] = cumul[s] + norm[s];
+    int32_t next[LITLEN_SYMS];
+    memcpy(next, cumul, (size_t)nsym * sizeof *next);
+    for (uint32_t u = 0; u < L; u++)
+        ct->state_table[next[sym_at[u]]++] = (uint16_t)(L + u);
+
+    for (int s = 0; s < nsym; s++) {
+        fse_symtt_t *tt = &ct->tt[s];
+        if (norm[s] == 0) {
+            tt->delta_nbits = 0;
+            tt->delta_state = 0;
+        } else if (norm[s] == 1) {
+            tt->delta_nbits = ((uint32_t)log << 16) - L;
+            tt->delta_state = cumul[s] - 1;
+        } else {
+            uint32_t max_bits = (uint32_t)(log - highbit((uint32_t)norm[s] - 1));
+            uint32_t min_state_plus = (uint32_t)norm[s] << max_bits;
+            tt->delta_nbits = (max_bits << 16) - min_state_plus;
+            tt->delta_state = cumul[s] - norm[s];
+        }
+    }
+    ct->log = log;
+}
+
+void fse_build_dtable(const int16_t *norm, int nsym, int log, fse_dtable_t *dt) {
+    uint32_t L = 1u << log;
+    uint16_t sym_at[1 << FSE_MAX_TABLELOG];
+    spread_symbols(norm, nsym, log, sym_at);
+
+    uint32_t next[LITLEN_SYMS];
+    for (int s = 0; s < nsym; s++) next[s] = (uint32_t)norm[s];
+    for (uint32_t u = 0; u < L; u++) {
+        int s = sym_at[u];
+        uint32_t x = next[s]++;              /* in [norm, 2*norm) */
+        int nb = log - highbit(x);
+        dt->table[u].sym   = (uint16_t)s;
+        dt->table[u].nbits = (uint8_t)nb;
+        dt->table[u].base  = (uint16_t)((x << nb) - L);
+    }
+    dt->log = log;
+}
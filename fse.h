@@ -0,0 +1,87 @@
+#ifndef FSE_H
+#define FSE_H
+
+#include <stdint.h>
+#include "bitstream.h"
+#include "lz_tables.h"
+
+/*
+ * Finite-state entropy (tANS) coding for the lit/len and distance streams.
+ *
+ * A table of L = 2^log states is shared out among the symbols in
+ * proportion to their normalized counts; a symbol with count c costs
+ * log2(L / c) bits on average, so fractional-bit probabilities are coded
+ * without Huffman's whole-bit rounding.  Encoding runs over the symbols
+ * in reverse; the bits it emits are written back in reverse, so the
+ * decoder reads forward with the ordinary bit reader.
+ */
+
+#define FSE_MIN_TABLELOG  5
+#define FSE_MAX_TABLELOG  12
+#define FSE_LL_TABLELOG   12   /* lit/len (286 symbols): 11 loses ~0.3% */
+#define FSE_D_TABLELOG    8    /* distances (35 symbols): 9 saves ~0.01% */
+
+/* Decode table entry: the state's symbol, and how to reach the next state */
+typedef struct {
+    uint16_t sym;
+    uint8_t  nbits;     /* bits to read for the next state */
+    uint16_t base;      /* next state = base + read(nbits) */
+} fse_dentry_t;
+
+typedef struct {
+    int          log;
+    fse_dentry_t table[1 << FSE_MAX_TABLELOG];
+} fse_dtable_t;
+
+/* Encode table: next-state lookup plus per-symbol transform */
+typedef struct {
+    uint32_t delta_nbits;   /* (x + delta_nbits) >> 16 = bits to emit */
+    int32_t  delta_state;   /* offset into state_table */
+} fse_symtt_t;
+
+typedef struct {
+    int         log;
+    uint16_t    state_table[1 << FSE_MAX_TABLELOG];
+    fse_symtt_t tt[LITLEN_SYMS];
+} fse_ctable_t;
+
+/*
+ * Normalize frequencies to counts summing to 2^log (every used symbol
+ * gets at least 1).  log starts at max_log and shrinks for small inputs.
+ * Returns log, or -1 if no symbol is used.
+ */
+int fse_normalize(const uint32_t *freqs, int nsym, int max_log, int16_t *norm);
+
+/* Write / read normalized counts (3-bit log, then counts with zero runs).
+ * fse_read_counts returns 0, or -1 on malformed input. */
+int fse_write_counts(bit_writer_t *bw, const int16_t *norm, int nsym, int log);
+int fse_read_counts(bit_reader_t *br, int16_t *norm, int nsym, int *log);
+
+void fse_build_ctable(const int16_t *norm, int nsym, int log, fse_ctable_t *ct);
+void fse_build_dtable(const int16_t *norm, int nsym, int log, fse_dtable_t *dt);
+
+/* Encoder state for a stream whose last symbol (first encoded) is sym;
+ * no bits are emitted for it.  States live in [L, 2L). */
+static inline uint32_t fse_init_state(const fse_ctable_t *ct, int sym) {
+    fse_symtt_t tt = ct->tt[sym];
+    uint32_t nbits = (tt.delta_nbits + (1u << 15)) >> 16;
+    uint32_t value = (nbits << 16) - tt.delta_nbits;
+    return ct->state_table[(int32_t)(value >> nbits) + tt.delta_state];
+}
+
+/* Encode sym: returns the emitted bits packed as (value << 4) | nbits */
+static inline uint32_t fse_encode(const fse_ctable_t *ct, uint32_t *state, int sym) {
+    fse_symtt_t tt = ct->tt[sym];
+    uint32_t x = *state;
+    uint32_t nbits = (x + tt.delta_nbits) >> 16;
+    *state = ct->state_table[(int32_t)(x >> nbits) + tt.delta_state];
+    return ((x & ((1u << nbits) - 1)) << 4) | nbits;
+}
+
+/* Advance a decoder state to the next symbol's state */
+static inline uint32_t fse_next_state(const fse_dtable_t *dt, bit_reader_t *br, uint32_t state) {
+    fse_dentry_t e = dt->table[state];
+    return e.base + br_read(br, e.nbits);
+}
+
+#endif
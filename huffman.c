@@ -1,4 +1,5 @@
 #include "huffman.h"
+#include "odz.h"
 #include <stdlib.h>
 #include <string.h>
 
@@ -13,56 +14,76 @@ static uint16_t bit_reverse(uint16_t code, int len) {
     return r;
 }
 
-/* ── Build code lengths (Huffman tree) ─────────────────────── */
+/* ── Build code lengths (length-limited Huffman) ───────────── */
 
 /*
- * Two-queue Huffman tree builder.
- * Sorts non-zero-frequency symbols, merges bottom-up,
- * extracts depths, then length-limits if needed.
+ * Package-merge (Larmore & Hirschberg): optimal code lengths subject to
+ * len <= max_bits, so no after-the-fact limiting is needed.
+ *
+ * Active symbols are radix-sorted by frequency.  The list for the deepest
+ * level holds just the leaves; each shallower level merges the leaves with
+ * pairs packaged from the level below.  The first 2(n-1) items of the top
+ * list are selected, and a leaf's code length is the number of levels
+ * whose selected prefix contains it.
  */
 
-typedef struct { int sym; uint32_t freq; } sf_t;
+typedef struct { uint32_t freq; uint16_t sym; } sf_t;
 
-static int sf_cmp(const void *a, const void *b) {
-    const sf_t *x = a, *y = b;
-    if (x->freq != y->freq) return (x->freq < y->freq) ? -1 : 1;
-    return (x->sym < y->sym) ? -1 : 1;
-}
+#define PM_MAX_ITEMS (2 * LITLEN_SYMS)
 
-static void limit_lengths(uint8_t *lengths, int nsym, int max_bits) {
-    /* Check if limiting is needed */
-    int overflow = 0;
-    for (int i = 0; i < nsym; i++)
-        if (lengths[i] > max_bits) overflow = 1;
-    if (!overflow) return;
+/* Stable LSD radix sort on freq, 8 bits per pass; passes where every key
+ * shares the same digit (typically the high bytes) are skipped. */
+static void sort_by_freq(sf_t *a, sf_t *tmp, int n) {
+    for (int shift = 0; shift < 32; shift += 8) {
+        int count[256] = {0};
+        for (int i = 0; i < n; i++) count[(a[i].freq >> shift) & 0xFF]++;
+        if (count[(a[0].freq >> shift) & 0xFF] == n) continue;
 
-    /* Cap all lengths */
-    for (int i = 0; i < nsym; i++)
-        if (lengths[i] > max_bits) lengths[i] = (uint8_t)max_bits;
+        int pos = 0;
+        for (int d = 0; d < 256; d++) { int c = count[d]; count[d] = pos; pos += c; }
+        for (int i = 0; i < n; i++) tmp[count[(a[i].freq >> shift) & 0xFF]++] = a[i];
+        memcpy(a, tmp, (size_t)n * sizeof *a);
+    }
+}
 
-    /* Compute kraft sum: sum of 2^(max_bits - len[i]) for active symbols */
-    int32_t kraft = 0;
-    for (int i = 0; i < nsym; i++)
-        if (lengths[i] > 0)
-            kraft += 1 << (max_bits - lengths[i]);
-    int32_t target = 1 << max_bits;
-
-    /* Oversubscribed: lengthen codes starting from longest available < max_bits */
-    while (kraft > target) {
-        for (int d = max_bits - 1; d >= 1; d--) {
-            /* Find any symbol at this length */
-            for (int i = 0; i < nsym; i++) {
-                if (lengths[i] == d) {
-                    kraft -= 1 << (max_bits - d);
-                    lengths[i]++;
-                    kraft += 1 << (max_bits - lengths[i]);
-                    goto check_kraft;
-                }
+/* lens[i] = code length of the i-th lightest leaf; requires 2 < n <= 2^max_bits */
+static void package_merge(const sf_t *leaves, int n, int max_bits, uint8_t *lens) {
+    uint64_t wa[PM_MAX_ITEMS], wb[PM_MAX_ITEMS];
+    uint8_t  is_leaf[HUFF_MAX_BITS + 1][PM_MAX_ITEMS];
+    int      count[HUFF_MAX_BITS + 1];
+
+    uint64_t *below = wa, *cur = wb;
+    for (int i = 0; i < n; i++) { below[i] = leaves[i].freq; is_leaf[max_bits][i] = 1; }
+    count[max_bits] = n;
+
+    for (int j = max_bits - 1; j >= 1; j--) {
+        int npkg = count[j + 1] / 2;
+        int li = 0, pi = 0, o = 0;
+        while (li < n || pi < npkg) {
+            uint64_t pw = pi < npkg ? below[2 * pi] + below[2 * pi + 1] : UINT64_MAX;
+            if (li < n && leaves[li].freq <= pw) {
+                cur[o] = leaves[li++].freq;
+                is_leaf[j][o++] = 1;
+            } else {
+                cur[o] = pw;
+                is_leaf[j][o++] = 0;
+                pi++;
             }
         }
-        break; /* can't fix further */
-check_kraft:
-        ;
+        count[j] = o;
+        uint64_t *t = below; below = cur; cur = t;
+    }
+
+    /* Walk down from the top: the selected prefix at level j consists of
+     * k leaves (the k lightest) plus packages expanding to 2*(c-k) items
+     * of level j+1. */
+    memset(lens, 0, (size_t)n);
+    int c = 2 * n - 2;
+    for (int j = 1; j <= max_bits && c > 0; j++) {
+        int k = 0;
+        for (int i = 0; i < c; i++) k += is_leaf[j][i];
+        for (int i = 0; i < k; i++) lens[i]++;
+        c = 2 * (c - k);
     }
 }
 
@@ -71,58 +92,20 @@ void huff_build_lengths(const uint32_t *freqs, int nsym, int max_bits,
     memset(out, 0, (size_t)nsym);
 
     /* Collect active symbols */
-    sf_t sf[LITLEN_SYMS];  /* max alphabet size */
+    sf_t sf[LITLEN_SYMS], tmp[LITLEN_SYMS];  /* max alphabet size */
     int na = 0;
     for (int i = 0; i < nsym; i++)
-        if (freqs[i] > 0) { sf[na].sym = i; sf[na].freq = freqs[i]; na++; }
+        if (freqs[i] > 0) { sf[na].sym = (uint16_t)i; sf[na].freq = freqs[i]; na++; }
 
     if (na == 0) return;
     if (na == 1) { out[sf[0].sym] = 1; return; }
     if (na == 2) { out[sf[0].sym] = 1; out[sf[1].sym] = 1; return; }
 
-    /* Sort by frequency ascending */
-    qsort(sf, (size_t)na, sizeof(sf_t), sf_cmp);
-
-    /* Build tree with two-queue method.
-     * Nodes 0..na-1 = leaves (sorted).  Nodes na..2*na-2 = internal. */
-    int total = 2 * na - 1;
-    uint32_t nfreq[LITLEN_SYMS * 2];
-    int16_t  npar[LITLEN_SYMS * 2];
-
-    for (int i = 0; i < na; i++) { nfreq[i] = sf[i].freq; npar[i] = -1; }
-
-    int lf = 0;                     /* leaf front */
-    int ib = na;                    /* internal back (write position) */
-    int it = na;                    /* internal front (read position) */
+    sort_by_freq(sf, tmp, na);
 
-    for (int i = na; i < total; i++) {
-        /* Pick two smallest */
-        int a, b;
-        if (it >= ib || (lf < na && nfreq[lf] <= nfreq[it]))
-            a = lf++;
-        else
-            a = it++;
-        if (it >= ib || (lf < na && nfreq[lf] <= nfreq[it]))
-            b = lf++;
-        else
-            b = it++;
-
-        nfreq[i] = nfreq[a] + nfreq[b];
-        npar[a] = (int16_t)i;
-        npar[b] = (int16_t)i;
-        npar[i] = -1;
-        ib = i + 1;
-    }
-
-    /* Extract depths */
-    for (int i = 0; i < na; i++) {
-        int depth = 0;
-        for (int j = i; npar[j] != -1; j = npar[j]) depth++;
-        out[sf[i].sym] = (uint8_t)depth;
-    }
-
-    /* Length-limit */
-    limit_lengths(out, nsym, max_bits);
+    uint8_t lens[LITLEN_SYMS];
+    package_merge(sf, na, max_bits, lens);
+    for (int i = 0; i < na; i++) out[sf[i].sym] = lens[i];
 }
 
 /* ── Build canonical codes from lengths ────────────────────── */
@@ -250,8 +233,9 @@ int huff_build_decode_table2(const uint8_t *lengths, int nsym,
 
     /* Allocate or reuse secondary array */
     if (sec_total > t->secondary_cap) {
-        free(t->secondary);
-        t->secondary = malloc((size_t)sec_total * sizeof(huff_entry_t));
+        odz_free(t->mem, t->secondary, (size_t)t->secondary_cap * sizeof(huff_entry_t));
+        t->secondary_cap = 0;
+        t->secondary = odz_alloc(t->mem, (size_t)sec_total * sizeof(huff_entry_t));
         if (!t->secondary) return -1;
         t->secondary_cap = sec_total;
     }
@@ -292,7 +276,7 @@ int huff_build_decode_table2(const uint8_t *lengths, int nsym,
 }
 
 void huff_free_decode_table2(huff_decode_table_t *t) {
-    free(t->secondary);
+    odz_free(t->mem, t->secondary, (size_t)t->secondary_cap * sizeof(huff_entry_t));
     t->secondary = NULL;
     t->secondary_size = 0;
     t->secondary_cap = 0;
@@ -354,12 +338,24 @@ static int rle_encode(const uint8_t *lens, int n,
     return out;
 }
 
-void huff_write_trees(bit_writer_t *bw,
-                      const uint8_t *ll_lens, int n_ll,
-                      const uint8_t *d_lens, int n_dist) {
+/* RLE symbols + code-length code for one lit/len + distance tree pair */
+typedef struct {
+    int      n_ll, n_dist, hclen, nrle;
+    uint8_t  rle_syms[LITLEN_SYMS + DIST_SYMS + 64];
+    uint8_t  rle_extra[LITLEN_SYMS + DIST_SYMS + 64];
+    uint8_t  rle_ebits[LITLEN_SYMS + DIST_SYMS + 64];
+    uint8_t  cl_lens[CODELEN_SYMS];
+    uint16_t cl_codes[CODELEN_SYMS];
+} tree_plan_t;
+
+static void plan_trees(tree_plan_t *tp,
+                       const uint8_t *ll_lens, int n_ll,
+                       const uint8_t *d_lens, int n_dist) {
     /* Trim trailing zeros (but keep at least 257 lit/len and 1 dist) */
     while (n_ll > 257 && ll_lens[n_ll - 1] == 0) n_ll--;
     while (n_dist > 1 && d_lens[n_dist - 1] == 0) n_dist--;
+    tp->n_ll = n_ll;
+    tp->n_dist = n_dist;
 
     /* Concatenate and RLE-encode */
     uint8_t combined[LITLEN_SYMS + DIST_SYMS];
@@ -367,47 +363,60 @@ void huff_write_trees(bit_writer_t *bw,
     memcpy(combined + n_ll, d_lens, (size_t)n_dist);
     int total_lens = n_ll + n_dist;
 
-    uint8_t rle_syms[LITLEN_SYMS + DIST_SYMS + 64];
-    uint8_t rle_extra[LITLEN_SYMS + DIST_SYMS + 64];
-    uint8_t rle_ebits[LITLEN_SYMS + DIST_SYMS + 64];
-    int nrle = rle_encode(combined, total_lens, rle_syms, rle_extra, rle_ebits);
+    tp->nrle = rle_encode(combined, total_lens, tp->rle_syms, tp->rle_extra, tp->rle_ebits);
 
     /* Build Huffman tree for the RLE symbols (code-length alphabet) */
     uint32_t cl_freq[CODELEN_SYMS] = {0};
-    for (int i = 0; i < nrle; i++) cl_freq[rle_syms[i]]++;
+    for (int i = 0; i < tp->nrle; i++) cl_freq[tp->rle_syms[i]]++;
 
-    uint8_t  cl_lens[CODELEN_SYMS];
-    uint16_t cl_codes[CODELEN_SYMS];
-    huff_build_lengths(cl_freq, CODELEN_SYMS, HUFF_CL_MAX_BITS, cl_lens);
-    huff_build_codes(cl_lens, CODELEN_SYMS, cl_codes);
+    huff_build_lengths(cl_freq, CODELEN_SYMS, HUFF_CL_MAX_BITS, tp->cl_lens);
+    huff_build_codes(tp->cl_lens, CODELEN_SYMS, tp->cl_codes);
 
     /* Trim trailing zeros in permuted order */
     int hclen = CODELEN_SYMS;
-    while (hclen > 4 && cl_lens[codelen_order[hclen - 1]] == 0) hclen--;
+    while (hclen > 4 && tp->cl_lens[codelen_order[hclen - 1]] == 0) hclen--;
+    tp->hclen = hclen;
+}
+
+size_t huff_tree_bits(const uint8_t *ll_lens, int n_ll,
+                      const uint8_t *d_lens, int n_dist, int hdist_bits) {
+    tree_plan_t tp;
+    plan_trees(&tp, ll_lens, n_ll, d_lens, n_dist);
+    size_t bits = 5 + (size_t)hdist_bits + 4 + 3 * (size_t)tp.hclen;
+    for (int i = 0; i < tp.nrle; i++)
+        bits += (size_t)tp.cl_lens[tp.rle_syms[i]] + tp.rle_ebits[i];
+    return bits;
+}
 
-    /* Write header: HLIT(5), HDIST(5), HCLEN(4) */
-    bw_write(bw, (uint32_t)(n_ll - 257), 5);
-    bw_write(bw, (uint32_t)(n_dist - 1), 5);
-    bw_write(bw, (uint32_t)(hclen - 4), 4);
+void huff_write_trees(bit_writer_t *bw,
+                      const uint8_t *ll_lens, int n_ll,
+                      const uint8_t *d_lens, int n_dist, int hdist_bits) {
+    tree_plan_t tp;
+    plan_trees(&tp, ll_lens, n_ll, d_lens, n_dist);
+
+    /* Write header: HLIT(5), HDIST(hdist_bits), HCLEN(4) */
+    bw_write(bw, (uint32_t)(tp.n_ll - 257), 5);
+    bw_write(bw, (uint32_t)(tp.n_dist - 1), hdist_bits);
+    bw_write(bw, (uint32_t)(tp.hclen - 4), 4);
 
     /* Write code-length code lengths (3 bits each, permuted order) */
-    for (int i = 0; i < hclen; i++)
-        bw_write(bw, cl_lens[codelen_order[i]], 3);
+    for (int i = 0; i < tp.hclen; i++)
+        bw_write(bw, tp.cl_lens[codelen_order[i]], 3);
 
     /* Write RLE-encoded lit/len + distance lengths */
-    for (int i = 0; i < nrle; i++) {
-        int s = rle_syms[i];
-        bw_write(bw, cl_codes[s], cl_lens[s]);
-        if (rle_ebits[i] > 0)
-            bw_write(bw, rle_extra[i], rle_ebits[i]);
+    for (int i = 0; i < tp.nrle; i++) {
+        int s = tp.rle_syms[i];
+        bw_write(bw, tp.cl_codes[s], tp.cl_lens[s]);
+        if (tp.rle_ebits[i] > 0)
+            bw_write(bw, tp.rle_extra[i], tp.rle_ebits[i]);
     }
 }
 
 int huff_read_trees(bit_reader_t *br,
                      uint8_t *ll_lens, int *n_ll,
-                     uint8_t *d_lens, int *n_dist) {
+                     uint8_t *d_lens, int *n_dist, int hdist_bits) {
     int hlit  = (int)br_read(br, 5) + 257;
-    int hdist = (int)br_read(br, 5) + 1;
+    int hdist = (int)br_read(br, hdist_bits) + 1;
     int hclen = (int)br_read(br, 4) + 4;
     // fix: dont actually trust hlit/hdist too much as it is user-controlled
     if (hlit > LITLEN_SYMS || hdist > DIST_SYMS) return -1;
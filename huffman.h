@@ -21,6 +21,7 @@ typedef struct {
     huff_entry_t *secondary;                         /* overflow sub-tables */
     int           secondary_size;
     int           secondary_cap;
+    const struct odz_mem *mem;                       /* secondary's allocator, NULL = malloc */
 } huff_decode_table_t;
 
 /*
@@ -57,13 +58,47 @@ int  huff_build_decode_table2(const uint8_t *lengths, int nsym,
                               huff_decode_table_t *t);
 void huff_free_decode_table2(huff_decode_table_t *t);
 
+/*
+ * Decode one symbol using a two-level table.
+ * *nsec counts secondary-table lookups (for odz_stats_t).
+ */
+static inline int huff_decode2(bit_reader_t *br,
+                               const huff_decode_table_t *t, uint64_t *nsec) {
+    uint32_t bits = br_peek(br, HUFF_MAX_BITS);
+    huff_entry_t e = t->primary[bits & ((1 << HUFF_PRIMARY_BITS) - 1)];
+    if ((e.len & 0x8000) == 0) {
+        /* Primary hit (95%+ of cases) */
+        br_consume(br, e.len);
+        return e.sym;
+    }
+    /* Secondary lookup */
+    (*nsec)++;
+    int total_bits = e.len & 0x7FFF;
+    int sub_idx = e.sym + (int)((bits >> HUFF_PRIMARY_BITS) &
+                  ((1u << (total_bits - HUFF_PRIMARY_BITS)) - 1));
+    huff_entry_t se = t->secondary[sub_idx];
+    br_consume(br, se.len);
+    return se.sym;
+}
+
+/* Width of the HDIST field: DEFLATE (and odz v2-v4) allow up to 32
+ * distance symbols, odz v5 widens it for the repeat-offset symbols */
+#define HUFF_HDIST_BITS     5
+#define HUFF_HDIST_BITS_V5  6
+
 /*
  * Write lit/len + distance Huffman trees to the bitstream
  * using the DEFLATE 3-level code-length encoding.
  */
 void huff_write_trees(bit_writer_t *bw,
                       const uint8_t *ll_lens, int n_ll,
-                      const uint8_t *d_lens, int n_dist);
+                      const uint8_t *d_lens, int n_dist, int hdist_bits);
+
+/*
+ * Size in bits that huff_write_trees would emit for these lengths.
+ */
+size_t huff_tree_bits(const uint8_t *ll_lens, int n_ll,
+                      const uint8_t *d_lens, int n_dist, int hdist_bits);
 
 /*
  * Read lit/len + distance Huffman trees from the bitstream.
@@ -71,6 +106,6 @@ void huff_write_trees(bit_writer_t *bw,
  */
 int  huff_read_trees(bit_reader_t *br,
                      uint8_t *ll_lens, int *n_ll,
-                     uint8_t *d_lens, int *n_dist);
+                     uint8_t *d_lens, int *n_dist, int hdist_bits);
 
 #endif
@@ -4,7 +4,7 @@
 #include <stdio.h>
 #include <stdint.h>
 
-#define ODZ_FORMAT_VERSION  2
+#define ODZ_FORMAT_VERSION  5
 
 /* Error codes */
 #define ODZ_OK          0
@@ -12,19 +12,266 @@
 #define ODZ_ERR_OOM     2
 #define ODZ_ERR_FORMAT  3   /* bad magic, unsupported version */
 #define ODZ_ERR_CORRUPT 4   /* data integrity error */
+#define ODZ_ERR_REF     5   /* patch stream: reference missing or not the one it was made from */
+#define ODZ_ERR_KEY     6   /* encrypted stream: no key or passphrase given, or not its own */
+
+/* Container formats (odz_options_t.format).
+ * Compression writes the chosen format.  Decompression with ODZ_FORMAT_ODZ
+ * auto-detects odz, gzip and zlib by their magic bytes; raw DEFLATE has
+ * no header and must be requested explicitly. */
+#define ODZ_FORMAT_ODZ      0
+#define ODZ_FORMAT_GZIP     1   /* RFC 1952 */
+#define ODZ_FORMAT_ZLIB     2   /* RFC 1950 */
+#define ODZ_FORMAT_DEFLATE  3   /* RFC 1951, no container */
+
+/* Block size range for odz streams (odz_options_t.block_size).  Smaller
+ * blocks need less memory to decode; larger ones compress a little better
+ * and carry less per-block overhead.  The size is stored in the stream
+ * header and the decoder allocates to match. */
+#define ODZ_BLOCK_SIZE_MIN  (4u << 10)
+#define ODZ_BLOCK_SIZE_MAX  (64u << 20)
+
+/* Pre-LZ filters for odz streams (odz_options_t.filter), chosen per block.
+ * x86 helps executables, delta sampled or slowly changing values, shuffle
+ * arrays of fixed-width records (little-endian int / float columns).
+ * AUTO picks one, or none, for each block from sampled byte statistics;
+ * delta and shuffle take their width from filter_width, 0 = detect. */
+#define ODZ_FILTER_NONE     0
+#define ODZ_FILTER_X86      1   /* E8/E9 call/jmp targets, relative → absolute */
+#define ODZ_FILTER_DELTA    2   /* byte minus the byte filter_width back */
+#define ODZ_FILTER_SHUFFLE  3   /* filter_width-byte records split into byte planes */
+#define ODZ_FILTER_AUTO     4
+
+/* Compression levels (odz_options_t.level): how hard the matcher looks,
+ * from a 4-step chain without lazy matching at 1 to 4096 steps at 9.
+ * Levels 1-7 decode at about the same speed; 8 and 9 also try
+ * Burrows-Wheeler blocks, which decode a few times slower. */
+#define ODZ_LEVEL_MIN       1
+#define ODZ_LEVEL_DEFAULT   6
+#define ODZ_LEVEL_MAX       9
+
+/* Encryption (odz_options_t.key / passphrase): every block of an odz
+ * stream sealed with ChaCha20-Poly1305 under a key of its own, derived
+ * from the caller's over a random salt in the header.  A raw key is
+ * ODZ_KEY_SIZE bytes of secret; a passphrase goes through PBKDF2, which
+ * takes a noticeable fraction of a second per stream by design. */
+#define ODZ_KEY_SIZE        32
+
+/* I/O strategy (odz_options_t.io).
+ * The overlapped modes read ahead and write behind on 1 MB chunks so
+ * device latency hides behind compute.  A mode that is unavailable at
+ * build or run time falls back: io_uring → threads → stdio.
+ * With io_direct set, input reads bypass the page cache (O_DIRECT, Linux). */
+#define ODZ_IO_STDIO        0   /* read, compute, write in turn */
+#define ODZ_IO_THREADS      1   /* reader + writer threads */
+#define ODZ_IO_URING        2   /* io_uring on the caller's thread; seekable files */
+
+/* Worker pool (odz_options_t.pool), built with thread support only:
+ * odz_pool_create returns NULL without it, and a NULL pool means "run
+ * on the caller's thread".  Tasks from odz_pool_submit are scheduled
+ * work-stealing alongside the block tasks of any odz_compress using the
+ * same pool, so callers can queue whole files and the pool still keeps
+ * every thread busy when one file is much larger than the rest. */
+typedef struct odz_pool odz_pool_t;
+
+odz_pool_t *odz_pool_create(int threads);
+int  odz_pool_threads(const odz_pool_t *pool);     /* 1 for NULL */
+int  odz_pool_submit(odz_pool_t *pool, void (*fn)(void *), void *arg);  /* ODZ_OK */
+void odz_pool_wait_all(odz_pool_t *pool);          /* every submitted task done */
+void odz_pool_destroy(odz_pool_t *pool);
+
+/* Compression context (odz_options_t.ctx): the matcher's tables, kept
+ * from call to call so a thread serving many small requests neither
+ * allocates nor clears full-size tables each time.  One thread at a time
+ * may use a context; it holds the tables of the largest block it has
+ * seen until freed. */
+typedef struct odz_ctx odz_ctx_t;
+
+odz_ctx_t *odz_ctx_create(void);
+void odz_ctx_free(odz_ctx_t *ctx);
+
+/* Pace callback (odz_options_t.pace), asked before each block of an
+ * adaptive odz compression for outside pressure: >0 asks for less effort
+ * (whatever feeds the compressor is falling behind), <0 allows more
+ * (output is backed up and compute would idle), 0 leaves the choice to
+ * target_speed. */
+typedef int (*odz_pace_fn)(void *userdata);
 
 /* Progress callback.
  * Return 0 to continue, nonzero to abort. */
 typedef int (*odz_progress_fn)(uint64_t processed, uint64_t total, void *userdata);
 
-/* Options (pass NULL for defaults / no progress) */
+/* Histogram sizes: lengths and distances are bucketed by their
+ * DEFLATE code (lengths 3-258 → 29 codes, distances 1-32768 → 30 codes). */
+#define ODZ_STATS_BLOCK_TYPES  8
+#define ODZ_STATS_LEN_CODES    29
+#define ODZ_STATS_DIST_CODES   30
+
+/* Performance counters, filled by odz_compress / odz_decompress when
+ * odz_options_t.stats is set (the struct is zeroed on entry).
+ * Fields that do not apply to a direction stay 0. */
 typedef struct {
+    /* Wall time per stage, nanoseconds (compute stages summed over the
+     * threads when blocks run on a pool) */
+    uint64_t ns_read;
+    uint64_t ns_match;          /* LZ77 hash-chain search (compress) */
+    uint64_t ns_huff_build;     /* tree build (compress) / tree read + decode tables (decompress) */
+    uint64_t ns_huff_code;      /* bitstream emission (compress) / symbol decode + LZ replay (decompress) */
+    uint64_t ns_write;
+    uint64_t ns_total;
+
+    /* Per block type (see odz_block_type_name): count, raw bytes, bytes on disk incl. header */
+    uint64_t block_count[ODZ_STATS_BLOCK_TYPES];
+    uint64_t block_raw[ODZ_STATS_BLOCK_TYPES];
+    uint64_t block_comp[ODZ_STATS_BLOCK_TYPES];
+
+    /* Matcher: candidates walked in lz_matcher_find_best (compress) */
+    uint64_t chain_searches;
+    uint64_t chain_steps;
+    uint32_t chain_steps_max;
+
+    /* Tokens */
+    uint64_t literals;
+    uint64_t matches;
+    uint64_t match_bytes;
+    uint64_t rep_matches;       /* matches coded as a repeat offset (compress) */
+    uint64_t ref_matches;       /* patch mode: matches into the reference (compress) */
+    uint64_t ref_bytes;
+    uint64_t len_hist[ODZ_STATS_LEN_CODES];    /* compress only */
+    uint64_t dist_hist[ODZ_STATS_DIST_CODES];  /* compress only */
+
+    /* Two-level Huffman decode: lookups and secondary-table fallbacks (decompress) */
+    uint64_t huff_lookups;
+    uint64_t huff_secondary;
+    uint64_t huff_trees_reused; /* Huffman blocks that reused the previous block's trees */
+    uint64_t filtered_blocks;   /* blocks coded through a pre-LZ filter */
+    uint64_t level_blocks[ODZ_LEVEL_MAX + 1];  /* odz blocks compressed at each level
+                                                 * (0: literals only, adaptive runs) */
+    uint64_t ns_kdf;            /* encrypted streams: deriving the stream key */
+    uint64_t ns_crypt;          /* encrypting (compress) / authenticating and decrypting blocks */
+    uint64_t literal_blocks;    /* blocks coded literals only, without LZ (compress) */
+} odz_stats_t;
+
+/* Allocator hooks (odz_options_t.alloc_fn / free_fn): the library's
+ * buffers for a call come from alloc_fn, and each goes back to free_fn
+ * with the size it was allocated with, for memory accounting.  Threads
+ * compressing blocks in parallel call them concurrently.  The thread
+ * pool and the I/O buffers still come from malloc. */
+typedef void *(*odz_alloc_fn)(void *userdata, size_t size);
+typedef void  (*odz_free_fn)(void *userdata, void *ptr, size_t size);
+
+/* Options (pass NULL for defaults / no progress) */
+typedef struct odz_options {
     odz_progress_fn progress;
     void *userdata;
+    odz_stats_t *stats;         /* optional performance counters */
+    int format;                 /* ODZ_FORMAT_*, 0 = odz */
+    int io;                     /* ODZ_IO_*, 0 = stdio */
+    int io_direct;              /* O_DIRECT input reads where supported */
+    odz_pool_t *pool;           /* compress an odz stream's blocks in parallel on this
+                                 * pool (then without cross-block tree reuse) */
+    uint32_t block_size;        /* odz compression, 0 = 1 MB; outside ODZ_BLOCK_SIZE_MIN..MAX
+                                 * odz_compress fails with ODZ_ERR_FORMAT */
+    FILE *patch_from;           /* patch mode (odz format): reference file that matches may
+                                 * copy from; decompression needs the same file again */
+    int filter;                 /* ODZ_FILTER_*, odz format only (0 = none) */
+    int filter_width;           /* delta distance / shuffle record size, 0 = detect;
+                                 * outside 0..255 odz_compress fails with ODZ_ERR_FORMAT */
+    odz_ctx_t *ctx;             /* compression: reuse this context on the calling thread
+                                 * (blocks run on a pool allocate their own) */
+    int level;                  /* ODZ_LEVEL_*, 0 = default; outside MIN..MAX
+                                 * odz_compress fails with ODZ_ERR_FORMAT */
+    double target_speed;        /* odz format: adapt the level block by block to compress
+                                 * this many MB/s (10^6 bytes), starting from level;
+                                 * 0 = fixed level */
+    int target_cpu;             /* target_speed counts the compressing threads' CPU time,
+                                 * a budget per CPU-second, instead of the wall clock */
+    odz_pace_fn pace;           /* odz format: outside pressure, also adapts the level
+                                 * (called with userdata) */
+    int dedup;                  /* odz format: code content seen earlier in the stream as
+                                 * references to it (content-defined chunks) */
+    uint64_t dedup_window;      /* how far back, in bytes of output, a dedup reference may
+                                 * reach; 0 = anywhere.  Decompression keeps a window-sized
+                                 * cache, or for 0 reads back its own output, which must then
+                                 * be a seekable file open for reading too ("w+b") */
+    odz_alloc_fn alloc_fn;      /* allocator hooks, both or neither (else ODZ_ERR_FORMAT); */
+    odz_free_fn free_fn;        /* NULL = malloc / free */
+    void *alloc_userdata;
+    int huge_pages;             /* back the big work buffers (matcher tables, tokens, block
+                                 * buffers) with 2 MB pages where the system provides them:
+                                 * reserved huge pages, else transparent ones (Linux) */
+    const uint8_t *key;         /* encrypt odz streams under this ODZ_KEY_SIZE-byte key, */
+    const char *passphrase;     /* or one derived from this (PBKDF2); decompressing needs the
+                                 * same (else ODZ_ERR_KEY).  Other formats: ODZ_ERR_FORMAT */
 } odz_options_t;
 
+/* Compressibility estimate: what odz_compress at a level (0 = default)
+ * would likely make of the data, from a cheap probe of sampled windows,
+ * in a small fraction of the time compressing takes.  The file variant
+ * maps the file and reads only the sampled parts.  Returns ODZ_OK, or
+ * ODZ_ERR_FORMAT for a level outside MIN..MAX. */
+typedef struct {
+    double   ratio;             /* predicted original / compressed size, odz format */
+    double   speed;             /* predicted compression MB/s on this machine, one thread */
+    uint64_t sampled;           /* bytes probed */
+} odz_estimate_t;
+
+int odz_estimate(const void *buf, size_t len, int level, odz_estimate_t *est);
+int odz_estimate_file(FILE *in, int level, odz_estimate_t *est);
+
+/* Stream inspection: the block structure of an odz stream, from its
+ * headers alone.  Blocks are skipped with fseeko (read through where in
+ * does not seek), so even a very large stream is walked at metadata
+ * speed.  Of a Huffman or FSE block only the code tables at its head are
+ * read: Huffman code lengths, whose symbol probabilities are about
+ * 2^-length, or FSE normalized counts out of 1 << log (-1: below one).
+ * fn is called for each block in order and stops the walk by returning
+ * nonzero.  An encrypted stream's tables are ciphertext and not read, but
+ * its block headers are in the clear.  Returns ODZ_OK, ODZ_ERR_FORMAT for
+ * anything but an odz stream, or ODZ_ERR_CORRUPT / ODZ_ERR_IO for a
+ * damaged or truncated one. */
+#define ODZ_INSPECT_LITLEN_SYMS 286     /* 0-255 literal, 256 end, 257-285 length */
+#define ODZ_INSPECT_DIST_SYMS   35      /* 0-29 distance, 30-31 reference, 32-34 repeat */
+
+typedef struct {
+    int      version;
+    uint64_t original_size;
+    uint32_t block_size;
+    int      flags;             /* stream flags: 1 patch, 2 dedup, 4 encrypted */
+    uint64_t ref_size;          /* patch streams: the reference file's size and CRC-32 */
+    uint32_t ref_crc32;
+    uint64_t dedup_window;      /* dedup streams */
+    uint32_t header_size;       /* bytes before the first block */
+} odz_stream_info_t;
+
+typedef struct {
+    uint64_t index;
+    uint64_t offset;            /* of the block header in the stream */
+    int      type;              /* see odz_block_type_name */
+    int      last;
+    int      reuse_trees;       /* Huffman: codes with the previous block's trees */
+    int      multistream;
+    int      filter;            /* ODZ_FILTER_*, and its width */
+    int      filter_width;
+    uint32_t raw_size;
+    uint64_t comp_size;         /* on disk, block header included */
+    uint64_t src;               /* dedup blocks: output offset repeated */
+    int      have_tables;       /* code tables read (Huffman, unless reused, and FSE) */
+    uint32_t table_bytes;       /* of the payload they take */
+    int      ll_log, dist_log;  /* FSE: table logs, dist_log 0 for literals only */
+    int16_t  litlen[ODZ_INSPECT_LITLEN_SYMS];  /* code lengths or normalized counts */
+    int16_t  dist[ODZ_INSPECT_DIST_SYMS];
+} odz_block_info_t;
+
+typedef int (*odz_inspect_fn)(const odz_stream_info_t *stream, const odz_block_info_t *block,
+                              void *userdata);
+
+int odz_inspect(FILE *in, odz_inspect_fn fn, void *userdata);
+
 int odz_compress(FILE *in, FILE *out, const odz_options_t *opts);
 int odz_decompress(FILE *in, FILE *out, const odz_options_t *opts);
 const char *odz_strerror(int err);
+const char *odz_block_type_name(int type);  /* NULL for unused types */
+const char *odz_cpu_name(void);             /* vector kernels in use: generic, sse2, avx2, avx512 */
 
 #endif
@@ -1,63 +1,129 @@
 #include "lz_matcher.h"
+#include "odz_cpu.h"
 #include <stdlib.h>
 #include <string.h>
 
-static uint32_t hash3(uint8_t a, uint8_t b, uint8_t c, uint32_t mask){
-    uint32_t k = ((uint32_t)a<<16) ^ ((uint32_t)b<<8) ^ (uint32_t)c;
-    return (k * 2654435761u) & mask; // mask = (1<<hash_bits)-1
-}
+#if ODZ_CPU_X86
+#include <immintrin.h>
+#endif
+
+static lz_find_best_fn pick_find_best(void);
+static int pick_isa(void);
 
-int lz_matcher_init(lz_matcher_t *m, size_t n_block, int hash_bits, int max_chain_steps){
+int lz_matcher_init(lz_matcher_t *m, size_t n_block, int hash_bits, int max_chain_steps,
+                    const odz_mem_t *mem){
     size_t hash_size = (size_t)1 << hash_bits;
-    m->head = (int32_t*)malloc(hash_size * sizeof *m->head);
-    m->prev = (int32_t*)malloc(n_block   * sizeof *m->prev);
-    if (!m->head || !m->prev) { free(m->head); free(m->prev); return -1; }
+    if (mem) m->mem = *mem;
+    else memset(&m->mem, 0, sizeof m->mem);
+    m->head_cap = hash_size * sizeof *m->head;
+    m->prev_cap = n_block   * sizeof *m->prev;
+    m->head = (int32_t*)odz_alloc_big(&m->mem, m->head_cap);
+    m->prev = (int32_t*)odz_alloc_big(&m->mem, m->prev_cap);
+    if (!m->head || !m->prev) { lz_matcher_free(m); return -1; }
     m->n = n_block;
     m->hash_mask = (uint32_t)hash_size - 1u;
-    m->max_chain_steps = max_chain_steps;
+    m->find_best = pick_find_best();
+    lz_matcher_set_chain(m, max_chain_steps);
+    m->searches = m->steps = 0;
+    m->steps_max = 0;
     memset(m->head, 0xFF, hash_size * sizeof *m->head); // -1
     return 0;
 }
 
-void lz_matcher_reset(lz_matcher_t *m, size_t n_block){
+void lz_matcher_reset(lz_matcher_t *m, size_t n_block, int hash_bits){
+    size_t hash_size = (size_t)1 << hash_bits;
     m->n = n_block;
-    // keep capacity; caller must ensure prev[] big enough or recreate
-    memset(m->head, 0xFF, ((size_t)m->hash_mask + 1) * sizeof *m->head);
+    m->hash_mask = (uint32_t)hash_size - 1u;
+    m->searches = m->steps = 0;
+    m->steps_max = 0;
+    // keep capacity; caller must ensure head[] / prev[] big enough or recreate
+    memset(m->head, 0xFF, hash_size * sizeof *m->head);
 }
 
 void lz_matcher_free(lz_matcher_t *m){
-    free(m->head); free(m->prev);
+    odz_free_big(&m->mem, m->head, m->head_cap);
+    odz_free_big(&m->mem, m->prev, m->prev_cap);
     m->head = m->prev = NULL; m->n = 0;
+    m->head_cap = m->prev_cap = 0;
 }
 
-void lz_matcher_insert(lz_matcher_t *m, const uint8_t *in, size_t i) {
-    if (i + 2 >= m->n) { m->prev[i] = -1; return; }
-    uint32_t h = hash3(in[i], in[i+1], in[i+2], m->hash_mask);
-    m->prev[i] = m->head[h];
-    m->head[h] = (int32_t)i;
+/* ── Match length kernels ──────────────────────────────────── */
+
+/* Word-wise then tail (lz_match_len_generic, lz_matcher.h) */
+static inline int match_len_generic(const uint8_t *a, const uint8_t *b, int maxl){
+    return lz_match_len_generic(a, b, maxl);
 }
 
-static int match_len(const uint8_t *a, const uint8_t *b, int maxl){
+#if ODZ_CPU_X86
+ODZ_TARGET("sse2")
+static inline int match_len_sse2(const uint8_t *a, const uint8_t *b, int maxl){
     int l = 0;
-    // word-wise then tail
-    while (l + (int)sizeof(size_t) <= maxl &&
-           *(const size_t*)(a + l) == *(const size_t*)(b + l)) l += (int)sizeof(size_t);
-    while (l < maxl && a[l] == b[l]) l++;
-    return l;
+    while (l + 16 <= maxl) {
+        __m128i x = _mm_loadu_si128((const __m128i *)(a + l));
+        __m128i y = _mm_loadu_si128((const __m128i *)(b + l));
+        unsigned ne = ~(unsigned)_mm_movemask_epi8(_mm_cmpeq_epi8(x, y)) & 0xFFFFu;
+        if (ne) return l + __builtin_ctz(ne);
+        l += 16;
+    }
+    return l + match_len_generic(a + l, b + l, maxl - l);
 }
 
-void lz_matcher_find_best(const lz_matcher_t *m, const uint8_t *in, size_t i, size_t n,
-                          int window, int min_match, int max_match,
-                          int *out_len, int *out_dist)
+ODZ_TARGET("avx2")
+static inline int match_len_avx2(const uint8_t *a, const uint8_t *b, int maxl){
+    int l = 0;
+    while (l + 32 <= maxl) {
+        __m256i x = _mm256_loadu_si256((const __m256i *)(a + l));
+        __m256i y = _mm256_loadu_si256((const __m256i *)(b + l));
+        unsigned ne = ~(unsigned)_mm256_movemask_epi8(_mm256_cmpeq_epi8(x, y));
+        if (ne) return l + __builtin_ctz(ne);
+        l += 32;
+    }
+    return l + match_len_sse2(a + l, b + l, maxl - l);
+}
+
+/* 256-bit compares into mask registers (zmm width only costs clock
+ * speed here, matches are short); a masked load covers the tail
+ * without reading past maxl. */
+ODZ_TARGET("avx512f,avx512bw,avx512vl")
+static inline int match_len_avx512(const uint8_t *a, const uint8_t *b, int maxl){
+    int l = 0;
+    while (l + 32 <= maxl) {
+        __mmask32 ne = _mm256_cmpneq_epi8_mask(_mm256_loadu_si256((const __m256i *)(a + l)),
+                                               _mm256_loadu_si256((const __m256i *)(b + l)));
+        if (ne) return l + __builtin_ctz(ne);
+        l += 32;
+    }
+    __mmask32 live = (__mmask32)((1ull << (maxl - l)) - 1);
+    __mmask32 ne = _mm256_mask_cmpneq_epi8_mask(live, _mm256_maskz_loadu_epi8(live, a + l),
+                                                _mm256_maskz_loadu_epi8(live, b + l));
+    return ne ? l + __builtin_ctz(ne) : maxl;
+}
+#endif
+
+/* ── Chain search ──────────────────────────────────────────── */
+
+/* Always inlined into the entry points below, so match_len is a constant
+ * there and its vector body inlines into the chain walk; the lz_search_fn
+ * instances also fix the window, match limits and chain depth, and insert
+ * i once walked, on the hash already computed. */
+static ODZ_ALWAYS_INLINE
+void find_best(lz_matcher_t *m, const uint8_t *in, size_t i, size_t n,
+               int window, int min_match, int max_match, int max_steps, int insert,
+               int *out_len, int *out_dist, lz_match_len_fn match_len)
 {
     int best_len = 0, best_dist = 0;
+    if (insert && i + 2 >= n) m->prev[i] = -1;
     if (i + (size_t)min_match <= n) {
-        uint32_t h = hash3(in[i], in[i+1], in[i+2], m->hash_mask);
+        uint32_t h = lz_hash3(in[i], in[i+1], in[i+2], m->hash_mask);
         int32_t p = m->head[h];
+        if (insert) {
+            m->prev[i] = p;
+            m->head[h] = (int32_t)i;
+        }
         int steps = 0;
         int maxl = (int)((n - i) < (size_t)max_match ? (n - i) : (size_t)max_match);
 
-        while (p >= 0 && steps++ < m->max_chain_steps) {
+        while (p >= 0 && steps++ < max_steps) {
             int dist = (int)(i - (size_t)p);
             if (dist > 0 && dist <= window) {
                 int l = match_len(in + p, in + i, maxl);
@@ -68,11 +134,153 @@ void lz_matcher_find_best(const lz_matcher_t *m, const uint8_t *in, size_t i, si
             }
             p = m->prev[p];
         }
+        if (steps > max_steps) steps = max_steps;
+        m->searches++;
+        m->steps += (uint64_t)steps;
+        if ((uint32_t)steps > m->steps_max) m->steps_max = (uint32_t)steps;
     }
     *out_len = best_len; *out_dist = best_dist;
 }
 
-void lz_matcher_find_best_next(const lz_matcher_t *m, const uint8_t *in, size_t i, size_t n,
+static void find_best_generic(lz_matcher_t *m, const uint8_t *in, size_t i, size_t n,
+                              int window, int min_match, int max_match,
+                              int *out_len, int *out_dist)
+{
+    find_best(m, in, i, n, window, min_match, max_match,
+              m->max_chain_steps, 0, out_len, out_dist, match_len_generic);
+}
+
+#if ODZ_CPU_X86
+ODZ_TARGET("sse2")
+static void find_best_sse2(lz_matcher_t *m, const uint8_t *in, size_t i, size_t n,
+                           int window, int min_match, int max_match,
+                           int *out_len, int *out_dist)
+{
+    find_best(m, in, i, n, window, min_match, max_match,
+              m->max_chain_steps, 0, out_len, out_dist, match_len_sse2);
+}
+
+ODZ_TARGET("avx2")
+static void find_best_avx2(lz_matcher_t *m, const uint8_t *in, size_t i, size_t n,
+                           int window, int min_match, int max_match,
+                           int *out_len, int *out_dist)
+{
+    find_best(m, in, i, n, window, min_match, max_match,
+              m->max_chain_steps, 0, out_len, out_dist, match_len_avx2);
+}
+
+ODZ_TARGET("avx512f,avx512bw,avx512vl")
+static void find_best_avx512(lz_matcher_t *m, const uint8_t *in, size_t i, size_t n,
+                             int window, int min_match, int max_match,
+                             int *out_len, int *out_dist)
+{
+    find_best(m, in, i, n, window, min_match, max_match,
+              m->max_chain_steps, 0, out_len, out_dist, match_len_avx512);
+}
+#endif
+
+/* Search instances for the odz parameter set, one per ISA and chain depth
+ * the levels use (compress.c effort ladder); a depth not listed walks
+ * m->max_chain_steps instead */
+#define SEARCH_AT(isa, target, steps)                                                   \
+    target static void search_##isa##_##steps(lz_matcher_t *m, const uint8_t *in,      \
+                                              size_t i, size_t n,                      \
+                                              int *out_len, int *out_dist)             \
+    {                                                                                  \
+        find_best(m, in, i, n, (int)ODZ_WINDOW, ODZ_MIN_MATCH, ODZ_MAX_MATCH,          \
+                  steps ? steps : m->max_chain_steps, 1, out_len, out_dist,            \
+                  match_len_##isa);                                                    \
+    }
+#define SEARCH_ISA(isa, target)                                                        \
+    SEARCH_AT(isa, target, 0)                                                          \
+    SEARCH_AT(isa, target, 4)    SEARCH_AT(isa, target, 8)    SEARCH_AT(isa, target, 16)  \
+    SEARCH_AT(isa, target, 32)   SEARCH_AT(isa, target, 64)   SEARCH_AT(isa, target, 256) \
+    SEARCH_AT(isa, target, 512)  SEARCH_AT(isa, target, 1024) SEARCH_AT(isa, target, 4096)
+#define SEARCH_ROW(isa)                                                                \
+    { search_##isa##_0, search_##isa##_4, search_##isa##_8, search_##isa##_16,          \
+      search_##isa##_32, search_##isa##_64, search_##isa##_256, search_##isa##_512,     \
+      search_##isa##_1024, search_##isa##_4096 }
+
+static const int search_depths[] = { 0, 4, 8, 16, 32, 64, 256, 512, 1024, 4096 };
+#define SEARCH_DEPTHS ((int)(sizeof search_depths / sizeof search_depths[0]))
+
+SEARCH_ISA(generic, )
+#if ODZ_CPU_X86
+SEARCH_ISA(sse2,   ODZ_TARGET("sse2"))
+SEARCH_ISA(avx2,   ODZ_TARGET("avx2"))
+SEARCH_ISA(avx512, ODZ_TARGET("avx512f,avx512bw,avx512vl"))
+#endif
+
+static const lz_search_fn search_table[][SEARCH_DEPTHS] = {
+    SEARCH_ROW(generic),
+#if ODZ_CPU_X86
+    SEARCH_ROW(sse2),
+    SEARCH_ROW(avx2),
+    SEARCH_ROW(avx512),
+#endif
+};
+
+/* Row of search_table / variants[] for this CPU */
+static int pick_isa(void){
+#if ODZ_CPU_X86
+    unsigned f = odz_cpu_features();
+    if (f & ODZ_CPU_AVX512) return 3;
+    if (f & ODZ_CPU_AVX2)   return 2;
+    if (f & ODZ_CPU_SSE2)   return 1;
+#endif
+    return 0;
+}
+
+void lz_matcher_set_chain(lz_matcher_t *m, int max_chain_steps){
+    int d = SEARCH_DEPTHS - 1;
+    while (d > 0 && search_depths[d] != max_chain_steps) d--;
+    m->max_chain_steps = max_chain_steps;
+    m->search = search_table[pick_isa()][d];
+}
+
+static const struct {
+    const char     *isa;
+    unsigned        need;       /* ODZ_CPU_* */
+    lz_find_best_fn find_best;
+    lz_match_len_fn match_len;
+} variants[] = {
+    { "generic", 0, find_best_generic, match_len_generic },
+#if ODZ_CPU_X86
+    { "sse2",   ODZ_CPU_SSE2,   find_best_sse2,   match_len_sse2 },
+    { "avx2",   ODZ_CPU_AVX2,   find_best_avx2,   match_len_avx2 },
+    { "avx512", ODZ_CPU_AVX512, find_best_avx512, match_len_avx512 },
+#endif
+};
+
+static lz_find_best_fn pick_find_best(void){
+    return variants[pick_isa()].find_best;
+}
+
+static int find_variant(const char *isa){
+    for (int k = 0; k < (int)(sizeof variants / sizeof variants[0]); k++)
+        if (strcmp(variants[k].isa, isa) == 0)
+            return (odz_cpu_features() & variants[k].need) == variants[k].need ? k : -1;
+    return -1;
+}
+
+lz_find_best_fn lz_find_best_variant(const char *isa){
+    int k = find_variant(isa);
+    return k < 0 ? NULL : variants[k].find_best;
+}
+
+lz_match_len_fn lz_match_len_variant(const char *isa){
+    int k = find_variant(isa);
+    return k < 0 ? NULL : variants[k].match_len;
+}
+
+void lz_matcher_find_best(lz_matcher_t *m, const uint8_t *in, size_t i, size_t n,
+                          int window, int min_match, int max_match,
+                          int *out_len, int *out_dist)
+{
+    m->find_best(m, in, i, n, window, min_match, max_match, out_len, out_dist);
+}
+
+void lz_matcher_find_best_next(lz_matcher_t *m, const uint8_t *in, size_t i, size_t n,
                                int window, int min_match, int max_match,
                                int *out_len, int *out_dist)
 {
@@ -80,3 +288,60 @@ void lz_matcher_find_best_next(const lz_matcher_t *m, const uint8_t *in, size_t
     // pretend i+1 is the current position; safe because matcher chains are built incrementally (see compressor loop)
     lz_matcher_find_best(m, in, i+1, n, window, min_match, max_match, out_len, out_dist);
 }
+
+/* ── Reference index (patch mode) ──────────────────────────── */
+
+static inline uint32_t ref_hash(const uint8_t *p, int bits){
+    uint64_t a, b;
+    memcpy(&a, p, 8);
+    memcpy(&b, p + 8, 8);
+    return (uint32_t)(((a ^ (b * 0xC2B2AE3D27D4EB4Full)) * 0x9E3779B97F4A7C15ull) >> (64 - bits));
+}
+
+int lz_ref_init(lz_ref_t *r, const uint8_t *data, uint64_t size, const odz_mem_t *mem){
+    /* Stride 8, wider for huge references so the table stays <= 64 MB */
+    int shift = 3;
+    while ((size >> shift) > (1u << 23)) shift++;
+    int bits = 10;
+    while (bits < 24 && ((uint64_t)1 << bits) < 2 * (size >> shift)) bits++;
+
+    r->data = data;
+    r->size = size;
+    r->shift = shift;
+    r->hash_bits = bits;
+    r->mask = (1u << bits) - 1;
+    r->mem = mem;
+    r->table = odz_alloc_big(mem, ((size_t)1 << bits) * sizeof *r->table);
+    if (!r->table) return -1;
+    memset(r->table, 0xFF, ((size_t)1 << bits) * sizeof *r->table);
+    if (size < LZ_REF_MIN) return 0;
+    for (uint64_t p = 0; p <= size - LZ_REF_MIN; p += (uint64_t)1 << shift)
+        r->table[ref_hash(data + p, bits)] = (uint32_t)(p >> shift);
+    return 0;
+}
+
+void lz_ref_free(lz_ref_t *r){
+    if (r->table) odz_free_big(r->mem, r->table, ((size_t)1 << r->hash_bits) * sizeof *r->table);
+    r->table = NULL;
+}
+
+int lz_ref_match_len(const lz_ref_t *r, const uint8_t *in, size_t i, size_t n,
+                     uint64_t pos, int max_len){
+    if (pos >= r->size) return 0;
+    uint64_t avail = r->size - pos;
+    if ((uint64_t)max_len > avail) max_len = (int)avail;
+    if ((size_t)max_len > n - i) max_len = (int)(n - i);
+    return match_len_generic(in + i, r->data + pos, max_len);
+}
+
+int lz_ref_find(const lz_ref_t *r, const uint8_t *in, size_t i, size_t n,
+                int max_len, uint64_t *pos){
+    if (n - i < LZ_REF_MIN) return 0;
+    uint32_t e = r->table[ref_hash(in + i, r->hash_bits)];
+    if (e == UINT32_MAX) return 0;
+    uint64_t p = (uint64_t)e << r->shift;
+    int len = lz_ref_match_len(r, in, i, n, p, max_len);
+    if (len < LZ_REF_MIN) return 0;
+    *pos = p;
+    return len;
+}
@@ -2,30 +2,140 @@
 #define LZ_MATCHER_H
 #include <stdint.h>
 #include <stddef.h>
+#include <string.h>
+#include "odz.h"
 
-typedef struct {
+typedef struct lz_matcher lz_matcher_t;
+
+/* find_best variant for the CPU, chosen in lz_matcher_init */
+typedef void (*lz_find_best_fn)(lz_matcher_t *m, const uint8_t *in, size_t i, size_t n,
+								int window, int min_match, int max_match,
+								int *out_len, int *out_dist);
+
+/* The same search compiled for the odz parameter set (ODZ_WINDOW,
+ * ODZ_MIN_MATCH, ODZ_MAX_MATCH) and one chain depth, so they are constants
+ * in the walk, which then inserts i itself: chosen for the CPU and depth
+ * in lz_matcher_set_chain */
+typedef void (*lz_search_fn)(lz_matcher_t *m, const uint8_t *in, size_t i, size_t n,
+							 int *out_len, int *out_dist);
+
+struct lz_matcher {
 	int32_t *head;
 	int32_t *prev;
 	size_t   n;
 	uint32_t hash_mask;
 	int      max_chain_steps;
-} lz_matcher_t;
+	lz_find_best_fn find_best;
+	lz_search_fn search;
+	odz_mem_t mem;			/* where head[] and prev[] came from */
+	size_t   head_cap, prev_cap;
+
+	/* Search counters (read by odz_stats_t) */
+	uint64_t searches;
+	uint64_t steps;
+	uint32_t steps_max;
+};
 
 #define HASH_BITS 15
 #define MAX_CHAIN_STEPS 256
 
-int  lz_matcher_init(lz_matcher_t *m, size_t n_block, int hash_bits, int max_chain_steps);
-void lz_matcher_reset(lz_matcher_t *m, size_t n_block);
+/* Hash chain bucket of the 3 bytes a b c; mask = (1 << hash_bits) - 1 */
+static inline uint32_t lz_hash3(uint8_t a, uint8_t b, uint8_t c, uint32_t mask){
+	uint32_t k = ((uint32_t)a<<16) ^ ((uint32_t)b<<8) ^ (uint32_t)c;
+	return (k * 2654435761u) & mask;
+}
+
+/* mem may be NULL (malloc); the matcher keeps a copy for freeing */
+int  lz_matcher_init(lz_matcher_t *m, size_t n_block, int hash_bits, int max_chain_steps,
+					 const odz_mem_t *mem);
+/* Reuse m for another block: head[] must hold 1 << hash_bits entries and
+ * prev[] n_block, as from an lz_matcher_init with at least those */
+void lz_matcher_reset(lz_matcher_t *m, size_t n_block, int hash_bits);
 void lz_matcher_free(lz_matcher_t *m);
 
-/* NOTE: plain prototype (no static/inline) */
-void lz_matcher_insert(lz_matcher_t *m, const uint8_t *in, size_t i);
+/* Depth of the chain walk, and the search instance compiled for it */
+void lz_matcher_set_chain(lz_matcher_t *m, int max_chain_steps);
+
+/* Inline: the compressor runs it at nearly every position */
+static inline void lz_matcher_insert(lz_matcher_t *m, const uint8_t *in, size_t i){
+	if (i + 2 >= m->n) { m->prev[i] = -1; return; }
+	uint32_t h = lz_hash3(in[i], in[i+1], in[i+2], m->hash_mask);
+	m->prev[i] = m->head[h];
+	m->head[h] = (int32_t)i;
+}
 
-void lz_matcher_find_best(const lz_matcher_t *m, const uint8_t *in, size_t i, size_t n,
+/* Best match at in[i] for the odz parameters, at the lz_matcher_set_chain
+ * depth; i goes into the chains too, so is not inserted again */
+static inline void lz_matcher_search(lz_matcher_t *m, const uint8_t *in, size_t i, size_t n,
+									 int *out_len, int *out_dist){
+	m->search(m, in, i, n, out_len, out_dist);
+}
+
+void lz_matcher_find_best(lz_matcher_t *m, const uint8_t *in, size_t i, size_t n,
 						  int window, int min_match, int max_match,
 						  int *out_len, int *out_dist);
 
-void lz_matcher_find_best_next(const lz_matcher_t *m, const uint8_t *in, size_t i, size_t n,
+void lz_matcher_find_best_next(lz_matcher_t *m, const uint8_t *in, size_t i, size_t n,
 							   int window, int min_match, int max_match,
 							   int *out_len, int *out_dist);
+
+/* Common prefix of a and b up to maxl: word-wise, then the tail.  memcpy
+ * keeps the unaligned loads well-defined. */
+static inline int lz_match_len_generic(const uint8_t *a, const uint8_t *b, int maxl){
+	int l = 0;
+	while (l + (int)sizeof(size_t) <= maxl) {
+		size_t x, y;
+		memcpy(&x, a + l, sizeof x);
+		memcpy(&y, b + l, sizeof y);
+		if (x != y) break;
+		l += (int)sizeof(size_t);
+	}
+	while (l < maxl && a[l] == b[l]) l++;
+	return l;
+}
+
+/* Length (up to max_match) of the match at in[i] against dist bytes back:
+ * how the repeat offsets are probed before the chain is walked */
+static inline int lz_match_len_at(const uint8_t *in, size_t i, size_t n, size_t dist, int max_match){
+	if (dist == 0 || dist > i) return 0;
+	if ((size_t)max_match > n - i) max_match = (int)(n - i);
+	if (max_match <= 0 || in[i] != in[i - dist]) return 0;
+	return lz_match_len_generic(in + i - dist, in + i, max_match);
+}
+
+/* One instruction set's kernels, to time the variants against each other
+ * (odz_microbench): isa is "generic", "sse2", "avx2" or "avx512".  NULL
+ * when that variant is not built in, or the CPU, less the ODZ_CPU cap,
+ * lacks it.  A find_best variant goes in lz_matcher_t.find_best. */
+typedef int (*lz_match_len_fn)(const uint8_t *a, const uint8_t *b, int maxl);
+
+lz_find_best_fn lz_find_best_variant(const char *isa);
+lz_match_len_fn lz_match_len_variant(const char *isa);
+
+/* Long-range index over a reference file (patch mode).  Every stride-th
+ * position is hashed on its first LZ_REF_MIN bytes, so any common run of
+ * LZ_REF_MIN + stride - 1 bytes is found from some input position. */
+typedef struct {
+	const uint8_t *data;
+	uint64_t size;
+	uint32_t *table;		/* position >> shift, UINT32_MAX = empty */
+	uint32_t  mask;
+	int       shift;		/* log2(stride) */
+	int       hash_bits;
+	const odz_mem_t *mem;
+} lz_ref_t;
+
+#define LZ_REF_MIN 16
+
+int  lz_ref_init(lz_ref_t *r, const uint8_t *data, uint64_t size, const odz_mem_t *mem);
+void lz_ref_free(lz_ref_t *r);
+
+/* Bytes (up to max_len) in[i..n) has in common with the reference at pos */
+int  lz_ref_match_len(const lz_ref_t *r, const uint8_t *in, size_t i, size_t n,
+					  uint64_t pos, int max_len);
+
+/* Match of at least LZ_REF_MIN bytes for in[i..n) through the index:
+ * returns its length (0 if none) and sets *pos */
+int  lz_ref_find(const lz_ref_t *r, const uint8_t *in, size_t i, size_t n,
+				 int max_len, uint64_t *pos);
 #endif
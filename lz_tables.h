@@ -6,13 +6,21 @@
  *
  * Lengths 3-258 are encoded as symbols 257-285 plus extra bits.
  * Distances 1-32768 are encoded as symbols 0-29 plus extra bits.
+ * odz adds distance symbols 30-31 for matches into a patch reference
+ * and, from v5, 32-34 for the repeat offsets; trees trim unused trailing
+ * symbols, so DEFLATE output never carries them.
  */
 
 #include <stdint.h>
 
 #define LITLEN_SYMS   286   /* 0-255 literal, 256 end, 257-285 length */
 #define LITLEN_END    256
-#define DIST_SYMS     30
+#define DIST_SYMS     35    /* 0-29 distance, 30-31 reference, 32-34 repeat */
+#define DIST_CODES    30    /* DEFLATE distance codes */
+#define DIST_REF_NEXT 30    /* reference: where the previous one ended */
+#define DIST_REF_POS  31    /* reference: explicit position follows */
+#define DIST_REP0     32    /* + k: k-th most recent distance, k < DIST_REPS */
+#define DIST_REPS     3
 #define CODELEN_SYMS  19
 
 /* ── Length codes (symbols 257-285) ────────────────────────── */
@@ -1,19 +1,41 @@
 /*
  * odz — a DEFLATE-class compressor
  *
- * Format v2: "ODZ\x02" | original_size(u64 LE) | blocks...
+ * Format v5: "ODZ\x05" | original_size(u64 LE) | block_size(u32 LE) | stream_flags(u8) | blocks...
  * Each block: flags(u8) | raw_size(u32 LE) | [compressed_size(u32 LE)] | data
+ * flags: bit 0 last, bits 1-2 type (stored/Huffman/FSE/dedup), bit 5 filtered (+ filter id(u8)
+ * width(u8) after compressed_size), bit 6 multi-stream, bit 7 reuse previous trees
  *
- * Compression pipeline: LZ77 hash-chain → Huffman → bitstream
+ * stream_flags bit 0 (patch) adds ref_size(u64 LE) | ref_crc32(u32 LE): matches may
+ * copy from a reference file (--patch-from), which decompression needs again.
+ * stream_flags bit 1 (dedup) adds dedup_window(u64 LE): dedup blocks carry src(u64 LE)
+ * instead of compressed_size and repeat raw_size bytes of earlier output (--dedup).
+ * stream_flags bit 2 (encrypted) adds kdf(u8) | kdf_param(u8) | salt[16] | check[16]: each
+ * block's payload is ChaCha20-Poly1305 ciphertext followed by its 16-byte tag (--key-file).
+ *
+ * --format=gzip|zlib|deflate writes standard DEFLATE streams instead;
+ * gzip and zlib input is recognised on decompression.
+ *
+ * Compression pipeline: LZ77 hash-chain → Huffman (or FSE if clearly smaller) → bitstream
  * Processes input in 1 MB blocks for bounded memory usage.
  *
+ * Batch mode (-r, or more than two inputs) runs files on a work-stealing
+ * pool of -T threads; files over one block fan out into block tasks.
+ *
  * Build: cmake --build . --config Release
  */
 
+#ifndef _WIN32
+#define _POSIX_C_SOURCE 200809L  /* strdup, lstat under -std=c17 */
+#endif
 #include <stdio.h>
 #include <string.h>
 #include <stdlib.h>
 #include <sys/stat.h>
+#ifndef _WIN32
+#include <dirent.h>
+#include <unistd.h>
+#endif
 
 #include "libodzip.h"
 
@@ -30,6 +52,128 @@ static int progress_cb(uint64_t processed, uint64_t total, void *userdata) {
     return 0;
 }
 
+/* ── Stats output (-v3 / --stats[=json]) ──────────────────── */
+
+static double ms(uint64_t ns) { return (double)ns / 1e6; }
+
+static void print_stats_text(const odz_stats_t *st, int mode) {
+    fprintf(stderr, "  stages (ms): read %.2f  match %.2f  huff-build %.2f  %s %.2f  write %.2f  total %.2f\n",
+            ms(st->ns_read), ms(st->ns_match), ms(st->ns_huff_build),
+            mode == 'c' ? "emit" : "decode", ms(st->ns_huff_code),
+            ms(st->ns_write), ms(st->ns_total));
+    if (st->ns_kdf || st->ns_crypt)
+        fprintf(stderr, "  encryption (ms): key derivation %.2f  %s %.2f\n",
+                ms(st->ns_kdf), mode == 'c' ? "seal" : "open", ms(st->ns_crypt));
+    fprintf(stderr, "  kernels: %s\n", odz_cpu_name());
+    for (int b = 0; b < ODZ_STATS_BLOCK_TYPES; b++) {
+        if (!st->block_count[b]) continue;
+        fprintf(stderr, "  %-8s blocks: %llu  raw %llu → %llu bytes\n",
+                odz_block_type_name(b),
+                (unsigned long long)st->block_count[b],
+                (unsigned long long)st->block_raw[b],
+                (unsigned long long)st->block_comp[b]);
+    }
+    uint64_t bytes = st->literals + st->match_bytes;
+    fprintf(stderr, "  tokens: %llu literals, %llu matches (%llu bytes), literal ratio %.1f%%\n",
+            (unsigned long long)st->literals, (unsigned long long)st->matches,
+            (unsigned long long)st->match_bytes,
+            bytes ? 100.0 * st->literals / bytes : 0.0);
+    if (st->rep_matches)
+        fprintf(stderr, "  repeat-offset matches: %llu\n", (unsigned long long)st->rep_matches);
+    if (st->ref_matches)
+        fprintf(stderr, "  reference matches: %llu (%llu bytes)\n",
+                (unsigned long long)st->ref_matches, (unsigned long long)st->ref_bytes);
+    if (st->chain_searches)
+        fprintf(stderr, "  chain steps: avg %.2f  max %u  (%llu searches)\n",
+                (double)st->chain_steps / st->chain_searches, st->chain_steps_max,
+                (unsigned long long)st->chain_searches);
+    if (st->huff_trees_reused)
+        fprintf(stderr, "  huffman trees reused: %llu blocks\n",
+                (unsigned long long)st->huff_trees_reused);
+    if (st->filtered_blocks)
+        fprintf(stderr, "  filtered: %llu blocks\n", (unsigned long long)st->filtered_blocks);
+    if (st->literal_blocks)
+        fprintf(stderr, "  literals only: %llu blocks\n", (unsigned long long)st->literal_blocks);
+    if (mode == 'c') {
+        int any = 0;
+        for (int l = 0; l <= ODZ_LEVEL_MAX; l++) {
+            if (!st->level_blocks[l]) continue;
+            fprintf(stderr, "%s %d×%llu", any ? "" : "  levels (×blocks):", l,
+                    (unsigned long long)st->level_blocks[l]);
+            any = 1;
+        }
+        if (any) fprintf(stderr, "\n");
+    }
+    if (st->huff_lookups)
+        fprintf(stderr, "  huffman lookups: %llu, secondary %.3f%%\n",
+                (unsigned long long)st->huff_lookups,
+                100.0 * st->huff_secondary / st->huff_lookups);
+    if (st->matches && mode == 'c') {
+        fprintf(stderr, "  length codes:");
+        for (int c = 0; c < ODZ_STATS_LEN_CODES; c++)
+            fprintf(stderr, " %llu", (unsigned long long)st->len_hist[c]);
+        fprintf(stderr, "\n  distance codes:");
+        for (int c = 0; c < ODZ_STATS_DIST_CODES; c++)
+            fprintf(stderr, " %llu", (unsigned long long)st->dist_hist[c]);
+        fprintf(stderr, "\n");
+    }
+}
+
+static void print_u64_array(FILE *f, const uint64_t *a, int n) {
+    fputc('[', f);
+    for (int i = 0; i < n; i++)
+        fprintf(f, "%s%llu", i ? "," : "", (unsigned long long)a[i]);
+    fputc(']', f);
+}
+
+static void print_stats_json(const odz_stats_t *st, int mode,
+                             const char *in_path, const char *out_path) {
+    FILE *f = stdout;
+    uint64_t bytes = st->literals + st->match_bytes;
+    fprintf(f, "{\"mode\":\"%s\",\"input\":\"%s\",\"output\":\"%s\",\"kernels\":\"%s\",",
+            mode == 'c' ? "compress" : "decompress", in_path, out_path, odz_cpu_name());
+    fprintf(f, "\"ns\":{\"read\":%llu,\"match\":%llu,\"huff_build\":%llu,"
+               "\"huff_code\":%llu,\"write\":%llu,\"kdf\":%llu,\"crypt\":%llu,\"total\":%llu},",
+            (unsigned long long)st->ns_read, (unsigned long long)st->ns_match,
+            (unsigned long long)st->ns_huff_build, (unsigned long long)st->ns_huff_code,
+            (unsigned long long)st->ns_write, (unsigned long long)st->ns_kdf,
+            (unsigned long long)st->ns_crypt, (unsigned long long)st->ns_total);
+    fprintf(f, "\"blocks\":{");
+    int first = 1;
+    for (int b = 0; b < ODZ_STATS_BLOCK_TYPES; b++) {
+        if (!odz_block_type_name(b)) continue;
+        fprintf(f, "%s\"%s\":{\"count\":%llu,\"raw\":%llu,\"comp\":%llu}",
+                first ? "" : ",", odz_block_type_name(b),
+                (unsigned long long)st->block_count[b],
+                (unsigned long long)st->block_raw[b],
+                (unsigned long long)st->block_comp[b]);
+        first = 0;
+    }
+    fprintf(f, "},\"chain\":{\"searches\":%llu,\"steps\":%llu,\"avg\":%.3f,\"max\":%u},",
+            (unsigned long long)st->chain_searches, (unsigned long long)st->chain_steps,
+            st->chain_searches ? (double)st->chain_steps / st->chain_searches : 0.0,
+            st->chain_steps_max);
+    fprintf(f, "\"tokens\":{\"literals\":%llu,\"matches\":%llu,\"match_bytes\":%llu,"
+               "\"rep_matches\":%llu,\"ref_matches\":%llu,\"ref_bytes\":%llu,"
+               "\"literal_ratio\":%.4f},",
+            (unsigned long long)st->literals, (unsigned long long)st->matches,
+            (unsigned long long)st->match_bytes, (unsigned long long)st->rep_matches,
+            (unsigned long long)st->ref_matches, (unsigned long long)st->ref_bytes,
+            bytes ? (double)st->literals / bytes : 0.0);
+    fprintf(f, "\"len_hist\":");
+    print_u64_array(f, st->len_hist, ODZ_STATS_LEN_CODES);
+    fprintf(f, ",\"dist_hist\":");
+    print_u64_array(f, st->dist_hist, ODZ_STATS_DIST_CODES);
+    fprintf(f, ",\"level_blocks\":");
+    print_u64_array(f, st->level_blocks, ODZ_LEVEL_MAX + 1);
+    fprintf(f, ",\"huff\":{\"lookups\":%llu,\"secondary\":%llu,\"secondary_rate\":%.6f,"
+               "\"trees_reused\":%llu},\"filtered_blocks\":%llu,\"literal_blocks\":%llu}\n",
+            (unsigned long long)st->huff_lookups, (unsigned long long)st->huff_secondary,
+            st->huff_lookups ? (double)st->huff_secondary / st->huff_lookups : 0.0,
+            (unsigned long long)st->huff_trees_reused, (unsigned long long)st->filtered_blocks,
+            (unsigned long long)st->literal_blocks);
+}
+
 static int file_exists(const char *path) {
     struct stat st;
     return stat(path, &st) == 0;
@@ -40,9 +184,515 @@ static const char *base_name(const char *path) {
     return p ? p + 1 : path;
 }
 
-static int ends_with_odz(const char *s) {
+/* Output formats: --format name, file extension, ODZ_FORMAT_* */
+static const struct {
+    const char *name;
+    const char *ext;
+    int         format;
+} formats[] = {
+    { "odz",     ".odz",     ODZ_FORMAT_ODZ     },
+    { "gzip",    ".gz",      ODZ_FORMAT_GZIP    },
+    { "zlib",    ".zz",      ODZ_FORMAT_ZLIB    },
+    { "deflate", ".deflate", ODZ_FORMAT_DEFLATE },
+};
+#define NFORMATS ((int)(sizeof formats / sizeof formats[0]))
+
+/* Index into formats[] of the known extension s ends with, or -1 */
+static int find_ext(const char *s) {
     size_t len = strlen(s);
-    return len >= 4 && strcmp(s + len - 4, ".odz") == 0;
+    for (int f = 0; f < NFORMATS; f++) {
+        size_t n = strlen(formats[f].ext);
+        if (len > n && strcmp(s + len - n, formats[f].ext) == 0) return f;
+    }
+    return -1;
+}
+
+/* Output name for in: add the format's extension when compressing, strip
+ * a known one (else add .raw) when decompressing */
+static void auto_output(char *dst, size_t cap, const char *in, int mode, int fmt) {
+    if (mode == 'c') {
+        snprintf(dst, cap, "%s%s", in, formats[fmt >= 0 ? fmt : 0].ext);
+        return;
+    }
+    int e = find_ext(in);
+    if (e >= 0)
+        snprintf(dst, cap, "%.*s", (int)(strlen(in) - strlen(formats[e].ext)), in);
+    else
+        snprintf(dst, cap, "%s.raw", in);
+}
+
+/* Compression defaults to odz.  Decompression sniffs odz / gzip / zlib
+ * from the header; raw DEFLATE has no magic, so it comes from --format or
+ * the .deflate extension. */
+static int pick_format(int mode, int fmt, int in_ext) {
+    if (fmt >= 0)
+        return formats[fmt].format;
+    if (mode == 'd' && in_ext >= 0 && formats[in_ext].format == ODZ_FORMAT_DEFLATE)
+        return ODZ_FORMAT_DEFLATE;
+    return ODZ_FORMAT_ODZ;
+}
+
+/* ── Batch mode (-r / several inputs) ─────────────────────── */
+
+typedef struct batch batch_t;
+
+typedef struct {
+    const batch_t *batch;
+    char       *in_path;
+    char       *out_path;
+    int         mode;
+    int         format;
+    long long   in_size, out_size;
+    const char *err;            /* NULL on success */
+} batch_job_t;
+
+struct batch {
+    batch_job_t *jobs;
+    size_t       n, cap;
+    int          mode, fmt;     /* from the command line, 0 / -1 = auto */
+    int          force;
+    int          failed;        /* inputs that could not be queued */
+    odz_options_t opts;
+};
+
+static int batch_add(batch_t *b, const char *path, long long size, int walked) {
+    int ext = find_ext(path);
+    int mode = b->mode ? b->mode : (ext >= 0 && !walked ? 'd' : 'c');
+    /* Walking a tree, only pick up files the mode applies to */
+    if (walked && (mode == 'd') != (ext >= 0)) return 0;
+
+    if (b->n == b->cap) {
+        size_t cap = b->cap ? 2 * b->cap : 256;
+        batch_job_t *jobs = realloc(b->jobs, cap * sizeof *jobs);
+        if (!jobs) return -1;
+        b->jobs = jobs;
+        b->cap = cap;
+    }
+    char out[4096];
+    auto_output(out, sizeof out, path, mode, b->fmt);
+    batch_job_t *j = &b->jobs[b->n];
+    memset(j, 0, sizeof *j);
+    j->batch = b;
+    j->in_path = strdup(path);
+    j->out_path = strdup(out);
+    if (!j->in_path || !j->out_path) { free(j->in_path); free(j->out_path); return -1; }
+    j->mode = mode;
+    j->format = pick_format(mode, b->fmt, ext);
+    j->in_size = size;
+    b->n++;
+    return 0;
+}
+
+/* Queue path: a regular file, or with recurse a directory's files.
+ * Symlinks found while walking are skipped, as gzip -r does. */
+static void batch_collect(batch_t *b, const char *path, int recurse, int walked) {
+    struct stat sb;
+    if ((walked ? lstat(path, &sb) : stat(path, &sb)) != 0) {
+        fprintf(stderr, "odz: %s: cannot stat\n", path);
+        b->failed++;
+        return;
+    }
+    if (S_ISREG(sb.st_mode)) {
+        if (batch_add(b, path, (long long)sb.st_size, walked) != 0) die("out of memory");
+        return;
+    }
+    if (!S_ISDIR(sb.st_mode)) {
+        if (!walked) { fprintf(stderr, "odz: %s: not a regular file\n", path); b->failed++; }
+        return;
+    }
+#ifndef _WIN32
+    if (!recurse) {
+        fprintf(stderr, "odz: %s: is a directory (use -r)\n", path);
+        b->failed++;
+        return;
+    }
+    DIR *d = opendir(path);
+    if (!d) {
+        fprintf(stderr, "odz: %s: cannot open directory\n", path);
+        b->failed++;
+        return;
+    }
+    struct dirent *e;
+    while ((e = readdir(d)) != NULL) {
+        if (strcmp(e->d_name, ".") == 0 || strcmp(e->d_name, "..") == 0) continue;
+        char child[4096];
+        size_t len = strlen(path);
+        int sep = len && path[len - 1] != '/';
+        if (snprintf(child, sizeof child, "%s%s%s", path, sep ? "/" : "", e->d_name)
+                >= (int)sizeof child) {
+            fprintf(stderr, "odz: %s/%s: path too long\n", path, e->d_name);
+            b->failed++;
+            continue;
+        }
+        batch_collect(b, child, recurse, 1);
+    }
+    closedir(d);
+#else
+    (void)recurse;
+    fprintf(stderr, "odz: %s: directories are not supported on this platform\n", path);
+    b->failed++;
+#endif
+}
+
+/* Pool task: one whole file.  Compressing with the pool in the options
+ * splits a large file into block tasks on the same workers. */
+static void batch_run(void *arg) {
+    batch_job_t *j = arg;
+    const batch_t *b = j->batch;
+    if (!b->force && file_exists(j->out_path)) {
+        j->err = "output exists (use -f to overwrite)";
+        return;
+    }
+    FILE *fin = fopen(j->in_path, "rb");
+    if (!fin) { j->err = "cannot open input file"; return; }
+    FILE *fout = fopen(j->out_path, j->mode == 'c' ? "wb" : "w+b");  /* dedup reads back */
+    if (!fout) { fclose(fin); j->err = "cannot open output file"; return; }
+
+    odz_options_t opts = b->opts;
+    opts.format = j->format;
+    int rc = j->mode == 'c' ? odz_compress(fin, fout, &opts) : odz_decompress(fin, fout, &opts);
+    if (rc == ODZ_OK && fflush(fout) != 0) rc = ODZ_ERR_IO;
+    if (rc == ODZ_OK) {
+        fseek(fout, 0, SEEK_END);
+        j->out_size = ftell(fout);
+    }
+    fclose(fin);
+    if (fclose(fout) != 0 && rc == ODZ_OK) rc = ODZ_ERR_IO;
+    if (rc != ODZ_OK) {
+        remove(j->out_path);
+        j->err = odz_strerror(rc);
+    }
+}
+
+/* Largest first: a big file's reader / writer is serial, so start it early */
+static int job_cmp_size(const void *a, const void *b) {
+    long long x = (*(batch_job_t *const *)a)->in_size;
+    long long y = (*(batch_job_t *const *)b)->in_size;
+    return (x < y) - (x > y);
+}
+
+static int batch_main(batch_t *b, odz_pool_t *pool) {
+    batch_job_t **order = malloc((b->n ? b->n : 1) * sizeof *order);
+    if (!order) die("out of memory");
+    for (size_t i = 0; i < b->n; i++) order[i] = &b->jobs[i];
+    qsort(order, b->n, sizeof *order, job_cmp_size);
+
+    if (verbosity >= 2)
+        fprintf(stderr, "%zu files on %d thread%s\n", b->n,
+                odz_pool_threads(pool), odz_pool_threads(pool) == 1 ? "" : "s");
+    for (size_t i = 0; i < b->n; i++)
+        odz_pool_submit(pool, batch_run, order[i]);
+    odz_pool_wait_all(pool);
+    free(order);
+
+    int failed = b->failed;
+    long long in_total = 0, out_total = 0;
+    size_t done = 0;
+    for (size_t i = 0; i < b->n; i++) {
+        batch_job_t *j = &b->jobs[i];
+        if (j->err) {
+            fprintf(stderr, "odz: %s: %s\n", j->in_path, j->err);
+            failed++;
+        } else {
+            done++;
+            in_total += j->in_size;
+            out_total += j->out_size;
+            if (verbosity >= 2)
+                fprintf(stderr, "  %s → %s  %lld → %lld bytes\n",
+                        j->in_path, j->out_path, j->in_size, j->out_size);
+        }
+        free(j->in_path);
+        free(j->out_path);
+    }
+    free(b->jobs);
+
+    if (verbosity >= 2)
+        fprintf(stderr, "  %zu files, %lld → %lld bytes, %d failed\n",
+                done, in_total, out_total, failed);
+    return failed ? 1 : 0;
+}
+
+/* "-B" argument: bytes, or with a K / M suffix */
+static uint32_t parse_block_size(const char *v) {
+    char *end;
+    unsigned long long n = strtoull(v, &end, 10);
+    if (end == v) return 0;
+    if (*end == 'K' || *end == 'k') { n <<= 10; end++; }
+    else if (*end == 'M' || *end == 'm') { n <<= 20; end++; }
+    if (*end || n < ODZ_BLOCK_SIZE_MIN || n > ODZ_BLOCK_SIZE_MAX) return 0;
+    return (uint32_t)n;
+}
+
+/* "--dedup=" window: bytes, or with a K / M / G / T suffix; 0 = no limit */
+static int parse_window(const char *v, uint64_t *window) {
+    char *end;
+    unsigned long long n = strtoull(v, &end, 10);
+    int shift = 0;
+    if (end == v) return -1;
+    if (*end && strchr("Kk", *end)) shift = 10;
+    else if (*end && strchr("Mm", *end)) shift = 20;
+    else if (*end && strchr("Gg", *end)) shift = 30;
+    else if (*end && strchr("Tt", *end)) shift = 40;
+    if (shift) end++;
+    if (*end || n > (UINT64_MAX >> shift)) return -1;
+    *window = (uint64_t)n << shift;
+    return 0;
+}
+
+/* "--filter=" argument: auto, none, x86, delta[:N], shuffle[:N] */
+static int parse_filter(const char *v, int *filter, int *width) {
+    static const struct { const char *name; int id; } names[] = {
+        { "none", ODZ_FILTER_NONE }, { "x86", ODZ_FILTER_X86 }, { "delta", ODZ_FILTER_DELTA },
+        { "shuffle", ODZ_FILTER_SHUFFLE }, { "auto", ODZ_FILTER_AUTO },
+    };
+    const char *colon = strchr(v, ':');
+    size_t len = colon ? (size_t)(colon - v) : strlen(v);
+    for (size_t i = 0; i < sizeof names / sizeof names[0]; i++) {
+        if (strlen(names[i].name) != len || strncmp(v, names[i].name, len) != 0) continue;
+        *filter = names[i].id;
+        *width = 0;
+        if (!colon) return 0;
+        if (*filter != ODZ_FILTER_DELTA && *filter != ODZ_FILTER_SHUFFLE) return -1;
+        char *end;
+        long n = strtol(colon + 1, &end, 10);
+        if (*end || end == colon + 1 || n < (*filter == ODZ_FILTER_DELTA ? 1 : 2) || n > 255) return -1;
+        *width = (int)n;
+        return 0;
+    }
+    return -1;
+}
+
+/* "--target-speed=" argument: MB/s, optionally ",cpu" */
+static int parse_target_speed(const char *v, double *speed, int *cpu) {
+    char *end;
+    double x = strtod(v, &end);
+    if (end == v || !(x > 0) || x > 1e6) return -1;
+    *cpu = 0;
+    if (strcmp(end, ",cpu") == 0) *cpu = 1;
+    else if (*end) return -1;
+    *speed = x;
+    return 0;
+}
+
+/* "--key-file=": the raw key, exactly ODZ_KEY_SIZE bytes (head -c32 /dev/urandom) */
+static int read_key_file(const char *path, uint8_t key[ODZ_KEY_SIZE]) {
+    FILE *f = fopen(path, "rb");
+    if (!f) return -1;
+    uint8_t extra;
+    int ok = fread(key, 1, ODZ_KEY_SIZE, f) == ODZ_KEY_SIZE && fread(&extra, 1, 1, f) == 0;
+    fclose(f);
+    return ok ? 0 : -1;
+}
+
+/* "--pass-file=": the first line, without its line ending */
+static char *read_pass_file(const char *path) {
+    FILE *f = fopen(path, "rb");
+    if (!f) return NULL;
+    char buf[1024];
+    char *line = fgets(buf, sizeof buf, f);
+    fclose(f);
+    if (!line) return NULL;
+    buf[strcspn(buf, "\r\n")] = '\0';
+    return buf[0] ? strdup(buf) : NULL;
+}
+
+/* ── Estimate (--estimate) ────────────────────────────────── */
+
+/* One line per file: predicted ratio and speed at level, without
+ * compressing.  Returns 1 if any file failed, as batch mode does. */
+static int estimate_main(const char **paths, int n, int level) {
+    int failed = 0;
+    for (int i = 0; i < n; i++) {
+        FILE *f = fopen(paths[i], "rb");
+        if (!f) {
+            fprintf(stderr, "odz: %s: cannot open input file\n", paths[i]);
+            failed = 1;
+            continue;
+        }
+        odz_estimate_t est;
+        int rc = odz_estimate_file(f, level, &est);
+        fclose(f);
+        if (rc != ODZ_OK) {
+            fprintf(stderr, "odz: %s: %s\n", paths[i], odz_strerror(rc));
+            failed = 1;
+            continue;
+        }
+        printf("%s: ratio %.2f (%.1f%%), ~%.1f MB/s at -%d, %.0f KB sampled\n", paths[i],
+               est.ratio, 100.0 / est.ratio, est.speed, level ? level : ODZ_LEVEL_DEFAULT,
+               (double)est.sampled / 1024.0);
+    }
+    return failed;
+}
+
+/* ── Inspect (odz inspect FILE) ───────────────────────────── */
+
+typedef struct {
+    int      json;
+    int      symbols;           /* -v2: each block's code lengths / counts */
+    uint64_t blocks;
+    uint64_t comp;              /* stream bytes, header included */
+    uint64_t count[ODZ_STATS_BLOCK_TYPES];
+    uint64_t raw_t[ODZ_STATS_BLOCK_TYPES];
+    uint64_t comp_t[ODZ_STATS_BLOCK_TYPES];
+} inspect_t;
+
+static double ratio(uint64_t raw, uint64_t comp) { return comp ? (double)raw / comp : 0.0; }
+
+/* Symbols a block's tables give a code: literals, lengths, distances */
+static void used_symbols(const odz_block_info_t *b, int *lit, int *len, int *dist) {
+    *lit = *len = *dist = 0;
+    for (int s = 0; s < 256; s++) *lit += b->litlen[s] != 0;
+    for (int s = 257; s < ODZ_INSPECT_LITLEN_SYMS; s++) *len += b->litlen[s] != 0;
+    for (int s = 0; s < ODZ_INSPECT_DIST_SYMS; s++) *dist += b->dist[s] != 0;
+}
+
+static void print_i16_array(FILE *f, const int16_t *a, int n) {
+    fputc('[', f);
+    for (int i = 0; i < n; i++)
+        fprintf(f, "%s%d", i ? "," : "", a[i]);
+    fputc(']', f);
+}
+
+static int inspect_block(const odz_stream_info_t *s, const odz_block_info_t *b, void *userdata) {
+    inspect_t *ins = userdata;
+    if (b->index == 0) {
+        ins->comp = s->header_size;
+        if (ins->json) {
+            printf("\"version\":%d,\"original_size\":%llu,\"block_size\":%u,\"patch\":%s,"
+                   "\"dedup\":%s,\"encrypted\":%s,", s->version, (unsigned long long)s->original_size,
+                   s->block_size, s->flags & 1 ? "true" : "false", s->flags & 2 ? "true" : "false",
+                   s->flags & 4 ? "true" : "false");
+            if (s->flags & 1)
+                printf("\"ref_size\":%llu,\"ref_crc32\":%u,", (unsigned long long)s->ref_size,
+                       s->ref_crc32);
+            if (s->flags & 2)
+                printf("\"dedup_window\":%llu,", (unsigned long long)s->dedup_window);
+            printf("\"blocks\":[");
+        } else {
+            printf("  odz v%d, %llu bytes in blocks of %u%s%s%s\n", s->version,
+                   (unsigned long long)s->original_size, s->block_size,
+                   s->flags & 1 ? ", patch" : "", s->flags & 2 ? ", dedup" : "",
+                   s->flags & 4 ? ", encrypted" : "");
+            printf("  %8s %14s %-8s %9s %9s %7s %6s  %-11s %s\n", "block", "offset", "type",
+                   "raw", "comp", "ratio", "tables", "lit/len/dst", "flags");
+        }
+    }
+    ins->blocks++;
+    ins->comp += b->comp_size;
+    ins->count[b->type]++;
+    ins->raw_t[b->type]  += b->raw_size;
+    ins->comp_t[b->type] += b->comp_size;
+
+    int lit, len, dist;
+    used_symbols(b, &lit, &len, &dist);
+    const char *type = odz_block_type_name(b->type);
+    int fse = strcmp(type, "fse") == 0, ref = strcmp(type, "dedup") == 0;
+    const char *filter = b->filter == ODZ_FILTER_X86 ? "x86" : b->filter == ODZ_FILTER_DELTA ? "delta"
+                       : b->filter == ODZ_FILTER_SHUFFLE ? "shuffle" : NULL;
+    if (ins->json) {
+        printf("%s{\"offset\":%llu,\"type\":\"%s\",\"raw\":%u,\"comp\":%llu,\"ratio\":%.4f",
+               b->index ? "," : "", (unsigned long long)b->offset, type, b->raw_size,
+               (unsigned long long)b->comp_size, ratio(b->raw_size, b->comp_size));
+        if (b->last) printf(",\"last\":true");
+        if (b->reuse_trees) printf(",\"reuse_trees\":true");
+        if (b->multistream) printf(",\"multistream\":true");
+        if (filter) printf(",\"filter\":\"%s\",\"filter_width\":%d", filter, b->filter_width);
+        if (ref) printf(",\"src\":%llu", (unsigned long long)b->src);
+        if (b->have_tables) {
+            printf(",\"tables\":{\"bytes\":%u,\"literals\":%d,\"lengths\":%d,\"distances\":%d",
+                   b->table_bytes, lit, len, dist);
+            if (fse) printf(",\"ll_log\":%d,\"dist_log\":%d", b->ll_log, b->dist_log);
+            if (ins->symbols) {
+                printf(",\"%s\":{\"litlen\":", fse ? "counts" : "code_lengths");
+                print_i16_array(stdout, b->litlen, ODZ_INSPECT_LITLEN_SYMS);
+                printf(",\"dist\":");
+                print_i16_array(stdout, b->dist, ODZ_INSPECT_DIST_SYMS);
+                printf("}");
+            }
+            printf("}");
+        }
+        printf("}");
+    } else {
+        char tables[16] = "-", syms[24] = "-";
+        if (b->have_tables) {
+            snprintf(tables, sizeof tables, "%u", b->table_bytes);
+            snprintf(syms, sizeof syms, "%d/%d/%d", lit, len, dist);
+        } else if (b->reuse_trees) {
+            snprintf(tables, sizeof tables, "reused");
+        }
+        printf("  %8llu %14llu %-8s %9u %9llu %7.2f %6s  %-11s", (unsigned long long)b->index,
+               (unsigned long long)b->offset, type, b->raw_size, (unsigned long long)b->comp_size,
+               ratio(b->raw_size, b->comp_size), tables, syms);
+        if (b->last) printf(" last");
+        if (b->multistream) printf(" multi");
+        if (filter) printf(" %s:%d", filter, b->filter_width);
+        if (ref) printf(" src=%llu", (unsigned long long)b->src);
+        printf("\n");
+    }
+    return 0;
+}
+
+/* Block by block listing of odz streams, from their headers.  Returns 1
+ * if any file failed, as batch mode does. */
+static int inspect_main(const char **paths, int n, int json) {
+    int failed = 0;
+    for (int i = 0; i < n; i++) {
+        FILE *f = fopen(paths[i], "rb");
+        if (!f) {
+            fprintf(stderr, "odz: %s: cannot open input file\n", paths[i]);
+            failed = 1;
+            continue;
+        }
+        inspect_t ins;
+        memset(&ins, 0, sizeof ins);
+        ins.json = json;
+        ins.symbols = verbosity >= 2;
+        if (json) printf("{\"file\":\"%s\",", paths[i]);
+        else printf("%s:\n", paths[i]);
+        int rc = odz_inspect(f, inspect_block, &ins);
+        fclose(f);
+
+        if (json) {
+            if (ins.blocks) printf("],\"comp_size\":%llu,\"totals\":{", (unsigned long long)ins.comp);
+            int first = 1;
+            for (int b = 0; ins.blocks && b < ODZ_STATS_BLOCK_TYPES; b++) {
+                if (!ins.count[b]) continue;
+                printf("%s\"%s\":{\"count\":%llu,\"raw\":%llu,\"comp\":%llu}", first ? "" : ",",
+                       odz_block_type_name(b), (unsigned long long)ins.count[b],
+                       (unsigned long long)ins.raw_t[b], (unsigned long long)ins.comp_t[b]);
+                first = 0;
+            }
+            if (ins.blocks) printf("}%s", rc != ODZ_OK ? "," : "");
+            if (rc != ODZ_OK) printf("\"error\":\"%s\"", odz_strerror(rc));
+            printf("}\n");
+        } else {
+            for (int b = 0; b < ODZ_STATS_BLOCK_TYPES; b++) {
+                if (!ins.count[b]) continue;
+                printf("  %-8s blocks: %llu  raw %llu → %llu bytes  (ratio %.2f)\n",
+                       odz_block_type_name(b), (unsigned long long)ins.count[b],
+                       (unsigned long long)ins.raw_t[b], (unsigned long long)ins.comp_t[b],
+                       ratio(ins.raw_t[b], ins.comp_t[b]));
+            }
+            if (ins.blocks)
+                printf("  %llu blocks, %llu bytes on disk\n", (unsigned long long)ins.blocks,
+                       (unsigned long long)ins.comp);
+        }
+        if (rc != ODZ_OK) {
+            fprintf(stderr, "odz: %s: %s\n", paths[i], odz_strerror(rc));
+            failed = 1;
+        }
+    }
+    return failed;
+}
+
+/* CPUs online, for -T0 and the batch default */
+static int cpu_count(void) {
+#ifndef _WIN32
+    long n = sysconf(_SC_NPROCESSORS_ONLN);
+    return n > 0 ? (int)n : 1;
+#else
+    return 1;
+#endif
 }
 
 static void usage(const char *prog) {
@@ -52,28 +702,81 @@ static void usage(const char *prog) {
         "  %s [options] <input>\n"
         "  %s [options] <input> <output>\n"
         "  %s [options] c <input> <output>\n"
-        "  %s [options] d <input> <output>\n\n"
+        "  %s [options] d <input> <output>\n"
+        "  %s [options] [-r] <input|dir>...   (batch)\n"
+        "  %s [--json] [-v2] inspect <file.odz>...   (list blocks, -v2: code tables)\n\n"
         "options:\n"
         "  -c              force compress\n"
         "  -d              force decompress\n"
         "  -o, --out FILE  output file\n"
         "  -f, --force     overwrite existing output\n"
+        "  --format=FMT    odz (default), gzip, zlib or deflate (raw)\n"
+        "  --io=MODE       threads (default: read-ahead/write-behind), uring, stdio\n"
+        "  --direct        bypass the page cache for input reads (O_DIRECT)\n"
+        "  --huge-pages    put the matcher tables and block buffers on 2 MB pages\n"
+        "  -r              batch: recurse into directories\n"
+        "  -T N            threads (0 = all CPUs; default: all in batch, else 1)\n"
+        "  -B SIZE         block size, 4K to 64M (default 1M; K/M suffix)\n"
+        "  -1 .. -9        level: faster .. smaller (default 6)\n"
+        "  --target-speed=MB/s[,cpu]  odz: adapt the level block by block to\n"
+        "                  compress MB/s (cpu: per CPU-second, a CPU budget)\n"
+        "  --filter=F      pre-LZ filter: auto, none (default), x86, delta[:N],\n"
+        "                  shuffle[:N] (N = width in bytes, default detected)\n"
+        "  --patch-from=OLD  compress against reference file OLD; decompress\n"
+        "                  needs the same OLD again\n"
+        "  --dedup[=WIN]   odz: store repeated content once, as references to where\n"
+        "                  it was first written, up to WIN back (K/M/G/T suffix;\n"
+        "                  default no limit, decompression reads its output back)\n"
+        "  --key-file=FILE odz: encrypt / decrypt with the 32-byte key in FILE\n"
+        "  --pass-file=FILE  odz: encrypt / decrypt with a passphrase, the first\n"
+        "                  line of FILE\n"
+        "  --pass-env=VAR  odz: the same, passphrase from environment variable VAR\n"
+        "  --estimate      predict ratio and speed at the level for each input,\n"
+        "                  from a sampled probe, without writing anything\n"
+        "  --json          inspect: print JSON, one object per file\n"
         "  -v0             silent\n"
         "  -v1             progress (default)\n"
         "  -v2             verbose (progress + summary)\n"
+        "  -v3             verbose + per-stage performance counters\n"
+        "  --stats[=json]  print performance counters (json: to stdout)\n"
         "  -h, --help      show this help\n\n"
         "Auto-detects mode from extension:\n"
-        "  file.txt     → compress  → file.txt.odz\n"
-        "  file.txt.odz → decompress → file.txt\n",
-        ODZ_FORMAT_VERSION, prog, prog, prog, prog);
+        "  file.txt     → compress  → file.txt.odz (.gz, .zz, .deflate)\n"
+        "  file.txt.odz → decompress → file.txt  (also .gz, .zz, .deflate)\n\n"
+        "Batch mode (-r, or more than two inputs) writes each output next to its\n"
+        "input and keeps going past errors.  Walking a directory compresses files\n"
+        "without a known extension, or with -d decompresses the ones with one.\n",
+        ODZ_FORMAT_VERSION, prog, prog, prog, prog, prog, prog);
 }
 
 int main(int argc, char **argv) {
     int force = 0;
     int mode = 0;   /* 0=auto, 'c'=compress, 'd'=decompress */
+    int stats = 0;  /* 0=off, 't'=text, 'j'=json */
+    int fmt = -1;   /* index into formats[], -1 = default / from extension */
+    int io = ODZ_IO_THREADS;
+    int io_direct = 0;
+    int huge_pages = 0;
+    int io_set = 0;
+    int recurse = 0;
+    int threads = -1;   /* -1 = default */
+    uint32_t block_size = 0;
+    int level = 0;
+    double target_speed = 0;
+    int target_cpu = 0;
+    const char *patch_path = NULL;
+    int dedup = 0;
+    uint64_t dedup_window = 0;
+    int estimate = 0;
+    int json = 0;
+    int filter = ODZ_FILTER_NONE, filter_width = 0;
+    uint8_t key[ODZ_KEY_SIZE];
+    int have_key = 0;
+    char *passphrase = NULL;
     const char *out_path = NULL;
-    const char *positionals[3];
+    const char **positionals = malloc((size_t)argc * sizeof *positionals);
     int npos = 0;
+    if (!positionals) die("out of memory");
 
     for (int i = 1; i < argc; i++) {
         char *a = argv[i];
@@ -91,6 +794,78 @@ int main(int argc, char **argv) {
             verbosity = 1;
         } else if (strcmp(a, "-v2") == 0) {
             verbosity = 2;
+        } else if (strcmp(a, "-v3") == 0) {
+            verbosity = 3;
+            if (!stats) stats = 't';
+        } else if (strcmp(a, "--stats") == 0) {
+            stats = 't';
+        } else if (strcmp(a, "--stats=json") == 0) {
+            stats = 'j';
+        } else if (strncmp(a, "--format=", 9) == 0) {
+            for (fmt = NFORMATS - 1; fmt >= 0; fmt--)
+                if (strcmp(a + 9, formats[fmt].name) == 0) break;
+            if (fmt < 0) { fprintf(stderr, "odz: unknown format: %s\n", a + 9); return 2; }
+        } else if (strcmp(a, "--io=stdio") == 0) {
+            io = ODZ_IO_STDIO; io_set = 1;
+        } else if (strcmp(a, "--io=threads") == 0) {
+            io = ODZ_IO_THREADS; io_set = 1;
+        } else if (strcmp(a, "--io=uring") == 0) {
+            io = ODZ_IO_URING; io_set = 1;
+        } else if (strcmp(a, "--direct") == 0) {
+            io_direct = 1;
+        } else if (strcmp(a, "--huge-pages") == 0) {
+            huge_pages = 1;
+        } else if (strcmp(a, "-r") == 0) {
+            recurse = 1;
+        } else if (strncmp(a, "-T", 2) == 0) {
+            const char *v = a[2] ? a + 2 : (++i < argc ? argv[i] : NULL);
+            char *end;
+            if (!v) die("missing argument for -T");
+            long n = strtol(v, &end, 10);
+            if (*end || end == v || n < 0 || n > 4096) die("bad thread count for -T");
+            threads = (int)n;
+        } else if (strncmp(a, "-B", 2) == 0) {
+            const char *v = a[2] ? a + 2 : (++i < argc ? argv[i] : NULL);
+            if (!v) die("missing argument for -B");
+            if (!(block_size = parse_block_size(v))) die("bad block size for -B (4K to 64M)");
+        } else if (a[0] == '-' && a[1] >= '1' && a[1] <= '9' && !a[2]) {
+            level = a[1] - '0';
+        } else if (strncmp(a, "--target-speed=", 15) == 0) {
+            if (parse_target_speed(a + 15, &target_speed, &target_cpu) != 0) {
+                fprintf(stderr, "odz: bad target speed: %s\n", a + 15);
+                return 2;
+            }
+        } else if (strncmp(a, "--filter=", 9) == 0) {
+            if (parse_filter(a + 9, &filter, &filter_width) != 0) {
+                fprintf(stderr, "odz: bad filter: %s\n", a + 9);
+                return 2;
+            }
+        } else if (strncmp(a, "--patch-from=", 13) == 0) {
+            patch_path = a + 13;
+            if (!*patch_path) die("missing file for --patch-from");
+        } else if (strcmp(a, "--dedup") == 0) {
+            dedup = 1;
+        } else if (strncmp(a, "--dedup=", 8) == 0) {
+            if (parse_window(a + 8, &dedup_window) != 0) {
+                fprintf(stderr, "odz: bad dedup window: %s\n", a + 8);
+                return 2;
+            }
+            dedup = 1;
+        } else if (strncmp(a, "--key-file=", 11) == 0) {
+            if (read_key_file(a + 11, key) != 0) die("--key-file needs a file of exactly 32 bytes");
+            have_key = 1;
+        } else if (strncmp(a, "--pass-file=", 12) == 0) {
+            free(passphrase);
+            if (!(passphrase = read_pass_file(a + 12))) die("cannot read passphrase from --pass-file");
+        } else if (strncmp(a, "--pass-env=", 11) == 0) {
+            const char *v = getenv(a + 11);
+            if (!v || !*v) die("--pass-env: variable unset or empty");
+            free(passphrase);
+            if (!(passphrase = strdup(v))) die("out of memory");
+        } else if (strcmp(a, "--estimate") == 0) {
+            estimate = 1;
+        } else if (strcmp(a, "--json") == 0) {
+            json = 1;
         } else if (strcmp(a, "-o") == 0 || strcmp(a, "--out") == 0) {
             if (++i >= argc) die("missing argument for -o");
             out_path = argv[i];
@@ -98,17 +873,73 @@ int main(int argc, char **argv) {
             fprintf(stderr, "odz: unknown option: %s\n", a);
             usage(argv[0]); return 2;
         } else {
-            if (npos >= 3) { usage(argv[0]); return 2; }
             positionals[npos++] = a;
         }
     }
+    if (threads == 0) threads = cpu_count();
+    if (have_key && passphrase) die("give a key file or a passphrase, not both");
+
+    if (estimate) {
+        if (npos == 0) { usage(argv[0]); return 2; }
+        int rc = estimate_main(positionals, npos, level);
+        free(positionals);
+        return rc;
+    }
+
+    if (npos >= 2 && strcmp(positionals[0], "inspect") == 0) {
+        int rc = inspect_main(positionals + 1, npos - 1, json);
+        free(positionals);
+        return rc;
+    }
+
+    /* Legacy: "c <in> <out>" / "d <in> <out>" */
+    int legacy = !recurse && npos >= 1 && npos <= 3 && strlen(positionals[0]) == 1 &&
+                 (positionals[0][0] == 'c' || positionals[0][0] == 'd');
+
+    /* Batch: every positional is an input */
+    if (recurse || (npos > 2 && !legacy)) {
+        if (npos == 0) { usage(argv[0]); return 2; }
+        if (out_path) die("-o cannot be used with several inputs");
+        if (stats) die("--stats is per file and not available in batch mode");
+        if (patch_path) die("--patch-from is per file and not available in batch mode");
+        if (target_speed > 0 && !target_cpu)
+            die("files share the threads in batch mode: use --target-speed=N,cpu");
+        odz_pool_t *pool = odz_pool_create(threads < 0 ? cpu_count() : threads);
+        batch_t b = {
+            .mode  = mode,
+            .fmt   = fmt,
+            .force = force,
+            .opts  = {
+                .io        = io_set ? io : ODZ_IO_STDIO,
+                .io_direct = io_direct,
+                .huge_pages = huge_pages,
+                .pool      = pool,
+                .block_size = block_size,
+                .filter    = filter,
+                .filter_width = filter_width,
+                .level     = level,
+                .target_speed = target_speed,
+                .target_cpu = target_cpu,
+                .dedup     = dedup,
+                .dedup_window = dedup_window,
+                .key       = have_key ? key : NULL,
+                .passphrase = passphrase
+            }
+        };
+        for (int i = 0; i < npos; i++)
+            batch_collect(&b, positionals[i], recurse, 0);
+        free(positionals);
+        int rc = batch_main(&b, pool);
+        odz_pool_destroy(pool);
+        free(passphrase);
+        return rc;
+    }
+    if (npos > 3) { usage(argv[0]); return 2; }
 
     /* Parse positional arguments */
     const char *in_path = NULL;
 
-    /* Legacy: "c <in> <out>" / "d <in> <out>" */
-    if (npos >= 1 && strlen(positionals[0]) == 1 &&
-        (positionals[0][0] == 'c' || positionals[0][0] == 'd')) {
+    if (legacy) {
         mode = positionals[0][0];
         if (npos >= 2) in_path = positionals[1];
         if (npos >= 3 && !out_path) out_path = positionals[2];
@@ -116,28 +947,21 @@ int main(int argc, char **argv) {
         if (npos >= 1) in_path = positionals[0];
         if (npos >= 2 && !out_path) out_path = positionals[1];
     }
+    free(positionals);
 
     if (!in_path) { usage(argv[0]); return 2; }
 
     /* Auto-detect mode from extension */
+    int in_ext = find_ext(in_path);
     if (mode == 0)
-        mode = ends_with_odz(in_path) ? 'd' : 'c';
+        mode = in_ext >= 0 ? 'd' : 'c';
+
+    int format = pick_format(mode, fmt, in_ext);
 
     /* Auto-generate output path in current directory */
     char auto_out[4096];
     if (!out_path) {
-        const char *base = base_name(in_path);
-        if (mode == 'c') {
-            snprintf(auto_out, sizeof(auto_out), "%s.odz", base);
-        } else {
-            if (ends_with_odz(base)) {
-                size_t len = strlen(base) - 4;
-                memcpy(auto_out, base, len);
-                auto_out[len] = '\0';
-            } else {
-                snprintf(auto_out, sizeof(auto_out), "%s.raw", base);
-            }
-        }
+        auto_output(auto_out, sizeof auto_out, base_name(in_path), mode, fmt);
         out_path = auto_out;
     }
 
@@ -150,12 +974,36 @@ int main(int argc, char **argv) {
     FILE *fin = fopen(in_path, "rb");
     if (!fin) die("cannot open input file");
 
-    FILE *fout = fopen(out_path, "wb");
-    if (!fout) { fclose(fin); die("cannot open output file"); }
+    FILE *fref = NULL;
+    if (patch_path && !(fref = fopen(patch_path, "rb"))) { fclose(fin); die("cannot open patch reference"); }
+
+    FILE *fout = fopen(out_path, mode == 'c' ? "wb" : "w+b");   /* dedup reads back */
+    if (!fout) { fclose(fin); if (fref) fclose(fref); die("cannot open output file"); }
 
+    /* -T N > 1: compress the blocks of this one file in parallel */
+    odz_pool_t *pool = threads > 1 ? odz_pool_create(threads) : NULL;
+
+    odz_stats_t st;
     odz_options_t opts = {
         .progress = (verbosity >= 1) ? progress_cb : NULL,
-        .userdata = NULL
+        .userdata = NULL,
+        .stats    = stats ? &st : NULL,
+        .format   = format,
+        .io       = io,
+        .io_direct = io_direct,
+        .huge_pages = huge_pages,
+        .pool     = pool,
+        .block_size = block_size,
+        .patch_from = fref,
+        .filter   = filter,
+        .filter_width = filter_width,
+        .level    = level,
+        .target_speed = target_speed,
+        .target_cpu = target_cpu,
+        .dedup    = dedup,
+        .dedup_window = dedup_window,
+        .key      = have_key ? key : NULL,
+        .passphrase = passphrase
     };
 
     if (verbosity >= 2)
@@ -167,6 +1015,9 @@ int main(int argc, char **argv) {
         rc = odz_compress(fin, fout, &opts);
     else
         rc = odz_decompress(fin, fout, &opts);
+    odz_pool_destroy(pool);
+    if (fref) fclose(fref);
+    free(passphrase);
 
     if (verbosity >= 1)
         fprintf(stderr, "\n");
@@ -191,6 +1042,11 @@ int main(int argc, char **argv) {
             fprintf(stderr, "  %ld → %ld bytes\n", in_size, out_size);
     }
 
+    if (stats == 't')
+        print_stats_text(&st, mode);
+    else if (stats == 'j')
+        print_stats_json(&st, mode, in_path, out_path);
+
     fclose(fin);
     fclose(fout);
     return 0;
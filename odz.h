@@ -3,19 +3,204 @@
 #include <stdint.h>
 #include <stddef.h>
 #include <stdio.h>
+#include <string.h>
 
 /* ── Format constants ──────────────────────────────────────── */
-#define ODZ_VERSION     2
+#define ODZ_VERSION     5
+#define ODZ_VERSION_MIN 2           /* oldest stream version we still decode */
 #define ODZ_WINDOW      32768u      /* max back-reference distance */
 #define ODZ_MIN_MATCH   3
 #define ODZ_MAX_MATCH   258
-#define ODZ_BLOCK_SIZE  (1u << 20)  /* 1 MB blocks for streaming */
+#define ODZ_BLOCK_SIZE  (1u << 20)  /* default block size; v2/v3 streams always use it */
 
-/* Block types (bits 1-2 of block_flags) */
+/* v5 changed the token format only (repeat offsets, 6-bit HDIST); the
+ * header is laid out as in v4. */
+
+/* Stream header: "ODZ" version(1) original_size(8), then from v4
+ * block_size(4) stream_flags(1).  Stream flags announce optional header
+ * fields that follow; unknown ones are rejected. */
+#define ODZ_HEADER_SIZE_V3    12
+#define ODZ_HEADER_SIZE       17
+#define ODZ_STREAM_PATCH      0x01  /* + ref_size(8) ref_crc32(4) */
+#define ODZ_STREAM_DEDUP      0x02  /* + dedup_window(8), after the patch fields */
+#define ODZ_STREAM_ENCRYPTED  0x04  /* + kdf(1) kdf_param(1) salt(16) check(16), last;
+                                     * every block is followed by its tag(16) */
+#define ODZ_STREAM_FLAGS_KNOWN (ODZ_STREAM_PATCH | ODZ_STREAM_DEDUP | ODZ_STREAM_ENCRYPTED)
+#define ODZ_CRYPT_FIELDS      34
+#define ODZ_HEADER_SIZE_MAX   (ODZ_HEADER_SIZE + 12 + 8 + ODZ_CRYPT_FIELDS)
+
+/* Patch mode: matches may copy from a reference file, either continuing
+ * where the block's previous reference match ended (DIST_REF_NEXT, reset
+ * to 0 at each block) or from an explicit position (DIST_REF_POS).  The
+ * position follows the distance symbol in odz_ref_bits(ref size) bits,
+ * written ODZ_REF_PIECE bits at a time, low piece first. */
+#define ODZ_REF_PIECE 15
+
+static inline int odz_ref_bits(uint64_t ref_size) {
+    int b = 1;
+    while (b < 64 && (ref_size - 1) >> b) b++;
+    return b;
+}
+
+/* Repeat offsets (v5): the last DIST_REPS window distances, most recent
+ * first, starting from ODZ_REP_INIT at each block.  Symbol DIST_REP0 + k
+ * reuses rep[k] and moves it to the front; any other window distance is
+ * pushed on the front.  Reference matches leave them alone. */
+#define ODZ_REP_INIT { 1, 4, 8 }
+
+static inline void odz_rep_use(uint32_t *rep, int k, uint32_t dist) {
+    for (; k > 0; k--) rep[k] = rep[k - 1];
+    rep[0] = dist;
+}
+
+/* Block types (bits 1-3 of block_flags; bit 3 is set only from v5) */
 #define ODZ_BLOCK_STORED    0
 #define ODZ_BLOCK_HUFFMAN   1
+#define ODZ_BLOCK_FSE       2   /* v3+: same tokens, tANS-coded */
+#define ODZ_BLOCK_REF       3   /* dedup streams: src(8) replaces comp_size and data;
+                                 * raw_size bytes copied from output offset src */
+#define ODZ_BLOCK_BWT       4   /* v5: Burrows-Wheeler coded (odz_bwt.h), header as
+                                 * Huffman; raw_size at most ODZ_BWT_MAX */
+
+/* Dedup streams (ODZ_STREAM_DEDUP): a REF block repeats output already
+ * written, at most dedup_window bytes back (0 = anywhere before it). */
+#define ODZ_REF_BLOCK_HEADER 13
+
+#define ODZ_BLOCK_LAST        0x01
+#define ODZ_BLOCK_TYPE(f)     (((f) >> 1) & 7)
+
+/* Block flags (v3+, high bits of block_flags; unknown bits are rejected) */
+#define ODZ_BLOCK_REUSE_TREES 0x80  /* Huffman: no trees, reuse the previous block's */
+#define ODZ_BLOCK_MULTISTREAM 0x40  /* Huffman: tokens split over ODZ_HUFF_STREAMS streams */
+#define ODZ_BLOCK_FILTERED    0x20  /* Huffman / FSE / BWT: filter id(1) width(1) follow
+                                     * comp_size; the block decodes to the filtered bytes */
+#define ODZ_BLOCK_FLAGS_KNOWN (ODZ_BLOCK_LAST | (7 << 1) | ODZ_BLOCK_REUSE_TREES | \
+                               ODZ_BLOCK_MULTISTREAM | ODZ_BLOCK_FILTERED)
+
+#define ODZ_HUFF_STREAMS      4
+#define ODZ_MULTISTREAM_MIN   4096  /* tokens; below this the jump table isn't worth it */
+
+/* Loop unrolling hint, where the compiler takes one */
+#define ODZ_PRAGMA(x) _Pragma(#x)
+#if defined(__clang__)
+#define ODZ_UNROLL(n) ODZ_PRAGMA(unroll n)
+#elif defined(__GNUC__)
+#define ODZ_UNROLL(n) ODZ_PRAGMA(GCC unroll n)
+#else
+#define ODZ_UNROLL(n)
+#endif
+
+/* ── Decoding helpers ──────────────────────────────────────── */
+
+/* LZ77 match copy: dst[0..length) = dst[-dist..-dist+length), where the
+ * source may overlap the destination (dist < length repeats a pattern). */
+static inline void odz_copy_match(uint8_t *dst, size_t dist, size_t length) {
+    const uint8_t *s = dst - dist;
+    if (dist >= length) {
+        /* Non-overlapping: straight memcpy */
+        memcpy(dst, s, length);
+    } else if (dist == 1) {
+        /* Byte fill (very common for runs) */
+        memset(dst, s[0], length);
+    } else {
+        /* Overlapping: copy in dist-sized chunks */
+        size_t rem = length;
+        while (rem >= dist) {
+            memcpy(dst, s, dist);
+            dst += dist;
+            rem -= dist;
+        }
+        if (rem > 0) memcpy(dst, s, rem);
+    }
+}
+
+/* ── Literal-only probe (compress.c) ───────────────────────── */
+/* Whether matching in[0..n) is worth it, or the block should be coded
+ * from its byte histogram alone; odz_estimate models the same choice */
+int odz_lz_pays(const uint8_t *in, size_t n);
+
+/* ── Checksums (checksum.c) ────────────────────────────────── */
+uint32_t odz_crc32(uint32_t crc, const uint8_t *p, size_t n);      /* gzip; start with 0 */
+uint32_t odz_adler32(uint32_t adler, const uint8_t *p, size_t n);  /* zlib; start with 1 */
+
+#define ODZ_SHA256_SIZE 32
+
+typedef struct {
+    uint32_t h[8];
+    uint64_t len;
+    uint8_t  buf[64];
+} odz_sha256_t;
+
+void odz_sha256_init(odz_sha256_t *s);
+void odz_sha256_update(odz_sha256_t *s, const uint8_t *p, size_t n);
+void odz_sha256_final(odz_sha256_t *s, uint8_t out[ODZ_SHA256_SIZE]);
+void odz_sha256(const uint8_t *p, size_t n, uint8_t out[ODZ_SHA256_SIZE]);
+
+/* ── Encryption (odz_crypt.c) ──────────────────────────────── */
+
+#define ODZ_CRYPT_KEY    32
+#define ODZ_CRYPT_SALT   16
+#define ODZ_CRYPT_TAG    16
+#define ODZ_CRYPT_HEADER UINT64_MAX     /* nonce index of the header's check tag */
+
+typedef struct {
+    uint8_t key[ODZ_CRYPT_KEY];         /* this stream's, from the KDF */
+} odz_crypt_t;
+
+struct odz_options;
+/* Whether opts asks for an encrypted stream (a key or a passphrase) */
+int  odz_crypt_wanted(const struct odz_options *opts);
+/* Writer: draw a salt into the header fields, check tag zeroed, and
+ * derive the stream key.  ODZ_ERR_IO if no random bytes are to be had. */
+int  odz_crypt_begin(odz_crypt_t *c, const struct odz_options *opts, uint8_t fields[ODZ_CRYPT_FIELDS]);
+/* Fill in the check tag: the last ODZ_CRYPT_TAG bytes of the n-byte header */
+void odz_crypt_seal_header(const odz_crypt_t *c, uint8_t *hdr, size_t n);
+/* Reader: derive the key from the n-byte header, which ends with the
+ * fields, and verify its check tag.  ODZ_ERR_KEY without the matching
+ * key or passphrase, ODZ_ERR_FORMAT for an unknown KDF. */
+int  odz_crypt_read(odz_crypt_t *c, const struct odz_options *opts, const uint8_t *hdr, size_t n);
+
+/* Block index as nonce, ad authenticated alongside; p is encrypted or
+ * decrypted in place.  open returns -1, leaving p as it was, if the tag
+ * does not match. */
+void odz_crypt_seal(const odz_crypt_t *c, uint64_t index, const uint8_t *ad, size_t nad,
+                    uint8_t *p, size_t n, uint8_t tag[ODZ_CRYPT_TAG]);
+int  odz_crypt_open(const odz_crypt_t *c, uint64_t index, const uint8_t *ad, size_t nad,
+                    uint8_t *p, size_t n, const uint8_t tag[ODZ_CRYPT_TAG]);
+/* Zero key material (not optimised away) */
+void odz_crypt_wipe(void *p, size_t n);
+
+/* ── Memory (odz_mem.c) ────────────────────────────────────── */
+
+/* Where one odz_compress / odz_decompress call gets its memory: the
+ * caller's hooks (odz_options_t.alloc_fn / free_fn) or malloc, and
+ * whether big buffers go on huge pages.  A NULL odz_mem_t * means malloc.
+ * Frees pass the size allocated, for the hooks' accounting. */
+typedef struct odz_mem {
+    void *(*alloc)(void *userdata, size_t size);
+    void  (*free)(void *userdata, void *ptr, size_t size);
+    void  *userdata;
+    int    huge;
+} odz_mem_t;
+
+/* From odz_options_t (NULL: malloc, no huge pages); ODZ_ERR_FORMAT if
+ * only one of the hooks is set */
+int   odz_mem_from(odz_mem_t *mem, const struct odz_options *opts);
+
+void *odz_alloc(const odz_mem_t *mem, size_t n);
+void  odz_free(const odz_mem_t *mem, void *p, size_t n);
+/* Grow or shrink p from old to n bytes; on failure p is left as it was */
+void *odz_realloc(const odz_mem_t *mem, void *p, size_t old, size_t n);
+
+/* Work buffers of a block or more (matcher tables, tokens, block data):
+ * with mem->huge, 2 MB aligned and backed by huge pages where the system
+ * has them, else as odz_alloc.  Free with odz_free_big and the same n. */
+void *odz_alloc_big(const odz_mem_t *mem, size_t n);
+void  odz_free_big(const odz_mem_t *mem, void *p, size_t n);
 
 /* ── Utilities ─────────────────────────────────────────────── */
+uint64_t odz_now_ns(void);   /* monotonic clock, for odz_stats_t */
+uint64_t odz_cpu_ns(void);   /* CPU time of the calling thread */
 void     wr_u32le(uint8_t *dst, uint32_t x);
 uint32_t rd_u32le(const uint8_t *src);
 void     wr_u64le(uint8_t *dst, uint64_t x);
@@ -0,0 +1,657 @@
+/*
+ * odz_bench — end-to-end throughput / ratio benchmark
+ *
+ * Compresses and decompresses each corpus at each setting through the
+ * public odz_compress / odz_decompress API (memory-backed FILE streams),
+ * verifies the roundtrip, and reports MB/s, ratio and peak RSS.
+ *
+ * Corpora are either generated deterministically (text, logs, binary,
+ * random, zeros, mixed) or read from every regular file in a directory.
+ *
+ * With --baseline, results are compared against a previous --json run
+ * and regressions (slower than the threshold, or larger output) are
+ * flagged; the exit status is then nonzero so release jobs can gate on it.
+ *
+ * With --calibrate, each corpus is run through odz_estimate and a real
+ * compression at every level instead, and the estimate's error reported.
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <time.h>
+#include <dirent.h>
+#include <sys/stat.h>
+#include <sys/resource.h>
+
+#include "libodzip.h"
+
+#define DEFAULT_SIZE   (8u << 20)
+#define DEFAULT_REPS   5
+#define DEFAULT_WARMUP 1
+#define MAX_CORPORA    256
+#define MAX_RESULTS    4096
+
+static void die(const char *m) { fprintf(stderr, "odz_bench: error: %s\n", m); exit(1); }
+
+/* ── Settings ──────────────────────────────────────────────── */
+
+typedef struct {
+    const char   *name;
+    odz_options_t opts;
+} bench_setting_t;
+
+static const bench_setting_t settings[] = {
+    { "default", { .progress = NULL, .userdata = NULL } },
+    { "level1",  { .progress = NULL, .userdata = NULL, .level = 1 } },
+    { "gzip",    { .progress = NULL, .userdata = NULL, .format = ODZ_FORMAT_GZIP } },
+};
+#define NSETTINGS (sizeof(settings) / sizeof(settings[0]))
+
+/* ── Deterministic synthetic corpora ───────────────────────── */
+
+typedef struct {
+    char    *name;
+    uint8_t *data;
+    size_t   size;
+} corpus_t;
+
+static uint64_t rng_state;
+
+static uint64_t rng_next(void) {
+    /* xorshift64* */
+    rng_state ^= rng_state >> 12;
+    rng_state ^= rng_state << 25;
+    rng_state ^= rng_state >> 27;
+    return rng_state * 2685821657736338717ull;
+}
+
+static uint32_t rng_below(uint32_t n) { return (uint32_t)((rng_next() >> 32) % n); }
+
+/* Skewed pick: small indices are much more likely (rough Zipf) */
+static uint32_t rng_zipf(uint32_t n) {
+    uint32_t a = rng_below(n), b = rng_below(n);
+    return (a * b) / n;
+}
+
+static const char *words[] = {
+    "the", "of", "and", "to", "in", "a", "is", "that", "for", "it",
+    "as", "was", "with", "be", "by", "on", "not", "he", "this", "are",
+    "or", "his", "from", "at", "which", "but", "have", "an", "they", "you",
+    "were", "their", "one", "all", "we", "can", "her", "has", "there", "been",
+    "compression", "block", "window", "stream", "symbol", "distance", "length",
+    "frequency", "table", "decoder", "encoder", "buffer", "archive", "format",
+    "history", "literal", "matcher", "chain", "entropy", "alphabet", "header",
+};
+#define NWORDS (sizeof(words) / sizeof(words[0]))
+
+static size_t put_str(uint8_t *dst, size_t pos, size_t cap, const char *s) {
+    while (*s && pos < cap) dst[pos++] = (uint8_t)*s++;
+    return pos;
+}
+
+static void gen_text(uint8_t *d, size_t n) {
+    size_t p = 0;
+    int sentence = 0;
+    while (p < n) {
+        const char *w = words[rng_zipf(NWORDS)];
+        if (sentence == 0 && p < n) {
+            d[p++] = (uint8_t)(w[0] - 'a' + 'A');
+            w++;
+        }
+        p = put_str(d, p, n, w);
+        sentence++;
+        if (sentence > 6 && rng_below(8) == 0) {
+            p = put_str(d, p, n, rng_below(6) == 0 ? ".\n" : ". ");
+            sentence = 0;
+        } else {
+            p = put_str(d, p, n, rng_below(12) == 0 ? ", " : " ");
+        }
+    }
+}
+
+static void gen_logs(uint8_t *d, size_t n) {
+    static const char *levels[] = { "INFO", "INFO", "INFO", "DEBUG", "WARN", "ERROR" };
+    static const char *paths[] = {
+        "/api/v1/users", "/api/v1/orders", "/static/app.js", "/health",
+        "/api/v1/search", "/login", "/static/style.css", "/api/v2/metrics",
+    };
+    static const int codes[] = { 200, 200, 200, 200, 304, 404, 500, 201 };
+    size_t p = 0;
+    uint64_t ts = 1700000000000ull;
+    char line[256];
+    while (p < n) {
+        ts += rng_below(50);
+        int len = snprintf(line, sizeof line,
+            "%llu.%03llu [%s] 10.%u.%u.%u \"GET %s?id=%u\" %d %uus req=%08x\n",
+            (unsigned long long)(ts / 1000), (unsigned long long)(ts % 1000),
+            levels[rng_zipf(6)], rng_below(4), rng_below(256), rng_below(256),
+            paths[rng_zipf(8)], rng_below(100000), codes[rng_zipf(8)],
+            100 + rng_zipf(20000), (unsigned)rng_next());
+        for (int i = 0; i < len && p < n; i++) d[p++] = (uint8_t)line[i];
+    }
+}
+
+/* Fixed-width little-endian records: counters, small ints, floats */
+static void gen_binary(uint8_t *d, size_t n) {
+    uint32_t seq = 0;
+    float level = 100.0f;
+    size_t p = 0;
+    while (p < n) {
+        uint8_t rec[16];
+        seq++;
+        level += (float)((int)rng_below(201) - 100) / 1000.0f;
+        uint32_t id = rng_zipf(64);
+        uint32_t val = 1000 + rng_below(16);
+        memcpy(rec, &seq, 4);
+        memcpy(rec + 4, &id, 4);
+        memcpy(rec + 8, &val, 4);
+        memcpy(rec + 12, &level, 4);
+        for (int i = 0; i < 16 && p < n; i++) d[p++] = rec[i];
+    }
+}
+
+static void gen_random(uint8_t *d, size_t n) {
+    for (size_t p = 0; p < n; p++) d[p] = (uint8_t)(rng_next() >> 56);
+}
+
+static void gen_zeros(uint8_t *d, size_t n) {
+    memset(d, 0, n);
+}
+
+static void gen_mixed(uint8_t *d, size_t n) {
+    void (*gens[])(uint8_t *, size_t) = { gen_text, gen_logs, gen_binary, gen_random, gen_zeros };
+    const size_t seg = 64 * 1024;
+    for (size_t p = 0, k = 0; p < n; p += seg, k++) {
+        size_t len = n - p < seg ? n - p : seg;
+        gens[k % 5](d + p, len);
+    }
+}
+
+static int add_synthetic(corpus_t *c, size_t size) {
+    static const struct {
+        const char *name;
+        void (*gen)(uint8_t *, size_t);
+    } gens[] = {
+        { "text",   gen_text },
+        { "logs",   gen_logs },
+        { "binary", gen_binary },
+        { "random", gen_random },
+        { "zeros",  gen_zeros },
+        { "mixed",  gen_mixed },
+    };
+    int n = (int)(sizeof(gens) / sizeof(gens[0]));
+    for (int i = 0; i < n; i++) {
+        c[i].name = strdup(gens[i].name);
+        c[i].data = malloc(size);
+        c[i].size = size;
+        if (!c[i].name || !c[i].data) die("out of memory");
+        rng_state = 0x9E3779B97F4A7C15ull + (uint64_t)i;
+        gens[i].gen(c[i].data, size);
+    }
+    return n;
+}
+
+static int add_directory(corpus_t *c, const char *dir) {
+    DIR *dp = opendir(dir);
+    if (!dp) die("cannot open corpus directory");
+    int n = 0;
+    struct dirent *de;
+    while ((de = readdir(dp)) != NULL && n < MAX_CORPORA) {
+        char path[4096];
+        snprintf(path, sizeof path, "%s/%s", dir, de->d_name);
+        struct stat st;
+        if (stat(path, &st) != 0 || !S_ISREG(st.st_mode) || st.st_size == 0) continue;
+
+        FILE *f = fopen(path, "rb");
+        if (!f) continue;
+        uint8_t *buf = malloc((size_t)st.st_size);
+        if (!buf) die("out of memory");
+        size_t got = fread(buf, 1, (size_t)st.st_size, f);
+        fclose(f);
+
+        c[n].name = strdup(de->d_name);
+        c[n].data = buf;
+        c[n].size = got;
+        if (!c[n].name) die("out of memory");
+        n++;
+    }
+    closedir(dp);
+    if (n == 0) die("no regular files in corpus directory");
+    return n;
+}
+
+/* ── Timing / memory ───────────────────────────────────────── */
+
+static double now_sec(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec * 1e-9;
+}
+
+/* Reset the peak-RSS watermark so each measurement is independent.
+ * Linux only; elsewhere the process-lifetime peak is reported. */
+static void rss_reset_peak(void) {
+    FILE *f = fopen("/proc/self/clear_refs", "w");
+    if (!f) return;
+    fputs("5", f);
+    fclose(f);
+}
+
+static long rss_peak_kb(void) {
+    FILE *f = fopen("/proc/self/status", "r");
+    if (f) {
+        char line[256];
+        long kb = -1;
+        while (fgets(line, sizeof line, f))
+            if (sscanf(line, "VmHWM: %ld kB", &kb) == 1) break;
+        fclose(f);
+        if (kb >= 0) return kb;
+    }
+    struct rusage ru;
+    getrusage(RUSAGE_SELF, &ru);
+#ifdef __APPLE__
+    return ru.ru_maxrss / 1024;
+#else
+    return ru.ru_maxrss;
+#endif
+}
+
+/* ── One measurement ───────────────────────────────────────── */
+
+typedef struct {
+    const char *corpus;
+    const char *setting;
+    uint64_t    bytes;
+    uint64_t    comp_bytes;
+    double      ratio;       /* original / compressed */
+    double      comp_mbs;
+    double      decomp_mbs;
+    long        peak_rss_kb;
+} result_t;
+
+static int run_compress(const corpus_t *c, const odz_options_t *opts,
+                        uint8_t *cbuf, size_t ccap, size_t *csize) {
+    FILE *in  = fmemopen(c->data, c->size, "rb");
+    FILE *out = fmemopen(cbuf, ccap, "w+b");
+    if (!in || !out) die("fmemopen failed");
+    int rc = odz_compress(in, out, opts);
+    fflush(out);
+    *csize = (size_t)ftello(out);
+    fclose(in);
+    fclose(out);
+    return rc;
+}
+
+static int run_decompress(const uint8_t *cbuf, size_t csize, const odz_options_t *opts,
+                          uint8_t *dbuf, size_t dcap, size_t *dsize) {
+    FILE *in  = fmemopen((void *)cbuf, csize, "rb");
+    FILE *out = fmemopen(dbuf, dcap, "w+b");
+    if (!in || !out) die("fmemopen failed");
+    int rc = odz_decompress(in, out, opts);
+    fflush(out);
+    *dsize = (size_t)ftello(out);
+    fclose(in);
+    fclose(out);
+    return rc;
+}
+
+static int bench_one(const corpus_t *c, const bench_setting_t *s,
+                     int warmup, int reps, result_t *r) {
+    size_t ccap = c->size + c->size / 8 + 65536;
+    size_t dcap = c->size + 1;
+    uint8_t *cbuf = malloc(ccap);
+    uint8_t *dbuf = malloc(dcap);
+    if (!cbuf || !dbuf) die("out of memory");
+    memset(cbuf, 0, ccap);
+    memset(dbuf, 0, dcap);
+
+    size_t csize = 0, dsize = 0;
+    double best_c = 1e30, best_d = 1e30;
+    long peak = 0;
+
+    for (int k = 0; k < warmup + reps; k++) {
+        rss_reset_peak();
+        double t0 = now_sec();
+        int rc = run_compress(c, &s->opts, cbuf, ccap, &csize);
+        double t1 = now_sec();
+        if (rc != ODZ_OK) {
+            fprintf(stderr, "odz_bench: %s/%s: compress: %s\n", c->name, s->name, odz_strerror(rc));
+            free(cbuf); free(dbuf);
+            return -1;
+        }
+        rc = run_decompress(cbuf, csize, &s->opts, dbuf, dcap, &dsize);
+        double t2 = now_sec();
+        if (rc != ODZ_OK) {
+            fprintf(stderr, "odz_bench: %s/%s: decompress: %s\n", c->name, s->name, odz_strerror(rc));
+            free(cbuf); free(dbuf);
+            return -1;
+        }
+        if (dsize != c->size || memcmp(dbuf, c->data, c->size) != 0) {
+            fprintf(stderr, "odz_bench: %s/%s: roundtrip mismatch\n", c->name, s->name);
+            free(cbuf); free(dbuf);
+            return -1;
+        }
+        long kb = rss_peak_kb();
+        if (kb > peak) peak = kb;
+        if (k < warmup) continue;
+        if (t1 - t0 < best_c) best_c = t1 - t0;
+        if (t2 - t1 < best_d) best_d = t2 - t1;
+    }
+
+    double mb = (double)c->size / 1e6;
+    r->corpus      = c->name;
+    r->setting     = s->name;
+    r->bytes       = c->size;
+    r->comp_bytes  = csize;
+    r->ratio       = csize > 0 ? (double)c->size / (double)csize : 0.0;
+    r->comp_mbs    = best_c > 0 ? mb / best_c : 0.0;
+    r->decomp_mbs  = best_d > 0 ? mb / best_d : 0.0;
+    r->peak_rss_kb = peak;
+
+    free(cbuf);
+    free(dbuf);
+    return 0;
+}
+
+/* ── Estimate calibration ──────────────────────────────────── */
+
+typedef struct {
+    double sum_ratio_err, sum_speed_err;
+    double min_gain;            /* estimate speed / compression speed */
+    int    n;
+} calib_t;
+
+/* Estimate vs real compression of one corpus at one level, best of reps */
+static void calibrate_one(const corpus_t *c, int level, int reps, calib_t *cal) {
+    size_t ccap = c->size + c->size / 8 + 65536;
+    uint8_t *cbuf = malloc(ccap);
+    if (!cbuf) die("out of memory");
+    odz_options_t opts = { .progress = NULL, .userdata = NULL, .level = level };
+    odz_estimate_t est = { 0 };
+    size_t csize = 0;
+    double best_e = 1e30, best_c = 1e30;
+    for (int k = 0; k < reps; k++) {
+        double t0 = now_sec();
+        if (odz_estimate(c->data, c->size, level, &est) != ODZ_OK) die("estimate failed");
+        double t1 = now_sec();
+        if (run_compress(c, &opts, cbuf, ccap, &csize) != ODZ_OK) die("compress failed");
+        double t2 = now_sec();
+        if (t1 - t0 < best_e) best_e = t1 - t0;
+        if (t2 - t1 < best_c) best_c = t2 - t1;
+    }
+    free(cbuf);
+
+    double ratio = csize ? (double)c->size / (double)csize : 0.0;
+    double mbs = (double)c->size / 1e6 / best_c;
+    double gain = best_c / best_e;
+    double re = 100.0 * (est.ratio - ratio) / ratio;
+    double se = 100.0 * (est.speed - mbs) / mbs;
+    printf("%-16s %5d %9.3f %9.3f %+7.1f%% %10.1f %10.1f %+7.1f%% %8.0fx\n",
+           c->name, level, est.ratio, ratio, re, est.speed, mbs, se, gain);
+    cal->sum_ratio_err += re < 0 ? -re : re;
+    cal->sum_speed_err += se < 0 ? -se : se;
+    if (cal->n == 0 || gain < cal->min_gain) cal->min_gain = gain;
+    cal->n++;
+}
+
+static void calibrate(const corpus_t *c, int ncorp, int reps) {
+    calib_t cal = { 0, 0, 0, 0 };
+    printf("kernels: %s\n", odz_cpu_name());
+    printf("%-16s %5s %9s %9s %8s %10s %10s %8s %9s\n", "corpus", "level", "est ratio",
+           "ratio", "error", "est MB/s", "MB/s", "error", "est gain");
+    for (int i = 0; i < ncorp; i++)
+        for (int level = ODZ_LEVEL_MIN; level <= ODZ_LEVEL_MAX; level++)
+            calibrate_one(&c[i], level, reps, &cal);
+    if (cal.n)
+        printf("mean |error|: ratio %.1f%%, speed %.1f%%; estimate ≥ %.0fx faster than compression\n",
+               cal.sum_ratio_err / cal.n, cal.sum_speed_err / cal.n, cal.min_gain);
+}
+
+/* ── Output ────────────────────────────────────────────────── */
+
+static void print_table(const result_t *r, int n) {
+    printf("kernels: %s\n", odz_cpu_name());
+    printf("%-16s %-10s %12s %12s %8s %10s %10s %10s\n",
+           "corpus", "setting", "bytes", "compressed", "ratio",
+           "comp MB/s", "dec MB/s", "peak KB");
+    for (int i = 0; i < n; i++)
+        printf("%-16s %-10s %12llu %12llu %8.3f %10.1f %10.1f %10ld\n",
+               r[i].corpus, r[i].setting,
+               (unsigned long long)r[i].bytes, (unsigned long long)r[i].comp_bytes,
+               r[i].ratio, r[i].comp_mbs, r[i].decomp_mbs, r[i].peak_rss_kb);
+}
+
+/* Write s as a JSON string; corpus names are file names and may hold anything. */
+static void json_puts(FILE *f, const char *s) {
+    fputc('"', f);
+    for (; *s; s++) {
+        unsigned char c = (unsigned char)*s;
+        if (c == '"' || c == '\\') fprintf(f, "\\%c", c);
+        else if (c < 0x20)         fprintf(f, "\\u%04x", c);
+        else                       fputc(c, f);
+    }
+    fputc('"', f);
+}
+
+static void write_json(FILE *f, const result_t *r, int n) {
+    fprintf(f, "{\n  \"odz_format\": %d,\n  \"kernels\": \"%s\",\n  \"results\": [\n",
+            ODZ_FORMAT_VERSION, odz_cpu_name());
+    for (int i = 0; i < n; i++) {
+        fprintf(f, "    {\"corpus\": ");
+        json_puts(f, r[i].corpus);
+        fprintf(f, ", \"setting\": ");
+        json_puts(f, r[i].setting);
+        fprintf(f,
+            ", \"bytes\": %llu, "
+            "\"comp_bytes\": %llu, \"ratio\": %.4f, \"comp_mbs\": %.2f, "
+            "\"decomp_mbs\": %.2f, \"peak_rss_kb\": %ld}%s\n",
+            (unsigned long long)r[i].bytes, (unsigned long long)r[i].comp_bytes,
+            r[i].ratio, r[i].comp_mbs, r[i].decomp_mbs, r[i].peak_rss_kb,
+            i + 1 < n ? "," : "");
+    }
+    fprintf(f, "  ]\n}\n");
+}
+
+/* ── Baseline comparison ───────────────────────────────────── */
+
+/* Minimal reader for the JSON written above: one result object per line,
+ * names unescaped as json_puts wrote them. */
+static int json_str(const char *obj, const char *key, char *dst, size_t cap) {
+    char pat[64];
+    snprintf(pat, sizeof pat, "\"%s\": \"", key);
+    const char *p = strstr(obj, pat);
+    if (!p) return -1;
+    p += strlen(pat);
+    size_t i = 0;
+    while (*p && *p != '"' && i + 1 < cap) {
+        if (*p == '\\' && p[1] == 'u' && p[2] && p[3] && p[4] && p[5]) {
+            char hex[5] = { p[2], p[3], p[4], p[5], '\0' };
+            dst[i++] = (char)strtol(hex, NULL, 16);
+            p += 6;
+        } else {
+            if (*p == '\\' && p[1]) p++;
+            dst[i++] = *p++;
+        }
+    }
+    dst[i] = '\0';
+    return 0;
+}
+
+static int json_num(const char *obj, const char *key, double *out) {
+    char pat[64];
+    snprintf(pat, sizeof pat, "\"%s\": ", key);
+    const char *p = strstr(obj, pat);
+    if (!p) return -1;
+    *out = strtod(p + strlen(pat), NULL);
+    return 0;
+}
+
+static int compare_baseline(const char *path, const result_t *r, int n, double threshold) {
+    FILE *f = fopen(path, "r");
+    if (!f) die("cannot open baseline file");
+
+    int regressions = 0, matched = 0;
+    char line[1024];
+    while (fgets(line, sizeof line, f)) {
+        char corpus[256], setting[64];
+        double bytes, comp_bytes, comp_mbs, decomp_mbs;
+        if (json_str(line, "corpus", corpus, sizeof corpus) != 0 ||
+            json_str(line, "setting", setting, sizeof setting) != 0 ||
+            json_num(line, "bytes", &bytes) != 0 ||
+            json_num(line, "comp_bytes", &comp_bytes) != 0 ||
+            json_num(line, "comp_mbs", &comp_mbs) != 0 ||
+            json_num(line, "decomp_mbs", &decomp_mbs) != 0)
+            continue;
+
+        for (int i = 0; i < n; i++) {
+            if (strcmp(r[i].corpus, corpus) != 0 || strcmp(r[i].setting, setting) != 0)
+                continue;
+            if ((double)r[i].bytes != bytes) {
+                printf("  %s/%s: corpus size changed, skipped\n", corpus, setting);
+                break;
+            }
+            matched++;
+            double dc = comp_mbs > 0 ? 100.0 * (r[i].comp_mbs - comp_mbs) / comp_mbs : 0.0;
+            double dd = decomp_mbs > 0 ? 100.0 * (r[i].decomp_mbs - decomp_mbs) / decomp_mbs : 0.0;
+            double ds = comp_bytes > 0 ? 100.0 * ((double)r[i].comp_bytes - comp_bytes) / comp_bytes : 0.0;
+            int bad = 0;
+            if (dc < -threshold) bad = 1;
+            if (dd < -threshold) bad = 1;
+            if (ds > 0.1) bad = 1;
+            printf("  %-16s %-10s comp %+6.1f%%  dec %+6.1f%%  size %+6.2f%%%s\n",
+                   corpus, setting, dc, dd, ds, bad ? "  REGRESSION" : "");
+            regressions += bad;
+            break;
+        }
+    }
+    fclose(f);
+
+    if (matched == 0) printf("  no comparable results in baseline\n");
+    return regressions;
+}
+
+/* ── Main ──────────────────────────────────────────────────── */
+
+static size_t parse_size(const char *s) {
+    char *end;
+    double v = strtod(s, &end);
+    if (end == s || v < 0) die("invalid size");
+    if (*end == 'k' || *end == 'K') v *= 1024;
+    else if (*end == 'm' || *end == 'M') v *= 1024 * 1024;
+    else if (*end == 'g' || *end == 'G') v *= 1024.0 * 1024 * 1024;
+    return (size_t)v;
+}
+
+static void usage(const char *prog) {
+    fprintf(stderr,
+        "odz_bench — end-to-end odz benchmark (format v%d)\n\n"
+        "usage: %s [options]\n\n"
+        "options:\n"
+        "  -d, --corpus DIR     benchmark every regular file in DIR\n"
+        "                       (default: synthetic text/logs/binary/random/zeros/mixed)\n"
+        "  -s, --size N         synthetic corpus size, K/M/G suffixes (default 8M)\n"
+        "  -w, --warmup N       untimed warm-up runs (default %d)\n"
+        "  -n, --reps N         timed repetitions, best is reported (default %d)\n"
+        "  -j, --json FILE      also write results as JSON ('-' for stdout)\n"
+        "  -b, --baseline FILE  compare against a previous --json run\n"
+        "  -t, --threshold PCT  speed regression threshold in percent (default 5)\n"
+        "  -c, --calibrate      report odz_estimate's error against compression\n"
+        "                       at every level instead\n"
+        "  -h, --help           show this help\n\n"
+        "Exit status is 1 on roundtrip failure or flagged regression.\n",
+        ODZ_FORMAT_VERSION, prog, DEFAULT_WARMUP, DEFAULT_REPS);
+}
+
+int main(int argc, char **argv) {
+    const char *corpus_dir = NULL, *json_path = NULL, *baseline_path = NULL;
+    size_t size = DEFAULT_SIZE;
+    int reps = DEFAULT_REPS, warmup = DEFAULT_WARMUP;
+    double threshold = 5.0;
+    int calib = 0;
+
+    for (int i = 1; i < argc; i++) {
+        const char *a = argv[i];
+        const char *v = (i + 1 < argc) ? argv[i + 1] : NULL;
+        if (strcmp(a, "-h") == 0 || strcmp(a, "--help") == 0) {
+            usage(argv[0]); return 0;
+        } else if (strcmp(a, "-d") == 0 || strcmp(a, "--corpus") == 0) {
+            if (!v) die("missing argument for --corpus");
+            corpus_dir = v; i++;
+        } else if (strcmp(a, "-s") == 0 || strcmp(a, "--size") == 0) {
+            if (!v) die("missing argument for --size");
+            size = parse_size(v); i++;
+        } else if (strcmp(a, "-w") == 0 || strcmp(a, "--warmup") == 0) {
+            if (!v) die("missing argument for --warmup");
+            warmup = atoi(v); i++;
+        } else if (strcmp(a, "-n") == 0 || strcmp(a, "--reps") == 0) {
+            if (!v) die("missing argument for --reps");
+            reps = atoi(v); i++;
+        } else if (strcmp(a, "-j") == 0 || strcmp(a, "--json") == 0) {
+            if (!v) die("missing argument for --json");
+            json_path = v; i++;
+        } else if (strcmp(a, "-b") == 0 || strcmp(a, "--baseline") == 0) {
+            if (!v) die("missing argument for --baseline");
+            baseline_path = v; i++;
+        } else if (strcmp(a, "-t") == 0 || strcmp(a, "--threshold") == 0) {
+            if (!v) die("missing argument for --threshold");
+            threshold = atof(v); i++;
+        } else if (strcmp(a, "-c") == 0 || strcmp(a, "--calibrate") == 0) {
+            calib = 1;
+        } else {
+            fprintf(stderr, "odz_bench: unknown option: %s\n", a);
+            usage(argv[0]); return 2;
+        }
+    }
+    if (size == 0) die("corpus size must be nonzero");
+    if (reps < 1) reps = 1;
+    if (warmup < 0) warmup = 0;
+
+    static corpus_t corpora[MAX_CORPORA];
+    int ncorp = corpus_dir ? add_directory(corpora, corpus_dir)
+                           : add_synthetic(corpora, size);
+
+    if (calib) {
+        calibrate(corpora, ncorp, reps);
+        for (int c = 0; c < ncorp; c++) {
+            free(corpora[c].name);
+            free(corpora[c].data);
+        }
+        return 0;
+    }
+
+    static result_t results[MAX_RESULTS];
+    int nres = 0, failed = 0;
+    for (int c = 0; c < ncorp; c++) {
+        for (size_t s = 0; s < NSETTINGS && nres < MAX_RESULTS; s++) {
+            if (bench_one(&corpora[c], &settings[s], warmup, reps, &results[nres]) != 0)
+                failed = 1;
+            else
+                nres++;
+        }
+    }
+
+    print_table(results, nres);
+
+    if (json_path) {
+        FILE *f = strcmp(json_path, "-") == 0 ? stdout : fopen(json_path, "w");
+        if (!f) die("cannot open JSON output file");
+        write_json(f, results, nres);
+        if (f != stdout) fclose(f);
+    }
+
+    int regressions = 0;
+    if (baseline_path) {
+        printf("\nbaseline %s (threshold %.1f%%):\n", baseline_path, threshold);
+        regressions = compare_baseline(baseline_path, results, nres, threshold);
+        printf("%d regression(s)\n", regressions);
+    }
+
+    for (int c = 0; c < ncorp; c++) {
+        free(corpora[c].name);
+        free(corpora[c].data);
+    }
+    return (failed || regressions) ? 1 : 0;
+}
@@ -0,0 +1,425 @@
+/*
+ * Burrows-Wheeler block coding (see odz_bwt.h).
+ *
+ * Payload: rows(32) × BWT_CHAINS | ntables-1 (3) | ntables × code lengths (as
+ * huff_write_trees, over BWT_SYMS symbols and an empty distance tree) |
+ * per group of BWT_GROUP symbols: its table, move-to-front coded in
+ * unary (k one bits, then a zero), then the group's symbols.
+ *
+ * Symbols: BWT_RUNA / BWT_RUNB are the bijective base-2 digits of a run
+ * of move-to-front zeros, least significant first (as bzip2); 2-256 are
+ * move-to-front indices 1-255; BWT_EOB ends the block.
+ *
+ * The transform sorts the block's suffixes with an implicit sentinel
+ * below every byte.  Its last column is written without the sentinel's
+ * row, the primary row (suffix 0).  rows[k] is the row of suffix
+ * k·n/BWT_CHAINS, between 1 and n: rows[0] locates the primary, and the
+ * others let the decoder walk BWT_CHAINS stretches of the block at once,
+ * so their cache misses overlap.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "odz_bwt.h"
+#include "libodzip.h"
+#include "huffman.h"
+#include "lz_tables.h"
+
+#define BWT_RUNA    0
+#define BWT_RUNB    1
+#define BWT_EOB     257
+#define BWT_SYMS    258
+#define BWT_GROUP   50
+#define BWT_TABLES  6
+#define BWT_ITERS   4       /* table refinement passes */
+#define BWT_CHAINS  4
+
+/* ── Suffix sorting (SA-IS) ────────────────────────────────────
+ * Nong, Zhang and Chan's induced sorting, with the sentinel implicit:
+ * suffix n sorts first and is not stored, so sa[0..n) ranks suffixes
+ * 0..n-1.  Each level's string is bytes (s8) at the top and names
+ * (s32) in the recursion; ls marks S-type positions.
+ */
+
+#define CHR(i) (s8 ? (int32_t)s8[i] : s32[i])
+#define IS_LMS(i) ((i) > 0 && ls[i] && !ls[(i) - 1])
+
+/* Start (end = 0) or end of each character's bucket */
+static void sa_buckets(const uint8_t *s8, const int32_t *s32, int32_t n, int32_t k,
+                       int32_t *bkt, int end) {
+    memset(bkt, 0, (size_t)k * sizeof *bkt);
+    for (int32_t i = 0; i < n; i++) bkt[CHR(i)]++;
+    int32_t sum = 0;
+    for (int32_t c = 0; c < k; c++) {
+        sum += bkt[c];
+        bkt[c] = end ? sum : sum - bkt[c];
+    }
+}
+
+/* Induce L-type suffixes from the seeded S ones, then S-type from L */
+static void sa_induce(const uint8_t *s8, const int32_t *s32, const uint8_t *ls,
+                      int32_t *sa, int32_t n, int32_t k, int32_t *bkt) {
+    sa_buckets(s8, s32, n, k, bkt, 0);
+    sa[bkt[CHR(n - 1)]++] = n - 1;      /* precedes the sentinel, so L-type */
+    for (int32_t i = 0; i < n; i++) {
+        int32_t j = sa[i] - 1;
+        if (j >= 0 && !ls[j]) sa[bkt[CHR(j)]++] = j;
+    }
+    sa_buckets(s8, s32, n, k, bkt, 1);
+    for (int32_t i = n - 1; i >= 0; i--) {
+        int32_t j = sa[i] - 1;
+        if (j >= 0 && ls[j]) sa[--bkt[CHR(j)]] = j;
+    }
+}
+
+/* Suffix array of s[0..n) over alphabet k.  Returns 0, or -1 if out of memory. */
+static int sais(const uint8_t *s8, const int32_t *s32, int32_t *sa, int32_t n, int32_t k,
+                const odz_mem_t *mem) {
+    if (n == 0) return 0;
+    uint8_t *ls = odz_alloc_big(mem, (size_t)n);
+    int32_t *bkt = odz_alloc(mem, (size_t)k * sizeof *bkt);
+    int rc = -1;
+    if (!ls || !bkt) goto done;
+
+    ls[n - 1] = 0;
+    for (int32_t i = n - 2; i >= 0; i--)
+        ls[i] = CHR(i) < CHR(i + 1) || (CHR(i) == CHR(i + 1) && ls[i + 1]);
+
+    /* Sort the LMS substrings: seed them at their bucket ends and induce */
+    sa_buckets(s8, s32, n, k, bkt, 1);
+    for (int32_t i = 0; i < n; i++) sa[i] = -1;
+    for (int32_t i = 1; i < n; i++)
+        if (IS_LMS(i)) sa[--bkt[CHR(i)]] = i;
+    sa_induce(s8, s32, ls, sa, n, k, bkt);
+
+    /* Name them in sorted order, equal substrings alike; the names go to
+     * sa[n1 + pos / 2] (LMS positions are at least 2 apart), and are then
+     * packed in text order at the end of sa */
+    int32_t n1 = 0;
+    for (int32_t i = 0; i < n; i++)
+        if (IS_LMS(sa[i])) sa[n1++] = sa[i];
+    for (int32_t i = n1; i < n; i++) sa[i] = -1;
+    int32_t name = 0, prev = -1;
+    for (int32_t i = 0; i < n1; i++) {
+        int32_t pos = sa[i];
+        int diff = 0;
+        for (int32_t d = 0;; d++) {
+            if (prev < 0 || pos + d == n || prev + d == n ||
+                CHR(pos + d) != CHR(prev + d) || ls[pos + d] != ls[prev + d]) {
+                diff = 1;
+                break;
+            }
+            if (d > 0 && (IS_LMS(pos + d) || IS_LMS(prev + d))) break;
+        }
+        if (diff) {
+            name++;
+            prev = pos;
+        }
+        sa[n1 + pos / 2] = name - 1;
+    }
+    for (int32_t i = n - 1, j = n - 1; i >= n1; i--)
+        if (sa[i] >= 0) sa[j--] = sa[i];
+
+    /* Sort the LMS suffixes: by recursion unless the names are unique */
+    int32_t *s1 = sa + n - n1;
+    if (name < n1) {
+        if (sais(NULL, s1, sa, n1, name, mem) != 0) goto done;
+    } else {
+        for (int32_t i = 0; i < n1; i++) sa[s1[i]] = i;
+    }
+
+    /* Seed them in that order at their bucket ends and induce the rest */
+    for (int32_t i = 1, j = 0; i < n; i++)
+        if (IS_LMS(i)) s1[j++] = i;
+    for (int32_t i = 0; i < n1; i++) sa[i] = s1[sa[i]];
+    for (int32_t i = n1; i < n; i++) sa[i] = -1;
+    sa_buckets(s8, s32, n, k, bkt, 1);
+    for (int32_t i = n1 - 1; i >= 0; i--) {
+        int32_t j = sa[i];
+        sa[i] = -1;
+        sa[--bkt[CHR(j)]] = j;
+    }
+    sa_induce(s8, s32, ls, sa, n, k, bkt);
+    rc = 0;
+
+done:
+    odz_free_big(mem, ls, (size_t)n);
+    odz_free(mem, bkt, (size_t)k * sizeof *bkt);
+    return rc;
+}
+
+#undef CHR
+#undef IS_LMS
+
+/* ── Move-to-front, zero runs ──────────────────────────────── */
+
+/* Append the digits of a run of r ≥ 1 zeros */
+static size_t put_run(uint16_t *syms, size_t ns, uint32_t r) {
+    while (r) {
+        r--;
+        syms[ns++] = (uint16_t)(BWT_RUNA + (r & 1));
+        r >>= 1;
+    }
+    return ns;
+}
+
+/* Symbols for the last column bwt[0..n) into syms (n + 1 entries at
+ * most); returns their count, BWT_EOB included */
+static size_t mtf_encode(const uint8_t *bwt, size_t n, uint16_t *syms) {
+    uint8_t order[256];
+    for (int c = 0; c < 256; c++) order[c] = (uint8_t)c;
+    size_t ns = 0;
+    uint32_t zrun = 0;
+    for (size_t i = 0; i < n; i++) {
+        uint8_t c = bwt[i];
+        if (order[0] == c) {
+            zrun++;
+            continue;
+        }
+        if (zrun) ns = put_run(syms, ns, zrun);
+        zrun = 0;
+        uint8_t prev = order[0];
+        int j = 0;
+        do {
+            uint8_t t = order[++j];
+            order[j] = prev;
+            prev = t;
+        } while (prev != c);
+        order[0] = c;
+        syms[ns++] = (uint16_t)(j + 1);
+    }
+    if (zrun) ns = put_run(syms, ns, zrun);
+    syms[ns++] = BWT_EOB;
+    return ns;
+}
+
+/* ── Code tables ───────────────────────────────────────────────
+ * As bzip2: the tables start as bands of the symbol range holding equal
+ * shares of the symbols, then each pass assigns every group the table
+ * that codes it cheapest and rebuilds each table from its groups.
+ * Every table codes every symbol in use, so any assignment decodes.
+ */
+
+static int table_count(size_t ns) {
+    return ns < 200 ? 2 : ns < 600 ? 3 : ns < 1200 ? 4 : ns < 2400 ? 5 : BWT_TABLES;
+}
+
+static void plan_tables(const uint16_t *syms, size_t ns, int ntab, uint8_t *sel,
+                        uint8_t lens[][BWT_SYMS]) {
+    uint32_t freq[BWT_SYMS] = {0};
+    for (size_t i = 0; i < ns; i++) freq[syms[i]]++;
+
+    size_t left = ns;
+    int gs = 0;
+    for (int t = ntab; t > 0; t--) {
+        size_t target = left / (size_t)t, acc = 0;
+        int ge = gs - 1;
+        while (acc < target && ge < BWT_SYMS - 1) acc += freq[++ge];
+        if (ge > gs && t != ntab && t != 1 && (ntab - t) % 2 == 1) acc -= freq[ge--];
+        for (int v = 0; v < BWT_SYMS; v++) lens[t - 1][v] = v >= gs && v <= ge ? 0 : 15;
+        gs = ge + 1;
+        left -= acc;
+    }
+
+    for (int it = 0; it < BWT_ITERS; it++) {
+        uint32_t tfreq[BWT_TABLES][BWT_SYMS];
+        memset(tfreq, 0, sizeof tfreq);
+        for (size_t g = 0, i = 0; i < ns; g++, i += BWT_GROUP) {
+            size_t end = i + BWT_GROUP < ns ? i + BWT_GROUP : ns;
+            uint32_t best = UINT32_MAX;
+            for (int t = 0; t < ntab; t++) {
+                uint32_t cost = 0;
+                for (size_t k = i; k < end; k++) cost += lens[t][syms[k]];
+                if (cost < best) {
+                    best = cost;
+                    sel[g] = (uint8_t)t;
+                }
+            }
+            for (size_t k = i; k < end; k++) tfreq[sel[g]][syms[k]]++;
+        }
+        for (int t = 0; t < ntab; t++) {
+            for (int v = 0; v < BWT_SYMS; v++)
+                if (!tfreq[t][v] && freq[v]) tfreq[t][v] = 1;
+            huff_build_lengths(tfreq[t], BWT_SYMS, HUFF_MAX_BITS, lens[t]);
+        }
+    }
+}
+
+/* ── Encode ────────────────────────────────────────────────── */
+
+int odz_bwt_encode(const uint8_t *in, size_t n, bit_writer_t *bw, const odz_mem_t *mem) {
+    if (n == 0 || n > ODZ_BWT_MAX) return -1;
+    size_t sa_size = (n + 1) * sizeof(int32_t), nsel_max = n / BWT_GROUP + 2;
+    int32_t *sa = odz_alloc_big(mem, sa_size);
+    uint8_t *bwt = odz_alloc_big(mem, n);
+    uint8_t *sel = odz_alloc(mem, nsel_max);
+    int rc = -1;
+    if (!sa || !bwt || !sel) goto done;
+
+    /* Last column, primary row dropped */
+    if (sais(in, NULL, sa, (int32_t)n, 256, mem) != 0) goto done;
+    uint32_t rows[BWT_CHAINS] = {0};
+    bwt[0] = in[n - 1];
+    for (size_t i = 0, k = 1; i < n; i++) {
+        for (int c = 0; c < BWT_CHAINS; c++)
+            if ((size_t)sa[i] == n * (size_t)c / BWT_CHAINS) rows[c] = (uint32_t)i + 1;
+        if (sa[i] != 0) bwt[k++] = in[sa[i] - 1];
+    }
+
+    /* The symbols take over the suffix array's space */
+    uint16_t *syms = (uint16_t *)(void *)sa;
+    size_t ns = mtf_encode(bwt, n, syms);
+    int ntab = table_count(ns);
+    uint8_t lens[BWT_TABLES][BWT_SYMS];
+    plan_tables(syms, ns, ntab, sel, lens);
+
+    uint8_t d_lens[1] = {0};
+    uint16_t codes[BWT_TABLES][BWT_SYMS];
+    for (int c = 0; c < BWT_CHAINS; c++) bw_write(bw, rows[c], 32);
+    bw_write(bw, (uint32_t)ntab - 1, 3);
+    for (int t = 0; t < ntab; t++) {
+        huff_write_trees(bw, lens[t], BWT_SYMS, d_lens, 1, HUFF_HDIST_BITS_V5);
+        huff_build_codes(lens[t], BWT_SYMS, codes[t]);
+    }
+
+    /* Selectors cost at most BWT_TABLES bits per group */
+    if (bw_reserve(bw, ns * HUFF_MAX_BITS / 8 + (ns / BWT_GROUP + 1) + 8) != 0) goto done;
+    uint8_t order[BWT_TABLES] = { 0, 1, 2, 3, 4, 5 };
+    for (size_t g = 0, i = 0; i < ns; g++, i += BWT_GROUP) {
+        int j = 0;
+        while (order[j] != sel[g]) j++;
+        memmove(order + 1, order, (size_t)j);
+        order[0] = sel[g];
+        bw_write_fast(bw, (1u << j) - 1, j + 1);
+
+        const uint8_t *l = lens[sel[g]];
+        const uint16_t *c = codes[sel[g]];
+        size_t end = i + BWT_GROUP < ns ? i + BWT_GROUP : ns;
+        for (size_t k = i; k < end; k++) bw_write_fast(bw, c[syms[k]], l[syms[k]]);
+    }
+    if (bw_write(bw, 0, 0) != 0) goto done;
+    rc = 0;
+
+done:
+    odz_free_big(mem, sa, sa_size);
+    odz_free_big(mem, bwt, n);
+    odz_free(mem, sel, nsel_max);
+    return rc;
+}
+
+/* ── Decode ────────────────────────────────────────────────── */
+
+/* Undo the symbol coding: the last column into out[0..raw_size) */
+static int mtf_decode(bit_reader_t *br, const huff_decode_table_t *tabs, int ntab,
+                      uint8_t *out, size_t raw_size) {
+    uint8_t order[256], torder[BWT_TABLES] = { 0, 1, 2, 3, 4, 5 };
+    for (int c = 0; c < 256; c++) order[c] = (uint8_t)c;
+    const huff_decode_table_t *tab = NULL;
+    size_t op = 0;
+    uint64_t run = 0, digit = 1, nsec = 0;
+    for (int left = 0;; left--) {
+        if (left == 0) {
+            int j = 0;
+            while (br_read(br, 1))
+                if (++j >= ntab) return ODZ_ERR_CORRUPT;
+            uint8_t t = torder[j];
+            memmove(torder + 1, torder, (size_t)j);
+            torder[0] = t;
+            tab = &tabs[t];
+            left = BWT_GROUP;
+        }
+        int sym = huff_decode2(br, tab, &nsec);
+        if (sym <= BWT_RUNB) {
+            run += digit << sym;
+            digit <<= 1;
+            if (run > raw_size - op) return ODZ_ERR_CORRUPT;
+            continue;
+        }
+        if (run) {
+            memset(out + op, order[0], (size_t)run);
+            op += (size_t)run;
+            run = 0;
+            digit = 1;
+        }
+        if (sym == BWT_EOB) break;
+        if (sym > BWT_EOB || op >= raw_size) return ODZ_ERR_CORRUPT;
+        int j = sym - 1;
+        uint8_t c = order[j];
+        memmove(order + 1, order, (size_t)j);
+        order[0] = c;
+        out[op++] = c;
+    }
+    return op == raw_size ? ODZ_OK : ODZ_ERR_CORRUPT;
+}
+
+int odz_bwt_decode(const uint8_t *comp, size_t comp_size, uint8_t *out, size_t raw_size,
+                   uint32_t *tt, const odz_mem_t *mem) {
+    bit_reader_t br;
+    br_init(&br, comp, comp_size);
+    uint32_t rows[BWT_CHAINS];
+    int bad = raw_size > ODZ_BWT_MAX;
+    for (int c = 0; c < BWT_CHAINS; c++) {
+        rows[c] = br_read(&br, 32);
+        bad |= rows[c] == 0 || rows[c] > raw_size;
+    }
+    int ntab = (int)br_read(&br, 3) + 1;
+    if (bad || ntab < 2 || ntab > BWT_TABLES) return ODZ_ERR_CORRUPT;
+    uint32_t primary = rows[0];
+
+    huff_decode_table_t *tabs = odz_alloc(mem, (size_t)ntab * sizeof *tabs);
+    if (!tabs) return ODZ_ERR_OOM;
+    int built = 0, rc = ODZ_ERR_CORRUPT;
+    for (; built < ntab; built++) {
+        uint8_t ll_lens[LITLEN_SYMS], d_lens[DIST_SYMS];
+        int n_ll, n_dist;
+        if (huff_read_trees(&br, ll_lens, &n_ll, d_lens, &n_dist, HUFF_HDIST_BITS_V5) != 0 ||
+            n_ll > BWT_SYMS)
+            goto done;
+        tabs[built] = (huff_decode_table_t){ .secondary = NULL, .mem = mem };
+        if (huff_build_decode_table2(ll_lens, BWT_SYMS, &tabs[built]) != 0) {
+            huff_free_decode_table2(&tabs[built]);
+            rc = ODZ_ERR_OOM;
+            goto done;
+        }
+    }
+    if ((rc = mtf_decode(&br, tabs, ntab, out, raw_size)) != ODZ_OK) goto done;
+
+    /* Invert: tt[j] = (row whose suffix follows row j's) << 8 | row j's
+     * first byte, filled by scanning the last column, sentinel row
+     * skipped; then walk from each chain's row, in step */
+    uint32_t count[256] = {0}, next[256];
+    for (size_t i = 0; i < raw_size; i++) count[out[i]]++;
+    uint32_t sum = 1;
+    for (int c = 0; c < 256; c++) {
+        next[c] = sum;
+        sum += count[c];
+    }
+    tt[0] = 0;
+    for (uint32_t r = 0; r < primary; r++)
+        tt[next[out[r]]++] = r << 8 | out[r];
+    for (uint32_t r = primary + 1; r <= raw_size; r++)
+        tt[next[out[r - 1]]++] = r << 8 | out[r - 1];
+    size_t start[BWT_CHAINS + 1];
+    uint32_t pos[BWT_CHAINS];
+    for (int c = 0; c <= BWT_CHAINS; c++) start[c] = raw_size * (size_t)c / BWT_CHAINS;
+    for (int c = 0; c < BWT_CHAINS; c++) pos[c] = tt[rows[c]];
+    size_t step = start[1] - start[0];     /* the shortest stretch */
+    for (size_t k = 0; k < step; k++) {
+        for (int c = 0; c < BWT_CHAINS; c++) {
+            out[start[c] + k] = (uint8_t)pos[c];
+            pos[c] = tt[pos[c] >> 8];
+        }
+    }
+    for (int c = 0; c < BWT_CHAINS; c++) {
+        for (size_t k = start[c] + step; k < start[c + 1]; k++) {
+            out[k] = (uint8_t)pos[c];
+            pos[c] = tt[pos[c] >> 8];
+        }
+    }
+
+done:
+    for (int t = 0; t < built; t++) huff_free_decode_table2(&tabs[t]);
+    odz_free(mem, tabs, (size_t)ntab * sizeof *tabs);
+    return rc;
+}
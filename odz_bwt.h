@@ -0,0 +1,33 @@
+#ifndef ODZ_BWT_H
+#define ODZ_BWT_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "odz.h"
+#include "bitstream.h"
+
+/*
+ * Burrows-Wheeler block coding (ODZ_BLOCK_BWT): the block is sorted by
+ * suffix (SA-IS, linear time), the last column is move-to-front coded
+ * with its runs of zeros written as bijective base-2 digits, and those
+ * symbols are Huffman-coded, switching among up to BWT_TABLES tables
+ * every BWT_GROUP symbols.  The whole block is the context, where LZ77
+ * sees only ODZ_WINDOW back, so on text it codes well past any LZ level,
+ * at several times the cost.  Blocks carry no state between them.
+ */
+
+/* Largest block the transform takes: the decoder packs a row index and
+ * a byte into 32 bits */
+#define ODZ_BWT_MAX ((1u << 24) - 1)
+
+/* Code in[0..n) (n ≤ ODZ_BWT_MAX) as a BWT block payload onto bw, with
+ * work buffers from mem.  Returns 0, or -1 if out of memory. */
+int odz_bwt_encode(const uint8_t *in, size_t n, bit_writer_t *bw, const odz_mem_t *mem);
+
+/* Decode a BWT block payload into out[0..raw_size), using tt (raw_size + 1
+ * entries) as scratch and mem for the code tables.  Returns ODZ_OK,
+ * ODZ_ERR_CORRUPT or ODZ_ERR_OOM. */
+int odz_bwt_decode(const uint8_t *comp, size_t comp_size, uint8_t *out, size_t raw_size,
+                   uint32_t *tt, const odz_mem_t *mem);
+
+#endif
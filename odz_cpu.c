@@ -0,0 +1,55 @@
+/*
+ * CPU feature detection for kernel dispatch (see odz_cpu.h).
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "odz_cpu.h"
+#include "libodzip.h"
+
+#if ODZ_CPU_X86
+
+static unsigned detect(void) {
+    unsigned f = 0;
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("sse2"))   f |= ODZ_CPU_SSE2;
+    if (__builtin_cpu_supports("pclmul")) f |= ODZ_CPU_PCLMUL;
+    if (__builtin_cpu_supports("avx2"))   f |= ODZ_CPU_AVX2;
+    if (__builtin_cpu_supports("avx512f") && __builtin_cpu_supports("avx512bw") &&
+        __builtin_cpu_supports("avx512vl"))
+        f |= ODZ_CPU_AVX512;
+
+    const char *cap = getenv("ODZ_CPU");
+    if (cap) {
+        if (strcmp(cap, "generic") == 0)     f = 0;
+        else if (strcmp(cap, "sse2") == 0)  f &= ODZ_CPU_SSE2 | ODZ_CPU_PCLMUL;
+        else if (strcmp(cap, "avx2") == 0)  f &= ~(unsigned)ODZ_CPU_AVX512;
+    }
+    return f;
+}
+
+unsigned odz_cpu_features(void) {
+    /* Detection is idempotent, so racing first calls just agree */
+    static unsigned cached;     /* features | 0x80000000 once known */
+    unsigned f = __atomic_load_n(&cached, __ATOMIC_RELAXED);
+    if (!f) {
+        f = detect() | 0x80000000u;
+        __atomic_store_n(&cached, f, __ATOMIC_RELAXED);
+    }
+    return f & ~0x80000000u;
+}
+
+#else
+
+unsigned odz_cpu_features(void) { return 0; }
+
+#endif
+
+const char *odz_cpu_name(void) {
+    unsigned f = odz_cpu_features();
+    if (f & ODZ_CPU_AVX512) return "avx512";
+    if (f & ODZ_CPU_AVX2)   return "avx2";
+    if (f & ODZ_CPU_SSE2)   return "sse2";
+    return "generic";
+}
@@ -0,0 +1,39 @@
+#ifndef ODZ_CPU_H
+#define ODZ_CPU_H
+
+/*
+ * Runtime CPU feature dispatch.
+ *
+ * The hot kernels (match length, CRC-32, Adler-32) come in several
+ * variants compiled with per-function target attributes, so a portable
+ * build (ODZ_PORTABLE, no -march=native) carries the vector paths too and
+ * picks the best one the CPU supports at run time.  Setting ODZ_CPU to
+ * generic, sse2, avx2 or avx512 caps the choice, for testing and
+ * benchmarking one variant against another.
+ */
+
+#if (defined(__x86_64__) || defined(__i386__)) && defined(__GNUC__)
+#define ODZ_CPU_X86 1
+#define ODZ_TARGET(isa) __attribute__((target(isa)))
+#else
+#define ODZ_CPU_X86 0
+#endif
+
+/* Kernel templates must inline into each variant to pick up its target */
+#if defined(__GNUC__)
+#define ODZ_ALWAYS_INLINE inline __attribute__((always_inline))
+#elif defined(_MSC_VER)
+#define ODZ_ALWAYS_INLINE __forceinline
+#else
+#define ODZ_ALWAYS_INLINE inline
+#endif
+
+#define ODZ_CPU_SSE2    0x01
+#define ODZ_CPU_PCLMUL  0x02   /* carry-less multiply (CRC folding) */
+#define ODZ_CPU_AVX2    0x04
+#define ODZ_CPU_AVX512  0x08   /* AVX-512 F + BW + VL */
+
+/* Features detected on this CPU, less any the ODZ_CPU cap excludes */
+unsigned odz_cpu_features(void);
+
+#endif
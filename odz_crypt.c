@@ -0,0 +1,557 @@
+/*
+ * Stream encryption (odz_options_t.key / passphrase): ChaCha20-Poly1305
+ * (RFC 8439) over every block, in portable C, with an AVX2 keystream
+ * picked at run time (see odz_cpu.h).
+ *
+ * Each stream draws a random salt; its key is PBKDF2-HMAC-SHA256 of the
+ * passphrase over that salt, or HMAC-SHA256 of the raw key and the salt.
+ * No two streams share a key, so a block's nonce can simply be its index.
+ * The block header is the associated data and the 16-byte tag follows the
+ * payload, so a block decrypts on its own given its index: blocks may be
+ * opened in parallel or out of order, and none can be moved, dropped or
+ * altered without its tag failing.  The stream header carries a check tag
+ * of its own (nonce ODZ_CRYPT_HEADER over the header bytes) that tells a
+ * wrong key from damaged data before any block is read.
+ */
+
+#ifdef _WIN32
+#define _CRT_RAND_S             /* rand_s */
+#endif
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+
+#include "odz.h"
+#include "odz_cpu.h"
+#include "libodzip.h"
+
+#if ODZ_CPU_X86
+#include <immintrin.h>
+#endif
+
+#define KDF_RAW_KEY     0       /* key = HMAC-SHA256(raw key, salt) */
+#define KDF_PBKDF2      1       /* key = PBKDF2-HMAC-SHA256(passphrase, salt, 2^param) */
+#define KDF_LOG2        18      /* PBKDF2 iterations written, as log2 */
+#define KDF_LOG2_MIN    10
+#define KDF_LOG2_MAX    30
+
+/* Little-endian words, inline for the cipher loops (rd_u32le is not) */
+static inline uint32_t ld32(const uint8_t *p) {
+    return (uint32_t)p[0] | (uint32_t)p[1] << 8 | (uint32_t)p[2] << 16 | (uint32_t)p[3] << 24;
+}
+
+static inline void st32(uint8_t *p, uint32_t v) {
+    p[0] = (uint8_t)v; p[1] = (uint8_t)(v >> 8); p[2] = (uint8_t)(v >> 16); p[3] = (uint8_t)(v >> 24);
+}
+
+/* ── HMAC-SHA256 and PBKDF2 (RFC 2104, RFC 8018) ───────────── */
+
+typedef struct {
+    odz_sha256_t inner, outer;  /* states after the padded key block */
+} hmac_t;
+
+static void hmac_init(hmac_t *h, const uint8_t *key, size_t n) {
+    uint8_t k[64] = { 0 }, pad[64];
+    if (n > sizeof k) odz_sha256(key, n, k);
+    else memcpy(k, key, n);
+    for (int i = 0; i < 64; i++) pad[i] = k[i] ^ 0x36;
+    odz_sha256_init(&h->inner);
+    odz_sha256_update(&h->inner, pad, 64);
+    for (int i = 0; i < 64; i++) pad[i] = k[i] ^ 0x5c;
+    odz_sha256_init(&h->outer);
+    odz_sha256_update(&h->outer, pad, 64);
+    odz_crypt_wipe(k, sizeof k);
+    odz_crypt_wipe(pad, sizeof pad);
+}
+
+/* MAC of a || b under h's key; h itself is left as it was */
+static void hmac(const hmac_t *h, const uint8_t *a, size_t na, const uint8_t *b, size_t nb,
+                 uint8_t out[ODZ_SHA256_SIZE]) {
+    odz_sha256_t s = h->inner;
+    odz_sha256_update(&s, a, na);
+    if (nb) odz_sha256_update(&s, b, nb);
+    odz_sha256_final(&s, out);
+    s = h->outer;
+    odz_sha256_update(&s, out, ODZ_SHA256_SIZE);
+    odz_sha256_final(&s, out);
+}
+
+/* One 32-byte output block: the inner and outer pads are hashed once,
+ * so each iteration costs two SHA-256 compressions */
+static void pbkdf2_sha256(const uint8_t *pass, size_t npass, const uint8_t *salt, size_t nsalt,
+                          uint64_t iters, uint8_t out[ODZ_CRYPT_KEY]) {
+    hmac_t h;
+    hmac_init(&h, pass, npass);
+    static const uint8_t one[4] = { 0, 0, 0, 1 };
+    uint8_t u[ODZ_SHA256_SIZE];
+    hmac(&h, salt, nsalt, one, sizeof one, u);
+    memcpy(out, u, ODZ_CRYPT_KEY);
+    for (uint64_t i = 1; i < iters; i++) {
+        hmac(&h, u, sizeof u, NULL, 0, u);
+        for (int k = 0; k < ODZ_CRYPT_KEY; k++) out[k] ^= u[k];
+    }
+    odz_crypt_wipe(u, sizeof u);
+    odz_crypt_wipe(&h, sizeof h);
+}
+
+/* ── ChaCha20 (RFC 8439 §2.4) ──────────────────────────────── */
+
+#define ROTL32(x, r) (((x) << (r)) | ((x) >> (32 - (r))))
+#define QUARTER(a, b, c, d) \
+    a += b; d ^= a; d = ROTL32(d, 16); \
+    c += d; b ^= c; b = ROTL32(b, 12); \
+    a += b; d ^= a; d = ROTL32(d, 8);  \
+    c += d; b ^= c; b = ROTL32(b, 7)
+
+static void chacha20_block(const uint32_t in[16], uint32_t out[16]) {
+    uint32_t x[16];
+    memcpy(x, in, sizeof x);
+    for (int i = 0; i < 10; i++) {
+        QUARTER(x[0], x[4], x[8],  x[12]);
+        QUARTER(x[1], x[5], x[9],  x[13]);
+        QUARTER(x[2], x[6], x[10], x[14]);
+        QUARTER(x[3], x[7], x[11], x[15]);
+        QUARTER(x[0], x[5], x[10], x[15]);
+        QUARTER(x[1], x[6], x[11], x[12]);
+        QUARTER(x[2], x[7], x[8],  x[13]);
+        QUARTER(x[3], x[4], x[9],  x[14]);
+    }
+    for (int i = 0; i < 16; i++) out[i] = x[i] + in[i];
+}
+
+static void chacha20_init(uint32_t st[16], const uint8_t key[ODZ_CRYPT_KEY], uint64_t index) {
+    st[0] = 0x61707865u; st[1] = 0x3320646eu; st[2] = 0x79622d32u; st[3] = 0x6b206574u;
+    for (int i = 0; i < 8; i++) st[4 + i] = ld32(key + 4 * i);
+    st[12] = 0;                               /* block counter */
+    st[13] = 0;                               /* nonce: 0(4) index(8) */
+    st[14] = (uint32_t)index;
+    st[15] = (uint32_t)(index >> 32);
+}
+
+#if ODZ_CPU_X86
+#define ROTV(v, k) _mm256_or_si256(_mm256_slli_epi32(v, k), _mm256_srli_epi32(v, 32 - (k)))
+#define QUARTERV(a, b, c, d) \
+    a = _mm256_add_epi32(a, b); d = _mm256_shuffle_epi8(_mm256_xor_si256(d, a), rot16); \
+    c = _mm256_add_epi32(c, d); b = ROTV(_mm256_xor_si256(b, c), 12);                   \
+    a = _mm256_add_epi32(a, b); d = _mm256_shuffle_epi8(_mm256_xor_si256(d, a), rot8);  \
+    c = _mm256_add_epi32(c, d); b = ROTV(_mm256_xor_si256(b, c), 7)
+
+/* Eight words of eight blocks → the eight words of each block, in place */
+ODZ_TARGET("avx2")
+static ODZ_ALWAYS_INLINE void transpose8(__m256i v[8]) {
+    __m256i t[8], u[8];
+    for (int i = 0; i < 8; i += 2) {
+        t[i]     = _mm256_unpacklo_epi32(v[i], v[i + 1]);
+        t[i + 1] = _mm256_unpackhi_epi32(v[i], v[i + 1]);
+    }
+    for (int i = 0; i < 8; i += 4) {
+        u[i]     = _mm256_unpacklo_epi64(t[i], t[i + 2]);
+        u[i + 1] = _mm256_unpackhi_epi64(t[i], t[i + 2]);
+        u[i + 2] = _mm256_unpacklo_epi64(t[i + 1], t[i + 3]);
+        u[i + 3] = _mm256_unpackhi_epi64(t[i + 1], t[i + 3]);
+    }
+    for (int j = 0; j < 4; j++) {
+        v[j]     = _mm256_permute2x128_si256(u[j], u[j + 4], 0x20);
+        v[j + 4] = _mm256_permute2x128_si256(u[j], u[j + 4], 0x31);
+    }
+}
+
+/*
+ * Eight blocks at once, one state word per register across them (lane j
+ * is counter st[12] + j).  Whole 512-byte runs only; returns the bytes
+ * done and leaves st[12] at the next counter.
+ */
+ODZ_TARGET("avx2")
+static size_t chacha20_xor_avx2(uint32_t st[16], uint8_t *p, size_t n) {
+    const __m256i rot16 = _mm256_set_epi8(13, 12, 15, 14, 9, 8, 11, 10, 5, 4, 7, 6, 1, 0, 3, 2,
+                                          13, 12, 15, 14, 9, 8, 11, 10, 5, 4, 7, 6, 1, 0, 3, 2);
+    const __m256i rot8 = _mm256_set_epi8(14, 13, 12, 15, 10, 9, 8, 11, 6, 5, 4, 7, 2, 1, 0, 3,
+                                         14, 13, 12, 15, 10, 9, 8, 11, 6, 5, 4, 7, 2, 1, 0, 3);
+    size_t done = 0;
+    for (; n - done >= 512; done += 512, st[12] += 8) {
+        __m256i in[16], x[16];
+        for (int i = 0; i < 16; i++) in[i] = _mm256_set1_epi32((int)st[i]);
+        in[12] = _mm256_add_epi32(in[12], _mm256_set_epi32(7, 6, 5, 4, 3, 2, 1, 0));
+        memcpy(x, in, sizeof x);
+        for (int r = 0; r < 10; r++) {
+            QUARTERV(x[0], x[4], x[8],  x[12]);
+            QUARTERV(x[1], x[5], x[9],  x[13]);
+            QUARTERV(x[2], x[6], x[10], x[14]);
+            QUARTERV(x[3], x[7], x[11], x[15]);
+            QUARTERV(x[0], x[5], x[10], x[15]);
+            QUARTERV(x[1], x[6], x[11], x[12]);
+            QUARTERV(x[2], x[7], x[8],  x[13]);
+            QUARTERV(x[3], x[4], x[9],  x[14]);
+        }
+        for (int i = 0; i < 16; i++) x[i] = _mm256_add_epi32(x[i], in[i]);
+        transpose8(x);
+        transpose8(x + 8);
+        uint8_t *q = p + done;
+        for (int j = 0; j < 8; j++, q += 64) {
+            __m256i *lo = (__m256i *)q, *hi = (__m256i *)(q + 32);
+            _mm256_storeu_si256(lo, _mm256_xor_si256(_mm256_loadu_si256(lo), x[j]));
+            _mm256_storeu_si256(hi, _mm256_xor_si256(_mm256_loadu_si256(hi), x[8 + j]));
+        }
+    }
+    return done;
+}
+#endif
+
+/* XOR n bytes of keystream, from block counter 1 on, into p */
+static void chacha20_xor(uint32_t st[16], uint8_t *p, size_t n) {
+    uint32_t ks[16];
+    st[12] = 1;
+#if ODZ_CPU_X86
+    if (n >= 512 && (odz_cpu_features() & ODZ_CPU_AVX2)) {
+        size_t done = chacha20_xor_avx2(st, p, n);
+        p += done;
+        n -= done;
+    }
+#endif
+    for (; n > 0; st[12]++) {
+        chacha20_block(st, ks);
+        if (n >= 64) {
+            for (int i = 0; i < 16; i++) st32(p + 4 * i, ld32(p + 4 * i) ^ ks[i]);
+            p += 64;
+            n -= 64;
+        } else {
+            uint8_t b[64];
+            for (int i = 0; i < 16; i++) st32(b + 4 * i, ks[i]);
+            for (size_t i = 0; i < n; i++) p[i] ^= b[i];
+            odz_crypt_wipe(b, sizeof b);
+            n = 0;
+        }
+    }
+    odz_crypt_wipe(ks, sizeof ks);
+}
+
+/* ── Poly1305 (RFC 8439 §2.5) ─────────────────────────────── */
+
+#ifdef __SIZEOF_INT128__
+
+/* 44-bit limbs: three 64x64 → 128-bit products per term instead of five */
+__extension__ typedef unsigned __int128 u128;
+
+#define M44 0xfffffffffffull
+#define M42 0x3ffffffffffull
+
+typedef struct {
+    uint64_t r[3], h[3], pad[2];
+    uint8_t  buf[16];
+    size_t   nbuf;
+} poly1305_t;
+
+static inline uint64_t ld64(const uint8_t *p) { return ld32(p) | (uint64_t)ld32(p + 4) << 32; }
+
+static void poly1305_init(poly1305_t *p, const uint8_t key[32]) {
+    uint64_t t0 = ld64(key), t1 = ld64(key + 8);
+    p->r[0] = t0 & 0xffc0fffffffull;
+    p->r[1] = ((t0 >> 44) | (t1 << 20)) & 0xfffffc0ffffull;
+    p->r[2] = (t1 >> 24) & 0x00ffffffc0full;
+    p->h[0] = p->h[1] = p->h[2] = 0;
+    p->pad[0] = ld64(key + 16);
+    p->pad[1] = ld64(key + 24);
+    p->nbuf = 0;
+}
+
+/* Whole 16-byte blocks; full adds 2^128, as all but the padded tail do */
+static void poly1305_blocks(poly1305_t *p, const uint8_t *m, size_t n, int full) {
+    const uint64_t hibit = full ? (uint64_t)1 << 40 : 0;    /* 2^128 in limb 2 */
+    const uint64_t r0 = p->r[0], r1 = p->r[1], r2 = p->r[2];
+    const uint64_t s1 = r1 * (5 << 2), s2 = r2 * (5 << 2);
+    uint64_t h0 = p->h[0], h1 = p->h[1], h2 = p->h[2];
+    for (; n >= 16; m += 16, n -= 16) {
+        uint64_t t0 = ld64(m), t1 = ld64(m + 8);
+        h0 += t0 & M44;
+        h1 += ((t0 >> 44) | (t1 << 20)) & M44;
+        h2 += ((t1 >> 24) & M42) | hibit;
+
+        u128 d0 = (u128)h0 * r0 + (u128)h1 * s2 + (u128)h2 * s1;
+        u128 d1 = (u128)h0 * r1 + (u128)h1 * r0 + (u128)h2 * s2;
+        u128 d2 = (u128)h0 * r2 + (u128)h1 * r1 + (u128)h2 * r0;
+
+        uint64_t c;
+        c = (uint64_t)(d0 >> 44); h0 = (uint64_t)d0 & M44; d1 += c;
+        c = (uint64_t)(d1 >> 44); h1 = (uint64_t)d1 & M44; d2 += c;
+        c = (uint64_t)(d2 >> 42); h2 = (uint64_t)d2 & M42;
+        h0 += c * 5;
+        c = h0 >> 44; h0 &= M44; h1 += c;
+    }
+    p->h[0] = h0; p->h[1] = h1; p->h[2] = h2;
+}
+
+static void poly1305_final(poly1305_t *p, uint8_t tag[ODZ_CRYPT_TAG]) {
+    if (p->nbuf) {
+        p->buf[p->nbuf] = 1;
+        memset(p->buf + p->nbuf + 1, 0, 16 - p->nbuf - 1);
+        poly1305_blocks(p, p->buf, 16, 0);
+    }
+    uint64_t h0 = p->h[0], h1 = p->h[1], h2 = p->h[2], c;
+    c = h1 >> 44; h1 &= M44; h2 += c;
+    c = h2 >> 42; h2 &= M42; h0 += c * 5;
+    c = h0 >> 44; h0 &= M44; h1 += c;
+    c = h1 >> 44; h1 &= M44; h2 += c;
+    c = h2 >> 42; h2 &= M42; h0 += c * 5;
+    c = h0 >> 44; h0 &= M44; h1 += c;
+
+    /* h - p, kept if it did not go negative (constant time) */
+    uint64_t g0 = h0 + 5;  c = g0 >> 44; g0 &= M44;
+    uint64_t g1 = h1 + c;  c = g1 >> 44; g1 &= M44;
+    uint64_t g2 = h2 + c - ((uint64_t)1 << 42);
+    uint64_t keep = (g2 >> 63) - 1;
+    h0 = (h0 & ~keep) | (g0 & keep);
+    h1 = (h1 & ~keep) | (g1 & keep);
+    h2 = (h2 & ~keep) | (g2 & keep);
+
+    /* Plus the pad, mod 2^128 */
+    uint64_t t0 = p->pad[0], t1 = p->pad[1];
+    h0 += t0 & M44;                                    c = h0 >> 44; h0 &= M44;
+    h1 += (((t0 >> 44) | (t1 << 20)) & M44) + c;      c = h1 >> 44; h1 &= M44;
+    h2 += ((t1 >> 24) & M42) + c;
+    uint64_t w0 = h0 | (h1 << 44), w1 = (h1 >> 20) | (h2 << 24);
+    st32(tag + 0, (uint32_t)w0);  st32(tag + 4, (uint32_t)(w0 >> 32));
+    st32(tag + 8, (uint32_t)w1);  st32(tag + 12, (uint32_t)(w1 >> 32));
+    odz_crypt_wipe(p, sizeof *p);
+}
+
+#else
+
+/* 26-bit limbs, for compilers without a 128-bit integer */
+typedef struct {
+    uint32_t r[5], h[5], pad[4];
+    uint8_t  buf[16];
+    size_t   nbuf;
+} poly1305_t;
+
+static void poly1305_init(poly1305_t *p, const uint8_t key[32]) {
+    p->r[0] = (ld32(key + 0))      & 0x3ffffff;
+    p->r[1] = (ld32(key + 3) >> 2) & 0x3ffff03;
+    p->r[2] = (ld32(key + 6) >> 4) & 0x3ffc0ff;
+    p->r[3] = (ld32(key + 9) >> 6) & 0x3f03fff;
+    p->r[4] = (ld32(key + 12) >> 8) & 0x00fffff;
+    for (int i = 0; i < 5; i++) p->h[i] = 0;
+    for (int i = 0; i < 4; i++) p->pad[i] = ld32(key + 16 + 4 * i);
+    p->nbuf = 0;
+}
+
+static void poly1305_blocks(poly1305_t *p, const uint8_t *m, size_t n, int full) {
+    const uint32_t hibit = full ? 1u << 24 : 0;     /* 2^128 in limb 4 */
+    const uint32_t r0 = p->r[0], r1 = p->r[1], r2 = p->r[2], r3 = p->r[3], r4 = p->r[4];
+    const uint32_t s1 = r1 * 5, s2 = r2 * 5, s3 = r3 * 5, s4 = r4 * 5;
+    uint32_t h0 = p->h[0], h1 = p->h[1], h2 = p->h[2], h3 = p->h[3], h4 = p->h[4];
+    for (; n >= 16; m += 16, n -= 16) {
+        h0 += (ld32(m + 0))      & 0x3ffffff;
+        h1 += (ld32(m + 3) >> 2) & 0x3ffffff;
+        h2 += (ld32(m + 6) >> 4) & 0x3ffffff;
+        h3 += (ld32(m + 9) >> 6) & 0x3ffffff;
+        h4 += (ld32(m + 12) >> 8) | hibit;
+
+        uint64_t d0 = (uint64_t)h0 * r0 + (uint64_t)h1 * s4 + (uint64_t)h2 * s3 + (uint64_t)h3 * s2 + (uint64_t)h4 * s1;
+        uint64_t d1 = (uint64_t)h0 * r1 + (uint64_t)h1 * r0 + (uint64_t)h2 * s4 + (uint64_t)h3 * s3 + (uint64_t)h4 * s2;
+        uint64_t d2 = (uint64_t)h0 * r2 + (uint64_t)h1 * r1 + (uint64_t)h2 * r0 + (uint64_t)h3 * s4 + (uint64_t)h4 * s3;
+        uint64_t d3 = (uint64_t)h0 * r3 + (uint64_t)h1 * r2 + (uint64_t)h2 * r1 + (uint64_t)h3 * r0 + (uint64_t)h4 * s4;
+        uint64_t d4 = (uint64_t)h0 * r4 + (uint64_t)h1 * r3 + (uint64_t)h2 * r2 + (uint64_t)h3 * r1 + (uint64_t)h4 * r0;
+
+        uint32_t c;
+        c = (uint32_t)(d0 >> 26); h0 = (uint32_t)d0 & 0x3ffffff; d1 += c;
+        c = (uint32_t)(d1 >> 26); h1 = (uint32_t)d1 & 0x3ffffff; d2 += c;
+        c = (uint32_t)(d2 >> 26); h2 = (uint32_t)d2 & 0x3ffffff; d3 += c;
+        c = (uint32_t)(d3 >> 26); h3 = (uint32_t)d3 & 0x3ffffff; d4 += c;
+        c = (uint32_t)(d4 >> 26); h4 = (uint32_t)d4 & 0x3ffffff;
+        h0 += c * 5;
+        c = h0 >> 26; h0 &= 0x3ffffff; h1 += c;
+    }
+    p->h[0] = h0; p->h[1] = h1; p->h[2] = h2; p->h[3] = h3; p->h[4] = h4;
+}
+
+static void poly1305_final(poly1305_t *p, uint8_t tag[ODZ_CRYPT_TAG]) {
+    if (p->nbuf) {
+        p->buf[p->nbuf] = 1;
+        memset(p->buf + p->nbuf + 1, 0, 16 - p->nbuf - 1);
+        poly1305_blocks(p, p->buf, 16, 0);
+    }
+    uint32_t h0 = p->h[0], h1 = p->h[1], h2 = p->h[2], h3 = p->h[3], h4 = p->h[4], c;
+    c = h1 >> 26; h1 &= 0x3ffffff; h2 += c;
+    c = h2 >> 26; h2 &= 0x3ffffff; h3 += c;
+    c = h3 >> 26; h3 &= 0x3ffffff; h4 += c;
+    c = h4 >> 26; h4 &= 0x3ffffff; h0 += c * 5;
+    c = h0 >> 26; h0 &= 0x3ffffff; h1 += c;
+
+    /* h - p, kept if it did not go negative (constant time) */
+    uint32_t g0 = h0 + 5;  c = g0 >> 26; g0 &= 0x3ffffff;
+    uint32_t g1 = h1 + c;  c = g1 >> 26; g1 &= 0x3ffffff;
+    uint32_t g2 = h2 + c;  c = g2 >> 26; g2 &= 0x3ffffff;
+    uint32_t g3 = h3 + c;  c = g3 >> 26; g3 &= 0x3ffffff;
+    uint32_t g4 = h4 + c - (1u << 26);
+    uint32_t keep = (g4 >> 31) - 1;
+    h0 = (h0 & ~keep) | (g0 & keep);
+    h1 = (h1 & ~keep) | (g1 & keep);
+    h2 = (h2 & ~keep) | (g2 & keep);
+    h3 = (h3 & ~keep) | (g3 & keep);
+    h4 = (h4 & ~keep) | (g4 & keep);
+
+    /* To 4 x 32 bits, plus the pad, mod 2^128 */
+    uint32_t w0 = h0 | (h1 << 26), w1 = (h1 >> 6) | (h2 << 20);
+    uint32_t w2 = (h2 >> 12) | (h3 << 14), w3 = (h3 >> 18) | (h4 << 8);
+    uint64_t f;
+    f = (uint64_t)w0 + p->pad[0];             st32(tag + 0, (uint32_t)f);
+    f = (uint64_t)w1 + p->pad[1] + (f >> 32); st32(tag + 4, (uint32_t)f);
+    f = (uint64_t)w2 + p->pad[2] + (f >> 32); st32(tag + 8, (uint32_t)f);
+    f = (uint64_t)w3 + p->pad[3] + (f >> 32); st32(tag + 12, (uint32_t)f);
+    odz_crypt_wipe(p, sizeof *p);
+}
+
+#endif
+
+static void poly1305_update(poly1305_t *p, const uint8_t *m, size_t n) {
+    if (n == 0) return;
+    if (p->nbuf) {
+        size_t k = 16 - p->nbuf < n ? 16 - p->nbuf : n;
+        memcpy(p->buf + p->nbuf, m, k);
+        p->nbuf += k;
+        m += k;
+        n -= k;
+        if (p->nbuf < 16) return;
+        poly1305_blocks(p, p->buf, 16, 1);
+        p->nbuf = 0;
+    }
+    poly1305_blocks(p, m, n & ~(size_t)15, 1);
+    memcpy(p->buf, m + (n & ~(size_t)15), n & 15);
+    p->nbuf = n & 15;
+}
+
+/* Zeros up to the next 16-byte boundary, as the AEAD construction pads */
+static void poly1305_pad16(poly1305_t *p) {
+    static const uint8_t zero[16] = { 0 };
+    if (p->nbuf) poly1305_update(p, zero, 16 - p->nbuf);
+}
+
+/* ── AEAD (RFC 8439 §2.8) ──────────────────────────────────── */
+
+/* Tag over ad and the ciphertext c, under the one-time key from block 0 */
+static void aead_tag(const uint32_t st0[16], const uint8_t *ad, size_t nad,
+                     const uint8_t *c, size_t n, uint8_t tag[ODZ_CRYPT_TAG]) {
+    uint32_t st[16], ks[16];
+    uint8_t otk[32], lens[16];
+    memcpy(st, st0, sizeof st);
+    st[12] = 0;
+    chacha20_block(st, ks);
+    for (int i = 0; i < 8; i++) st32(otk + 4 * i, ks[i]);
+
+    poly1305_t p;
+    poly1305_init(&p, otk);
+    poly1305_update(&p, ad, nad);
+    poly1305_pad16(&p);
+    poly1305_update(&p, c, n);
+    poly1305_pad16(&p);
+    wr_u64le(lens, nad);
+    wr_u64le(lens + 8, n);
+    poly1305_update(&p, lens, sizeof lens);
+    poly1305_final(&p, tag);
+    odz_crypt_wipe(otk, sizeof otk);
+    odz_crypt_wipe(ks, sizeof ks);
+    odz_crypt_wipe(st, sizeof st);
+}
+
+void odz_crypt_seal(const odz_crypt_t *c, uint64_t index, const uint8_t *ad, size_t nad,
+                    uint8_t *p, size_t n, uint8_t tag[ODZ_CRYPT_TAG]) {
+    uint32_t st[16];
+    chacha20_init(st, c->key, index);
+    chacha20_xor(st, p, n);
+    aead_tag(st, ad, nad, p, n, tag);
+    odz_crypt_wipe(st, sizeof st);
+}
+
+int odz_crypt_open(const odz_crypt_t *c, uint64_t index, const uint8_t *ad, size_t nad,
+                   uint8_t *p, size_t n, const uint8_t tag[ODZ_CRYPT_TAG]) {
+    uint32_t st[16];
+    uint8_t want[ODZ_CRYPT_TAG];
+    chacha20_init(st, c->key, index);
+    aead_tag(st, ad, nad, p, n, want);
+    uint8_t diff = 0;
+    for (int i = 0; i < ODZ_CRYPT_TAG; i++) diff |= (uint8_t)(want[i] ^ tag[i]);
+    if (diff) { odz_crypt_wipe(st, sizeof st); return -1; }
+    chacha20_xor(st, p, n);
+    odz_crypt_wipe(st, sizeof st);
+    return 0;
+}
+
+/* ── Stream keys ───────────────────────────────────────────── */
+
+static int random_bytes(uint8_t *p, size_t n) {
+#ifdef _WIN32
+    while (n > 0) {
+        unsigned int v;
+        if (rand_s(&v) != 0) return -1;
+        size_t k = n < sizeof v ? n : sizeof v;
+        memcpy(p, &v, k);
+        p += k;
+        n -= k;
+    }
+    return 0;
+#else
+    FILE *f = fopen("/dev/urandom", "rb");
+    if (!f) return -1;
+    size_t got = fread(p, 1, n, f);
+    fclose(f);
+    return got == n ? 0 : -1;
+#endif
+}
+
+static void derive(odz_crypt_t *c, const odz_options_t *opts, int kdf, int log2_iters,
+                   const uint8_t salt[ODZ_CRYPT_SALT]) {
+    if (kdf == KDF_RAW_KEY) {
+        hmac_t h;
+        hmac_init(&h, opts->key, ODZ_KEY_SIZE);
+        hmac(&h, salt, ODZ_CRYPT_SALT, NULL, 0, c->key);
+        odz_crypt_wipe(&h, sizeof h);
+    } else {
+        pbkdf2_sha256((const uint8_t *)opts->passphrase, strlen(opts->passphrase),
+                      salt, ODZ_CRYPT_SALT, (uint64_t)1 << log2_iters, c->key);
+    }
+}
+
+/* Check tag: the stream header up to the tag, under the reserved index */
+static void header_tag(const odz_crypt_t *c, const uint8_t *hdr, size_t n, uint8_t tag[ODZ_CRYPT_TAG]) {
+    odz_crypt_seal(c, ODZ_CRYPT_HEADER, hdr, n, NULL, 0, tag);
+}
+
+int odz_crypt_wanted(const odz_options_t *opts) {
+    return opts && (opts->key || opts->passphrase);
+}
+
+int odz_crypt_begin(odz_crypt_t *c, const odz_options_t *opts, uint8_t fields[ODZ_CRYPT_FIELDS]) {
+    int kdf = opts->key ? KDF_RAW_KEY : KDF_PBKDF2;
+    fields[0] = (uint8_t)kdf;
+    fields[1] = kdf == KDF_PBKDF2 ? KDF_LOG2 : 0;
+    if (random_bytes(fields + 2, ODZ_CRYPT_SALT) != 0) return ODZ_ERR_IO;
+    memset(fields + 2 + ODZ_CRYPT_SALT, 0, ODZ_CRYPT_TAG);
+    derive(c, opts, kdf, fields[1], fields + 2);
+    return ODZ_OK;
+}
+
+void odz_crypt_seal_header(const odz_crypt_t *c, uint8_t *hdr, size_t n) {
+    header_tag(c, hdr, n - ODZ_CRYPT_TAG, hdr + n - ODZ_CRYPT_TAG);
+}
+
+int odz_crypt_read(odz_crypt_t *c, const odz_options_t *opts, const uint8_t *hdr, size_t n) {
+    const uint8_t *fields = hdr + n - ODZ_CRYPT_FIELDS;
+    int kdf = fields[0], log2_iters = fields[1];
+    if (kdf != KDF_RAW_KEY && kdf != KDF_PBKDF2) return ODZ_ERR_FORMAT;
+    if (kdf == KDF_PBKDF2 && (log2_iters < KDF_LOG2_MIN || log2_iters > KDF_LOG2_MAX))
+        return ODZ_ERR_FORMAT;
+    if (kdf == KDF_RAW_KEY ? !opts || !opts->key : !opts || !opts->passphrase) return ODZ_ERR_KEY;
+    derive(c, opts, kdf, log2_iters, fields + 2);
+
+    uint8_t want[ODZ_CRYPT_TAG], diff = 0;
+    header_tag(c, hdr, n - ODZ_CRYPT_TAG, want);
+    for (int i = 0; i < ODZ_CRYPT_TAG; i++) diff |= (uint8_t)(want[i] ^ hdr[n - ODZ_CRYPT_TAG + (size_t)i]);
+    if (diff) { odz_crypt_wipe(c, sizeof *c); return ODZ_ERR_KEY; }
+    return ODZ_OK;
+}
+
+void odz_crypt_wipe(void *p, size_t n) {
+    volatile uint8_t *v = p;
+    while (n--) *v++ = 0;
+}
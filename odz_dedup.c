@@ -0,0 +1,191 @@
+/*
+ * Content-defined chunking and chunk fingerprints (see odz_dedup.h).
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "libodzip.h"
+#include "odz.h"
+#include "odz_dedup.h"
+
+/* Fingerprint table: open addressing on the digest's first 8 bytes,
+ * grown at half load.  off == ODZ_DEDUP_FRESH marks an empty slot. */
+typedef struct {
+    uint8_t  digest[ODZ_SHA256_SIZE];
+    uint64_t off;               /* output offset where the chunk was written */
+} dedup_entry_t;
+
+#define DEDUP_TABLE_MIN 1024
+
+struct odz_dedup {
+    odz_mem_t mem;
+    uint64_t  gear[256];
+    size_t    block_size;
+    size_t    min_chunk;
+    uint64_t  cut_mask;         /* a cut where these top hash bits are all 0 */
+    uint64_t  window;
+
+    /* Input buffered ahead: buf[pos..len) not yet handed out, refilled
+     * to at least one block so every chunk can reach its maximum */
+    uint8_t  *buf;
+    size_t    pos, len;
+    int       eof;
+    uint64_t  emitted;          /* output offset of buf[pos] */
+
+    /* The chunk at buf[pos], measured and looked up but not yet taken */
+    size_t    next_len;         /* 0 = none */
+    uint64_t  next_src;         /* ODZ_DEDUP_FRESH or its earlier offset */
+    uint8_t   next_digest[ODZ_SHA256_SIZE];
+
+    dedup_entry_t *tab;
+    size_t    tab_cap, tab_used;
+};
+
+/* ── Fingerprint table ─────────────────────────────────────── */
+
+static dedup_entry_t *table_slot(dedup_entry_t *tab, size_t cap, const uint8_t *digest) {
+    size_t i = (size_t)rd_u64le(digest) & (cap - 1);
+    while (tab[i].off != ODZ_DEDUP_FRESH && memcmp(tab[i].digest, digest, ODZ_SHA256_SIZE) != 0)
+        i = (i + 1) & (cap - 1);
+    return &tab[i];
+}
+
+static int table_alloc(odz_dedup_t *d, size_t cap) {
+    dedup_entry_t *tab = odz_alloc(&d->mem, cap * sizeof *tab);
+    if (!tab) return -1;
+    for (size_t i = 0; i < cap; i++) tab[i].off = ODZ_DEDUP_FRESH;
+    for (size_t i = 0; i < d->tab_cap; i++) {
+        if (d->tab[i].off != ODZ_DEDUP_FRESH)
+            *table_slot(tab, cap, d->tab[i].digest) = d->tab[i];
+    }
+    odz_free(&d->mem, d->tab, d->tab_cap * sizeof *d->tab);
+    d->tab = tab;
+    d->tab_cap = cap;
+    return 0;
+}
+
+/* Record a chunk written at off, replacing an older copy.  Short of
+ * memory to grow, the table fills to 3/4 and then stops indexing. */
+static void table_put(odz_dedup_t *d, const uint8_t *digest, uint64_t off) {
+    if (2 * (d->tab_used + 1) > d->tab_cap && table_alloc(d, 2 * d->tab_cap) != 0 &&
+        4 * (d->tab_used + 1) > 3 * d->tab_cap)
+        return;
+    dedup_entry_t *e = table_slot(d->tab, d->tab_cap, digest);
+    if (e->off == ODZ_DEDUP_FRESH) {
+        memcpy(e->digest, digest, ODZ_SHA256_SIZE);
+        d->tab_used++;
+    }
+    e->off = off;
+}
+
+/* ── Chunking ──────────────────────────────────────────────── */
+
+/*
+ * Gear hash: h = (h << 1) + gear[byte], so bit k of h depends on the last
+ * k + 1 bytes and the top bits on the last 64.  A chunk ends where the
+ * top bits are all zero, tested only past the minimum length; hashing
+ * starts 64 bytes before it so the first test sees a full window.
+ */
+static size_t chunk_len(const odz_dedup_t *d, const uint8_t *p, size_t n) {
+    if (n > d->block_size) n = d->block_size;
+    if (n <= d->min_chunk) return n;
+    uint64_t h = 0;
+    size_t i = d->min_chunk - 64;
+    for (; i < d->min_chunk; i++) h = (h << 1) + d->gear[p[i]];
+    for (; i < n; i++) {
+        h = (h << 1) + d->gear[p[i]];
+        if (!(h & d->cut_mask)) return i + 1;
+    }
+    return n;
+}
+
+/* Keep at least a block buffered, unless the input has ended */
+static void refill(odz_dedup_t *d, odz_io_t *io) {
+    if (d->eof || d->len - d->pos >= d->block_size) return;
+    memmove(d->buf, d->buf + d->pos, d->len - d->pos);
+    d->len -= d->pos;
+    d->pos = 0;
+    size_t want = 2 * d->block_size - d->len;
+    size_t got = odz_io_read(io, d->buf + d->len, want);
+    d->len += got;
+    if (got < want) d->eof = 1;
+}
+
+/* Measure and look up the chunk at buf[pos]; 0 at the end of input */
+static size_t measure(odz_dedup_t *d, odz_io_t *io) {
+    if (d->next_len) return d->next_len;
+    refill(d, io);
+    if (d->pos == d->len) return 0;
+    d->next_len = chunk_len(d, d->buf + d->pos, d->len - d->pos);
+    odz_sha256(d->buf + d->pos, d->next_len, d->next_digest);
+    const dedup_entry_t *e = table_slot(d->tab, d->tab_cap, d->next_digest);
+    d->next_src = ODZ_DEDUP_FRESH;
+    if (e->off != ODZ_DEDUP_FRESH && (!d->window || d->emitted - e->off <= d->window))
+        d->next_src = e->off;
+    return d->next_len;
+}
+
+/* ── Public interface ──────────────────────────────────────── */
+
+int odz_dedup_create(odz_dedup_t **pd, size_t block_size, uint64_t window,
+                     const odz_mem_t *mem) {
+    odz_dedup_t *d = odz_alloc(mem, sizeof *d);
+    if (!d) return ODZ_ERR_OOM;
+    memset(d, 0, sizeof *d);
+    if (mem) d->mem = *mem;
+    *pd = d;
+
+    /* Fixed seed: the same input always chunks the same way */
+    uint64_t x = 0x6f647a2d67656172u;     /* "odz-gear" */
+    for (int i = 0; i < 256; i++) {
+        uint64_t z = (x += 0x9e3779b97f4a7c15u);
+        z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9u;
+        z = (z ^ (z >> 27)) * 0x94d049bb133111ebu;
+        d->gear[i] = z ^ (z >> 31);
+    }
+
+    /* Average chunk ≈ min_chunk + 2^bits ≈ block_size / 8 */
+    d->block_size = block_size;
+    d->min_chunk = block_size / 16;
+    int bits = 0;
+    while (((size_t)2 << bits) <= d->min_chunk) bits++;
+    d->cut_mask = ~(~(uint64_t)0 >> bits);
+    d->window = window;
+
+    d->buf = odz_alloc_big(&d->mem, 2 * block_size);
+    if (!d->buf || table_alloc(d, DEDUP_TABLE_MIN) != 0) {
+        odz_dedup_free(d);
+        *pd = NULL;
+        return ODZ_ERR_OOM;
+    }
+    return ODZ_OK;
+}
+
+void odz_dedup_free(odz_dedup_t *d) {
+    if (!d) return;
+    odz_mem_t mem = d->mem;
+    odz_free_big(&mem, d->buf, 2 * d->block_size);
+    odz_free(&mem, d->tab, d->tab_cap * sizeof *d->tab);
+    odz_free(&mem, d, sizeof *d);
+}
+
+size_t odz_dedup_read(odz_dedup_t *d, odz_io_t *io, uint8_t *dst, uint64_t *src) {
+    if (!measure(d, io)) return 0;
+    *src = d->next_src;
+    size_t n = 0;
+    do {
+        if (*src == ODZ_DEDUP_FRESH) {
+            memcpy(dst + n, d->buf + d->pos, d->next_len);
+            table_put(d, d->next_digest, d->emitted);
+        }
+        n += d->next_len;
+        d->pos += d->next_len;
+        d->emitted += d->next_len;
+        d->next_len = 0;
+        /* Gather more of the same kind: fresh, or the source's continuation */
+    } while (measure(d, io) && n + d->next_len <= d->block_size &&
+             (*src == ODZ_DEDUP_FRESH ? d->next_src == ODZ_DEDUP_FRESH
+                                      : d->next_src == *src + n));
+    return n;
+}
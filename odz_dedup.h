@@ -0,0 +1,42 @@
+#ifndef ODZ_DEDUP_H
+#define ODZ_DEDUP_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "odz_io.h"
+
+struct odz_mem;
+
+/*
+ * Dedup reader for odz streams (odz_options_t.dedup).  Input is cut into
+ * content-defined chunks with a gear rolling hash, so the cuts follow the
+ * data rather than its offset and a region copied elsewhere splits the
+ * same way once past its first chunk.  Each chunk's SHA-256 goes into a
+ * table of chunks already emitted; a chunk seen before comes back as a
+ * reference to the stream offset where it was written, and the encoder
+ * writes it as an ODZ_BLOCK_REF block instead of compressing it again.
+ *
+ * Chunks are 1/16 of the block size at least, about 1/8 on average and
+ * the block size at most.  Fresh chunks in a row are gathered into spans
+ * of up to a block, and so are repeats whose sources follow each other,
+ * so a long duplicated region costs a few REF blocks.
+ */
+
+typedef struct odz_dedup odz_dedup_t;
+
+#define ODZ_DEDUP_FRESH UINT64_MAX
+
+/* window: how far back (bytes of output) a reference may reach, 0 = no
+ * limit.  Buffers and the table come from mem (NULL = malloc), which is
+ * copied.  Returns ODZ_OK or ODZ_ERR_OOM. */
+int  odz_dedup_create(odz_dedup_t **d, size_t block_size, uint64_t window,
+                      const struct odz_mem *mem);
+void odz_dedup_free(odz_dedup_t *d);
+
+/* Next span of the input from io, at most block_size bytes.  Fresh data
+ * is copied to dst and *src set to ODZ_DEDUP_FRESH; a repeat leaves dst
+ * alone and sets *src to the output offset it repeats.  Returns the span
+ * length, 0 at EOF or on a read error (odz_io_error). */
+size_t odz_dedup_read(odz_dedup_t *d, odz_io_t *io, uint8_t *dst, uint64_t *src);
+
+#endif
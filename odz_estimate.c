@@ -0,0 +1,383 @@
+/*
+ * Compressibility estimate (odz_estimate): predicts what odz_compress
+ * would do to a buffer without running it.
+ *
+ * The input is sampled in windows of ODZ_WINDOW bytes spread evenly over
+ * it, all of it up to EST_WHOLE and about 1/EST_SHARE beyond that.  Each
+ * window gets a greedy match probe over a short hash chain, counting the
+ * same literal / length / distance / repeat symbols the encoder would
+ * emit, and their order-0 entropy plus the extra bits stands in for the
+ * entropy coded size, Huffman's or FSE's as the encoder would pick.  A
+ * calibration factor per level (measured with `odz_bench --calibrate`)
+ * carries that over to the encoder's deeper, lazy search.  At levels
+ * that try the Burrows-Wheeler transform, each window is also coded with
+ * the transform itself, and priced as whichever of the two the encoder
+ * would keep.
+ *
+ * Windows are visited in bit-reversed order, so that every prefix of
+ * the walk spans the input, and the walk stops early once EST_SETTLE of
+ * them agree: uniform data, such as random bytes or zeros, needs no
+ * more.
+ *
+ * The encoder's time goes mostly to walking hash chains, whose length
+ * depends on how often each hash recurs in a block, so the probe also
+ * models the steps the encoder would take at the level; the speed is
+ * then the probe's own, scaled by that work.
+ *
+ * Blocks odz_lz_pays turns down skip the matcher in the encoder, so
+ * windows it turns down skip the probe here: they are priced from their
+ * byte histogram, and timed by it.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "libodzip.h"
+#include "odz.h"
+#include "odz_io.h"
+#include "odz_bwt.h"
+#include "bitstream.h"
+#include "lz_matcher.h"
+#include "lz_tables.h"
+
+#define EST_WHOLE     (32u << 10)   /* inputs up to this are probed whole */
+#define EST_SHARE     16            /* beyond it, this fraction ... */
+#define EST_MAX       (2u << 20)    /* ... up to this many bytes */
+#define EST_SETTLE    4             /* windows that, agreeing ... */
+#define EST_SPREAD    (1.0 / 32)    /* ... to within this many bits a byte, end the walk */
+#define EST_HASH_BITS 13           /* the probe's chain */
+#define EST_COUNT_BITS 15           /* the encoder's, for blocks of 4K and up */
+#define EST_HUFF_BITS 200           /* Huffman trees and block header, per block, */
+#define EST_HUFF_SYM  2.5           /* and per symbol used */
+#define EST_FSE_BITS  400           /* the same for FSE tables */
+#define EST_FSE_SYM   10.0
+#define EST_BWT_SIZE  0.88          /* a whole block's BWT size, to a window's */
+#define REP_LONG      32            /* as compress.c: taken without a chain walk */
+
+/* Per level: the encoder's effort (as compress.c's effort_ladder), the
+ * probe's own chain depth, and the calibration of the probe's estimate
+ * to the encoder's output */
+static const struct {
+    int    chain, lazy, fse, bwt;
+    int    depth;
+    double size;
+} est_level[ODZ_LEVEL_MAX + 1] = {
+    {    0, 0, 0, 0, 1, 1.00 },  /* 0: unused */
+    {    4, 0, 0, 0, 1, 0.84 },
+    {    8, 0, 0, 0, 1, 0.88 },
+    {   16, 0, 0, 0, 2, 0.92 },
+    {   32, 1, 0, 0, 2, 0.86 },
+    {   64, 1, 1, 0, 4, 0.88 },
+    {  256, 1, 1, 0, 4, 0.82 },
+    {  512, 1, 1, 0, 4, 0.82 },
+    { 1024, 1, 1, 1, 8, 0.82 },
+    { 4096, 1, 1, 1, 8, 0.82 },
+};
+
+/* The encoder's time per byte, in probe time per byte: a base, and so
+ * much per chain step it takes (calibrated like the sizes above).  A
+ * block coded literals only costs so much per byte of the time its
+ * window's odz_lz_pays and histogram take, more with the FSE trial; the
+ * BWT trial, so much of a window's transform. */
+#define EST_TIME_BASE 1.1
+#define EST_TIME_STEP 0.5
+#define EST_TIME_LIT  1.0
+#define EST_TIME_LIT_FSE 2.8
+#define EST_TIME_BWT  1.1
+
+/* Symbol counts of the probed windows, and the encoder's chain work */
+typedef struct {
+    uint32_t ll[LITLEN_SYMS];
+    uint32_t d[DIST_SYMS];
+    uint64_t extra;             /* length / distance extra bits */
+    double   steps;             /* modelled chain steps */
+} est_hist_t;
+
+/* Probe tables: a short hash chain over one window, and how often each
+ * of the encoder's hash buckets occurs in it */
+typedef struct {
+    uint16_t head[1u << EST_HASH_BITS];
+    uint16_t prev[ODZ_WINDOW];
+    uint16_t count[1u << EST_COUNT_BITS];
+} est_tab_t;
+
+/* log2(x) in 1/256 bits (as in odz_filter.c) */
+static uint32_t log2_q8(uint32_t x) {
+    int e = 0;
+    while (x >> (e + 1)) e++;
+    uint32_t frac = e >= 8 ? (x >> (e - 8)) & 255 : (x << (8 - e)) & 255;
+    return (uint32_t)e * 256 + frac;
+}
+
+/* Order-0 size of a histogram, in 1/256 bits, at least floor per
+ * symbol (a Huffman code spends 1 bit on even the likeliest) */
+static uint64_t cost_q8(const uint32_t *h, int nsyms, uint32_t floor) {
+    uint32_t n = 0;
+    for (int s = 0; s < nsyms; s++) n += h[s];
+    if (n == 0) return 0;
+    uint32_t ln = log2_q8(n);
+    uint64_t c = 0;
+    for (int s = 0; s < nsyms; s++) {
+        if (!h[s]) continue;
+        uint32_t bits = ln - log2_q8(h[s]);
+        c += (uint64_t)h[s] * (bits > floor ? bits : floor);
+    }
+    return c;
+}
+
+static inline uint32_t est_hash(const uint8_t *p, int bits) {
+    uint32_t v = (uint32_t)p[0] << 16 | (uint32_t)p[1] << 8 | p[2];
+    return (v * 2654435761u) >> (32 - bits);
+}
+
+/* Chain steps the encoder takes at a position whose bucket holds count
+ * of the window's n positions: the bucket fills in proportion over a
+ * block of block bytes, to x at its end, and the walk stops at chain.
+ * Averaged over the block that is x/2, or chain - chain²/2x once full. */
+static double chain_steps(uint32_t count, size_t n, size_t block, int chain) {
+    double x = (double)count * (double)block / (double)n;
+    return x <= chain ? x / 2 : chain - (double)chain * chain / (2 * x);
+}
+
+/* Greedy parse of p[0..n), n ≤ ODZ_WINDOW, into h, with repeat offsets
+ * tried first as the encoder does.  They may reach back into the hist
+ * bytes before p, which the encoder would have seen in the same block;
+ * the chain stays in the window.  Positions are kept +1 in 16 bits so 0
+ * means empty. */
+static void probe_window(const uint8_t *p, size_t n, size_t hist, size_t block, int level,
+                         est_hist_t *h, est_tab_t *t) {
+    int depth = est_level[level].depth, chain = est_level[level].chain;
+    memset(t->head, 0, sizeof t->head);
+    /* Runs of one hash are added up at once: counting them one by one
+     * makes a chain of stores to the same bucket */
+    uint32_t run_k = 0, run = 0;
+    for (size_t i = 0; i + ODZ_MIN_MATCH <= n; i++) {
+        uint32_t k = est_hash(p + i, EST_COUNT_BITS);
+        if (k != run_k) {
+            t->count[run_k] += (uint16_t)run;
+            run_k = k;
+            run = 0;
+        }
+        run++;
+    }
+    t->count[run_k] += (uint16_t)run;
+
+    const uint8_t *b = p - hist;
+    uint32_t reps[DIST_REPS] = ODZ_REP_INIT;
+    size_t i = 0;
+    /* The last bytes, too few for a match, are left to the next window:
+     * in the encoder's block, a match would run on through them */
+    while (i + ODZ_MIN_MATCH <= n) {
+        size_t best = 0, dist = 0;
+        size_t max = n - i < ODZ_MAX_MATCH ? n - i : ODZ_MAX_MATCH;
+        for (int k = 0; k < DIST_REPS; k++) {
+            if (reps[k] > i + hist || b[i + hist - reps[k] + best] != p[i + best]) continue;
+            size_t len = (size_t)lz_match_len_at(b, i + hist, n + hist, reps[k], (int)max);
+            if (len > best) { best = len; dist = reps[k]; }
+            if (best == max) break;
+        }
+        uint32_t hk = est_hash(p + i, EST_HASH_BITS);
+        if (best < REP_LONG) {
+            size_t cbest = 0, cdist = 0;
+            uint16_t c = t->head[hk];
+            for (int step = 0; c && step < depth; step++, c = t->prev[c - 1]) {
+                const uint8_t *q = p + (c - 1);
+                if (q[cbest] != p[i + cbest]) continue;
+                size_t len = (size_t)lz_match_len_at(p, i, n, (size_t)(p + i - q), (int)max);
+                if (len > cbest) { cbest = len; cdist = i - (c - 1); }
+                if (len == max) break;
+            }
+            if (cbest > best) { best = cbest; dist = cdist; }
+            uint32_t count = t->count[est_hash(p + i, EST_COUNT_BITS)];
+            h->steps += cbest == max ? 1.0 : chain_steps(count, n, block, chain);
+        }
+        /* A lazy encoder searches the next position as well */
+        if (est_level[level].lazy && best >= ODZ_MIN_MATCH && best < ODZ_MAX_MATCH - 1 &&
+            i + 1 + ODZ_MIN_MATCH <= n)
+            h->steps += chain_steps(t->count[est_hash(p + i + 1, EST_COUNT_BITS)],
+                                    n, block, chain);
+        t->prev[i] = t->head[hk];
+        t->head[hk] = (uint16_t)(i + 1);
+        if (best < ODZ_MIN_MATCH) {
+            h->ll[p[i++]]++;
+            continue;
+        }
+        int sym = 0, ebits = 0, eval = 0;
+        len_to_code((int)best, &sym, &ebits, &eval);
+        h->ll[sym]++;
+        h->extra += (uint64_t)ebits;
+        int k = 0;
+        while (k < DIST_REPS && reps[k] != dist) k++;
+        if (k < DIST_REPS) {
+            h->d[DIST_REP0 + k]++;
+        } else {
+            dist_to_code((int)dist, &sym, &ebits, &eval);
+            h->d[sym]++;
+            h->extra += (uint64_t)ebits;
+            k = DIST_REPS - 1;
+        }
+        odz_rep_use(reps, k, (uint32_t)dist);
+        /* Index the match's interior too, as the encoder does */
+        size_t end = i + best;
+        for (i++; i < end; i++) {
+            if (i + ODZ_MIN_MATCH > n) continue;
+            uint32_t k = est_hash(p + i, EST_HASH_BITS);
+            t->prev[i] = t->head[k];
+            t->head[k] = (uint16_t)(i + 1);
+        }
+    }
+
+    memset(t->count, 0, sizeof t->count);
+}
+
+/* Entropy-coded size of a window's symbols (nll lit/len ones) and extra
+ * bits, scaled by scale, plus its share of the block's code tables, in
+ * bits: Huffman's, at least a bit a symbol, or at levels that try it
+ * FSE's where that saves the encoder's 1/64.  Tables cost so much a
+ * block and so much a symbol used. */
+static double coded_bits(const est_hist_t *h, int nll, double scale, size_t n, size_t block,
+                         int level) {
+    int used = 0;
+    for (int s = 0; s < nll; s++) used += h->ll[s] != 0;
+    for (int s = 0; s < DIST_SYMS; s++) used += h->d[s] != 0;
+    double share = (double)n / (double)block;
+    double huff = ((double)(cost_q8(h->ll, nll, 256) + cost_q8(h->d, DIST_SYMS, 256)) / 256.0 +
+                   (double)h->extra) * scale + (EST_HUFF_BITS + EST_HUFF_SYM * used) * share;
+    if (!est_level[level].fse) return huff;
+    double tans = ((double)(cost_q8(h->ll, nll, 0) + cost_q8(h->d, DIST_SYMS, 0)) / 256.0 +
+                   (double)h->extra) * scale + (EST_FSE_BITS + EST_FSE_SYM * used) * share;
+    return tans + huff / 64 < huff ? tans : huff;
+}
+
+/* Coded size of a window from its counts at level, in bits, never above
+ * stored */
+static double window_bits(const est_hist_t *h, size_t n, size_t block, int level) {
+    /* The deeper search gains on what matches, not on incompressible
+     * data, and not on the tables */
+    double c = coded_bits(h, LITLEN_SYMS, 1.0, n, block, level) / (8.0 * (double)n);
+    if (c >= 1.0) return 8.0 * (double)n;
+    double s = est_level[level].size;
+    return coded_bits(h, LITLEN_SYMS, s + (1.0 - s) * c, n, block, level);
+}
+
+/* The same for a window of a block coded literals only, from its byte
+ * histogram in h->ll: no calibration, as there is no search to model */
+static double literal_bits(const est_hist_t *h, size_t n, size_t block, int level) {
+    double bits = coded_bits(h, 256, 1.0, n, block, level);
+    return bits < 8.0 * (double)n ? bits : 8.0 * (double)n;
+}
+
+/* k's low bits bits reversed: counting k up visits 0 .. 2^bits - 1 so
+ * that any run from 0 is spread evenly over them */
+static size_t bit_reverse(size_t k, int bits) {
+    size_t r = 0;
+    for (int i = 0; i < bits; i++, k >>= 1) r = r << 1 | (k & 1);
+    return r;
+}
+
+/* BWT-coded size of a window, in bits, scaled to what it would come to
+ * in a whole block (by less, the less it compresses); the transform's
+ * time is added to *ns.  Returns -1 if out of memory. */
+static double bwt_bits(const uint8_t *in, size_t n, uint64_t *ns) {
+    uint64_t t0 = odz_now_ns();
+    bit_writer_t xw;
+    if (bw_init(&xw, n / 2 + 1024, NULL) != 0 ||
+        odz_bwt_encode(in, n, &xw, NULL) != 0 || bw_flush(&xw) != 0) {
+        bw_free(&xw);
+        return -1;
+    }
+    double bits = 8.0 * (double)xw.pos, c = bits / (8.0 * (double)n);
+    bw_free(&xw);
+    if (c < 1.0) bits *= EST_BWT_SIZE + (1.0 - EST_BWT_SIZE) * c;
+    *ns += odz_now_ns() - t0;
+    return bits;
+}
+
+int odz_estimate(const void *buf, size_t len, int level, odz_estimate_t *est) {
+    if (level == 0) level = ODZ_LEVEL_DEFAULT;
+    if (level < ODZ_LEVEL_MIN || level > ODZ_LEVEL_MAX) return ODZ_ERR_FORMAT;
+    memset(est, 0, sizeof *est);
+    if (len == 0) {
+        est->ratio = 1.0;
+        return ODZ_OK;
+    }
+
+    /* Windows: back to back over the whole input, or centred in even
+     * spans adding up to the sample budget */
+    size_t budget = len / EST_SHARE;
+    if (budget < EST_WHOLE) budget = EST_WHOLE;
+    if (budget > EST_MAX) budget = EST_MAX;
+    int whole = len <= budget;
+    size_t nwin = ((whole ? len : budget) + ODZ_WINDOW - 1) / ODZ_WINDOW;
+    size_t span = whole ? ODZ_WINDOW : len / nwin;
+    int order = 0;
+    while (((size_t)1 << order) < nwin) order++;
+
+    est_tab_t *t = calloc(1, sizeof *t);
+    est_hist_t *h = malloc(sizeof *h);
+    if (!t || !h) { free(t); free(h); return ODZ_ERR_OOM; }
+
+    /* Each window is first put to odz_lz_pays, as the encoder puts its
+     * block: one it turns down is coded from its histogram alone */
+    const uint8_t *p = buf;
+    size_t block = len < ODZ_BLOCK_SIZE ? len : ODZ_BLOCK_SIZE;
+    size_t lz_bytes = 0, seen = 0;
+    double bits = 0, steps = 0, lo = 0, hi = 0;
+    uint64_t lz_ns = 0, lit_ns = 0, bwt_ns = 0;
+    for (size_t k = 0; k < (size_t)1 << order; k++) {
+        size_t w = bit_reverse(k, order);
+        if (w >= nwin) continue;
+        size_t off = w * span + (whole || span < ODZ_WINDOW ? 0 : (span - ODZ_WINDOW) / 2);
+        size_t n = len - off < ODZ_WINDOW ? len - off : ODZ_WINDOW;
+        double wbits;
+        memset(h, 0, sizeof *h);
+        uint64_t t0 = odz_now_ns();
+        if (odz_lz_pays(p + off, n)) {
+            size_t hist = off % block < ODZ_WINDOW ? off % block : ODZ_WINDOW;
+            probe_window(p + off, n, hist, block, level, h, t);
+            lz_ns += odz_now_ns() - t0;
+            wbits = window_bits(h, n, block, level);
+            steps += h->steps;
+            lz_bytes += n;
+        } else {
+            for (size_t i = 0; i < n; i++) h->ll[p[off + i]]++;
+            lit_ns += odz_now_ns() - t0;
+            wbits = literal_bits(h, n, block, level);
+        }
+        /* The encoder keeps the transform if it saves 1/64 */
+        if (est_level[level].bwt) {
+            double xbits = bwt_bits(p + off, n, &bwt_ns);
+            if (xbits < 0) { free(t); free(h); return ODZ_ERR_OOM; }
+            if (xbits + wbits / 64 < wbits) wbits = xbits;
+        }
+        bits += wbits;
+        est->sampled += n;
+
+        double rate = wbits / (double)n;
+        if (seen++ == 0 || rate < lo) lo = rate;
+        if (seen == 1 || rate > hi) hi = rate;
+        if (seen >= EST_SETTLE && hi - lo <= EST_SPREAD) break;
+    }
+    free(t);
+    free(h);
+
+    /* Scale up to the input */
+    double out = bits / 8.0 / (double)est->sampled;
+    est->ratio = 1.0 / (out + (double)(ODZ_HEADER_SIZE + 9) / (double)len);
+    double step_rate = lz_bytes ? steps / (double)lz_bytes : 0;
+    double ns = (double)lz_ns * (EST_TIME_BASE + EST_TIME_STEP * step_rate) +
+                (double)lit_ns * (est_level[level].fse ? EST_TIME_LIT_FSE : EST_TIME_LIT) +
+                (double)bwt_ns * EST_TIME_BWT;
+    double ns_per_byte = (ns > 0 ? ns : 1) / (double)est->sampled;
+    est->speed = 1e3 / ns_per_byte;
+    return ODZ_OK;
+}
+
+int odz_estimate_file(FILE *f, int level, odz_estimate_t *est) {
+    odz_map_t m;
+    int rc = odz_io_map(&m, f);
+    if (rc != ODZ_OK) return rc;
+    rc = odz_estimate(m.data, (size_t)m.size, level, est);
+    odz_io_unmap(&m);
+    return rc;
+}
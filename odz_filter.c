@@ -0,0 +1,209 @@
+/*
+ * Pre-LZ transform filters (see odz_filter.h).
+ */
+
+#include <string.h>
+
+#include "odz_filter.h"
+#include "odz.h"
+
+/* ── x86 E8/E9 ─────────────────────────────────────────────── */
+
+/*
+ * A call / jmp rel32 whose operand's top byte is 00 or FF (a target
+ * within ±16 MB) has the operand rewritten as the absolute position it
+ * reaches, wrapped back into that same 25-bit signed range so the top
+ * byte stays 00 / FF and the decoder recognises it again.  Whether or
+ * not it converts, the scan skips the operand, so both directions stop
+ * at the same opcode bytes.  Positions are block-relative.
+ */
+#define X86_SPAN (1u << 24)
+
+static void x86_convert(uint8_t *p, size_t n, int encode) {
+    for (size_t i = 0; i + 5 <= n; ) {
+        if ((p[i] & 0xFE) != 0xE8) { i++; continue; }
+        if (p[i + 4] == 0x00 || p[i + 4] == 0xFF) {
+            uint32_t v  = rd_u32le(p + i + 1);
+            uint32_t pc = (uint32_t)(i + 5);
+            v = encode ? v + pc : v - pc;
+            wr_u32le(p + i + 1, ((v + X86_SPAN) & (2 * X86_SPAN - 1)) - X86_SPAN);
+        }
+        i += 5;
+    }
+}
+
+/* ── Transforms ────────────────────────────────────────────── */
+
+void odz_filter_encode(odz_filter_t f, const uint8_t *in, uint8_t *out, size_t n) {
+    size_t w = f.width;
+    switch (f.id) {
+    case ODZ_FILTER_X86:
+        memcpy(out, in, n);
+        x86_convert(out, n, 1);
+        break;
+    case ODZ_FILTER_DELTA:
+        for (size_t i = 0; i < n && i < w; i++) out[i] = in[i];
+        for (size_t i = w; i < n; i++) out[i] = (uint8_t)(in[i] - in[i - w]);
+        break;
+    case ODZ_FILTER_SHUFFLE: {
+        /* Whole records plane by plane, then the tail as is */
+        size_t m = n / w;
+        for (size_t j = 0; j < w; j++)
+            for (size_t r = 0; r < m; r++) out[j * m + r] = in[r * w + j];
+        memcpy(out + m * w, in + m * w, n - m * w);
+        break;
+    }
+    default:
+        memcpy(out, in, n);
+        break;
+    }
+}
+
+uint8_t *odz_filter_decode(odz_filter_t f, uint8_t *buf, uint8_t *tmp, size_t n) {
+    size_t w = f.width;
+    switch (f.id) {
+    case ODZ_FILTER_X86:
+        x86_convert(buf, n, 0);
+        return buf;
+    case ODZ_FILTER_DELTA:
+        for (size_t i = w; i < n; i++) buf[i] = (uint8_t)(buf[i] + buf[i - w]);
+        return buf;
+    case ODZ_FILTER_SHUFFLE: {
+        size_t m = n / w;
+        for (size_t j = 0; j < w; j++)
+            for (size_t r = 0; r < m; r++) tmp[r * w + j] = buf[j * m + r];
+        memcpy(tmp + m * w, buf + m * w, n - m * w);
+        return tmp;
+    }
+    default:
+        return buf;
+    }
+}
+
+int odz_filter_valid(odz_filter_t f) {
+    switch (f.id) {
+    case ODZ_FILTER_X86:     return f.width == 0;
+    case ODZ_FILTER_DELTA:   return f.width >= 1;
+    case ODZ_FILTER_SHUFFLE: return f.width >= 2;
+    default:                 return 0;
+    }
+}
+
+/* ── Detection ─────────────────────────────────────────────── */
+
+/*
+ * Up to 16 slices of 4 KB spread over the block are sampled.  The first
+ * pass finds the record width w (1-16) at which bytes repeat most often,
+ * and counts x86 call / jump opcodes with near operands.  The second
+ * costs the candidates by order-0 entropy: raw bytes, delta 1 and delta
+ * w, and shuffle w, whose planes are costed as plain bytes or as the
+ * change from one record to the next, whichever is lower, since LZ
+ * turns a plane of slowly changing bytes into runs.  Entropy is only a
+ * stand-in for the coded size, but a fair one for ranking.
+ */
+#define SAMPLE_SLICES  16
+#define SAMPLE_SLICE   4096
+#define WIDTH_MAX      16
+
+typedef struct {
+    const uint8_t *p;
+    size_t n, nslices, len;
+} sample_t;
+
+/* Start of slice k; lanes are counted by block offset, so any start works */
+static size_t slice_off(const sample_t *s, size_t k) {
+    return s->nslices > 1 ? (s->n / s->nslices * k) & ~(size_t)63 : 0;
+}
+
+/* log2(x) in 1/256 bits, within 0.09 bits: enough to rank candidates */
+static uint32_t log2_q8(uint32_t x) {
+    int e = 0;
+    while (x >> (e + 1)) e++;
+    uint32_t frac = e >= 8 ? (x >> (e - 8)) & 255 : (x << (8 - e)) & 255;
+    return (uint32_t)e * 256 + frac;
+}
+
+/* Order-0 size of a histogram, in 1/256 bits */
+static uint64_t cost_q8(const uint32_t *h) {
+    uint32_t n = 0;
+    for (int s = 0; s < 256; s++) n += h[s];
+    if (n == 0) return 0;
+    uint32_t ln = log2_q8(n);
+    uint64_t c = 0;
+    for (int s = 0; s < 256; s++)
+        if (h[s]) c += (uint64_t)h[s] * (ln - log2_q8(h[s]));
+    return c;
+}
+
+odz_filter_t odz_filter_pick(odz_filter_t req, const uint8_t *p, size_t n) {
+    odz_filter_t none = { ODZ_FILTER_NONE, 0 };
+    if (req.id == ODZ_FILTER_NONE || req.id == ODZ_FILTER_X86) return req;
+    if (req.width) return req;
+    if (n < 64) return req.id == ODZ_FILTER_AUTO ? none : (odz_filter_t){ req.id, 2 };
+
+    sample_t sm = { p, n, n > SAMPLE_SLICES * SAMPLE_SLICE ? SAMPLE_SLICES : 1, 0 };
+    sm.len = sm.nslices > 1 ? SAMPLE_SLICE : n;
+
+    /* Pass 1: record width, x86 opcodes */
+    uint32_t same[WIDTH_MAX + 1] = {0};
+    size_t x86_hits = 0, sampled = sm.nslices * sm.len;
+    for (size_t k = 0; k < sm.nslices; k++) {
+        size_t off = slice_off(&sm, k);
+        for (size_t i = off; i < off + sm.len; i++) {
+            uint8_t b = p[i];
+            for (int w = 1; w <= WIDTH_MAX && (size_t)w <= i; w++) same[w] += b == p[i - w];
+            if ((b & 0xFE) == 0xE8 && i + 4 < n && (p[i + 4] == 0x00 || p[i + 4] == 0xFF))
+                x86_hits++;
+        }
+    }
+
+    /* Calls and jumps with near targets: about 1 byte in 100 of x86 code,
+     * 1 in 4000 of random data */
+    if (req.id == ODZ_FILTER_AUTO && x86_hits * 200 >= sampled)
+        return (odz_filter_t){ ODZ_FILTER_X86, 0 };
+
+    /* A wider period has to repeat clearly more often to beat a narrower
+     * one (a 4-byte period also repeats at 8) */
+    int w = req.id == ODZ_FILTER_SHUFFLE ? 2 : 1;
+    for (int v = w + 1; v <= WIDTH_MAX; v++)
+        if (same[v] > same[w] + same[w] / 8) w = v;
+
+    /* Pass 2: costs for the candidates at that width */
+    uint32_t raw[256] = {0}, d1[256] = {0}, dw[256] = {0};
+    uint32_t lane[WIDTH_MAX][256], lane_d[WIDTH_MAX][256];
+    memset(lane, 0, sizeof lane);
+    memset(lane_d, 0, sizeof lane_d);
+    for (size_t k = 0; k < sm.nslices; k++) {
+        size_t off = slice_off(&sm, k);
+        for (size_t i = off; i < off + sm.len; i++) {
+            uint8_t b = p[i];
+            uint8_t dlt = i >= (size_t)w ? (uint8_t)(b - p[i - w]) : b;
+            raw[b]++;
+            d1[i ? (uint8_t)(b - p[i - 1]) : b]++;
+            dw[dlt]++;
+            lane[i % w][b]++;
+            lane_d[i % w][dlt]++;
+        }
+    }
+
+    uint64_t base = cost_q8(raw);
+    odz_filter_t best = { ODZ_FILTER_DELTA, 1 };
+    uint64_t best_cost = cost_q8(d1);
+    if (w > 1 && cost_q8(dw) < best_cost) {
+        best_cost = cost_q8(dw);
+        best.width = (uint8_t)w;
+    }
+    if (req.id == ODZ_FILTER_SHUFFLE) best_cost = UINT64_MAX;
+    if (w > 1 && req.id != ODZ_FILTER_DELTA) {
+        uint64_t c = 0;
+        for (int j = 0; j < w; j++) {
+            uint64_t a = cost_q8(lane[j]), b = cost_q8(lane_d[j]);
+            c += a < b ? a : b;
+        }
+        if (c < best_cost) { best_cost = c; best = (odz_filter_t){ ODZ_FILTER_SHUFFLE, (uint8_t)w }; }
+    }
+
+    /* A named filter is used regardless; auto wants it to save 1/8 */
+    if (req.id == ODZ_FILTER_AUTO && best_cost + base / 8 > base) return none;
+    return best;
+}
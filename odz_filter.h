@@ -0,0 +1,45 @@
+#ifndef ODZ_FILTER_H
+#define ODZ_FILTER_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "libodzip.h"
+
+/*
+ * Pre-LZ transform filters, applied per block before the matcher and
+ * undone after decoding.  They turn structure that LZ77 cannot see into
+ * byte-exact repeats and skewed byte statistics:
+ *
+ *   x86      E8/E9 call/jump operands, relative → absolute, so calls to
+ *            the same function become identical byte strings
+ *   delta    byte i minus byte i - width (sampled signals, counters, pixels)
+ *   shuffle  byte j of every width-byte record gathered into plane j, so
+ *            the high bytes of integer / float columns line up
+ *
+ * A filtered block carries ODZ_BLOCK_FILTERED and two extra header bytes:
+ * filter id (ODZ_FILTER_*) and width (delta / shuffle; 0 for x86).
+ */
+
+typedef struct {
+    uint8_t id;         /* ODZ_FILTER_* (ODZ_FILTER_AUTO only as a request) */
+    uint8_t width;      /* delta distance / shuffle record size */
+} odz_filter_t;
+
+#define ODZ_FILTER_WIDTH_MAX 255
+
+/* Filter for a block of n bytes: resolves ODZ_FILTER_AUTO, and a delta or
+ * shuffle request with width 0, from sampled byte statistics.  Returns
+ * id ODZ_FILTER_NONE when nothing is expected to pay off. */
+odz_filter_t odz_filter_pick(odz_filter_t req, const uint8_t *p, size_t n);
+
+/* Forward transform in[0..n) → out[0..n); f must be a concrete filter */
+void odz_filter_encode(odz_filter_t f, const uint8_t *in, uint8_t *out, size_t n);
+
+/* Inverse transform of buf[0..n), using tmp (n bytes) where it cannot run
+ * in place; returns whichever of the two holds the result */
+uint8_t *odz_filter_decode(odz_filter_t f, uint8_t *buf, uint8_t *tmp, size_t n);
+
+/* 1 if f is a concrete filter that a stream may name */
+int odz_filter_valid(odz_filter_t f);
+
+#endif
@@ -0,0 +1,215 @@
+/*
+ * Stream inspection (odz_inspect): the block structure of an odz stream,
+ * read from its headers alone.
+ *
+ * Each block header gives the block's type, raw size and, for coded
+ * blocks, the payload size, so the walk reads a few bytes per block and
+ * seeks over the rest.  Huffman and FSE blocks open with their code
+ * tables; only those first bytes of the payload are read, for the code
+ * lengths or normalized counts, never the tokens.  In an encrypted stream
+ * those are ciphertext too, so only the headers and tags are accounted.
+ */
+
+#ifndef _WIN32
+#define _POSIX_C_SOURCE 200809L  /* fseeko / ftello under -std=c17 */
+#endif
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef _MSC_VER
+#define fseeko _fseeki64
+#define ftello _ftelli64
+#endif
+
+#include "libodzip.h"
+#include "odz.h"
+#include "bitstream.h"
+#include "huffman.h"
+#include "fse.h"
+#include "lz_tables.h"
+#include "odz_filter.h"
+
+/* Payload bytes read for the code tables.  Trees take at most about 620
+ * (every code length with the longest run code), FSE counts less. */
+#define INSPECT_TABLE_MAX 1024
+
+/* Advance n bytes: seek where the stream allows it, read through where
+ * it does not (a pipe).  0, or -1 on a short stream. */
+static int skip(FILE *in, uint64_t n, int *seekable) {
+    if (*seekable && n <= (uint64_t)INT64_MAX) {
+        if (fseeko(in, (int64_t)n, SEEK_CUR) == 0) return 0;
+        *seekable = 0;
+    }
+    uint8_t buf[4096];
+    while (n > 0) {
+        size_t k = n < sizeof buf ? (size_t)n : sizeof buf;
+        if (fread(buf, 1, k, in) != k) return -1;
+        n -= k;
+    }
+    return 0;
+}
+
+/* Code tables at the head of a Huffman or FSE payload into b.  A block
+ * whose tables do not parse is corrupt. */
+static int read_tables(FILE *in, odz_block_info_t *b, uint32_t payload, int version) {
+    uint8_t buf[INSPECT_TABLE_MAX];
+    size_t n = payload < sizeof buf ? payload : sizeof buf;
+    if (fread(buf, 1, n, in) != n) return ODZ_ERR_IO;
+
+    bit_reader_t br;
+    br_init(&br, buf, n);
+    if (b->type == ODZ_BLOCK_HUFFMAN) {
+        uint8_t ll[LITLEN_SYMS], d[DIST_SYMS];
+        int n_ll, n_dist;
+        if (huff_read_trees(&br, ll, &n_ll, d, &n_dist,
+                            version >= 5 ? HUFF_HDIST_BITS_V5 : HUFF_HDIST_BITS) != 0)
+            return ODZ_ERR_CORRUPT;
+        for (int s = 0; s < LITLEN_SYMS; s++) b->litlen[s] = ll[s];
+        for (int s = 0; s < DIST_SYMS; s++) b->dist[s] = d[s];
+    } else {
+        int16_t norm[LITLEN_SYMS];
+        int has_dist = (int)br_read(&br, 1);
+        if (fse_read_counts(&br, norm, LITLEN_SYMS, &b->ll_log) != 0) return ODZ_ERR_CORRUPT;
+        memcpy(b->litlen, norm, sizeof b->litlen);
+        if (has_dist) {
+            if (fse_read_counts(&br, norm, DIST_SYMS, &b->dist_log) != 0) return ODZ_ERR_CORRUPT;
+            memcpy(b->dist, norm, sizeof b->dist);
+        }
+    }
+    size_t used = br_bytes_used(&br);
+    if (used > n) return ODZ_ERR_CORRUPT;     /* ran past what the block holds */
+    b->have_tables = 1;
+    b->table_bytes = (uint32_t)used;
+    return ODZ_OK;
+}
+
+/* Where a seekable stream ends, relative to its current position, so a
+ * block seeked past the end is caught before it is reported; else UINT64_MAX */
+static uint64_t stream_left(FILE *in) {
+    int64_t here = ftello(in);
+    if (here < 0 || fseeko(in, 0, SEEK_END) != 0) return UINT64_MAX;
+    int64_t end = ftello(in);
+    if (fseeko(in, here, SEEK_SET) != 0 || end < here) return UINT64_MAX;
+    return (uint64_t)(end - here);
+}
+
+int odz_inspect(FILE *in, odz_inspect_fn fn, void *userdata) {
+    odz_stream_info_t s;
+    memset(&s, 0, sizeof s);
+    int seekable = 1;
+    uint64_t size = stream_left(in);
+
+    /* Stream header, as odz_decompress reads it */
+    uint8_t hdr[ODZ_HEADER_SIZE_MAX];
+    if (fread(hdr, 1, ODZ_HEADER_SIZE_V3, in) != ODZ_HEADER_SIZE_V3) return ODZ_ERR_IO;
+    if (hdr[0] != 'O' || hdr[1] != 'D' || hdr[2] != 'Z') return ODZ_ERR_FORMAT;
+    if (hdr[3] < ODZ_VERSION_MIN || hdr[3] > ODZ_VERSION) return ODZ_ERR_FORMAT;
+    s.version = hdr[3];
+    s.original_size = rd_u64le(hdr + 4);
+    s.block_size = ODZ_BLOCK_SIZE;
+    s.header_size = ODZ_HEADER_SIZE_V3;
+    if (s.version >= 4) {
+        size_t n = ODZ_HEADER_SIZE - ODZ_HEADER_SIZE_V3;
+        if (fread(hdr + ODZ_HEADER_SIZE_V3, 1, n, in) != n) return ODZ_ERR_IO;
+        s.block_size = rd_u32le(hdr + 12);
+        s.flags = hdr[16];
+        s.header_size = ODZ_HEADER_SIZE;
+        if (s.block_size < ODZ_BLOCK_SIZE_MIN || s.block_size > ODZ_BLOCK_SIZE_MAX) return ODZ_ERR_FORMAT;
+        if (s.flags & ~ODZ_STREAM_FLAGS_KNOWN) return ODZ_ERR_FORMAT;
+    }
+    if (s.flags & ODZ_STREAM_PATCH) {
+        if (fread(hdr, 1, 12, in) != 12) return ODZ_ERR_IO;
+        s.ref_size  = rd_u64le(hdr);
+        s.ref_crc32 = rd_u32le(hdr + 8);
+        s.header_size += 12;
+    }
+    if (s.flags & ODZ_STREAM_DEDUP) {
+        if (fread(hdr, 1, 8, in) != 8) return ODZ_ERR_IO;
+        s.dedup_window = rd_u64le(hdr);
+        s.header_size += 8;
+    }
+    if (s.flags & ODZ_STREAM_ENCRYPTED) {
+        if (skip(in, ODZ_CRYPT_FIELDS, &seekable) != 0) return ODZ_ERR_IO;
+        s.header_size += ODZ_CRYPT_FIELDS;
+    }
+    uint32_t tag = (s.flags & ODZ_STREAM_ENCRYPTED) ? ODZ_CRYPT_TAG : 0;
+
+    odz_block_info_t *b = malloc(sizeof *b);
+    if (!b) return ODZ_ERR_OOM;
+    uint64_t pos = s.header_size, total = 0;
+    int rc = ODZ_OK;
+    for (uint64_t index = 0;; index++) {
+        memset(b, 0, sizeof *b);
+        b->index  = index;
+        b->offset = pos;
+
+        uint8_t bh[ODZ_REF_BLOCK_HEADER];
+        if (fread(bh, 1, 1, in) != 1) { rc = ODZ_ERR_IO; break; }
+        int flags = bh[0];
+        b->type = ODZ_BLOCK_TYPE(flags);
+        b->last = flags & ODZ_BLOCK_LAST;
+        if (s.version >= 3) {
+            if (flags & ~ODZ_BLOCK_FLAGS_KNOWN) { rc = ODZ_ERR_FORMAT; break; }
+            b->reuse_trees = (flags & ODZ_BLOCK_REUSE_TREES) != 0;
+            b->multistream = (flags & ODZ_BLOCK_MULTISTREAM) != 0;
+        }
+        int filtered = (flags & ODZ_BLOCK_FILTERED) != 0;
+        if (filtered && (s.version < 4 || b->type == ODZ_BLOCK_STORED || b->type == ODZ_BLOCK_REF)) {
+            rc = ODZ_ERR_CORRUPT;
+            break;
+        }
+        if ((b->reuse_trees || b->multistream) && b->type != ODZ_BLOCK_HUFFMAN) { rc = ODZ_ERR_CORRUPT; break; }
+
+        if (b->type == ODZ_BLOCK_STORED) {
+            if (fread(bh + 1, 1, 4, in) != 4) { rc = ODZ_ERR_IO; break; }
+            b->raw_size  = rd_u32le(bh + 1);
+            b->comp_size = 5 + (uint64_t)b->raw_size + tag;
+            if (skip(in, (uint64_t)b->raw_size + tag, &seekable) != 0) { rc = ODZ_ERR_IO; break; }
+        } else if (b->type == ODZ_BLOCK_HUFFMAN || (b->type == ODZ_BLOCK_FSE && s.version >= 3) ||
+                   (b->type == ODZ_BLOCK_BWT && s.version >= 5)) {
+            if (fread(bh + 1, 1, 8, in) != 8) { rc = ODZ_ERR_IO; break; }
+            b->raw_size = rd_u32le(bh + 1);
+            uint32_t payload = rd_u32le(bh + 5);
+            b->comp_size = (filtered ? 11 : 9) + (uint64_t)payload + tag;
+            if (filtered) {
+                uint8_t fb[2];
+                if (fread(fb, 1, 2, in) != 2) { rc = ODZ_ERR_IO; break; }
+                b->filter = fb[0];
+                b->filter_width = fb[1];
+                odz_filter_t filt = { fb[0], fb[1] };
+                if (!odz_filter_valid(filt)) { rc = ODZ_ERR_CORRUPT; break; }
+            }
+            uint32_t read = 0;
+            if (!b->reuse_trees && !tag && b->type != ODZ_BLOCK_BWT) {
+                if ((rc = read_tables(in, b, payload, s.version)) != ODZ_OK) break;
+                read = payload < INSPECT_TABLE_MAX ? payload : INSPECT_TABLE_MAX;
+            }
+            if (skip(in, (uint64_t)payload - read + tag, &seekable) != 0) { rc = ODZ_ERR_IO; break; }
+        } else if (b->type == ODZ_BLOCK_REF && (s.flags & ODZ_STREAM_DEDUP)) {
+            if (fread(bh + 1, 1, ODZ_REF_BLOCK_HEADER - 1, in) != ODZ_REF_BLOCK_HEADER - 1) {
+                rc = ODZ_ERR_IO;
+                break;
+            }
+            b->raw_size  = rd_u32le(bh + 1);
+            b->src       = rd_u64le(bh + 5);
+            b->comp_size = ODZ_REF_BLOCK_HEADER + tag;
+            if (tag && skip(in, tag, &seekable) != 0) { rc = ODZ_ERR_IO; break; }
+            if (b->src > total || b->raw_size > total - b->src) { rc = ODZ_ERR_CORRUPT; break; }
+        } else {
+            rc = ODZ_ERR_FORMAT;
+            break;
+        }
+        if (b->raw_size > s.block_size) { rc = ODZ_ERR_CORRUPT; break; }
+        if (pos + b->comp_size > size) { rc = ODZ_ERR_IO; break; }
+
+        pos   += b->comp_size;
+        total += b->raw_size;
+        if (fn && fn(&s, b, userdata) != 0) break;
+        if (b->last) {
+            if (total != s.original_size) rc = ODZ_ERR_CORRUPT;
+            break;
+        }
+    }
+    free(b);
+    return rc;
+}
@@ -0,0 +1,737 @@
+/*
+ * Overlapped block I/O: read-ahead / write-behind rings (see odz_io.h).
+ *
+ * Both rings hold IO_SLOTS chunks of IO_CHUNK bytes.  The caller copies
+ * out of the read ring and into the write ring, so the codecs keep their
+ * plain fread/fwrite call pattern while the device works on the other
+ * slots.  Chunk buffers are page-aligned so the same rings serve O_DIRECT.
+ */
+
+#if !defined(_WIN32) && !defined(_GNU_SOURCE)
+#define _GNU_SOURCE             /* O_DIRECT, pread under -std=c17 */
+#endif
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#endif
+#ifdef ODZ_HAVE_PTHREADS
+#include <pthread.h>
+#endif
+#ifndef _WIN32
+#include <sys/mman.h>
+#endif
+#ifdef ODZ_HAVE_IO_URING
+#include <linux/io_uring.h>
+#include <sys/syscall.h>
+#endif
+
+#ifdef _MSC_VER
+#define fseeko _fseeki64
+#define ftello _ftelli64
+#endif
+
+#include "libodzip.h"
+#include "odz_io.h"
+
+#define IO_CHUNK    (1u << 20)
+#define IO_SLOTS    3               /* triple-buffered each way */
+#define IO_ALIGN    4096            /* O_DIRECT buffer / offset alignment */
+
+typedef struct {
+    uint8_t *buf;
+    size_t   len;       /* read: valid bytes; write: bytes queued */
+    size_t   done;      /* io_uring: bytes transferred so far */
+    int64_t  off;       /* io_uring: file offset of buf[0] */
+    int      busy;      /* io_uring: request in flight */
+} io_slot_t;
+
+#ifdef ODZ_HAVE_IO_URING
+typedef struct {
+    int       fd;
+    unsigned *sq_tail, *sq_mask, *sq_array;
+    unsigned *cq_head, *cq_tail, *cq_mask;
+    struct io_uring_sqe *sqes;
+    struct io_uring_cqe *cqes;
+    void     *sq_map, *cq_map;
+    size_t    sq_map_sz, cq_map_sz, sqes_sz;
+    unsigned  inflight;
+} io_ring_t;
+#endif
+
+struct odz_io {
+    FILE     *in, *out;
+    int       backend;
+
+    /* Read side: rs[r_head ..] in file order; r_count filled (threads) */
+    io_slot_t rs[IO_SLOTS];
+    unsigned  r_head, r_count;
+    size_t    r_pos;            /* consumer offset into rs[r_head] */
+    int       r_eof, r_err;
+    int       in_fd;            /* pread / io_uring source, -1 = stdio */
+    int       in_fd_owned;      /* reopened here with O_DIRECT */
+    int64_t   in_start;         /* logical input position at open, -1 if unknown */
+    int64_t   in_off;           /* next offset to read from in_fd */
+    uint64_t  consumed;         /* bytes handed to the caller */
+
+    /* Write side: threads queue ws[w_head .. w_head+w_count) and the
+     * caller fills the slot after them; io_uring fills ws[w_head] */
+    io_slot_t ws[IO_SLOTS];
+    unsigned  w_head, w_count;
+    int       w_err;
+    int       out_fd;
+    int64_t   out_off;
+    int64_t   out_start;        /* output position at open, -1 if unknown */
+
+#ifdef ODZ_HAVE_PTHREADS
+    pthread_t       r_thr, w_thr;
+    int             r_started, w_started, stop;
+    pthread_mutex_t mu;
+    pthread_cond_t  cv;
+#endif
+#ifdef ODZ_HAVE_IO_URING
+    io_ring_t       ring;
+#endif
+};
+
+/* ── Shared setup ──────────────────────────────────────────── */
+
+static int alloc_slots(odz_io_t *io) {
+    for (int k = 0; k < IO_SLOTS; k++) {
+        io->rs[k].buf = aligned_alloc(IO_ALIGN, IO_CHUNK);
+        io->ws[k].buf = aligned_alloc(IO_ALIGN, IO_CHUNK);
+        if (!io->rs[k].buf || !io->ws[k].buf) return -1;
+    }
+    return 0;
+}
+
+static void free_slots(odz_io_t *io) {
+    for (int k = 0; k < IO_SLOTS; k++) {
+        free(io->rs[k].buf);
+        free(io->ws[k].buf);
+        io->rs[k].buf = io->ws[k].buf = NULL;
+    }
+}
+
+#ifndef _WIN32
+/* fd usable with pread/pwrite at explicit offsets */
+static int is_seekable_fd(int fd) {
+    struct stat sb;
+    return fstat(fd, &sb) == 0 && (S_ISREG(sb.st_mode) || S_ISBLK(sb.st_mode));
+}
+#endif
+
+/* Point in_fd at an O_DIRECT descriptor for the input, reading from the
+ * aligned offset below in_start and skipping the difference.  Silently
+ * stays buffered where O_DIRECT is unavailable (tmpfs, non-Linux). */
+static void open_direct(odz_io_t *io) {
+#if defined(O_DIRECT) && defined(__linux__)
+    int fd = fileno(io->in);
+    if (io->in_start < 0 || !is_seekable_fd(fd)) return;
+    char path[64];
+    snprintf(path, sizeof path, "/proc/self/fd/%d", fd);
+    int dfd = open(path, O_RDONLY | O_DIRECT);
+    if (dfd < 0) return;
+    io->in_fd = dfd;
+    io->in_fd_owned = 1;
+    io->in_off = io->in_start & ~(int64_t)(IO_ALIGN - 1);
+    io->r_pos = (size_t)(io->in_start - io->in_off);
+#else
+    (void)io;
+#endif
+}
+
+/* Read one chunk from in_fd (pread) or the FILE.  Short only at EOF or
+ * error (*err set). */
+static size_t fill_chunk(odz_io_t *io, uint8_t *buf, int *err) {
+#ifndef _WIN32
+    if (io->in_fd >= 0) {
+        size_t got = 0;
+        while (got < IO_CHUNK) {
+            ssize_t r = pread(io->in_fd, buf + got, IO_CHUNK - got, (off_t)io->in_off);
+            if (r < 0 && errno == EINTR) continue;
+            if (r < 0) { *err = 1; break; }
+            if (r == 0) break;
+            got += (size_t)r;
+            io->in_off += r;
+            if (io->in_fd_owned && got < IO_CHUNK) break;  /* O_DIRECT: short read is EOF */
+        }
+        return got;
+    }
+#endif
+    size_t got = fread(buf, 1, IO_CHUNK, io->in);
+    if (got < IO_CHUNK && ferror(io->in)) *err = 1;
+    return got;
+}
+
+/* ── Threads backend ───────────────────────────────────────── */
+
+#ifdef ODZ_HAVE_PTHREADS
+
+static void *reader_main(void *arg) {
+    odz_io_t *io = arg;
+    pthread_mutex_lock(&io->mu);
+    while (!io->stop) {
+        if (io->r_count == IO_SLOTS) {
+            pthread_cond_wait(&io->cv, &io->mu);
+            continue;
+        }
+        /* The tail slot is ours until r_count covers it */
+        io_slot_t *s = &io->rs[(io->r_head + io->r_count) % IO_SLOTS];
+        pthread_mutex_unlock(&io->mu);
+        int err = 0;
+        s->len = fill_chunk(io, s->buf, &err);
+        pthread_mutex_lock(&io->mu);
+        io->r_count++;
+        if (err) io->r_err = 1;
+        if (err || s->len < IO_CHUNK) io->r_eof = 1;
+        pthread_cond_broadcast(&io->cv);
+        if (io->r_eof) break;
+    }
+    pthread_mutex_unlock(&io->mu);
+    return NULL;
+}
+
+static void *writer_main(void *arg) {
+    odz_io_t *io = arg;
+    pthread_mutex_lock(&io->mu);
+    for (;;) {
+        if (io->w_count == 0) {
+            if (io->stop) break;    /* drained */
+            pthread_cond_wait(&io->cv, &io->mu);
+            continue;
+        }
+        io_slot_t *s = &io->ws[io->w_head];
+        pthread_mutex_unlock(&io->mu);
+        int ok = fwrite(s->buf, 1, s->len, io->out) == s->len;
+        pthread_mutex_lock(&io->mu);
+        if (!ok) io->w_err = 1;
+        s->len = 0;
+        io->w_head = (io->w_head + 1) % IO_SLOTS;
+        io->w_count--;
+        pthread_cond_broadcast(&io->cv);
+    }
+    pthread_mutex_unlock(&io->mu);
+    return NULL;
+}
+
+static int threads_open(odz_io_t *io, int direct) {
+    if (alloc_slots(io) != 0) return -1;
+    if (direct) open_direct(io);
+    if (pthread_mutex_init(&io->mu, NULL) != 0) return -1;
+    if (pthread_cond_init(&io->cv, NULL) != 0) {
+        pthread_mutex_destroy(&io->mu);
+        return -1;
+    }
+    io->r_started = pthread_create(&io->r_thr, NULL, reader_main, io) == 0;
+    io->w_started = io->r_started &&
+                    pthread_create(&io->w_thr, NULL, writer_main, io) == 0;
+    if (!io->w_started) {
+        if (io->r_started) {
+            pthread_mutex_lock(&io->mu);
+            io->stop = 1;
+            pthread_cond_broadcast(&io->cv);
+            pthread_mutex_unlock(&io->mu);
+            pthread_join(io->r_thr, NULL);
+        }
+        pthread_cond_destroy(&io->cv);
+        pthread_mutex_destroy(&io->mu);
+        return -1;
+    }
+    io->backend = ODZ_IO_THREADS;
+    return 0;
+}
+
+static size_t threads_read(odz_io_t *io, uint8_t *dst, size_t n) {
+    size_t total = 0;
+    pthread_mutex_lock(&io->mu);
+    while (total < n) {
+        if (io->r_count == 0) {
+            if (io->r_eof) break;
+            pthread_cond_wait(&io->cv, &io->mu);
+            continue;
+        }
+        io_slot_t *s = &io->rs[io->r_head];
+        size_t avail = s->len > io->r_pos ? s->len - io->r_pos : 0;
+        size_t k = n - total < avail ? n - total : avail;
+        memcpy(dst + total, s->buf + io->r_pos, k);  /* head slot is ours */
+        total += k;
+        io->r_pos += k;
+        if (io->r_pos >= s->len) {
+            io->r_pos = 0;
+            io->r_head = (io->r_head + 1) % IO_SLOTS;
+            io->r_count--;
+            pthread_cond_broadcast(&io->cv);
+        }
+    }
+    pthread_mutex_unlock(&io->mu);
+    return total;
+}
+
+/* Slot the caller may append to, waiting for the writer if all are queued */
+static io_slot_t *threads_fill_slot(odz_io_t *io) {
+    pthread_mutex_lock(&io->mu);
+    while (io->w_count == IO_SLOTS && !io->w_err)
+        pthread_cond_wait(&io->cv, &io->mu);
+    io_slot_t *s = io->w_err ? NULL : &io->ws[(io->w_head + io->w_count) % IO_SLOTS];
+    pthread_mutex_unlock(&io->mu);
+    return s;
+}
+
+static void threads_queue(odz_io_t *io) {
+    pthread_mutex_lock(&io->mu);
+    io->w_count++;
+    pthread_cond_broadcast(&io->cv);
+    pthread_mutex_unlock(&io->mu);
+}
+
+static void threads_close(odz_io_t *io) {
+    io_slot_t *s = threads_fill_slot(io);
+    if (s && s->len > 0) threads_queue(io);
+    pthread_mutex_lock(&io->mu);
+    io->stop = 1;
+    pthread_cond_broadcast(&io->cv);
+    pthread_mutex_unlock(&io->mu);
+    if (io->w_started) pthread_join(io->w_thr, NULL);
+    if (io->r_started) pthread_join(io->r_thr, NULL);
+    pthread_cond_destroy(&io->cv);
+    pthread_mutex_destroy(&io->mu);
+}
+
+#endif /* ODZ_HAVE_PTHREADS */
+
+/* ── io_uring backend ──────────────────────────────────────── */
+
+#ifdef ODZ_HAVE_IO_URING
+
+#define UD_WRITE    0x100u      /* user_data: slot index | UD_WRITE */
+
+static int ring_setup(io_ring_t *r, unsigned entries) {
+    struct io_uring_params p;
+    memset(&p, 0, sizeof p);
+    r->fd = (int)syscall(__NR_io_uring_setup, entries, &p);
+    if (r->fd < 0) return -1;
+
+    /* IORING_OP_READ / WRITE need Linux 5.6; probe rather than guess */
+    size_t probe_sz = sizeof(struct io_uring_probe) + 256 * sizeof(struct io_uring_probe_op);
+    struct io_uring_probe *probe = calloc(1, probe_sz);
+    int ok = probe && syscall(__NR_io_uring_register, r->fd, IORING_REGISTER_PROBE, probe, 256) == 0 &&
+             probe->last_op >= IORING_OP_WRITE &&
+             (probe->ops[IORING_OP_READ].flags & IO_URING_OP_SUPPORTED) &&
+             (probe->ops[IORING_OP_WRITE].flags & IO_URING_OP_SUPPORTED);
+    free(probe);
+    if (!ok) { close(r->fd); return -1; }
+
+    r->sq_map_sz = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+    r->cq_map_sz = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+    int single = (p.features & IORING_FEAT_SINGLE_MMAP) != 0;
+    if (single) {
+        if (r->cq_map_sz > r->sq_map_sz) r->sq_map_sz = r->cq_map_sz;
+        r->cq_map_sz = r->sq_map_sz;
+    }
+    r->sq_map = mmap(NULL, r->sq_map_sz, PROT_READ | PROT_WRITE, MAP_SHARED,
+                     r->fd, IORING_OFF_SQ_RING);
+    if (r->sq_map == MAP_FAILED) { close(r->fd); return -1; }
+    r->cq_map = single ? r->sq_map
+                       : mmap(NULL, r->cq_map_sz, PROT_READ | PROT_WRITE, MAP_SHARED,
+                              r->fd, IORING_OFF_CQ_RING);
+    r->sqes_sz = p.sq_entries * sizeof(struct io_uring_sqe);
+    r->sqes = mmap(NULL, r->sqes_sz, PROT_READ | PROT_WRITE, MAP_SHARED,
+                   r->fd, IORING_OFF_SQES);
+    if (r->cq_map == MAP_FAILED || r->sqes == MAP_FAILED) {
+        if (r->cq_map != MAP_FAILED && !single) munmap(r->cq_map, r->cq_map_sz);
+        if (r->sqes != MAP_FAILED) munmap(r->sqes, r->sqes_sz);
+        munmap(r->sq_map, r->sq_map_sz);
+        close(r->fd);
+        return -1;
+    }
+
+    uint8_t *sq = r->sq_map, *cq = r->cq_map;
+    r->sq_tail  = (unsigned *)(sq + p.sq_off.tail);
+    r->sq_mask  = (unsigned *)(sq + p.sq_off.ring_mask);
+    r->sq_array = (unsigned *)(sq + p.sq_off.array);
+    r->cq_head  = (unsigned *)(cq + p.cq_off.head);
+    r->cq_tail  = (unsigned *)(cq + p.cq_off.tail);
+    r->cq_mask  = (unsigned *)(cq + p.cq_off.ring_mask);
+    r->cqes     = (struct io_uring_cqe *)(cq + p.cq_off.cqes);
+    r->inflight = 0;
+    return 0;
+}
+
+static void ring_teardown(io_ring_t *r) {
+    munmap(r->sqes, r->sqes_sz);
+    if (r->cq_map != r->sq_map) munmap(r->cq_map, r->cq_map_sz);
+    munmap(r->sq_map, r->sq_map_sz);
+    close(r->fd);
+}
+
+/* Queue the untransferred remainder of slot s and submit it */
+static int ring_submit(odz_io_t *io, io_slot_t *s, unsigned ud) {
+    io_ring_t *r = &io->ring;
+    int is_write = (ud & UD_WRITE) != 0;
+    unsigned tail = *r->sq_tail;
+    unsigned idx = tail & *r->sq_mask;
+    struct io_uring_sqe *sqe = &r->sqes[idx];
+    memset(sqe, 0, sizeof *sqe);
+    sqe->opcode    = is_write ? IORING_OP_WRITE : IORING_OP_READ;
+    sqe->fd        = is_write ? io->out_fd : io->in_fd;
+    sqe->addr      = (uint64_t)(uintptr_t)(s->buf + s->done);
+    sqe->len       = (unsigned)((is_write ? s->len : IO_CHUNK) - s->done);
+    sqe->off       = (uint64_t)(s->off + (int64_t)s->done);
+    sqe->user_data = ud;
+    r->sq_array[idx] = idx;
+    __atomic_store_n(r->sq_tail, tail + 1, __ATOMIC_RELEASE);
+
+    long rc;
+    do rc = syscall(__NR_io_uring_enter, r->fd, 1, 0, 0, NULL, 0);
+    while (rc < 0 && errno == EINTR);
+    if (rc != 1) return -1;
+    s->busy = 1;
+    r->inflight++;
+    return 0;
+}
+
+static void ring_complete(odz_io_t *io, unsigned ud, int res) {
+    int is_write = (ud & UD_WRITE) != 0;
+    io_slot_t *s = is_write ? &io->ws[ud & 0xff] : &io->rs[ud & 0xff];
+    s->busy = 0;
+    io->ring.inflight--;
+
+    if (is_write) {
+        if (res > 0) s->done += (size_t)res;
+        if (res <= 0) io->w_err = 1;
+        else if (s->done < s->len && ring_submit(io, s, ud) == 0) return;
+        else if (s->done < s->len) io->w_err = 1;
+        s->len = s->done = 0;
+        return;
+    }
+
+    if (res < 0) { io->r_err = 1; s->len = s->done; return; }
+    s->done += (size_t)res;
+    /* Short read: resume unless at EOF (O_DIRECT can't resume unaligned) */
+    if (res > 0 && s->done < IO_CHUNK && !io->in_fd_owned && ring_submit(io, s, ud) == 0)
+        return;
+    s->len = s->done;
+}
+
+/* Wait for at least one completion, then reap everything available */
+static int ring_wait(odz_io_t *io) {
+    io_ring_t *r = &io->ring;
+    unsigned head = *r->cq_head;
+    if (head == __atomic_load_n(r->cq_tail, __ATOMIC_ACQUIRE)) {
+        long rc = syscall(__NR_io_uring_enter, r->fd, 0, 1, IORING_ENTER_GETEVENTS, NULL, 0);
+        if (rc < 0 && errno != EINTR) return -1;
+    }
+    while (head != __atomic_load_n(r->cq_tail, __ATOMIC_ACQUIRE)) {
+        struct io_uring_cqe *c = &r->cqes[head & *r->cq_mask];
+        unsigned ud = (unsigned)c->user_data;
+        int res = c->res;
+        __atomic_store_n(r->cq_head, ++head, __ATOMIC_RELEASE);
+        ring_complete(io, ud, res);
+    }
+    return 0;
+}
+
+static int read_submit(odz_io_t *io, unsigned k) {
+    io_slot_t *s = &io->rs[k];
+    s->off = io->in_off;
+    s->done = 0;
+    s->len = 0;
+    io->in_off += IO_CHUNK;
+    return ring_submit(io, s, k);
+}
+
+static int uring_open(odz_io_t *io, int direct) {
+#ifdef _WIN32
+    (void)io; (void)direct;
+    return -1;
+#else
+    /* Explicit offsets: both ends must be regular files / block devices */
+    if (io->in_start < 0 || !is_seekable_fd(fileno(io->in))) return -1;
+    if (fflush(io->out) != 0) return -1;
+    io->out_off = ftello(io->out);
+    if (io->out_off < 0 || !is_seekable_fd(fileno(io->out))) return -1;
+    if (ring_setup(&io->ring, 2 * IO_SLOTS) != 0) return -1;
+    if (alloc_slots(io) != 0) { ring_teardown(&io->ring); return -1; }
+
+    io->out_fd = fileno(io->out);
+    io->in_fd = fileno(io->in);
+    io->in_off = io->in_start;
+    if (direct) open_direct(io);
+    io->backend = ODZ_IO_URING;
+
+    /* Prime the read-ahead */
+    for (unsigned k = 0; k < IO_SLOTS; k++) {
+        if (read_submit(io, k) != 0) {
+            io->r_err = io->r_eof = 1;
+            break;
+        }
+    }
+    return 0;
+#endif
+}
+
+static size_t uring_read(odz_io_t *io, uint8_t *dst, size_t n) {
+    size_t total = 0;
+    while (total < n && !io->r_eof) {
+        io_slot_t *s = &io->rs[io->r_head];
+        while (s->busy) {
+            if (ring_wait(io) != 0) { io->r_err = io->r_eof = 1; return total; }
+        }
+        size_t avail = s->len > io->r_pos ? s->len - io->r_pos : 0;
+        size_t k = n - total < avail ? n - total : avail;
+        memcpy(dst + total, s->buf + io->r_pos, k);
+        total += k;
+        io->r_pos += k;
+        if (io->r_pos >= s->len) {
+            io->r_pos = 0;
+            if (s->len < IO_CHUNK || io->r_err) { io->r_eof = 1; break; }
+            if (read_submit(io, io->r_head) != 0) { io->r_err = 1; }
+            io->r_head = (io->r_head + 1) % IO_SLOTS;
+        }
+    }
+    return total;
+}
+
+/* Submit ws[w_head] and move on to the next slot */
+static void uring_queue(odz_io_t *io) {
+    io_slot_t *s = &io->ws[io->w_head];
+    s->off = io->out_off;
+    s->done = 0;
+    io->out_off += (int64_t)s->len;
+    if (ring_submit(io, s, io->w_head | UD_WRITE) != 0) io->w_err = 1;
+    io->w_head = (io->w_head + 1) % IO_SLOTS;
+}
+
+static io_slot_t *uring_fill_slot(odz_io_t *io) {
+    io_slot_t *s = &io->ws[io->w_head];
+    while (s->busy && !io->w_err) {
+        if (ring_wait(io) != 0) io->w_err = 1;
+    }
+    return io->w_err ? NULL : s;
+}
+
+static void uring_close(odz_io_t *io) {
+    if (!io->w_err && io->ws[io->w_head].len > 0) uring_queue(io);
+    /* Buffers can't be freed under in-flight requests (incl. read-ahead) */
+    while (io->ring.inflight > 0) {
+        if (ring_wait(io) != 0) { io->w_err = 1; break; }
+    }
+    ring_teardown(&io->ring);
+    /* Bring the output FILE's position up to what was written */
+    if (fseeko(io->out, io->out_off, SEEK_SET) != 0) io->w_err = 1;
+}
+
+#endif /* ODZ_HAVE_IO_URING */
+
+/* ── Public interface ──────────────────────────────────────── */
+
+int odz_io_open(odz_io_t **pio, FILE *in, FILE *out, int backend, int direct) {
+    odz_io_t *io = calloc(1, sizeof *io);
+    if (!io) return ODZ_ERR_OOM;
+    io->in = in;
+    io->out = out;
+    io->backend = ODZ_IO_STDIO;
+    io->in_fd = io->out_fd = -1;
+    io->in_start = in ? ftello(in) : -1;
+    io->out_start = out ? ftello(out) : -1;
+    *pio = io;
+
+#ifdef ODZ_HAVE_IO_URING
+    if (backend == ODZ_IO_URING) {
+        if (uring_open(io, direct) == 0) return ODZ_OK;
+        /* Undo a partial setup before falling back */
+        if (io->in_fd_owned) close(io->in_fd);
+        free_slots(io);
+        io->in_fd = io->out_fd = -1;
+        io->in_fd_owned = 0;
+        io->r_pos = 0;
+    }
+#endif
+    if (backend == ODZ_IO_URING) backend = ODZ_IO_THREADS;
+
+#ifdef ODZ_HAVE_PTHREADS
+    if (backend == ODZ_IO_THREADS && threads_open(io, direct) == 0) return ODZ_OK;
+#endif
+#ifndef _WIN32
+    if (io->in_fd_owned) close(io->in_fd);
+#endif
+    free_slots(io);
+    io->in_fd = -1;
+    io->in_fd_owned = 0;
+    io->r_pos = 0;
+    (void)direct;
+    return ODZ_OK;
+}
+
+size_t odz_io_read(odz_io_t *io, void *dst, size_t n) {
+    size_t got;
+    switch (io->backend) {
+#ifdef ODZ_HAVE_PTHREADS
+    case ODZ_IO_THREADS: got = threads_read(io, dst, n); break;
+#endif
+#ifdef ODZ_HAVE_IO_URING
+    case ODZ_IO_URING:   got = uring_read(io, dst, n); break;
+#endif
+    default:
+        got = fread(dst, 1, n, io->in);
+        if (got < n && ferror(io->in)) io->r_err = 1;
+        break;
+    }
+    io->consumed += got;
+    return got;
+}
+
+size_t odz_io_write(odz_io_t *io, const void *src, size_t n) {
+    if (io->backend == ODZ_IO_STDIO) return fwrite(src, 1, n, io->out);
+
+    const uint8_t *p = src;
+    size_t done = 0;
+    while (done < n) {
+        io_slot_t *s = NULL;
+#ifdef ODZ_HAVE_PTHREADS
+        if (io->backend == ODZ_IO_THREADS) s = threads_fill_slot(io);
+#endif
+#ifdef ODZ_HAVE_IO_URING
+        if (io->backend == ODZ_IO_URING) s = uring_fill_slot(io);
+#endif
+        if (!s) break;
+        size_t k = IO_CHUNK - s->len < n - done ? IO_CHUNK - s->len : n - done;
+        memcpy(s->buf + s->len, p + done, k);
+        s->len += k;
+        done += k;
+        if (s->len == IO_CHUNK) {
+#ifdef ODZ_HAVE_PTHREADS
+            if (io->backend == ODZ_IO_THREADS) threads_queue(io);
+#endif
+#ifdef ODZ_HAVE_IO_URING
+            if (io->backend == ODZ_IO_URING) uring_queue(io);
+#endif
+        }
+    }
+    return done;
+}
+
+int odz_io_error(const odz_io_t *io) {
+    return io->r_err;
+}
+
+int odz_io_backend(const odz_io_t *io) {
+    return io->backend;
+}
+
+int odz_io_write_backlog(odz_io_t *io) {
+    int full = 0;
+#ifdef ODZ_HAVE_PTHREADS
+    if (io->backend == ODZ_IO_THREADS) {
+        pthread_mutex_lock(&io->mu);
+        full = io->w_count >= IO_SLOTS - 1;    /* one being written, more waiting */
+        pthread_mutex_unlock(&io->mu);
+    }
+#endif
+#ifdef ODZ_HAVE_IO_URING
+    if (io->backend == ODZ_IO_URING) full = io->ws[io->w_head].busy;
+#endif
+    return full;
+}
+
+int odz_io_read_back(odz_io_t *io, uint64_t off, void *dst, size_t n) {
+    if (io->out_start < 0) return ODZ_ERR_IO;
+    int64_t pos = io->out_start + (int64_t)off;
+#ifdef ODZ_HAVE_IO_URING
+    if (io->backend == ODZ_IO_URING) {
+        if (!io->w_err && io->ws[io->w_head].len > 0) uring_queue(io);
+        for (unsigned k = 0; k < IO_SLOTS; k++) {
+            while (io->ws[k].busy && !io->w_err) {
+                if (ring_wait(io) != 0) io->w_err = 1;
+            }
+        }
+        if (io->w_err) return ODZ_ERR_IO;
+        for (size_t got = 0; got < n; ) {
+            ssize_t r = pread(io->out_fd, (uint8_t *)dst + got, n - got, (off_t)(pos + (int64_t)got));
+            if (r < 0 && errno == EINTR) continue;
+            if (r <= 0) return ODZ_ERR_IO;
+            got += (size_t)r;
+        }
+        return ODZ_OK;
+    }
+#endif
+#ifdef ODZ_HAVE_PTHREADS
+    if (io->backend == ODZ_IO_THREADS) {
+        io_slot_t *s = threads_fill_slot(io);
+        if (s && s->len > 0) threads_queue(io);
+        pthread_mutex_lock(&io->mu);
+        while (io->w_count > 0 && !io->w_err) pthread_cond_wait(&io->cv, &io->mu);
+        int err = io->w_err;
+        pthread_mutex_unlock(&io->mu);
+        if (err) return ODZ_ERR_IO;
+    }
+#endif
+    /* The writer is idle: read through the FILE and put its position back */
+    if (fflush(io->out) != 0) return ODZ_ERR_IO;
+    int64_t at = ftello(io->out);
+    if (at < 0) return ODZ_ERR_IO;
+    int ok = fseeko(io->out, pos, SEEK_SET) == 0 && fread(dst, 1, n, io->out) == n;
+    if (fseeko(io->out, at, SEEK_SET) != 0) io->w_err = 1;
+    return ok && !io->w_err ? ODZ_OK : ODZ_ERR_IO;
+}
+
+int odz_io_close(odz_io_t *io) {
+    if (!io) return ODZ_OK;
+#ifdef ODZ_HAVE_PTHREADS
+    if (io->backend == ODZ_IO_THREADS) threads_close(io);
+#endif
+#ifdef ODZ_HAVE_IO_URING
+    if (io->backend == ODZ_IO_URING) uring_close(io);
+#endif
+    /* Read-ahead moved the input FILE past what was consumed */
+    if (io->backend != ODZ_IO_STDIO && io->in_start >= 0)
+        fseeko(io->in, io->in_start + (int64_t)io->consumed, SEEK_SET);
+#ifndef _WIN32
+    if (io->in_fd_owned) close(io->in_fd);
+#endif
+    free_slots(io);
+    int rc = io->w_err ? ODZ_ERR_IO : ODZ_OK;
+    free(io);
+    return rc;
+}
+
+/* ── Whole-file mapping (patch references) ─────────────────── */
+
+int odz_io_map(odz_map_t *m, FILE *f) {
+    memset(m, 0, sizeof *m);
+    if (fseeko(f, 0, SEEK_END) != 0) return ODZ_ERR_IO;
+    int64_t size = ftello(f);
+    if (size < 0 || fseeko(f, 0, SEEK_SET) != 0) return ODZ_ERR_IO;
+    if ((uint64_t)size > SIZE_MAX) return ODZ_ERR_OOM;
+    m->size = (uint64_t)size;
+    if (size == 0) return ODZ_OK;
+#ifndef _WIN32
+    void *p = mmap(NULL, (size_t)size, PROT_READ, MAP_PRIVATE, fileno(f), 0);
+    if (p != MAP_FAILED) {
+        m->data = p;
+        m->mapped = 1;
+        return ODZ_OK;
+    }
+#endif
+    /* Not mappable (pipe, platform): read it in */
+    uint8_t *buf = malloc((size_t)size);
+    if (!buf) return ODZ_ERR_OOM;
+    if (fread(buf, 1, (size_t)size, f) != (size_t)size) { free(buf); return ODZ_ERR_IO; }
+    m->data = buf;
+    return ODZ_OK;
+}
+
+void odz_io_unmap(odz_map_t *m) {
+#ifndef _WIN32
+    if (m->mapped) { munmap((void *)m->data, (size_t)m->size); m->data = NULL; return; }
+#endif
+    free((void *)m->data);
+    m->data = NULL;
+}
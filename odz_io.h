@@ -0,0 +1,57 @@
+#ifndef ODZ_IO_H
+#define ODZ_IO_H
+
+/*
+ * Block I/O for the (de)compressors, with optional overlap of reads and
+ * writes against compute (odz_options_t.io):
+ *
+ *   ODZ_IO_STDIO    fread / fwrite on the caller's thread
+ *   ODZ_IO_THREADS  a reader thread fills a ring of 1 MB chunks ahead of
+ *                   the consumer; a writer thread drains output behind it
+ *   ODZ_IO_URING    the same rings driven by io_uring from the caller's
+ *                   thread (Linux; needs seekable files)
+ *
+ * Unavailable backends degrade: io_uring → threads → stdio.  Reads and
+ * writes keep fread/fwrite semantics: a short read means EOF or error.
+ * Write errors surface on a later write or at odz_io_close.
+ */
+
+#include <stdio.h>
+#include <stddef.h>
+#include <stdint.h>
+
+typedef struct odz_io odz_io_t;
+
+/* Returns ODZ_OK or ODZ_ERR_OOM; *io is always usable on success. */
+int    odz_io_open(odz_io_t **io, FILE *in, FILE *out, int backend, int direct);
+size_t odz_io_read(odz_io_t *io, void *dst, size_t n);
+size_t odz_io_write(odz_io_t *io, const void *src, size_t n);
+int    odz_io_error(const odz_io_t *io);   /* nonzero after a read error */
+int    odz_io_backend(const odz_io_t *io); /* ODZ_IO_* actually in use */
+
+/* Nonzero when the write-behind ring is (nearly) full: the device is
+ * more than a chunk behind and further writes will wait for it.  Always
+ * 0 for stdio. */
+int    odz_io_write_backlog(odz_io_t *io);
+
+/* Copy n bytes of the output written so far, from off bytes past where
+ * it stood at open, into dst.  Pending writes are drained first, so each
+ * call stalls the write-behind.  The output must be a seekable file that
+ * is also open for reading.  Returns ODZ_OK or ODZ_ERR_IO. */
+int    odz_io_read_back(odz_io_t *io, uint64_t off, void *dst, size_t n);
+
+/* Drain pending writes and release everything.  Returns ODZ_OK, or
+ * ODZ_ERR_IO if any write failed. */
+int    odz_io_close(odz_io_t *io);
+
+/* A whole file in memory: mmap where possible, else read in */
+typedef struct {
+    const uint8_t *data;
+    uint64_t       size;
+    int            mapped;
+} odz_map_t;
+
+int  odz_io_map(odz_map_t *m, FILE *f);     /* ODZ_OK, ODZ_ERR_IO or ODZ_ERR_OOM */
+void odz_io_unmap(odz_map_t *m);
+
+#endif
@@ -0,0 +1,128 @@
+/*
+ * Memory for the library's buffers: the caller's allocator hooks or
+ * malloc, and huge pages for the big work buffers.
+ *
+ * A 1 MB block touches a 4 MB prev[] table and its token buffer at
+ * random, far more 4K pages than the TLB covers.  On 2 MB pages the whole
+ * working set fits.  Without hooks a big buffer is mapped straight from
+ * the kernel: from the reserved huge page pool (MAP_HUGETLB) if there is
+ * one, else as an aligned anonymous mapping marked MADV_HUGEPAGE for
+ * transparent huge pages.  With hooks it is over-allocated through them
+ * and the 2 MB aligned part inside is marked the same way, so the hooks
+ * still see every byte.
+ */
+
+#if defined(__linux__) && !defined(_GNU_SOURCE)
+#define _GNU_SOURCE             /* MAP_ANONYMOUS, MAP_HUGETLB, madvise under -std=c17 */
+#endif
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+
+#ifdef __linux__
+#include <sys/mman.h>
+#endif
+
+#include "odz.h"
+#include "libodzip.h"
+
+#define HUGE_PAGE   ((size_t)2 << 20)
+#define HUGE_MIN    ((size_t)1 << 20)   /* smaller buffers do not get a page of their own */
+#define HUGE_HDR    16                  /* hooks: room below the aligned block for its base */
+
+int odz_mem_from(odz_mem_t *mem, const odz_options_t *opts) {
+    memset(mem, 0, sizeof *mem);
+    if (!opts) return ODZ_OK;
+    if (!opts->alloc_fn != !opts->free_fn) return ODZ_ERR_FORMAT;
+    mem->alloc    = opts->alloc_fn;
+    mem->free     = opts->free_fn;
+    mem->userdata = opts->alloc_userdata;
+    mem->huge     = opts->huge_pages;
+    return ODZ_OK;
+}
+
+void *odz_alloc(const odz_mem_t *mem, size_t n) {
+    return mem && mem->alloc ? mem->alloc(mem->userdata, n) : malloc(n);
+}
+
+void odz_free(const odz_mem_t *mem, void *p, size_t n) {
+    if (!p) return;
+    if (mem && mem->alloc) mem->free(mem->userdata, p, n);
+    else free(p);
+}
+
+void *odz_realloc(const odz_mem_t *mem, void *p, size_t old, size_t n) {
+    if (!mem || !mem->alloc) return realloc(p, n);
+    void *q = mem->alloc(mem->userdata, n);
+    if (!q) return NULL;
+    if (p) {
+        memcpy(q, p, old < n ? old : n);
+        mem->free(mem->userdata, p, old);
+    }
+    return q;
+}
+
+#ifdef __linux__
+
+static int use_huge(const odz_mem_t *mem, size_t n) {
+    return mem && mem->huge && n >= HUGE_MIN && n <= SIZE_MAX - 2 * HUGE_PAGE;
+}
+
+static size_t huge_round(size_t n) { return (n + HUGE_PAGE - 1) & ~(HUGE_PAGE - 1); }
+
+void *odz_alloc_big(const odz_mem_t *mem, size_t n) {
+    if (!use_huge(mem, n)) return odz_alloc(mem, n);
+
+    if (mem->alloc) {
+        size_t total = n + HUGE_PAGE + HUGE_HDR;
+        uint8_t *base = mem->alloc(mem->userdata, total);
+        if (!base) return NULL;
+        uintptr_t a = ((uintptr_t)base + HUGE_HDR + HUGE_PAGE - 1) & ~(uintptr_t)(HUGE_PAGE - 1);
+        uint8_t *p = (uint8_t *)a;
+        memcpy(p - sizeof base, &base, sizeof base);
+        size_t whole = (size_t)(base + total - p) & ~(HUGE_PAGE - 1);
+#ifdef MADV_HUGEPAGE
+        if (whole) madvise(p, whole, MADV_HUGEPAGE);   /* a hint: fine if refused */
+#endif
+        return p;
+    }
+
+    size_t len = huge_round(n);
+#ifdef MAP_HUGETLB
+    void *h = mmap(NULL, len, PROT_READ | PROT_WRITE,
+                   MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+    if (h != MAP_FAILED) return h;
+#endif
+    /* One page more than needed, trimmed to a 2 MB aligned range */
+    uint8_t *raw = mmap(NULL, len + HUGE_PAGE, PROT_READ | PROT_WRITE,
+                        MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (raw == MAP_FAILED) return NULL;
+    uintptr_t a = ((uintptr_t)raw + HUGE_PAGE - 1) & ~(uintptr_t)(HUGE_PAGE - 1);
+    uint8_t *p = (uint8_t *)a;
+    size_t head = (size_t)(p - raw);
+    if (head) munmap(raw, head);
+    if (HUGE_PAGE - head) munmap(p + len, HUGE_PAGE - head);
+#ifdef MADV_HUGEPAGE
+    madvise(p, len, MADV_HUGEPAGE);
+#endif
+    return p;
+}
+
+void odz_free_big(const odz_mem_t *mem, void *p, size_t n) {
+    if (!p) return;
+    if (!use_huge(mem, n)) { odz_free(mem, p, n); return; }
+    if (mem->alloc) {
+        uint8_t *base;
+        memcpy(&base, (uint8_t *)p - sizeof base, sizeof base);
+        mem->free(mem->userdata, base, n + HUGE_PAGE + HUGE_HDR);
+        return;
+    }
+    munmap(p, huge_round(n));
+}
+
+#else
+
+void *odz_alloc_big(const odz_mem_t *mem, size_t n) { return odz_alloc(mem, n); }
+void  odz_free_big(const odz_mem_t *mem, void *p, size_t n) { odz_free(mem, p, n); }
+
+#endif
@@ -0,0 +1,494 @@
+/*
+ * odz_microbench — per-kernel timings
+ *
+ * Where odz_bench times whole streams, this drives the hot kernels one
+ * at a time on fixed, generated inputs: hashing and match finding,
+ * the bit writer and reader, Huffman table builds and decoding, and the
+ * decoder's match copy.  For each it reports ns per call, cycles per
+ * call and per byte, and a checksum of everything the kernel returned or
+ * wrote, which both keeps the compiler from dropping the work and shows
+ * that an optimised kernel still computes the same thing.
+ *
+ * Cycles are CPU cycles of this thread from perf_event where the system
+ * allows it, else the x86 time-stamp counter (reference cycles at a fixed
+ * rate, so they drift from core cycles with frequency scaling), else not
+ * shown.  match_len and find_best run once per instruction-set variant
+ * the CPU supports; their checksums must agree across variants, and
+ * every kernel's from one repetition to the next, or the exit status is 1.
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <unistd.h>
+
+#ifdef __linux__
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+#endif
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#define HAVE_TSC 1
+#else
+#define HAVE_TSC 0
+#endif
+
+#include "odz.h"
+#include "bitstream.h"
+#include "huffman.h"
+#include "lz_matcher.h"
+#include "lz_tables.h"
+
+#define DEFAULT_SIZE   (1u << 20)
+#define DEFAULT_REPS   5
+#define BUILD_CALLS    2000        /* table builds per repetition */
+#define PAIR_STRIDE    272         /* match_len pairs: 258 bytes + slack */
+#define SEARCH_SPAN    (256u << 10) /* find_best: the slowest kernel, on a prefix */
+
+static void die(const char *m) { fprintf(stderr, "odz_microbench: error: %s\n", m); exit(1); }
+
+/* ── Clocks ────────────────────────────────────────────────── */
+
+static int perf_fd = -1;
+
+static const char *cycles_open(void) {
+#ifdef __linux__
+    struct perf_event_attr pe;
+    memset(&pe, 0, sizeof pe);
+    pe.type = PERF_TYPE_HARDWARE;
+    pe.size = sizeof pe;
+    pe.config = PERF_COUNT_HW_CPU_CYCLES;
+    pe.exclude_kernel = 1;
+    pe.exclude_hv = 1;
+    perf_fd = (int)syscall(SYS_perf_event_open, &pe, 0, -1, -1, 0);
+    if (perf_fd >= 0) {
+        ioctl(perf_fd, PERF_EVENT_IOC_ENABLE, 0);
+        return "perf_event (CPU cycles)";
+    }
+#endif
+    return HAVE_TSC ? "rdtsc (reference cycles)" : NULL;
+}
+
+static uint64_t cycles_now(void) {
+#ifdef __linux__
+    uint64_t c;
+    if (perf_fd >= 0 && read(perf_fd, &c, sizeof c) == (ssize_t)sizeof c) return c;
+#endif
+#if HAVE_TSC
+    return __rdtsc();
+#else
+    return 0;
+#endif
+}
+
+/* ── Inputs ────────────────────────────────────────────────── */
+
+static uint64_t rng_state = 0x9E3779B97F4A7C15ull;
+
+static uint64_t rng_next(void) {
+    /* xorshift64* */
+    rng_state ^= rng_state >> 12;
+    rng_state ^= rng_state << 25;
+    rng_state ^= rng_state >> 27;
+    return rng_state * 2685821657736338717ull;
+}
+
+static uint32_t rng_below(uint32_t n) { return (uint32_t)((rng_next() >> 32) % n); }
+
+/* Text-like bytes: a 4096-word vocabulary of made-up words, drawn with a
+ * skew toward the first ones, as in odz_bench's text corpus */
+#define VOCAB 4096
+
+static void gen_text(uint8_t *d, size_t n) {
+    static char words[VOCAB][12];
+    for (int w = 0; w < VOCAB; w++) {
+        int len = 2 + (int)rng_below(9);
+        for (int c = 0; c < len; c++) words[w][c] = (char)('a' + rng_below(26));
+        words[w][len] = '\0';
+    }
+    size_t p = 0;
+    while (p < n) {
+        uint32_t a = rng_below(VOCAB), b = rng_below(VOCAB);
+        for (const char *w = words[a * b / VOCAB]; *w && p < n; w++) d[p++] = (uint8_t)*w;
+        if (p < n) d[p++] = rng_below(10) ? ' ' : (rng_below(3) ? ',' : '\n');
+    }
+}
+
+typedef struct {
+    uint32_t dist, len;
+} copy_t;
+
+/* Everything the kernels run on, built once */
+typedef struct {
+    uint8_t  *text;
+    size_t    n;
+
+    uint8_t  *pair_a, *pair_b;      /* match_len: pairs agreeing for a set length */
+    size_t    npairs;
+
+    uint8_t   lit_lens[256];        /* the text's literal Huffman code */
+    uint16_t  lit_codes[256];
+    uint32_t  ll_freq[LITLEN_SYMS]; /* its literal/length histogram */
+    uint8_t  *stream;               /* the text coded with it */
+    size_t    stream_len;
+
+    copy_t   *copies;               /* the text's greedy parse, matches only */
+    size_t    ncopies;
+    uint8_t  *copy_out;
+
+    bit_writer_t bw;
+    huff_decode_table_t tab;
+
+    lz_match_len_fn match_len;      /* variant under test */
+    lz_find_best_fn find_best;
+} inputs_t;
+
+/* Pairs whose common prefix is 3-16 bytes half the time, 17-64 for 30%,
+ * else up to the 258 maximum */
+static void make_pairs(inputs_t *in) {
+    in->npairs = in->n / PAIR_STRIDE;
+    size_t sz = in->npairs * PAIR_STRIDE;
+    in->pair_a = malloc(sz);
+    in->pair_b = malloc(sz);
+    if (!in->pair_a || !in->pair_b) die("out of memory");
+    for (size_t i = 0; i < sz; i++) in->pair_a[i] = (uint8_t)(rng_next() >> 56);
+    memcpy(in->pair_b, in->pair_a, sz);
+    for (size_t k = 0; k < in->npairs; k++) {
+        uint32_t r = rng_below(10);
+        uint32_t len = r < 5 ? 3 + rng_below(14) : r < 8 ? 17 + rng_below(48) : 65 + rng_below(194);
+        if (len < ODZ_MAX_MATCH) in->pair_b[k * PAIR_STRIDE + len] ^= 0x5A;
+    }
+}
+
+static void make_code(inputs_t *in) {
+    uint32_t freq[256] = { 0 };
+    for (size_t i = 0; i < in->n; i++) freq[in->text[i]]++;
+    huff_build_lengths(freq, 256, HUFF_MAX_BITS, in->lit_lens);
+    huff_build_codes(in->lit_lens, 256, in->lit_codes);
+    memcpy(in->ll_freq, freq, sizeof freq);
+    in->ll_freq[256] = 1;
+
+    if (bw_init(&in->bw, in->n * 2 + 64, NULL) != 0) die("out of memory");
+    for (size_t i = 0; i < in->n; i++)
+        bw_write(&in->bw, in->lit_codes[in->text[i]], in->lit_lens[in->text[i]]);
+    bw_flush(&in->bw);
+    in->stream_len = in->bw.pos;
+    in->stream = malloc(in->stream_len);
+    if (!in->stream) die("out of memory");
+    memcpy(in->stream, in->bw.buf, in->stream_len);
+    memset(&in->tab, 0, sizeof in->tab);
+    if (huff_build_decode_table2(in->lit_lens, 256, &in->tab) != 0) die("out of memory");
+}
+
+static void make_copies(inputs_t *in) {
+    lz_matcher_t m;
+    if (lz_matcher_init(&m, in->n, HASH_BITS, MAX_CHAIN_STEPS, NULL) != 0) die("out of memory");
+    in->copies = malloc((in->n / ODZ_MIN_MATCH + 1) * sizeof *in->copies);
+    in->copy_out = malloc(ODZ_WINDOW + in->n);
+    if (!in->copies || !in->copy_out) die("out of memory");
+    size_t i = 0;
+    while (i < in->n) {
+        int len = 0, dist = 0;
+        lz_matcher_find_best(&m, in->text, i, in->n, (int)ODZ_WINDOW, ODZ_MIN_MATCH, ODZ_MAX_MATCH,
+                             &len, &dist);
+        if (len < ODZ_MIN_MATCH) len = 1;
+        else in->copies[in->ncopies++] = (copy_t){ (uint32_t)dist, (uint32_t)len };
+        for (size_t end = i + (size_t)len; i < end; i++) lz_matcher_insert(&m, in->text, i);
+    }
+    lz_matcher_free(&m);
+}
+
+/* 64-bit words of p folded into h */
+static uint64_t fold(uint64_t h, const uint8_t *p, size_t n) {
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+        uint64_t w;
+        memcpy(&w, p + i, 8);
+        h = (h ^ w) * 0x100000001B3ull;
+    }
+    for (; i < n; i++) h = (h ^ p[i]) * 0x100000001B3ull;
+    return h;
+}
+
+/* ── Kernels ───────────────────────────────────────────────────
+ * Each runs once over its input, returns a checksum and counts its calls
+ * and the bytes they cover. */
+
+static uint64_t k_hash3(inputs_t *in, uint64_t *calls, uint64_t *bytes) {
+    const uint8_t *t = in->text;
+    uint64_t sum = 0;
+    for (size_t i = 0; i + 2 < in->n; i++)
+        sum += lz_hash3(t[i], t[i + 1], t[i + 2], (1u << HASH_BITS) - 1);
+    *calls = *bytes = in->n - 2;
+    return sum;
+}
+
+static uint64_t k_match_len(inputs_t *in, uint64_t *calls, uint64_t *bytes) {
+    uint64_t sum = 0;
+    for (size_t k = 0; k < in->npairs; k++)
+        sum += (uint64_t)in->match_len(in->pair_a + k * PAIR_STRIDE, in->pair_b + k * PAIR_STRIDE,
+                                       ODZ_MAX_MATCH);
+    *calls = in->npairs;
+    *bytes = sum;
+    return sum;
+}
+
+/* A search and an insert at every position of the first SEARCH_SPAN bytes,
+ * with the default level's chain */
+static uint64_t k_find_best(inputs_t *in, uint64_t *calls, uint64_t *bytes) {
+    size_t n = in->n < SEARCH_SPAN ? in->n : SEARCH_SPAN;
+    lz_matcher_t m;
+    if (lz_matcher_init(&m, n, HASH_BITS, MAX_CHAIN_STEPS, NULL) != 0) die("out of memory");
+    m.find_best = in->find_best;
+    uint64_t sum = 0;
+    for (size_t i = 0; i < n; i++) {
+        int len = 0, dist = 0;
+        lz_matcher_find_best(&m, in->text, i, n, (int)ODZ_WINDOW, ODZ_MIN_MATCH, ODZ_MAX_MATCH,
+                             &len, &dist);
+        sum = sum * 31 + (uint64_t)len * 65536 + (uint64_t)dist;
+        lz_matcher_insert(&m, in->text, i);
+    }
+    lz_matcher_free(&m);
+    *calls = *bytes = n;
+    return sum;
+}
+
+static uint64_t k_bw_write(inputs_t *in, uint64_t *calls, uint64_t *bytes) {
+    bit_writer_t *w = &in->bw;
+    w->pos = 0;
+    w->bits = 0;
+    w->nbits = 0;
+    for (size_t i = 0; i < in->n; i++)
+        bw_write(w, in->lit_codes[in->text[i]], in->lit_lens[in->text[i]]);
+    bw_flush(w);
+    *calls = in->n;
+    *bytes = w->pos;
+    return fold(w->pos, w->buf, w->pos);
+}
+
+/* The coded text read back as raw fields of the code lengths */
+static uint64_t k_br_peek(inputs_t *in, uint64_t *calls, uint64_t *bytes) {
+    bit_reader_t r;
+    br_init(&r, in->stream, in->stream_len);
+    uint64_t sum = 0;
+    for (size_t i = 0; i < in->n; i++) {
+        int nb = in->lit_lens[in->text[i]];
+        sum = sum * 31 + br_peek(&r, nb);
+        br_consume(&r, nb);
+    }
+    *calls = in->n;
+    *bytes = in->stream_len;
+    return sum;
+}
+
+static uint64_t k_huff_decode2(inputs_t *in, uint64_t *calls, uint64_t *bytes) {
+    bit_reader_t r;
+    br_init(&r, in->stream, in->stream_len);
+    uint64_t sum = 0, nsec = 0;
+    for (size_t i = 0; i < in->n; i++)
+        sum = sum * 31 + (uint64_t)huff_decode2(&r, &in->tab, &nsec);
+    *calls = *bytes = in->n;
+    return sum ^ nsec;
+}
+
+static uint64_t k_build_decode(inputs_t *in, uint64_t *calls, uint64_t *bytes) {
+    uint64_t sum = 0;
+    for (int k = 0; k < BUILD_CALLS; k++) {
+        if (huff_build_decode_table2(in->lit_lens, 256, &in->tab) != 0) die("out of memory");
+        sum += fold(k, (const uint8_t *)in->tab.primary, sizeof in->tab.primary);
+    }
+    *calls = BUILD_CALLS;
+    *bytes = 0;
+    return sum;
+}
+
+static uint64_t k_build_lengths(inputs_t *in, uint64_t *calls, uint64_t *bytes) {
+    uint32_t freq[LITLEN_SYMS];
+    uint8_t lens[LITLEN_SYMS];
+    uint64_t sum = 0;
+    memcpy(freq, in->ll_freq, sizeof freq);
+    for (int k = 0; k < BUILD_CALLS; k++) {
+        freq[257 + k % 29] ^= 1;            /* not quite the same table every time */
+        huff_build_lengths(freq, LITLEN_SYMS, HUFF_MAX_BITS, lens);
+        sum = fold(sum, lens, sizeof lens);
+    }
+    *calls = BUILD_CALLS;
+    *bytes = 0;
+    return sum;
+}
+
+/* The text's matches replayed through odz_copy_match after a window of it */
+static uint64_t k_copy_match(inputs_t *in, uint64_t *calls, uint64_t *bytes) {
+    uint8_t *out = in->copy_out;
+    size_t op = in->n < ODZ_WINDOW ? in->n : ODZ_WINDOW;
+    memcpy(out, in->text, op);
+    uint64_t total = 0;
+    for (size_t k = 0; k < in->ncopies; k++) {
+        const copy_t *c = &in->copies[k];
+        if (c->dist > op) continue;
+        odz_copy_match(out + op, c->dist, c->len);
+        op += c->len;
+        total += c->len;
+    }
+    *calls = in->ncopies;
+    *bytes = total;
+    return fold(total, out, op);
+}
+
+/* ── Runner ────────────────────────────────────────────────── */
+
+typedef struct {
+    const char *name;
+    int         per_isa;            /* 1: match_len, 2: find_best variants */
+    uint64_t  (*run)(inputs_t *, uint64_t *, uint64_t *);
+} kernel_t;
+
+static const kernel_t kernels[] = {
+    { "hash3",                    0, k_hash3 },
+    { "match_len",                1, k_match_len },
+    { "lz_matcher_find_best",     2, k_find_best },
+    { "bw_write",                 0, k_bw_write },
+    { "br_refill/br_peek",        0, k_br_peek },
+    { "huff_decode2",             0, k_huff_decode2 },
+    { "huff_build_decode_table2", 0, k_build_decode },
+    { "huff_build_lengths",       0, k_build_lengths },
+    { "odz_copy_match",           0, k_copy_match },
+};
+#define NKERNELS (sizeof(kernels) / sizeof(kernels[0]))
+
+static const char *isas[] = { "generic", "sse2", "avx2", "avx512" };
+#define NISAS (sizeof(isas) / sizeof(isas[0]))
+
+/* Best of reps runs, after one untimed; 0, or 1 if the checksum moved */
+static int bench(const kernel_t *k, const char *variant, inputs_t *in, int reps, int have_cycles,
+                 uint64_t *checksum) {
+    uint64_t calls = 0, bytes = 0;
+    uint64_t sum = k->run(in, &calls, &bytes);
+    uint64_t best_ns = UINT64_MAX, best_cyc = 0;
+    int unstable = 0;
+    for (int r = 0; r < reps; r++) {
+        uint64_t c0 = cycles_now(), t0 = odz_now_ns();
+        uint64_t s = k->run(in, &calls, &bytes);
+        uint64_t t1 = odz_now_ns(), c1 = cycles_now();
+        if (s != sum) unstable = 1;
+        if (t1 - t0 < best_ns) { best_ns = t1 - t0; best_cyc = c1 - c0; }
+    }
+    *checksum = sum;
+
+    double ns_op = calls ? (double)best_ns / (double)calls : 0.0;
+    char cyc_op[32] = "-", cyc_b[32] = "-", mbs[32] = "-";
+    if (have_cycles && calls) snprintf(cyc_op, sizeof cyc_op, "%.1f", (double)best_cyc / (double)calls);
+    if (have_cycles && bytes) snprintf(cyc_b, sizeof cyc_b, "%.2f", (double)best_cyc / (double)bytes);
+    if (bytes) snprintf(mbs, sizeof mbs, "%.1f", (double)bytes * 1e3 / (double)(best_ns ? best_ns : 1));
+    printf("%-26s %-8s %10.2f %10s %9s %9s  %016llx%s\n", k->name, variant, ns_op, cyc_op, cyc_b, mbs,
+           (unsigned long long)sum, unstable ? "  UNSTABLE" : "");
+    return unstable;
+}
+
+/* ── Main ──────────────────────────────────────────────────── */
+
+static size_t parse_size(const char *s) {
+    char *end;
+    double v = strtod(s, &end);
+    if (end == s || v < 0) die("invalid size");
+    if (*end == 'k' || *end == 'K') v *= 1024;
+    else if (*end == 'm' || *end == 'M') v *= 1024 * 1024;
+    return (size_t)v;
+}
+
+static void usage(const char *prog) {
+    fprintf(stderr,
+        "odz_microbench — per-kernel timings\n\n"
+        "usage: %s [options]\n\n"
+        "options:\n"
+        "  -s, --size N         generated input size, K/M suffixes (default 1M)\n"
+        "  -n, --reps N         timed repetitions, best is reported (default %d)\n"
+        "  -k, --kernel NAME    only kernels whose name contains NAME\n"
+        "  -h, --help           show this help\n\n"
+        "Set ODZ_CPU=generic|sse2|avx2 to cap the match_len / find_best variants.\n"
+        "Exit status is 1 if variants disagree or a checksum is unstable.\n",
+        prog, DEFAULT_REPS);
+}
+
+int main(int argc, char **argv) {
+    size_t size = DEFAULT_SIZE;
+    int reps = DEFAULT_REPS;
+    const char *only = NULL;
+
+    for (int i = 1; i < argc; i++) {
+        const char *a = argv[i];
+        const char *v = (i + 1 < argc) ? argv[i + 1] : NULL;
+        if (strcmp(a, "-h") == 0 || strcmp(a, "--help") == 0) {
+            usage(argv[0]); return 0;
+        } else if (strcmp(a, "-s") == 0 || strcmp(a, "--size") == 0) {
+            if (!v) die("missing argument for --size");
+            size = parse_size(v); i++;
+        } else if (strcmp(a, "-n") == 0 || strcmp(a, "--reps") == 0) {
+            if (!v) die("missing argument for --reps");
+            reps = atoi(v); i++;
+        } else if (strcmp(a, "-k") == 0 || strcmp(a, "--kernel") == 0) {
+            if (!v) die("missing argument for --kernel");
+            only = v; i++;
+        } else {
+            fprintf(stderr, "odz_microbench: unknown option: %s\n", a);
+            usage(argv[0]); return 2;
+        }
+    }
+    if (reps < 1) reps = 1;
+    if (size < 4 * PAIR_STRIDE) die("size too small");
+
+    inputs_t in;
+    memset(&in, 0, sizeof in);
+    in.n = size;
+    in.text = malloc(size);
+    if (!in.text) die("out of memory");
+    gen_text(in.text, size);
+    make_pairs(&in);
+    make_code(&in);
+    make_copies(&in);
+
+    const char *clock = cycles_open();
+    printf("input: %zu bytes of text, %zu match_len pairs, %zu matches; cycles: %s\n",
+           size, in.npairs, in.ncopies, clock ? clock : "not available");
+    printf("%-26s %-8s %10s %10s %9s %9s  %s\n", "kernel", "variant", "ns/call", "cycles/call",
+           "cycles/B", "MB/s", "checksum");
+
+    int failed = 0;
+    for (size_t k = 0; k < NKERNELS; k++) {
+        const kernel_t *kr = &kernels[k];
+        if (only && !strstr(kr->name, only)) continue;
+        if (!kr->per_isa) {
+            uint64_t sum;
+            failed |= bench(kr, "-", &in, reps, clock != NULL, &sum);
+            continue;
+        }
+        uint64_t first = 0;
+        int ran = 0;
+        for (size_t v = 0; v < NISAS; v++) {
+            in.match_len = lz_match_len_variant(isas[v]);
+            in.find_best = lz_find_best_variant(isas[v]);
+            if (!in.match_len || !in.find_best) continue;
+            uint64_t sum;
+            failed |= bench(kr, isas[v], &in, reps, clock != NULL, &sum);
+            if (ran++ && sum != first) {
+                printf("  %s: %s disagrees with %s\n", kr->name, isas[v], isas[0]);
+                failed = 1;
+            }
+            if (ran == 1) first = sum;
+        }
+    }
+
+    huff_free_decode_table2(&in.tab);
+    bw_free(&in.bw);
+    free(in.text);
+    free(in.pair_a);
+    free(in.pair_b);
+    free(in.stream);
+    free(in.copies);
+    free(in.copy_out);
+    if (perf_fd >= 0) close(perf_fd);
+    return failed;
+}
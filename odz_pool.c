@@ -0,0 +1,272 @@
+/*
+ * Work-stealing task pool (see odz_pool.h).
+ *
+ * Tasks are coarse (a 1 MB block, a whole file), so plain mutexes are
+ * cheap enough: one per deque for push / pop / steal, and one pool lock
+ * for the counters and the condition variable everyone sleeps on.
+ */
+
+#include <stdlib.h>
+
+#include "odz_pool.h"
+
+#ifdef ODZ_HAVE_PTHREADS
+
+#include <pthread.h>
+
+typedef struct {
+    void (*fn)(void *);
+    void *arg;
+    odz_group_t *group;
+} task_t;
+
+/* Ring buffer: steal from head (oldest), owner pops from tail (newest) */
+typedef struct {
+    pthread_mutex_t lock;
+    task_t *buf;
+    size_t  cap, head, count;
+} deque_t;
+
+struct odz_pool {
+    int        nworkers;        /* fixed once the workers are released */
+    int        ndq;
+    pthread_t *threads;
+    deque_t   *dq;              /* nworkers own deques + 1 injection deque */
+
+    pthread_mutex_t lock;
+    pthread_cond_t  cond;       /* any push, group completion or stop */
+    size_t     queued;          /* tasks sitting in deques */
+    size_t     outstanding;     /* submitted, not yet finished */
+    uint64_t   gen;             /* bumped with every broadcast */
+    int        stop;
+};
+
+/* Which pool / deque the current thread works for */
+static _Thread_local odz_pool_t *tls_pool;
+static _Thread_local int tls_index;
+
+/* ── Deques ────────────────────────────────────────────────── */
+
+static int dq_push(deque_t *d, const task_t *t) {
+    pthread_mutex_lock(&d->lock);
+    if (d->count == d->cap) {
+        size_t cap = d->cap ? 2 * d->cap : 16;
+        task_t *buf = malloc(cap * sizeof *buf);
+        if (!buf) { pthread_mutex_unlock(&d->lock); return -1; }
+        for (size_t i = 0; i < d->count; i++) buf[i] = d->buf[(d->head + i) % d->cap];
+        free(d->buf);
+        d->buf = buf;
+        d->cap = cap;
+        d->head = 0;
+    }
+    d->buf[(d->head + d->count) % d->cap] = *t;
+    d->count++;
+    pthread_mutex_unlock(&d->lock);
+    return 0;
+}
+
+/* Take the newest (bottom) or oldest (top) task, only if it belongs to
+ * group g when g is non-NULL */
+static int dq_take(deque_t *d, int bottom, const odz_group_t *g, task_t *t) {
+    int ok = 0;
+    pthread_mutex_lock(&d->lock);
+    if (d->count) {
+        size_t i = bottom ? (d->head + d->count - 1) % d->cap : d->head;
+        if (!g || d->buf[i].group == g) {
+            *t = d->buf[i];
+            if (!bottom) d->head = (d->head + 1) % d->cap;
+            d->count--;
+            ok = 1;
+        }
+    }
+    pthread_mutex_unlock(&d->lock);
+    return ok;
+}
+
+/* Own deque first, then steal round the others starting past self */
+static int take(odz_pool_t *p, int self, const odz_group_t *g, task_t *t) {
+    int n = p->nworkers + 1;
+    int found = self >= 0 && dq_take(&p->dq[self], 1, g, t);
+    for (int k = 1; !found && k <= n; k++) {
+        int v = ((self < 0 ? 0 : self) + k) % n;
+        if (v != self) found = dq_take(&p->dq[v], 0, g, t);
+    }
+    if (found) {
+        pthread_mutex_lock(&p->lock);
+        p->queued--;
+        pthread_mutex_unlock(&p->lock);
+    }
+    return found;
+}
+
+static void run(odz_pool_t *p, const task_t *t) {
+    t->fn(t->arg);
+    pthread_mutex_lock(&p->lock);
+    p->outstanding--;
+    if (t->group) t->group->pending--;
+    p->gen++;
+    pthread_cond_broadcast(&p->cond);
+    pthread_mutex_unlock(&p->lock);
+}
+
+/* ── Workers ───────────────────────────────────────────────── */
+
+typedef struct {
+    odz_pool_t *p;
+    int index;
+} worker_arg_t;
+
+static void *worker_main(void *arg) {
+    worker_arg_t w = *(worker_arg_t *)arg;
+    free(arg);
+    odz_pool_t *p = w.p;
+    tls_pool = p;
+    tls_index = w.index;
+    /* Wait for odz_pool_create to settle nworkers */
+    pthread_mutex_lock(&p->lock);
+    pthread_mutex_unlock(&p->lock);
+    for (;;) {
+        task_t t;
+        if (take(p, w.index, NULL, &t)) { run(p, &t); continue; }
+        pthread_mutex_lock(&p->lock);
+        while (!p->stop && p->queued == 0) pthread_cond_wait(&p->cond, &p->lock);
+        int done = p->stop && p->queued == 0;
+        pthread_mutex_unlock(&p->lock);
+        if (done) return NULL;
+    }
+}
+
+/* ── API ───────────────────────────────────────────────────── */
+
+odz_pool_t *odz_pool_create(int threads) {
+    if (threads < 1) threads = 1;
+    odz_pool_t *p = calloc(1, sizeof *p);
+    if (!p) return NULL;
+    p->threads = calloc((size_t)threads, sizeof *p->threads);
+    p->dq = calloc((size_t)threads + 1, sizeof *p->dq);
+    if (!p->threads || !p->dq) { free(p->threads); free(p->dq); free(p); return NULL; }
+    p->ndq = threads + 1;
+    for (int i = 0; i < p->ndq; i++) pthread_mutex_init(&p->dq[i].lock, NULL);
+    pthread_mutex_init(&p->lock, NULL);
+    pthread_cond_init(&p->cond, NULL);
+
+    /* If fewer threads start than asked, the last deque started becomes
+     * the injection deque */
+    pthread_mutex_lock(&p->lock);
+    for (int i = 0; i < threads; i++) {
+        worker_arg_t *w = malloc(sizeof *w);
+        if (w) { w->p = p; w->index = i; }
+        if (!w || pthread_create(&p->threads[i], NULL, worker_main, w) != 0) {
+            free(w);
+            break;
+        }
+        p->nworkers++;
+    }
+    pthread_mutex_unlock(&p->lock);
+    if (p->nworkers == 0) {
+        odz_pool_destroy(p);
+        return NULL;
+    }
+    return p;
+}
+
+int odz_pool_threads(const odz_pool_t *p) {
+    return p ? p->nworkers : 1;
+}
+
+void odz_pool_spawn(odz_pool_t *p, odz_group_t *g, void (*fn)(void *), void *arg) {
+    task_t t = { fn, arg, g };
+    int self = tls_pool == p ? tls_index : p->nworkers;
+
+    pthread_mutex_lock(&p->lock);
+    p->outstanding++;
+    if (g) g->pending++;
+    p->queued++;
+    pthread_mutex_unlock(&p->lock);
+
+    if (dq_push(&p->dq[self], &t) != 0) {
+        pthread_mutex_lock(&p->lock);
+        p->queued--;
+        pthread_mutex_unlock(&p->lock);
+        run(p, &t);
+        return;
+    }
+    pthread_mutex_lock(&p->lock);
+    p->gen++;
+    pthread_cond_broadcast(&p->cond);
+    pthread_mutex_unlock(&p->lock);
+}
+
+void odz_pool_wait(odz_pool_t *p, odz_group_t *g) {
+    /* Workers help with the group's own tasks; outside threads just
+     * sleep, so the pool never runs more than its thread count. */
+    int self = tls_pool == p ? tls_index : -1;
+    for (;;) {
+        pthread_mutex_lock(&p->lock);
+        uint64_t gen = p->gen;
+        int done = g->pending == 0;
+        pthread_mutex_unlock(&p->lock);
+        if (done) return;
+
+        task_t t;
+        if (self >= 0 && take(p, self, g, &t)) { run(p, &t); continue; }
+
+        pthread_mutex_lock(&p->lock);
+        while (g->pending && p->gen == gen) pthread_cond_wait(&p->cond, &p->lock);
+        pthread_mutex_unlock(&p->lock);
+    }
+}
+
+int odz_pool_submit(odz_pool_t *p, void (*fn)(void *), void *arg) {
+    if (p) odz_pool_spawn(p, NULL, fn, arg);
+    else fn(arg);
+    return ODZ_OK;
+}
+
+void odz_pool_wait_all(odz_pool_t *p) {
+    if (!p) return;
+    pthread_mutex_lock(&p->lock);
+    while (p->outstanding) pthread_cond_wait(&p->cond, &p->lock);
+    pthread_mutex_unlock(&p->lock);
+}
+
+void odz_pool_destroy(odz_pool_t *p) {
+    if (!p) return;
+    pthread_mutex_lock(&p->lock);
+    p->stop = 1;
+    pthread_cond_broadcast(&p->cond);
+    pthread_mutex_unlock(&p->lock);
+    for (int i = 0; i < p->nworkers; i++) pthread_join(p->threads[i], NULL);
+    for (int i = 0; i < p->ndq; i++) {
+        pthread_mutex_destroy(&p->dq[i].lock);
+        free(p->dq[i].buf);
+    }
+    pthread_mutex_destroy(&p->lock);
+    pthread_cond_destroy(&p->cond);
+    free(p->threads);
+    free(p->dq);
+    free(p);
+}
+
+#else /* !ODZ_HAVE_PTHREADS */
+
+/* No threads: there is no pool, and the API degrades to running inline */
+
+odz_pool_t *odz_pool_create(int threads) { (void)threads; return NULL; }
+int  odz_pool_threads(const odz_pool_t *p) { (void)p; return 1; }
+void odz_pool_destroy(odz_pool_t *p) { (void)p; }
+void odz_pool_wait_all(odz_pool_t *p) { (void)p; }
+void odz_pool_wait(odz_pool_t *p, odz_group_t *g) { (void)p; (void)g; }
+
+void odz_pool_spawn(odz_pool_t *p, odz_group_t *g, void (*fn)(void *), void *arg) {
+    (void)p; (void)g;
+    fn(arg);
+}
+
+int odz_pool_submit(odz_pool_t *p, void (*fn)(void *), void *arg) {
+    (void)p;
+    fn(arg);
+    return ODZ_OK;
+}
+
+#endif
@@ -0,0 +1,34 @@
+#ifndef ODZ_POOL_H
+#define ODZ_POOL_H
+
+/*
+ * Work-stealing task pool (public handle in libodzip.h).
+ *
+ * Each worker owns a deque: tasks it spawns go on the bottom and it pops
+ * them from there (newest first, still cache-warm); idle workers steal
+ * from the top of the others' (oldest first, the biggest pieces left).
+ * Tasks from outside the pool go to a shared injection deque that every
+ * worker steals from.
+ *
+ * A group counts its unfinished tasks.  A worker waiting on a group runs
+ * that group's queued tasks itself instead of sleeping, so a whole-file
+ * task can fan out into block tasks without tying up a thread.
+ */
+
+#include <stddef.h>
+#include "libodzip.h"
+
+typedef struct {
+    size_t pending;     /* spawned, not yet finished (under the pool lock) */
+} odz_group_t;
+
+#define ODZ_GROUP_INIT { 0 }
+
+/* Queue fn(arg), counted in g if non-NULL.  Runs it inline if the task
+ * cannot be queued (out of memory). */
+void odz_pool_spawn(odz_pool_t *p, odz_group_t *g, void (*fn)(void *), void *arg);
+
+/* Return once every task spawned in g has finished */
+void odz_pool_wait(odz_pool_t *p, odz_group_t *g);
+
+#endif
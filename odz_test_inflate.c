@@ -0,0 +1,167 @@
+/*
+ * odz_test_inflate — decode fixed-Huffman DEFLATE streams made elsewhere
+ *
+ * odz's own gzip / zlib output always carries dynamic trees, so a
+ * roundtrip never reaches the fixed-code path (RFC 1951 §3.2.6).  These
+ * streams come from zlib (level 1, and Z_FIXED raw DEFLATE) and from
+ * gzip -1; each is decoded through odz_decompress and compared with the
+ * input it was made from.  The raw stream covers distances 1-3 and
+ * over 24K, both ends of the distance code.
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+
+#include "libodzip.h"
+
+/* ── Streams ───────────────────────────────────────────────── */
+
+/* zlib.compress(b"abc" * 50, 1) */
+static const uint8_t zlib_abc[] = {
+    0x78, 0x01, 0x4b, 0x4c, 0x4a, 0x4e, 0x1c, 0x7c, 0x08, 0x00, 0xf0, 0x7c,
+    0x39, 0x6d,
+};
+
+/* gzip -1 -n of the line in hello_text */
+static const uint8_t gzip_hello[] = {
+    0x1f, 0x8b, 0x08, 0x00, 0x00, 0x00, 0x00, 0x00, 0x04, 0x03, 0xf3, 0x48,
+    0xcd, 0xc9, 0xc9, 0xd7, 0x51, 0xc8, 0x40, 0xa2, 0xac, 0x14, 0xd2, 0x32,
+    0x2b, 0x52, 0x53, 0x14, 0x3c, 0x4a, 0xd3, 0xd2, 0x72, 0x13, 0xf3, 0x14,
+    0x92, 0xf3, 0x53, 0x52, 0x8b, 0x15, 0xd2, 0x8a, 0xf2, 0x73, 0x15, 0xd2,
+    0xab, 0x32, 0x0b, 0xf4, 0xb8, 0x00, 0x45, 0x4d, 0x36, 0x3b, 0x34, 0x00,
+    0x00, 0x00,
+};
+
+/* raw DEFLATE, zlib level 9 with Z_FIXED, of far_text() */
+static const uint8_t deflate_far[] = {
+    0x2b, 0x4e, 0x2d, 0xca, 0x4f, 0x4a, 0xc9, 0x48, 0xcf, 0x2d, 0xc8, 0x2d,
+    0xca, 0x4c, 0x4a, 0xab, 0xac, 0x4a, 0xce, 0xc8, 0x4c, 0x4a, 0x29, 0xc9,
+    0x2d, 0xca, 0x2e, 0xcd, 0x2d, 0x29, 0xcd, 0xa8, 0xac, 0x2c, 0xca, 0xcc,
+    0xac, 0x48, 0x49, 0x4e, 0xca, 0xcc, 0x2a, 0x29, 0xcc, 0x4a, 0xad, 0x4a,
+    0x4c, 0xca, 0x48, 0xad, 0xca, 0xc9, 0x2a, 0x48, 0x4e, 0xce, 0x2f, 0xaf,
+    0xa8, 0x4c, 0x4a, 0x4b, 0x4b, 0x49, 0x4d, 0xad, 0xcc, 0x29, 0x4d, 0x2f,
+    0xc8, 0x4d, 0xce, 0x2c, 0x28, 0x48, 0x4f, 0x29, 0xcf, 0x2f, 0x28, 0x2a,
+    0xce, 0x2a, 0x4b, 0xcf, 0x4e, 0xc9, 0x2e, 0xcd, 0xce, 0x28, 0x4c, 0x2c,
+    0x49, 0x2e, 0x4d, 0xaa, 0x4c, 0x2d, 0xaa, 0xcc, 0x2d, 0xae, 0xa8, 0x28,
+    0xce, 0x2c, 0x4d, 0x4d, 0xcb, 0x48, 0x29, 0xca, 0x49, 0x4b, 0x2d, 0x2e,
+    0x2d, 0x4c, 0xae, 0xcc, 0x48, 0xcd, 0xce, 0x2e, 0xae, 0x4a, 0x2e, 0x48,
+    0xcc, 0x2d, 0xaf, 0xc8, 0xcc, 0x2a, 0x2d, 0x49, 0x05, 0x9a, 0x51, 0x9c,
+    0x5d, 0x50, 0x94, 0x9e, 0x91, 0x5b, 0x98, 0x5c, 0x5e, 0x51, 0x96, 0x54,
+    0x90, 0x99, 0x9c, 0x52, 0x98, 0x5f, 0x92, 0x99, 0x96, 0x9c, 0x97, 0x54,
+    0x52, 0x9c, 0x94, 0x93, 0x95, 0x5c, 0x51, 0x50, 0x5a, 0x99, 0x94, 0x59,
+    0x5c, 0x5e, 0x56, 0x50, 0x59, 0x58, 0x90, 0x58, 0x55, 0x55, 0x95, 0x9a,
+    0x9f, 0x96, 0x99, 0x5c, 0x9c, 0x5a, 0x91, 0x9c, 0x99, 0x54, 0x55, 0x90,
+    0x5f, 0x9c, 0x9e, 0x95, 0x53, 0x91, 0x9d, 0x95, 0x98, 0x0d, 0x54, 0x5a,
+    0x55, 0x9c, 0x5a, 0x9e, 0x9d, 0x9f, 0x5b, 0x5e, 0x50, 0x92, 0x98, 0x92,
+    0x52, 0x58, 0x94, 0x55, 0x52, 0x9a, 0x99, 0x91, 0x54, 0x9a, 0x5f, 0x95,
+    0x53, 0x91, 0x5c, 0x55, 0x91, 0x55, 0x50, 0x9a, 0x97, 0x9d, 0x55, 0x9c,
+    0x56, 0x91, 0x9e, 0x98, 0x95, 0x59, 0x91, 0x9b, 0x9e, 0x98, 0x52, 0x9e,
+    0x54, 0x92, 0x9e, 0x9b, 0x52, 0x92, 0x91, 0x93, 0x54, 0x9c, 0x55, 0x9e,
+    0x96, 0x99, 0x56, 0x5e, 0x9c, 0x9f, 0x97, 0x9d, 0x59, 0x58, 0x9e, 0x5c,
+    0x96, 0x91, 0x95, 0x5f, 0x99, 0x58, 0x92, 0x9a, 0x5a, 0x5c, 0x50, 0x5c,
+    0x98, 0x98, 0x9b, 0x51, 0x9a, 0x9c, 0x53, 0x94, 0x96, 0x98, 0x5e, 0x5a,
+    0x52, 0x51, 0x54, 0x94, 0x5e, 0x50, 0x9c, 0x5f, 0x9a, 0x95, 0x5d, 0x94,
+    0x9a, 0x93, 0x51, 0x91, 0x9c, 0x58, 0x90, 0x5b, 0x9c, 0x9e, 0x5f, 0x58,
+    0x96, 0x99, 0x5f, 0x58, 0x9a, 0x9e, 0x59, 0x92, 0x9a, 0x96, 0x9c, 0x99,
+    0x91, 0x99, 0x99, 0x9a, 0x56, 0x95, 0x5e, 0x98, 0x9c, 0x92, 0x96, 0x94,
+    0x96, 0x59, 0x95, 0x98, 0x97, 0x56, 0x9c, 0x9a, 0x9e, 0x5e, 0x9a, 0x5b,
+    0x90, 0x96, 0x51, 0x5e, 0x98, 0x99, 0x9e, 0x92, 0x5b, 0x92, 0x9c, 0x94,
+    0x91, 0x98, 0x53, 0x9c, 0x92, 0x98, 0x52, 0x51, 0x5a, 0x9e, 0x91, 0x9a,
+    0x9a, 0x99, 0x9e, 0x94, 0x5d, 0x96, 0x96, 0x95, 0x57, 0x51, 0x99, 0x96,
+    0x58, 0x5c, 0x58, 0x98, 0x9c, 0x97, 0x9d, 0x9e, 0x94, 0x95, 0x54, 0x99,
+    0x97, 0x55, 0x92, 0x55, 0x58, 0x94, 0x92, 0x57, 0x51, 0x5e, 0x95, 0x98,
+    0x5d, 0x5a, 0x91, 0x98, 0x91, 0x99, 0x97, 0x9f, 0x53, 0x5a, 0x5c, 0x52,
+    0x99, 0x94, 0x5a, 0x96, 0x93, 0x9d, 0x9e, 0x59, 0x59, 0x90, 0x5f, 0x92,
+    0x94, 0x5a, 0x91, 0x53, 0x50, 0x52, 0x94, 0x54, 0x50, 0x55, 0x92, 0x96,
+    0x9e, 0x57, 0x95, 0x9c, 0x9c, 0x9e, 0x9a, 0x5c, 0x54, 0x9e, 0x55, 0x9a,
+    0x9e, 0x97, 0x51, 0x90, 0x52, 0x96, 0x9e, 0x99, 0x58, 0x91, 0x92, 0x9e,
+    0x06, 0x74, 0x72, 0x79, 0x6e, 0x49, 0x66, 0x72, 0x52, 0x55, 0x4e, 0x79,
+    0x65, 0x62, 0x7a, 0x4e, 0x6a, 0x59, 0x15, 0x91, 0xa0, 0xa2, 0x92, 0x38,
+    0x98, 0x98, 0x94, 0x4c, 0x36, 0x2a, 0xc9, 0x48, 0x55, 0x28, 0x2c, 0xcd,
+    0x4c, 0xce, 0x56, 0x48, 0x2a, 0xca, 0x2f, 0xcf, 0x53, 0x48, 0xcb, 0xaf,
+    0x50, 0xc8, 0x02, 0x86, 0x56, 0xb1, 0x42, 0x7e, 0x59, 0x6a, 0x91, 0x02,
+    0x48, 0x3a, 0x27, 0xb1, 0xaa, 0x52, 0x21, 0x25, 0x3f, 0x5d, 0x4f, 0x61,
+    0x54, 0xf1, 0xa8, 0xe2, 0x51, 0xc5, 0xa3, 0x8a, 0x47, 0x15, 0x8f, 0x2a,
+    0x1e, 0x55, 0x3c, 0xaa, 0x78, 0x54, 0xf1, 0xa8, 0xe2, 0x51, 0xc5, 0xa3,
+    0x8a, 0x47, 0x15, 0x8f, 0x2a, 0x1e, 0x55, 0x3c, 0xaa, 0x78, 0x54, 0xf1,
+    0xa8, 0xe2, 0x51, 0xc5, 0xa3, 0x8a, 0x47, 0x15, 0x8f, 0x2a, 0x1e, 0x55,
+    0x3c, 0xaa, 0x78, 0x54, 0xf1, 0xa8, 0xe2, 0x51, 0xc5, 0xa3, 0x8a, 0x47,
+    0x15, 0x8f, 0x2a, 0x1e, 0x55, 0x3c, 0xaa, 0x78, 0x54, 0xf1, 0xa8, 0xe2,
+    0x51, 0xc5, 0xa3, 0x8a, 0x47, 0x15, 0x8f, 0x2a, 0x1e, 0x55, 0x3c, 0xaa,
+    0x78, 0x54, 0xf1, 0xa8, 0xe2, 0x51, 0xc5, 0xa3, 0x8a, 0x47, 0x15, 0x8f,
+    0x2a, 0x1e, 0x55, 0x3c, 0xaa, 0x78, 0x54, 0xf1, 0xa8, 0xe2, 0x51, 0xc5,
+    0xa3, 0x8a, 0x47, 0x15, 0x8f, 0x2a, 0x1e, 0x55, 0x3c, 0xaa, 0x78, 0x54,
+    0xf1, 0xa8, 0xe2, 0x51, 0xc5, 0xa3, 0x8a, 0x47, 0x15, 0x8f, 0x2a, 0x1e,
+    0x55, 0x3c, 0xaa, 0x78, 0x54, 0xf1, 0xa8, 0xe2, 0x51, 0xc5, 0xa3, 0x8a,
+    0x47, 0x15, 0x8f, 0x2a, 0x1e, 0x55, 0x3c, 0xaa, 0x78, 0x54, 0xf1, 0xa8,
+    0xe2, 0x51, 0xc5, 0xa3, 0x8a, 0x47, 0x15, 0x8f, 0x2a, 0x1e, 0x55, 0x3c,
+    0xaa, 0x78, 0x54, 0xf1, 0xa8, 0xe2, 0x51, 0xc5, 0xa3, 0x8a, 0x47, 0x15,
+    0x8f, 0x2a, 0x1e, 0x55, 0x3c, 0xaa, 0x78, 0x54, 0xf1, 0xa8, 0xe2, 0x51,
+    0xc5, 0xa3, 0x8a, 0x47, 0x15, 0x8f, 0x2a, 0x1e, 0x55, 0x3c, 0xaa, 0x78,
+    0x54, 0xf1, 0xa8, 0xe2, 0x51, 0xc5, 0xa3, 0x8a, 0x47, 0x15, 0x8f, 0x2a,
+    0x1e, 0x55, 0x3c, 0xaa, 0x78, 0x54, 0xf1, 0xa8, 0xe2, 0x51, 0xc5, 0xa3,
+    0x8a, 0x69, 0xa8, 0xb8, 0x78, 0xf4, 0xae, 0xbf, 0x11, 0x7d, 0xd7, 0x1f,
+    0x00,
+};
+
+/* ── Expected output ───────────────────────────────────────── */
+
+static const char hello_text[] = "Hello, hello, hello: fixed Huffman codes from gzip.\n";
+
+/* 512 pseudo-random letters, short-distance runs, 28000 bytes of a
+ * repeated sentence, then the letters again from 28K+ back */
+static size_t far_text(uint8_t *out) {
+    static const char dog[] = "the quick brown fox jumps over the lazy dog. ";
+    uint32_t x = 12345;
+    size_t n = 0;
+    for (int i = 0; i < 512; i++) {
+        x = (x * 1103515245u + 12345u) & 0x7fffffff;
+        out[n++] = (uint8_t)('a' + (x >> 16) % 26);
+    }
+    for (int i = 0; i < 40; i++) out[n++] = 'z';
+    for (int i = 0; i < 20; i++) { out[n++] = 'x'; out[n++] = 'y'; }
+    for (int i = 0; i < 20; i++) { memcpy(out + n, "abc", 3); n += 3; }
+    for (int i = 0; i < 28000; i++) out[n++] = (uint8_t)dog[i % (sizeof dog - 1)];
+    memcpy(out + n, out, 512);
+    return n + 512;
+}
+
+/* ── Driver ────────────────────────────────────────────────── */
+
+static int check(const char *name, int format, const uint8_t *comp, size_t comp_size,
+                 const uint8_t *want, size_t want_size) {
+    FILE *in = fmemopen((void *)comp, comp_size, "rb");
+    char *got = NULL;
+    size_t got_size = 0;
+    FILE *out = open_memstream(&got, &got_size);
+    if (!in || !out) { fprintf(stderr, "odz_test_inflate: error: memory streams\n"); exit(1); }
+
+    odz_options_t opts = { .progress = NULL, .userdata = NULL, .format = format };
+    int rc = odz_decompress(in, out, &opts);
+    fclose(in);
+    fclose(out);
+
+    int ok = rc == ODZ_OK && got_size == want_size && memcmp(got, want, want_size) == 0;
+    if (rc != ODZ_OK)
+        printf("FAIL %s: %s\n", name, odz_strerror(rc));
+    else
+        printf("%s %s: %zu bytes\n", ok ? "ok  " : "FAIL", name, got_size);
+    free(got);
+    return ok;
+}
+
+int main(void) {
+    uint8_t abc[150], far[29164];
+    for (int i = 0; i < 150; i++) abc[i] = (uint8_t)"abc"[i % 3];
+    size_t far_size = far_text(far);
+
+    int ok = 1;
+    ok &= check("zlib level 1", ODZ_FORMAT_ODZ, zlib_abc, sizeof zlib_abc, abc, sizeof abc);
+    ok &= check("gzip -1", ODZ_FORMAT_ODZ, gzip_hello, sizeof gzip_hello,
+                (const uint8_t *)hello_text, sizeof hello_text - 1);
+    ok &= check("raw Z_FIXED", ODZ_FORMAT_DEFLATE, deflate_far, sizeof deflate_far, far, far_size);
+    return ok ? 0 : 1;
+}
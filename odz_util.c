@@ -1,7 +1,16 @@
+#ifndef _WIN32
+#define _POSIX_C_SOURCE 200809L  /* clock_gettime under -std=c17 */
+#endif
 #include <stdio.h>
 #include <stdlib.h>
 #include <stdint.h>
 
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <time.h>
+#endif
+
 #include "odz.h"
 #include "libodzip.h"
 
@@ -12,10 +21,50 @@ const char *odz_strerror(int err) {
         case ODZ_ERR_OOM:     return "out of memory";
         case ODZ_ERR_FORMAT:  return "invalid format";
         case ODZ_ERR_CORRUPT: return "corrupt data";
+        case ODZ_ERR_REF:     return "patch reference missing or does not match";
+        case ODZ_ERR_KEY:     return "encrypted: key or passphrase missing or wrong";
         default:              return "unknown error";
     }
 }
 
+const char *odz_block_type_name(int type) {
+    switch (type) {
+        case ODZ_BLOCK_STORED:  return "stored";
+        case ODZ_BLOCK_HUFFMAN: return "huffman";
+        case ODZ_BLOCK_FSE:     return "fse";
+        case ODZ_BLOCK_REF:     return "dedup";
+        case ODZ_BLOCK_BWT:     return "bwt";
+        default:                return NULL;
+    }
+}
+
+uint64_t odz_now_ns(void) {
+#ifdef _WIN32
+    LARGE_INTEGER freq, t;
+    QueryPerformanceFrequency(&freq);
+    QueryPerformanceCounter(&t);
+    return (uint64_t)((double)t.QuadPart * 1e9 / (double)freq.QuadPart);
+#else
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+#endif
+}
+
+uint64_t odz_cpu_ns(void) {
+#ifdef _WIN32
+    FILETIME c, e, k, u;
+    if (!GetThreadTimes(GetCurrentThread(), &c, &e, &k, &u)) return odz_now_ns();
+    uint64_t t = ((uint64_t)k.dwHighDateTime << 32 | k.dwLowDateTime) +
+                 ((uint64_t)u.dwHighDateTime << 32 | u.dwLowDateTime);
+    return t * 100;     /* 100 ns units */
+#else
+    struct timespec ts;
+    if (clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts) != 0) return odz_now_ns();
+    return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+#endif
+}
+
 void wr_u32le(uint8_t *dst, uint32_t x) {
 	dst[0]=x&0xFF; dst[1]=(x>>8)&0xFF; dst[2]=(x>>16)&0xFF; dst[3]=(x>>24)&0xFF;
 }
@@ -0,0 +1,385 @@
+/*
+ * odzd — local compression daemon
+ *
+ * Serves compress / decompress requests over a Unix domain socket (wire
+ * format and client library in odzd.h), so callers that handle many
+ * small payloads skip process startup, file I/O and cold tables.
+ *
+ * The main thread polls the listening socket and every idle connection.
+ * A connection with a request waiting becomes one task on the shared
+ * pool: it takes a warm compression context, serves that request and
+ * hands the connection back through a pipe, so a pool of N threads
+ * serves any number of connections and at most N requests run at once.
+ */
+
+#define _GNU_SOURCE             /* fmemopen, open_memstream */
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <sys/un.h>
+
+#include "libodzip.h"
+#include "odzd.h"
+
+#define CONN_MAX        1024
+#define RECV_TIMEOUT_S  10      /* a request that stalls this long drops its connection */
+#define WARM_SIZE       (64u << 10)
+
+static void die(const char *m) { fprintf(stderr, "odzd: error: %s\n", m); exit(1); }
+
+static volatile sig_atomic_t stop;
+static void on_signal(int sig) { (void)sig; stop = 1; }
+
+/* ── Server state ──────────────────────────────────────────── */
+
+typedef struct server server_t;
+
+typedef struct {
+    int       fd;
+    int       busy;             /* a task owns it (main thread only) */
+    server_t *srv;
+} conn_t;
+
+/* Task → main thread, through the pipe: the connection is idle again,
+ * or to be closed */
+typedef struct {
+    conn_t *c;
+    int     keep;
+    int     served;
+} done_msg_t;
+
+struct server {
+    odz_pool_t     *pool;
+    int             wake[2];
+    pthread_mutex_t lock;       /* free contexts */
+    odz_ctx_t     **ctx;
+    int             nctx;
+};
+
+static odz_ctx_t *ctx_get(server_t *s) {
+    pthread_mutex_lock(&s->lock);
+    odz_ctx_t *ctx = s->nctx ? s->ctx[--s->nctx] : NULL;
+    pthread_mutex_unlock(&s->lock);
+    return ctx;
+}
+
+static void ctx_put(server_t *s, odz_ctx_t *ctx) {
+    pthread_mutex_lock(&s->lock);
+    s->ctx[s->nctx++] = ctx;
+    pthread_mutex_unlock(&s->lock);
+}
+
+/* Run a context through a small compress so its tables are allocated and
+ * touched, and the code paths and kernels resolved, before the first
+ * request arrives */
+static void warm_up(odz_ctx_t *ctx) {
+    static uint8_t in[WARM_SIZE], out[WARM_SIZE + 4096];
+    for (size_t i = 0; i < sizeof in; i++) in[i] = (uint8_t)("odzd warm-up "[i % 13] ^ (i >> 9));
+    odz_options_t opts = { .ctx = ctx };
+    FILE *fi = fmemopen(in, sizeof in, "rb");
+    FILE *fo = fmemopen(out, sizeof out, "w+b");
+    if (fi && fo) odz_compress(fi, fo, &opts);
+    if (fi) fclose(fi);
+    if (fo) fclose(fo);
+}
+
+/* ── Requests ──────────────────────────────────────────────── */
+
+static int reply_error(int sock, int status) {
+    uint8_t hdr[ODZD_HDR_SIZE];
+    odzd_hdr_pack(hdr, status, 0, 0, 0);
+    return odzd_send(sock, hdr, -1, NULL, 0);
+}
+
+/* Serve one request on c.  Returns 1 to keep the connection, 0 to close
+ * it (EOF, a broken stream, or an inline payload left unread). */
+static int serve(conn_t *c, odz_ctx_t *ctx, int *served) {
+    uint8_t hdr[ODZD_HDR_SIZE];
+    int fd, op, flags, format;
+    uint64_t size;
+    *served = 0;
+    if (odzd_recv_hdr(c->fd, hdr, &fd) != 0) return 0;
+    int shm = 0;
+    if (odzd_hdr_unpack(hdr, &op, &flags, &format, &size) != 0 ||
+        (op != ODZD_OP_COMPRESS && op != ODZD_OP_DECOMPRESS) ||
+        (shm = (flags & ODZD_F_SHM) != 0) != (fd >= 0) || size > ODZD_PAYLOAD_MAX) {
+        if (fd >= 0) close(fd);
+        reply_error(c->fd, ODZ_ERR_FORMAT);
+        return 0;
+    }
+
+    /* Input: mapped from the client's buffer, or read off the socket */
+    uint8_t *in = NULL;
+    int rc = ODZ_OK, keep = 1;
+    if (shm) {
+        struct stat sb;
+        if (fstat(fd, &sb) != 0 || (uint64_t)sb.st_size < size) rc = ODZ_ERR_FORMAT;
+        else if (size && (in = mmap(NULL, (size_t)size, PROT_READ, MAP_SHARED, fd, 0)) == MAP_FAILED) {
+            in = NULL;
+            rc = ODZ_ERR_OOM;
+        }
+        close(fd);
+    } else if (!(in = malloc(size ? (size_t)size : 1))) {
+        rc = ODZ_ERR_OOM;
+        keep = 0;
+    } else if (odzd_read_all(c->fd, in, (size_t)size) != 0) {
+        free(in);
+        return 0;
+    }
+
+    /* Output: a fresh shared buffer, or memory to send back inline */
+    odzd_buf_t ob = { NULL, 0, -1 };
+    char *obuf = NULL;
+    size_t olen = 0;
+    FILE *fi = NULL, *fo = NULL;
+    uint8_t empty[1];           /* per call: requests run on many pool threads */
+    if (rc == ODZ_OK) {
+        /* Not every fmemopen takes size 0; an emptied w+ stream reads as empty */
+        fi = size ? fmemopen(in, (size_t)size, "rb") : fmemopen(empty, 1, "w+b");
+        if (shm) {
+            int dfd = -1;
+            if (odzd_shm_create(&ob, 0) == 0 && (dfd = dup(ob.fd)) >= 0 &&
+                !(fo = fdopen(dfd, "w+b")))
+                close(dfd);
+        } else {
+            fo = open_memstream(&obuf, &olen);
+        }
+        if (!fi || !fo) rc = ODZ_ERR_OOM;
+    }
+    if (rc == ODZ_OK) {
+        odz_options_t opts = { .ctx = ctx, .format = format };
+        rc = op == ODZD_OP_COMPRESS ? odz_compress(fi, fo, &opts) : odz_decompress(fi, fo, &opts);
+    }
+    int64_t osize = 0;
+    if (fo) {
+        if (fflush(fo) != 0 && rc == ODZ_OK) rc = ODZ_ERR_OOM;
+        if (shm) osize = ftello(fo);
+        if (fclose(fo) != 0 && rc == ODZ_OK) rc = ODZ_ERR_OOM;
+        if (!shm) osize = (int64_t)olen;
+    }
+    if (fi) fclose(fi);
+    if (shm) { if (in) munmap(in, (size_t)size); }
+    else free(in);
+
+    /* Reply */
+    if (rc == ODZ_OK && osize >= 0) {
+        odzd_hdr_pack(hdr, ODZ_OK, shm ? ODZD_F_SHM : 0, 0, (uint64_t)osize);
+        if (odzd_send(c->fd, hdr, shm ? ob.fd : -1, shm ? NULL : obuf,
+                      shm ? 0 : (size_t)osize) != 0)
+            keep = 0;
+        *served = 1;
+    } else if (reply_error(c->fd, rc == ODZ_OK ? ODZ_ERR_IO : rc) != 0) {
+        keep = 0;
+    }
+    odzd_buf_free(&ob);
+    free(obuf);
+    return keep;
+}
+
+static void serve_task(void *arg) {
+    conn_t *c = arg;
+    server_t *s = c->srv;
+    odz_ctx_t *ctx = ctx_get(s);
+    done_msg_t m = { c, 0, 0 };
+    m.keep = serve(c, ctx, &m.served);
+    if (ctx) ctx_put(s, ctx);
+    /* A whole message is under PIPE_BUF, so the write is atomic */
+    while (write(s->wake[1], &m, sizeof m) < 0 && errno == EINTR) {}
+}
+
+/* Take back the connections finished tasks hand over; closes those not
+ * to be kept.  Returns the requests they served. */
+static uint64_t reclaim(server_t *s, conn_t **conns, int *nconn) {
+    done_msg_t m[64];
+    uint64_t served = 0;
+    ssize_t r;
+    while ((r = read(s->wake[0], m, sizeof m)) > 0) {
+        for (ssize_t k = 0; k < r / (ssize_t)sizeof *m; k++) {
+            conn_t *c = m[k].c;
+            c->busy = 0;
+            served += (uint64_t)m[k].served;
+            if (m[k].keep) continue;
+            close(c->fd);
+            for (int i = 0; i < *nconn; i++)
+                if (conns[i] == c) { conns[i] = conns[--*nconn]; break; }
+            free(c);
+        }
+    }
+    return served;
+}
+
+/* ── Socket ────────────────────────────────────────────────── */
+
+static int listen_on(const char *path) {
+    struct sockaddr_un sa = { .sun_family = AF_UNIX };
+    if (strlen(path) >= sizeof sa.sun_path) die("socket path too long");
+    strcpy(sa.sun_path, path);
+
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0) die("cannot create socket");
+
+    /* A socket file nobody answers on is left over from an earlier run */
+    if (connect(fd, (struct sockaddr *)&sa, sizeof sa) == 0) die("another odzd is serving that socket");
+    if (errno == ECONNREFUSED) unlink(path);
+    close(fd);
+
+    fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0) die("cannot create socket");
+    fcntl(fd, F_SETFD, FD_CLOEXEC);
+    mode_t old = umask(077);    /* owner only */
+    int rc = bind(fd, (struct sockaddr *)&sa, sizeof sa);
+    umask(old);
+    if (rc != 0) { perror(path); exit(1); }
+    if (listen(fd, SOMAXCONN) != 0) die("listen failed");
+    return fd;
+}
+
+/* ── Main ──────────────────────────────────────────────────── */
+
+static int cpu_count(void) {
+    long n = sysconf(_SC_NPROCESSORS_ONLN);
+    return n > 0 ? (int)n : 1;
+}
+
+static void usage(const char *prog) {
+    fprintf(stderr,
+        "odzd — local odz compression daemon (format v%d)\n\n"
+        "usage: %s [options]\n\n"
+        "options:\n"
+        "  -s PATH         socket (default: $ODZD_SOCKET, $XDG_RUNTIME_DIR/odzd.sock\n"
+        "                  or /tmp/odzd-<uid>.sock)\n"
+        "  -T N            worker threads (0 = all CPUs, default)\n"
+        "  -v0             silent\n"
+        "  -v1             startup and shutdown lines (default)\n"
+        "  -h, --help      show this help\n\n"
+        "Clients use the odzd client library (odzd.h); SIGINT or SIGTERM stops\n"
+        "the daemon once the requests in flight are done.\n",
+        ODZ_FORMAT_VERSION, prog);
+}
+
+int main(int argc, char **argv) {
+    const char *path = NULL;
+    int threads = 0, verbosity = 1;
+    for (int i = 1; i < argc; i++) {
+        const char *a = argv[i];
+        if (strcmp(a, "-h") == 0 || strcmp(a, "--help") == 0) {
+            usage(argv[0]); return 0;
+        } else if (strncmp(a, "-s", 2) == 0) {
+            path = a[2] ? a + 2 : (++i < argc ? argv[i] : NULL);
+            if (!path) die("missing argument for -s");
+        } else if (strncmp(a, "-T", 2) == 0) {
+            const char *v = a[2] ? a + 2 : (++i < argc ? argv[i] : NULL);
+            char *end;
+            if (!v) die("missing argument for -T");
+            long n = strtol(v, &end, 10);
+            if (*end || end == v || n < 0 || n > 4096) die("bad thread count for -T");
+            threads = (int)n;
+        } else if (strncmp(a, "-v", 2) == 0 && a[2] >= '0' && a[2] <= '9' && !a[3]) {
+            verbosity = a[2] - '0';
+        } else {
+            fprintf(stderr, "odzd: unknown option: %s\n", a);
+            usage(argv[0]); return 2;
+        }
+    }
+    if (!path) path = odzd_default_path();
+    if (threads == 0) threads = cpu_count();
+
+    struct sigaction sa = { .sa_handler = on_signal };  /* no SA_RESTART: poll wakes */
+    sigemptyset(&sa.sa_mask);
+    sigaction(SIGINT, &sa, NULL);
+    sigaction(SIGTERM, &sa, NULL);
+    signal(SIGPIPE, SIG_IGN);
+
+    server_t srv = { 0 };
+    int lfd = listen_on(path);
+    if (pipe(srv.wake) != 0) die("pipe failed");
+    fcntl(srv.wake[0], F_SETFD, FD_CLOEXEC);
+    fcntl(srv.wake[0], F_SETFL, O_NONBLOCK);
+    fcntl(srv.wake[1], F_SETFD, FD_CLOEXEC);
+    pthread_mutex_init(&srv.lock, NULL);
+
+    /* Without thread support there is no pool: requests run on this
+     * thread, one at a time */
+    srv.pool = threads > 1 ? odz_pool_create(threads) : NULL;
+    int nctx = odz_pool_threads(srv.pool);
+    srv.ctx = malloc((size_t)nctx * sizeof *srv.ctx);
+    if (!srv.ctx) die("out of memory");
+    for (int i = 0; i < nctx; i++) {
+        if (!(srv.ctx[i] = odz_ctx_create())) die("out of memory");
+        warm_up(srv.ctx[i]);
+    }
+    srv.nctx = nctx;
+
+    conn_t *conns[CONN_MAX];
+    int nconn = 0;
+    struct pollfd pfd[CONN_MAX + 2];
+    conn_t *pconn[CONN_MAX + 2];
+    uint64_t served = 0;
+    if (verbosity >= 1)
+        fprintf(stderr, "odzd: listening on %s (%d thread%s)\n", path, nctx, nctx == 1 ? "" : "s");
+
+    while (!stop) {
+        int np = 0;
+        pfd[np++] = (struct pollfd){ lfd, POLLIN, 0 };
+        pfd[np++] = (struct pollfd){ srv.wake[0], POLLIN, 0 };
+        for (int i = 0; i < nconn; i++) {
+            if (conns[i]->busy) continue;
+            pconn[np] = conns[i];
+            pfd[np++] = (struct pollfd){ conns[i]->fd, POLLIN, 0 };
+        }
+        if (poll(pfd, (nfds_t)np, -1) < 0) {
+            if (errno == EINTR) continue;
+            die("poll failed");
+        }
+
+        /* Connections handed back by finished tasks */
+        if (pfd[1].revents & POLLIN) served += reclaim(&srv, conns, &nconn);
+
+        /* Requests waiting on idle connections (pconn entries are still
+         * valid: only busy connections were closed above) */
+        for (int i = 2; i < np; i++) {
+            if (!pfd[i].revents) continue;
+            conn_t *c = pconn[i];
+            c->busy = 1;
+            odz_pool_submit(srv.pool, serve_task, c);
+        }
+
+        if (pfd[0].revents & POLLIN) {
+            int fd = accept(lfd, NULL, NULL);
+            if (fd >= 0) {
+                conn_t *c = nconn < CONN_MAX ? malloc(sizeof *c) : NULL;
+                if (!c) { close(fd); continue; }
+                fcntl(fd, F_SETFD, FD_CLOEXEC);
+                struct timeval tv = { RECV_TIMEOUT_S, 0 };
+                setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof tv);
+                setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof tv);
+                *c = (conn_t){ fd, 0, &srv };
+                conns[nconn++] = c;
+            }
+        }
+    }
+
+    /* Finish what is in flight, then tear down */
+    odz_pool_wait_all(srv.pool);
+    odz_pool_destroy(srv.pool);
+    served += reclaim(&srv, conns, &nconn);
+    for (int i = 0; i < nconn; i++) { close(conns[i]->fd); free(conns[i]); }
+    for (int i = 0; i < srv.nctx; i++) odz_ctx_free(srv.ctx[i]);
+    free(srv.ctx);
+    close(lfd);
+    unlink(path);
+    if (verbosity >= 1)
+        fprintf(stderr, "odzd: stopped after %llu request%s\n",
+                (unsigned long long)served, served == 1 ? "" : "s");
+    return 0;
+}
@@ -0,0 +1,96 @@
+#ifndef ODZD_H
+#define ODZD_H
+
+/*
+ * odzd client: compress / decompress through a local odzd daemon over a
+ * Unix domain socket, without paying process startup and cold tables per
+ * payload.  A connection carries any number of requests, one at a time;
+ * use one connection per thread.
+ *
+ * Payloads travel inline over the socket, or in shared memory: an
+ * odzd_buf_t is a memory-backed file mapped by both sides, passed with
+ * the request, and the reply comes back the same way, so large payloads
+ * are never copied through the socket.
+ *
+ * Functions return ODZ_OK or an ODZ_ERR_* code: the daemon's result, or
+ * ODZ_ERR_IO when the connection fails.
+ */
+
+#include <stddef.h>
+#include <stdint.h>
+#include "libodzip.h"
+
+typedef struct odzd_client odzd_client_t;
+
+/* Shared-memory payload: size bytes at data, backed by fd */
+typedef struct {
+    void  *data;
+    size_t size;
+    int    fd;
+} odzd_buf_t;
+
+/* Socket path: $ODZD_SOCKET, else $XDG_RUNTIME_DIR/odzd.sock, else
+ * /tmp/odzd-<uid>.sock.  Returns a static buffer. */
+const char *odzd_default_path(void);
+
+/* Connect to the daemon at path (NULL = odzd_default_path()) */
+int  odzd_connect(odzd_client_t **c, const char *path);
+void odzd_close(odzd_client_t *c);
+
+/* Inline payloads.  format is ODZ_FORMAT_*, as in odz_options_t: on
+ * decompression ODZ_FORMAT_ODZ also recognises gzip and zlib, and only
+ * raw DEFLATE needs naming.  *out is malloc'd; the caller frees it. */
+int odzd_compress(odzd_client_t *c, int format, const void *in, size_t n,
+                  void **out, size_t *out_n);
+int odzd_decompress(odzd_client_t *c, int format, const void *in, size_t n,
+                    void **out, size_t *out_n);
+
+/* Shared-memory payloads: the first n bytes of in are the input, and
+ * *out receives a new buffer holding exactly the result, to be released
+ * with odzd_buf_free (it may be passed back as the next input).  Setting
+ * up the mapping costs more than copying a few KB, so these pay off for
+ * large payloads; small ones are quicker inline. */
+int  odzd_buf_alloc(odzd_buf_t *b, size_t size);
+void odzd_buf_free(odzd_buf_t *b);
+int  odzd_compress_buf(odzd_client_t *c, int format, const odzd_buf_t *in, size_t n,
+                       odzd_buf_t *out);
+int  odzd_decompress_buf(odzd_client_t *c, int format, const odzd_buf_t *in, size_t n,
+                         odzd_buf_t *out);
+
+/* ── Wire format (shared with the daemon) ─────────────────────
+ *
+ * Request:  "ODZD" | op(u8) | flags(u8) | format(u8) | 0(u8) | size(u64 LE)
+ * Response: "ODZD" | status(u8) | flags(u8) | 0(u16) | size(u64 LE)
+ *
+ * followed by size payload bytes, or, with ODZD_F_SHM, by nothing: the
+ * payload is the first size bytes of the file whose descriptor rides on
+ * the header (SCM_RIGHTS).  A shared-memory request gets a shared-memory
+ * response.
+ */
+#define ODZD_HDR_SIZE       16
+#define ODZD_OP_COMPRESS    1
+#define ODZD_OP_DECOMPRESS  2
+#define ODZD_F_SHM          0x01
+#define ODZD_PAYLOAD_MAX    ((uint64_t)1 << 32)   /* inline or shared, per request */
+
+void odzd_hdr_pack(uint8_t hdr[ODZD_HDR_SIZE], int code, int flags, int format, uint64_t size);
+int  odzd_hdr_unpack(const uint8_t hdr[ODZD_HDR_SIZE], int *code, int *flags, int *format,
+                     uint64_t *size);        /* -1 on bad magic */
+
+/* Header with an optional descriptor (fd < 0 for none) and n inline
+ * payload bytes, in one call where the socket takes it all.  0, or -1 on
+ * error. */
+int odzd_send(int sock, const uint8_t hdr[ODZD_HDR_SIZE], int fd, const void *payload, size_t n);
+
+/* Header and the descriptor riding on it, *fd = -1 if none.  0, or -1 on
+ * error or EOF. */
+int odzd_recv_hdr(int sock, uint8_t hdr[ODZD_HDR_SIZE], int *fd);
+
+/* Whole buffers; 0, or -1 on error or EOF */
+int odzd_write_all(int sock, const void *p, size_t n);
+int odzd_read_all(int sock, void *p, size_t n);
+
+/* A fresh memory-backed file of size bytes, mapped read-write */
+int odzd_shm_create(odzd_buf_t *b, size_t size);
+
+#endif
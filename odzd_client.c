@@ -0,0 +1,319 @@
+/*
+ * odzd client and wire helpers (see odzd.h).
+ */
+
+#define _GNU_SOURCE             /* memfd_create, MSG_CMSG_CLOEXEC */
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+
+#include "odzd.h"
+
+#ifndef MSG_NOSIGNAL
+#define MSG_NOSIGNAL 0          /* no SIGPIPE suppression per call here */
+#endif
+#ifndef MSG_CMSG_CLOEXEC
+#define MSG_CMSG_CLOEXEC 0
+#endif
+
+struct odzd_client {
+    int sock;
+};
+
+/* ── Wire ──────────────────────────────────────────────────── */
+
+/* Own copies of the odz_util.c helpers: the client library installs on
+ * its own, without libodzip */
+static void put_u64le(uint8_t *dst, uint64_t x) {
+    for (int i = 0; i < 8; i++) { dst[i] = (uint8_t)(x & 0xFF); x >>= 8; }
+}
+
+static uint64_t get_u64le(const uint8_t *src) {
+    uint64_t x = 0;
+    for (int i = 7; i >= 0; i--) x = (x << 8) | src[i];
+    return x;
+}
+
+void odzd_hdr_pack(uint8_t hdr[ODZD_HDR_SIZE], int code, int flags, int format, uint64_t size) {
+    memcpy(hdr, "ODZD", 4);
+    hdr[4] = (uint8_t)code;
+    hdr[5] = (uint8_t)flags;
+    hdr[6] = (uint8_t)format;
+    hdr[7] = 0;
+    put_u64le(hdr + 8, size);
+}
+
+int odzd_hdr_unpack(const uint8_t hdr[ODZD_HDR_SIZE], int *code, int *flags, int *format,
+                    uint64_t *size) {
+    if (memcmp(hdr, "ODZD", 4) != 0) return -1;
+    *code = hdr[4];
+    *flags = hdr[5];
+    *format = hdr[6];
+    *size = get_u64le(hdr + 8);
+    return 0;
+}
+
+int odzd_write_all(int sock, const void *p, size_t n) {
+    const uint8_t *b = p;
+    while (n) {
+        ssize_t w = send(sock, b, n, MSG_NOSIGNAL);
+        if (w < 0 && errno == EINTR) continue;
+        if (w <= 0) return -1;
+        b += w;
+        n -= (size_t)w;
+    }
+    return 0;
+}
+
+int odzd_read_all(int sock, void *p, size_t n) {
+    uint8_t *b = p;
+    while (n) {
+        ssize_t r = recv(sock, b, n, 0);
+        if (r < 0 && errno == EINTR) continue;
+        if (r <= 0) return -1;
+        b += r;
+        n -= (size_t)r;
+    }
+    return 0;
+}
+
+int odzd_send(int sock, const uint8_t hdr[ODZD_HDR_SIZE], int fd, const void *payload, size_t n) {
+    union { struct cmsghdr h; char buf[CMSG_SPACE(sizeof(int))]; } ctl;
+    struct iovec iov[2] = { { (void *)hdr, ODZD_HDR_SIZE }, { (void *)payload, n } };
+    struct msghdr msg = { 0 };
+    msg.msg_iov = iov;
+    msg.msg_iovlen = n ? 2 : 1;
+    if (fd >= 0) {
+        memset(&ctl, 0, sizeof ctl);
+        msg.msg_control = ctl.buf;
+        msg.msg_controllen = sizeof ctl.buf;
+        struct cmsghdr *cm = CMSG_FIRSTHDR(&msg);
+        cm->cmsg_level = SOL_SOCKET;
+        cm->cmsg_type = SCM_RIGHTS;
+        cm->cmsg_len = CMSG_LEN(sizeof(int));
+        memcpy(CMSG_DATA(cm), &fd, sizeof fd);
+    }
+    ssize_t w;
+    do w = sendmsg(sock, &msg, MSG_NOSIGNAL); while (w < 0 && errno == EINTR);
+    if (w < 0) return -1;
+
+    /* The descriptor went with the first byte; the rest is plain data */
+    size_t sent = (size_t)w;
+    if (sent < ODZD_HDR_SIZE) {
+        if (odzd_write_all(sock, hdr + sent, ODZD_HDR_SIZE - sent) != 0) return -1;
+        sent = ODZD_HDR_SIZE;
+    }
+    sent -= ODZD_HDR_SIZE;
+    return odzd_write_all(sock, (const uint8_t *)payload + sent, n - sent);
+}
+
+int odzd_recv_hdr(int sock, uint8_t hdr[ODZD_HDR_SIZE], int *fd) {
+    union { struct cmsghdr h; char buf[CMSG_SPACE(4 * sizeof(int))]; } ctl;
+    struct iovec iov = { hdr, ODZD_HDR_SIZE };
+    struct msghdr msg = { 0 };
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = ctl.buf;
+    msg.msg_controllen = sizeof ctl.buf;
+    *fd = -1;
+
+    ssize_t r;
+    do r = recvmsg(sock, &msg, MSG_CMSG_CLOEXEC); while (r < 0 && errno == EINTR);
+    if (r <= 0) return -1;
+
+    /* Keep the first descriptor, close any extras a peer sent */
+    for (struct cmsghdr *cm = CMSG_FIRSTHDR(&msg); cm; cm = CMSG_NXTHDR(&msg, cm)) {
+        if (cm->cmsg_level != SOL_SOCKET || cm->cmsg_type != SCM_RIGHTS) continue;
+        size_t nfd = (cm->cmsg_len - CMSG_LEN(0)) / sizeof(int);
+        for (size_t i = 0; i < nfd; i++) {
+            int f;
+            memcpy(&f, CMSG_DATA(cm) + i * sizeof(int), sizeof f);
+            if (*fd < 0) *fd = f;
+            else close(f);
+        }
+    }
+    if (odzd_read_all(sock, hdr + r, ODZD_HDR_SIZE - (size_t)r) != 0) {
+        if (*fd >= 0) close(*fd);
+        *fd = -1;
+        return -1;
+    }
+    return 0;
+}
+
+/* ── Shared memory ─────────────────────────────────────────── */
+
+static int shm_fd(void) {
+#if defined(__linux__) && defined(MFD_CLOEXEC)
+    return memfd_create("odzd", MFD_CLOEXEC);
+#else
+    /* A named object, unlinked at once so only the descriptor remains */
+    static unsigned seq;
+    char name[64];
+    for (int tries = 0; tries < 16; tries++) {
+        snprintf(name, sizeof name, "/odzd.%ld.%u", (long)getpid(), seq++);
+        int fd = shm_open(name, O_RDWR | O_CREAT | O_EXCL, 0600);
+        if (fd >= 0) { shm_unlink(name); return fd; }
+        if (errno != EEXIST) break;
+    }
+    return -1;
+#endif
+}
+
+static int shm_map(odzd_buf_t *b, int fd, size_t size) {
+    b->fd = fd;
+    b->size = size;
+    b->data = NULL;
+    if (size == 0) return 0;
+    void *p = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (p == MAP_FAILED) return -1;
+    b->data = p;
+    return 0;
+}
+
+int odzd_shm_create(odzd_buf_t *b, size_t size) {
+    int fd = shm_fd();
+    if (fd < 0) return -1;
+    if (ftruncate(fd, (off_t)size) != 0 || shm_map(b, fd, size) != 0) {
+        close(fd);
+        b->fd = -1;
+        return -1;
+    }
+    return 0;
+}
+
+int odzd_buf_alloc(odzd_buf_t *b, size_t size) {
+    return odzd_shm_create(b, size) == 0 ? ODZ_OK : ODZ_ERR_OOM;
+}
+
+void odzd_buf_free(odzd_buf_t *b) {
+    if (b->data) munmap(b->data, b->size);
+    if (b->fd >= 0) close(b->fd);
+    b->data = NULL;
+    b->size = 0;
+    b->fd = -1;
+}
+
+/* ── Client ────────────────────────────────────────────────── */
+
+const char *odzd_default_path(void) {
+    static char path[sizeof(((struct sockaddr_un *)0)->sun_path)];
+    const char *env = getenv("ODZD_SOCKET");
+    const char *run = getenv("XDG_RUNTIME_DIR");
+    if (env && *env) snprintf(path, sizeof path, "%s", env);
+    else if (run && *run) snprintf(path, sizeof path, "%s/odzd.sock", run);
+    else snprintf(path, sizeof path, "/tmp/odzd-%ld.sock", (long)getuid());
+    return path;
+}
+
+int odzd_connect(odzd_client_t **cp, const char *path) {
+    *cp = NULL;
+    if (!path) path = odzd_default_path();
+    struct sockaddr_un sa = { .sun_family = AF_UNIX };
+    if (strlen(path) >= sizeof sa.sun_path) return ODZ_ERR_IO;
+    strcpy(sa.sun_path, path);
+
+    odzd_client_t *c = malloc(sizeof *c);
+    if (!c) return ODZ_ERR_OOM;
+    c->sock = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (c->sock < 0) { free(c); return ODZ_ERR_IO; }
+    fcntl(c->sock, F_SETFD, FD_CLOEXEC);
+    if (connect(c->sock, (struct sockaddr *)&sa, sizeof sa) != 0) {
+        close(c->sock);
+        free(c);
+        return ODZ_ERR_IO;
+    }
+    *cp = c;
+    return ODZ_OK;
+}
+
+void odzd_close(odzd_client_t *c) {
+    if (!c) return;
+    close(c->sock);
+    free(c);
+}
+
+/* One round trip.  in_fd >= 0 sends the payload as shared memory and
+ * expects the reply the same way (*out_fd); otherwise both are inline. */
+static int request(odzd_client_t *c, int op, int format, const void *in, size_t n, int in_fd,
+                   void **out, size_t *out_n, int *out_fd) {
+    uint8_t hdr[ODZD_HDR_SIZE];
+    int shm = in_fd >= 0;
+    odzd_hdr_pack(hdr, op, shm ? ODZD_F_SHM : 0, format, n);
+    if (odzd_send(c->sock, hdr, in_fd, shm ? NULL : in, shm ? 0 : n) != 0) return ODZ_ERR_IO;
+
+    int status, flags, fmt, fd;
+    uint64_t size;
+    if (odzd_recv_hdr(c->sock, hdr, &fd) != 0) return ODZ_ERR_IO;
+    if (odzd_hdr_unpack(hdr, &status, &flags, &fmt, &size) != 0 ||
+        (status == ODZ_OK && (((flags & ODZD_F_SHM) != 0) != shm || (shm && fd < 0)))) {
+        if (fd >= 0) close(fd);
+        return ODZ_ERR_IO;
+    }
+    if (status != ODZ_OK) {
+        if (fd >= 0) close(fd);
+        return status;
+    }
+    *out_n = (size_t)size;
+    if (shm) {
+        *out_fd = fd;
+        return ODZ_OK;
+    }
+    if (fd >= 0) close(fd);
+
+    /* Read the reply even if it cannot be kept, so the stream stays in step */
+    uint8_t *buf = malloc(size ? (size_t)size : 1);
+    if (!buf) {
+        uint8_t sink[4096];
+        for (uint64_t left = size; left; ) {
+            size_t k = left < sizeof sink ? (size_t)left : sizeof sink;
+            if (odzd_read_all(c->sock, sink, k) != 0) return ODZ_ERR_IO;
+            left -= k;
+        }
+        return ODZ_ERR_OOM;
+    }
+    if (odzd_read_all(c->sock, buf, (size_t)size) != 0) { free(buf); return ODZ_ERR_IO; }
+    *out = buf;
+    return ODZ_OK;
+}
+
+int odzd_compress(odzd_client_t *c, int format, const void *in, size_t n,
+                  void **out, size_t *out_n) {
+    return request(c, ODZD_OP_COMPRESS, format, in, n, -1, out, out_n, NULL);
+}
+
+int odzd_decompress(odzd_client_t *c, int format, const void *in, size_t n,
+                    void **out, size_t *out_n) {
+    return request(c, ODZD_OP_DECOMPRESS, format, in, n, -1, out, out_n, NULL);
+}
+
+static int request_buf(odzd_client_t *c, int op, int format, const odzd_buf_t *in, size_t n,
+                       odzd_buf_t *out) {
+    if (n > in->size) return ODZ_ERR_FORMAT;
+    size_t size;
+    int fd;
+    int rc = request(c, op, format, NULL, n, in->fd, NULL, &size, &fd);
+    if (rc != ODZ_OK) return rc;
+    if (shm_map(out, fd, size) != 0) {
+        close(fd);
+        out->fd = -1;
+        return ODZ_ERR_OOM;
+    }
+    return ODZ_OK;
+}
+
+int odzd_compress_buf(odzd_client_t *c, int format, const odzd_buf_t *in, size_t n,
+                      odzd_buf_t *out) {
+    return request_buf(c, ODZD_OP_COMPRESS, format, in, n, out);
+}
+
+int odzd_decompress_buf(odzd_client_t *c, int format, const odzd_buf_t *in, size_t n,
+                        odzd_buf_t *out) {
+    return request_buf(c, ODZD_OP_DECOMPRESS, format, in, n, out);
+}